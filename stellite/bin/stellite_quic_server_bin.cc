@@ -13,10 +13,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <signal.h>
+
 #include <memory>
 #include <vector>
 
 #include "base/at_exit.h"
+#include "base/bind.h"
 #include "base/command_line.h"
 #include "base/logging.h"
 #include "base/run_loop.h"
@@ -26,10 +29,22 @@
 #include "net/quic/core/crypto/crypto_server_config_protobuf.h"
 #include "net/quic/core/quic_protocol.h"
 #include "stellite/process/daemon.h"
+#include "stellite/process/signal_watcher.h"
 #include "stellite/server/quic_proxy_server.h"
 
 const char* kDefaultPidFilePath = "/tmp/quic.pid";
 
+// SIGHUP: parses the config again and passes the reloadable part of it on.
+void ReloadConfig(const base::CommandLine* command_line,
+                  net::QuicProxyServer* quic_proxy_server) {
+  net::ServerConfig server_config;
+  if (!server_config.ParseCommandLine(command_line)) {
+    LOG(ERROR) << "Failed to parse the config, keeping the current one";
+    return;
+  }
+  quic_proxy_server->ReloadConfig(server_config);
+}
+
 int main(int argc, char* argv[]) {
   base::CommandLine::Init(argc, argv);
   base::CommandLine* command_line = base::CommandLine::ForCurrentProcess();
@@ -118,6 +133,13 @@ int main(int argc, char* argv[]) {
                                            server_config.quic_port()),
                            serialized_config);
 
+  net::SignalWatcher reload_watcher;
+  if (!reload_watcher.Start(SIGHUP,
+                            base::Bind(&ReloadConfig, command_line,
+                                       quic_proxy_server.get()))) {
+    LOG(WARNING) << "Config reload on SIGHUP is not available";
+  }
+
   base::RunLoop().Run();
 
   return 0;
@@ -14,9 +14,16 @@
 
 #include "stellite/fetcher/http_fetcher.h"
 
+#include <vector>
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/logging.h"
 #include "base/memory/ptr_util.h"
 #include "base/message_loop/message_loop.h"
 #include "base/threading/thread_task_runner_handle.h"
+#include "base/time/default_tick_clock.h"
+#include "net/base/net_errors.h"
 #include "net/http/http_request_headers.h"
 #include "net/url_request/url_fetcher.h"
 #include "net/url_request/url_request_context_getter.h"
@@ -28,10 +35,19 @@
 
 namespace stellite {
 
+namespace {
+
+// Granularity of the fetch timeouts.
+const int64_t kTimeoutTickMs = 100;
+
+}  // namespace
+
 HttpFetcher::HttpFetcher(
     scoped_refptr<HttpRequestContextGetter> context_getter)
-    : last_request_id_(0),
+    : timing_wheel_(base::TimeDelta::FromMilliseconds(kTimeoutTickMs),
+                    base::MakeUnique<base::DefaultTickClock>()),
       context_getter_(context_getter),
+      observer_(nullptr),
       weak_factory_(this) {
 }
 
@@ -40,13 +56,31 @@ HttpFetcher::~HttpFetcher() {}
 int HttpFetcher::Request(const HttpRequest& http_request,
                          int64_t timeout,
                          base::WeakPtr<HttpFetcherTask::Visitor> d) {
-  int request_id = ++last_request_id_;
+  return Request(http_request, net::URLFetcher::CreateUploadStreamCallback(),
+                 timeout, d);
+}
+
+int HttpFetcher::Request(const HttpRequest& http_request,
+                         const net::URLFetcher::CreateUploadStreamCallback&
+                             upload_stream_factory,
+                         int64_t timeout,
+                         base::WeakPtr<HttpFetcherTask::Visitor> d) {
+  int request_id = task_table_.Reserve();
+  if (request_id == HttpFetcherTaskTable::kInvalidRequestId) {
+    GetTaskRunner()->PostTask(
+        FROM_HERE,
+        base::Bind(&HttpFetcherTask::Visitor::OnTaskError, d, request_id,
+                   static_cast<const net::URLFetcher*>(nullptr),
+                   net::ERR_INSUFFICIENT_RESOURCES));
+    return request_id;
+  }
 
   GetTaskRunner()->PostTask(
       FROM_HERE,
       base::Bind(&HttpFetcher::StartRequest,
                  weak_factory_.GetWeakPtr(),
-                 request_id, http_request, timeout, d));
+                 request_id, http_request, upload_stream_factory,
+                 timeout, d));
   return request_id;
 }
 
@@ -61,34 +95,34 @@ bool HttpFetcher::AppendChunkToUpload(int request_id,
   return true;
 }
 
-void HttpFetcher::StartRequest(int request_id,
-                               const HttpRequest& http_request,
-                               int64_t timeout,
-                               base::WeakPtr<HttpFetcherTask::Visitor> d) {
+void HttpFetcher::StartRequest(
+    int request_id,
+    const HttpRequest& http_request,
+    const net::URLFetcher::CreateUploadStreamCallback& upload_stream_factory,
+    int64_t timeout,
+    base::WeakPtr<HttpFetcherTask::Visitor> d) {
   GURL request_url(http_request.url);
   if (!request_url.is_valid()) {
     LOG(ERROR) << "invalid request url: " << request_url.spec();
+    task_table_.Release(request_id);
     if (d.get()) {
       d->OnTaskError(request_id, nullptr, net::ERR_INVALID_URL);
     }
     return;
   }
 
-  HttpFetcherTask* task = new HttpFetcherTask(this, request_id, d);
-  request_map_.insert(std::make_pair(request_id, base::WrapUnique(task)));
-
-  task->Start(http_request, timeout);
+  HttpFetcherTask* task = task_table_.Create(request_id, this, d);
+  task->Start(http_request, upload_stream_factory, timeout);
 }
 
 void HttpFetcher::StartAppendChunkToUpload(int request_id,
                                            const std::string& data, bool fin) {
-  RequestMap::iterator it = request_map_.find(request_id);
-  if (it == request_map_.end()) {
+  HttpFetcherTask* task = FindTask(request_id);
+  if (task == nullptr) {
     LOG(ERROR) << "invalid request_id for append chunk upload";
     return;
   }
 
-  HttpFetcherTask* task = it->second.get();
   HttpFetcherTask::Visitor* visitor = task->visitor();
   if (!data.size()) {
     if (visitor) {
@@ -114,6 +148,22 @@ void HttpFetcher::Cancel(int request_id) {
                  request_id));
 }
 
+void HttpFetcher::PauseStream(int request_id) {
+  DCHECK(GetTaskRunner()->BelongsToCurrentThread());
+  HttpFetcherTask* task = FindTask(request_id);
+  if (task) {
+    task->PauseStream();
+  }
+}
+
+void HttpFetcher::ResumeStream(int request_id) {
+  DCHECK(GetTaskRunner()->BelongsToCurrentThread());
+  HttpFetcherTask* task = FindTask(request_id);
+  if (task) {
+    task->ResumeStream();
+  }
+}
+
 void HttpFetcher::StartCancel(int request_id) {
   HttpFetcherTask* task = FindTask(request_id);
   if (task == nullptr) {
@@ -124,21 +174,19 @@ void HttpFetcher::StartCancel(int request_id) {
 }
 
 void HttpFetcher::StartRelease(int request_id) {
-  if (request_map_.find(request_id) == request_map_.end()) {
-    return;
-  }
-  request_map_.erase(request_id);
+  task_table_.Release(request_id);
 }
 
 void HttpFetcher::CancelAll() {
-  while (!request_map_.empty()) {
-    (request_map_.begin()->second.get())->Stop();
+  std::vector<int> request_ids;
+  task_table_.GetRequestIds(&request_ids);
+  for (int request_id : request_ids) {
+    StartCancel(request_id);
   }
 }
 
 HttpFetcherTask* HttpFetcher::FindTask(int request_id) {
-  RequestMap::iterator it = request_map_.find(request_id);
-  return it != request_map_.end() ? it->second.get() : nullptr;
+  return task_table_.Find(request_id);
 }
 
 void HttpFetcher::ReleaseRequest(int request_id) {
@@ -15,7 +15,6 @@
 #ifndef STELLITE_FETCHER_HTTP_FETCHER_H_
 #define STELLITE_FETCHER_HTTP_FETCHER_H_
 
-#include <map>
 #include <memory>
 
 #include "base/memory/weak_ptr.h"
@@ -23,6 +22,8 @@
 #include "net/spdy/spdy_protocol.h"
 #include "net/url_request/url_fetcher.h"
 #include "stellite/fetcher/http_fetcher_task.h"
+#include "stellite/fetcher/http_fetcher_task_table.h"
+#include "stellite/fetcher/timing_wheel.h"
 #include "stellite/include/http_request.h"
 #include "stellite/include/stellite_export.h"
 
@@ -44,9 +45,24 @@ class STELLITE_EXPORT HttpFetcher {
 
   int Request(const HttpRequest& request, int64_t timeout,
               base::WeakPtr<HttpFetcherTask::Visitor> delegate);
+
+  // Uploads the stream made by |upload_stream_factory| in place of
+  // |request.upload_stream|, e.g. IOBufferChain::CreateUploadDataStream to
+  // avoid copying the body. The factory runs on the network thread.
+  int Request(const HttpRequest& request,
+              const net::URLFetcher::CreateUploadStreamCallback&
+                  upload_stream_factory,
+              int64_t timeout,
+              base::WeakPtr<HttpFetcherTask::Visitor> delegate);
   bool AppendChunkToUpload(int request_id, const std::string& data, bool fin);
   void Cancel(int request_id);
 
+  // Pause and resume reading the streamed response of |request_id|. Unlike
+  // the calls above these take effect immediately, so they must be called on
+  // the thread running the visitor, e.g. from OnTaskStream().
+  void PauseStream(int request_id);
+  void ResumeStream(int request_id);
+
   void CancelAll();
 
   // release task when it was done
@@ -54,13 +70,23 @@ class STELLITE_EXPORT HttpFetcher {
 
   HttpRequestContextGetter* context_getter() { return context_getter_.get(); }
 
- private:
-  typedef std::map<int, std::unique_ptr<HttpFetcherTask>> RequestMap;
+  // Fetch timeouts of the tasks.
+  TimingWheel* timing_wheel() { return &timing_wheel_; }
 
+  // Reports the backend requests of the tasks to |observer|, which may be
+  // null. Not owned; it must outlive the fetcher.
+  HttpFetcherTask::Observer* observer() { return observer_; }
+  void set_observer(HttpFetcherTask::Observer* observer) {
+    observer_ = observer;
+  }
+
+ private:
   HttpFetcherTask* FindTask(int request_id);
 
   // start request that work on base::SingleThreadTaskRunner
   void StartRequest(int request_id, const HttpRequest& http_request,
+                    const net::URLFetcher::CreateUploadStreamCallback&
+                        upload_stream_factory,
                     int64_t timeout,
                     base::WeakPtr<HttpFetcherTask::Visitor> delegate);
   void StartAppendChunkToUpload(int request_id, const std::string& data,
@@ -71,11 +97,15 @@ class STELLITE_EXPORT HttpFetcher {
   // select TaskRunner between current thread or network thread
   base::SingleThreadTaskRunner* GetTaskRunner();
 
-  int last_request_id_;
-  RequestMap request_map_; // task container
+  // Declared ahead of |task_table_| since the tasks cancel their timeouts
+  // when destroyed.
+  TimingWheel timing_wheel_;
+  HttpFetcherTaskTable task_table_; // task container
 
   scoped_refptr<HttpRequestContextGetter> context_getter_;
 
+  HttpFetcherTask::Observer* observer_;
+
   base::WeakPtrFactory<HttpFetcher> weak_factory_;
 
   DISALLOW_COPY_AND_ASSIGN(HttpFetcher);
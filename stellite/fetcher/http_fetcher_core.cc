@@ -5,6 +5,9 @@
 #include "stellite/fetcher/http_fetcher_core.h"
 
 #include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
 #include <utility>
 
 #include "base/bind.h"
@@ -33,10 +36,16 @@
 #include "net/url_request/url_request_context_getter.h"
 #include "net/url_request/url_request_throttler_manager.h"
 #include "stellite/fetcher/http_fetcher_delegate.h"
+#include "stellite/fetcher/io_buffer_chain.h"
 
 namespace {
 
-const int kBufferSize = 4096;
+// Size of the first read of a response. See MaybeGrowReadBuffer().
+const int kInitialReadBufferSize = 4096;
+
+// Streamed response bytes read ahead of the delegate. Raised to two full
+// reads for read buffers larger than half of it.
+const size_t kStreamReadAheadSize = 256 * 1024;
 bool g_ignore_certificate_requests = false;
 
 void EmptyCompletionCallback(int result) {}
@@ -79,7 +88,9 @@ HttpFetcherCore::HttpFetcherCore(URLFetcher* fetcher,
       delegate_task_runner_(base::ThreadTaskRunnerHandle::Get()),
       load_flags_(LOAD_NORMAL),
       response_code_(URLFetcher::RESPONSE_CODE_INVALID),
-      buffer_(new IOBuffer(kBufferSize)),
+      buffer_(new IOBuffer(kInitialReadBufferSize)),
+      read_buffer_size_(kInitialReadBufferSize),
+      max_read_buffer_size_(kInitialReadBufferSize),
       url_request_data_key_(NULL),
       was_fetched_via_proxy_(false),
       was_cached_(false),
@@ -103,6 +114,12 @@ HttpFetcherCore::HttpFetcherCore(URLFetcher* fetcher,
       current_response_bytes_(0),
       total_response_bytes_(-1),
       stream_response_(stream_response),
+      stream_batch_(new stellite::IOBufferChain()),
+      stream_batch_in_flight_(false),
+      stream_unacked_bytes_(0),
+      stream_read_stalled_(false),
+      stream_paused_(false),
+      paused_stream_bytes_(0),
       response_info_(nullptr) {
   CHECK(original_url_.is_valid());
 }
@@ -122,6 +139,26 @@ void HttpFetcherCore::Start() {
       FROM_HERE, base::Bind(&HttpFetcherCore::StartOnIOThread, this));
 }
 
+void HttpFetcherCore::PauseStream() {
+  DCHECK(delegate_task_runner_->BelongsToCurrentThread());
+  DCHECK(stream_response_);
+  stream_paused_ = true;
+}
+
+void HttpFetcherCore::ResumeStream() {
+  DCHECK(delegate_task_runner_->BelongsToCurrentThread());
+  stream_paused_ = false;
+  if (paused_stream_bytes_ == 0) {
+    return;
+  }
+
+  network_task_runner_->PostTask(
+      FROM_HERE,
+      base::Bind(&HttpFetcherCore::DidDeliverStreamBatch, this,
+                 paused_stream_bytes_));
+  paused_stream_bytes_ = 0;
+}
+
 void HttpFetcherCore::Stop() {
   if (delegate_task_runner_.get())  // May be NULL in tests.
     DCHECK(delegate_task_runner_->BelongsToCurrentThread());
@@ -264,6 +301,11 @@ void HttpFetcherCore::SetStopOnRedirect(bool stop_on_redirect) {
   stop_on_redirect_ = stop_on_redirect;
 }
 
+void HttpFetcherCore::SetMaxReadBufferSize(int max_read_buffer_size) {
+  max_read_buffer_size_ =
+      std::max(max_read_buffer_size, kInitialReadBufferSize);
+}
+
 void HttpFetcherCore::SetAutomaticallyRetryOn5xx(bool retry) {
   automatically_retry_on_5xx_ = retry;
 }
@@ -411,7 +453,7 @@ void HttpFetcherCore::OnReceivedRedirect(URLRequest* request,
     response_info_.reset(new HttpResponseInfo(request->response_info()));
 
     if (stream_response_) {
-      InformDelegateFetchStream(nullptr);
+      InformDelegateFetchStreamHeader();
     } else {
       InformDelegateFetchIsComplete();
     }
@@ -437,7 +479,7 @@ void HttpFetcherCore::OnResponseStarted(URLRequest* request, int net_error) {
 
     // notify a header received
     if (stream_response_) {
-      InformDelegateFetchStream(nullptr);
+      InformDelegateFetchStreamHeader();
     }
 
     InformDelegateUpdateFetchTimeout();
@@ -478,15 +520,20 @@ void HttpFetcherCore::OnReadCompleted(URLRequest* request, int bytes_read) {
 
     const int result =
         WriteBuffer(new DrainableIOBuffer(buffer_.get(), bytes_read));
+    MaybeGrowReadBuffer(bytes_read);
     if (result < 0) {
       // Write failed or waiting for write completion.
       return;
     }
-    bytes_read = request_->Read(buffer_.get(), kBufferSize);
+    bytes_read = request_->Read(buffer_.get(), read_buffer_size_);
   }
 
   // See comments re: HEAD requests in ReadResponse().
   if (bytes_read != ERR_IO_PENDING || request_type_ == URLFetcher::HEAD) {
+    // Deliver what is left of a streamed response ahead of the completion.
+    if (!stream_batch_->empty())
+      FlushStreamBatch();
+
     status_ = URLRequestStatus::FromError(bytes_read);
     received_response_content_length_ =
         request_->received_response_content_length();
@@ -739,36 +786,42 @@ void HttpFetcherCore::InformDelegateFetchIsCompleteInDelegateThread() {
   }
 }
 
-void HttpFetcherCore::InformDelegateFetchStream(
-    scoped_refptr<DrainableIOBuffer> data) {
+void HttpFetcherCore::InformDelegateFetchStreamHeader() {
   delegate_task_runner_->PostTask(
       FROM_HERE,
-      base::Bind(&HttpFetcherCore::InformDelegateFetchStreamInDelegateThread,
-                 this, data));
+      base::Bind(
+          &HttpFetcherCore::InformDelegateFetchStreamHeaderInDelegateThread,
+          this));
 }
 
-void HttpFetcherCore::InformDelegateFetchStreamInDelegateThread(
-    scoped_refptr<DrainableIOBuffer> data) {
+void HttpFetcherCore::InformDelegateFetchStreamHeaderInDelegateThread() {
   DCHECK(delegate_task_runner_->BelongsToCurrentThread());
   DCHECK(stream_response_);
-
-  if (!data.get()) {
-    if (delegate_) {
-      delegate_->OnFetchStream(fetcher_, response_info_.get(),
-                               nullptr, 0, false /* fin */);
-    }
-    return;
+  if (delegate_) {
+    delegate_->OnFetchStream(fetcher_, response_info_.get(),
+                             nullptr, 0, false /* fin */);
   }
+}
+
+void HttpFetcherCore::InformDelegateFetchStreamChainInDelegateThread(
+    scoped_refptr<stellite::IOBufferChain> chain) {
+  DCHECK(delegate_task_runner_->BelongsToCurrentThread());
+  DCHECK(stream_response_);
 
-  int stream_size = data->BytesRemaining();
   if (delegate_) {
-    delegate_->OnFetchStream(fetcher_, response_info_.get(),
-                             data->data(), stream_size, false /* fin */);
+    delegate_->OnFetchStreamChain(fetcher_, response_info_.get(), *chain);
+  }
+
+  // the delegate may have paused the stream while handling this batch
+  if (stream_paused_) {
+    paused_stream_bytes_ += chain->size();
+    return;
   }
 
   network_task_runner_->PostTask(
       FROM_HERE,
-      base::Bind(&HttpFetcherCore::DidWriteBuffer, this, data, stream_size));
+      base::Bind(&HttpFetcherCore::DidDeliverStreamBatch, this,
+                 chain->size()));
 }
 
 void HttpFetcherCore::InformDelegateUpdateFetchTimeout() {
@@ -906,10 +959,8 @@ void HttpFetcherCore::CompleteAddingUploadDataChunk(
 }
 
 int HttpFetcherCore::WriteBuffer(scoped_refptr<DrainableIOBuffer> data) {
-  if (stream_response_ && data->BytesRemaining() > 0) {
-    InformDelegateFetchStream(data);
-    return ERR_IO_PENDING;
-  }
+  if (stream_response_ && data->BytesRemaining() > 0)
+    return QueueStreamData(data);
 
   while (data->BytesRemaining() > 0) {
     const int result = response_writer_->Write(
@@ -950,6 +1001,66 @@ void HttpFetcherCore::DidWriteBuffer(scoped_refptr<DrainableIOBuffer> data,
   }
 }
 
+int HttpFetcherCore::QueueStreamData(scoped_refptr<DrainableIOBuffer> data) {
+  DCHECK(network_task_runner_->BelongsToCurrentThread());
+  size_t length = static_cast<size_t>(data->BytesRemaining());
+  if (data->BytesRemaining() < read_buffer_size_ / 2) {
+    // A short read would pin the whole read buffer until it is delivered,
+    // so copy it out and read into the same buffer again. Queued buffers
+    // then hold at most twice the bytes counted against the read-ahead.
+    scoped_refptr<IOBuffer> copy(new IOBuffer(length));
+    memcpy(copy->data(), data->data(), length);
+    data = new DrainableIOBuffer(copy.get(), static_cast<int>(length));
+  } else {
+    // |data| now belongs to the batch, so read the next chunk elsewhere.
+    buffer_ = new IOBuffer(read_buffer_size_);
+  }
+  stream_batch_->Append(data, length);
+  stream_unacked_bytes_ += length;
+
+  if (!stream_batch_in_flight_)
+    FlushStreamBatch();
+
+  size_t read_ahead_size = std::max(
+      kStreamReadAheadSize, 2 * static_cast<size_t>(max_read_buffer_size_));
+  if (stream_unacked_bytes_ >= read_ahead_size) {
+    stream_read_stalled_ = true;
+    return ERR_IO_PENDING;
+  }
+  return OK;
+}
+
+void HttpFetcherCore::FlushStreamBatch() {
+  DCHECK(network_task_runner_->BelongsToCurrentThread());
+  DCHECK(!stream_batch_->empty());
+  stream_batch_in_flight_ = true;
+  delegate_task_runner_->PostTask(
+      FROM_HERE,
+      base::Bind(
+          &HttpFetcherCore::InformDelegateFetchStreamChainInDelegateThread,
+          this, stream_batch_));
+  stream_batch_ = new stellite::IOBufferChain();
+}
+
+void HttpFetcherCore::DidDeliverStreamBatch(size_t bytes) {
+  DCHECK(network_task_runner_->BelongsToCurrentThread());
+  DCHECK_GE(stream_unacked_bytes_, bytes);
+  stream_unacked_bytes_ -= bytes;
+  stream_batch_in_flight_ = false;
+
+  // The request is gone once the response is complete or cancelled.
+  if (!request_.get())
+    return;
+
+  if (!stream_batch_->empty())
+    FlushStreamBatch();
+
+  if (stream_read_stalled_) {
+    stream_read_stalled_ = false;
+    ReadResponse();
+  }
+}
+
 void HttpFetcherCore::ReadResponse() {
   // Some servers may treat HEAD requests as GET requests. To free up the
   // network connection as soon as possible, signal that the request has
@@ -957,11 +1068,26 @@ void HttpFetcherCore::ReadResponse() {
   // about is the response code and headers, which we already have).
   int bytes_read = 0;
   if (request_type_ != URLFetcher::HEAD)
-    bytes_read = request_->Read(buffer_.get(), kBufferSize);
+    bytes_read = request_->Read(buffer_.get(), read_buffer_size_);
 
   OnReadCompleted(request_.get(), bytes_read);
 }
 
+void HttpFetcherCore::MaybeGrowReadBuffer(int bytes_read) {
+  DCHECK(network_task_runner_->BelongsToCurrentThread());
+  if (bytes_read < read_buffer_size_ ||
+      read_buffer_size_ >= max_read_buffer_size_) {
+    return;
+  }
+
+  // The read filled the buffer, so the body is arriving faster than it is
+  // read. Double the buffer to halve the reads, and the delegate callbacks,
+  // for the rest of the response. The chunk just read keeps the old buffer
+  // alive through its DrainableIOBuffer.
+  read_buffer_size_ = std::min(read_buffer_size_ * 2, max_read_buffer_size_);
+  buffer_ = new IOBuffer(read_buffer_size_);
+}
+
 void HttpFetcherCore::AssertHasNoUploadData() const {
   DCHECK(!upload_content_set_);
   DCHECK(upload_content_.empty());
@@ -32,6 +32,7 @@ class SingleThreadTaskRunner;
 
 namespace stellite {
 class HttpFetcherDelegate;
+class IOBufferChain;
 }
 
 namespace net {
@@ -64,6 +65,12 @@ class HttpFetcherCore : public base::RefCountedThreadSafe<HttpFetcherCore>,
   // safe to call this multiple times.
   void Stop();
 
+  // Holds back the next batch of a streamed response until ResumeStream(),
+  // so a slow consumer bounds what the request buffers. The end of a
+  // response already read is still delivered. Called on the delegate thread.
+  void PauseStream();
+  void ResumeStream();
+
   // URLFetcher-like functions.
 
   // For POST requests, set |content_type| to the MIME type of the
@@ -103,6 +110,9 @@ class HttpFetcherCore : public base::RefCountedThreadSafe<HttpFetcherCore>,
       const void* key,
       const URLFetcher::CreateDataCallback& create_data_callback);
   void SetStopOnRedirect(bool stop_on_redirect);
+  // Lets the read buffer grow up to |max_read_buffer_size| bytes while reads
+  // keep filling it. Reads start at 4KB. Must be called before Start().
+  void SetMaxReadBufferSize(int max_read_buffer_size);
   void SetAutomaticallyRetryOn5xx(bool retry);
   void SetMaxRetriesOn5xx(int max_retries);
   int GetMaxRetriesOn5xx() const;
@@ -221,10 +231,26 @@ class HttpFetcherCore : public base::RefCountedThreadSafe<HttpFetcherCore>,
   // Read response bytes from the request.
   void ReadResponse();
 
+  // Grows |buffer_| if the last read of |bytes_read| bytes filled it.
+  void MaybeGrowReadBuffer(int bytes_read);
+
+  // Adds a chunk of a streamed response to |stream_batch_|. Returns OK if
+  // the next chunk may be read right away, or ERR_IO_PENDING if reading
+  // must wait for the delegate to catch up.
+  int QueueStreamData(scoped_refptr<DrainableIOBuffer> data);
+
+  // Posts |stream_batch_| to the delegate thread as one delivery.
+  void FlushStreamBatch();
+
+  // Called on the network thread once the delegate is done with |bytes| of
+  // the streamed response.
+  void DidDeliverStreamBatch(size_t bytes);
+
   // notify header and streaming data about the download
-  void InformDelegateFetchStream(scoped_refptr<DrainableIOBuffer> data);
-  void InformDelegateFetchStreamInDelegateThread(
-      scoped_refptr<DrainableIOBuffer> data);
+  void InformDelegateFetchStreamHeader();
+  void InformDelegateFetchStreamHeaderInDelegateThread();
+  void InformDelegateFetchStreamChainInDelegateThread(
+      scoped_refptr<stellite::IOBufferChain> chain);
 
   void InformDelegateUpdateFetchTimeout();
   void InformDelegateUpdateFetchTimeoutInDelegateThread();
@@ -250,6 +276,8 @@ class HttpFetcherCore : public base::RefCountedThreadSafe<HttpFetcherCore>,
   int response_code_;                // HTTP status code for the request
   scoped_refptr<IOBuffer> buffer_;
                                      // Read buffer
+  int read_buffer_size_;             // Size of |buffer_|
+  int max_read_buffer_size_;         // Size |buffer_| may grow to
   scoped_refptr<URLRequestContextGetter> request_context_getter_;
                                      // Cookie/cache info for the request
   GURL initiator_;  // The request's initiator
@@ -350,6 +378,21 @@ class HttpFetcherCore : public base::RefCountedThreadSafe<HttpFetcherCore>,
 
   bool stream_response_;
 
+  // Streamed response batching, on the network thread. Only one batch is in
+  // flight to the delegate at a time; chunks read meanwhile are gathered in
+  // |stream_batch_| and posted together once it is acknowledged. Reading
+  // stalls while more than the read-ahead limit is unacknowledged.
+  scoped_refptr<stellite::IOBufferChain> stream_batch_;
+  bool stream_batch_in_flight_;
+  size_t stream_unacked_bytes_;
+  bool stream_read_stalled_;
+
+  // Streamed response flow control, on the delegate thread. While paused,
+  // delivered bytes are counted here instead of being acknowledged to the
+  // network thread.
+  bool stream_paused_;
+  size_t paused_stream_bytes_;
+
   std::unique_ptr<HttpResponseInfo> response_info_;
 
   DISALLOW_COPY_AND_ASSIGN(HttpFetcherCore);
@@ -17,6 +17,8 @@ class URLFetcher;
 
 namespace stellite {
 
+class IOBufferChain;
+
 class STELLITE_EXPORT HttpFetcherDelegate {
  public:
   virtual ~HttpFetcherDelegate() {}
@@ -28,6 +30,12 @@ class STELLITE_EXPORT HttpFetcherDelegate {
                              const net::HttpResponseInfo* response_info,
                              const char* data, size_t len, bool fin) = 0;
 
+  // Delivers the body chunks of a streamed response read since the last
+  // delivery. The chain is only valid during the call.
+  virtual void OnFetchStreamChain(const net::URLFetcher* source,
+                                  const net::HttpResponseInfo* response_info,
+                                  const IOBufferChain& chain) = 0;
+
   virtual void ResetTimeout() = 0;
 };
 
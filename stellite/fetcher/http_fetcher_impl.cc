@@ -177,6 +177,18 @@ void HttpFetcherImpl::Stop() {
   core_->Stop();
 }
 
+void HttpFetcherImpl::PauseStream() {
+  core_->PauseStream();
+}
+
+void HttpFetcherImpl::ResumeStream() {
+  core_->ResumeStream();
+}
+
+void HttpFetcherImpl::SetMaxReadBufferSize(int max_read_buffer_size) {
+  core_->SetMaxReadBufferSize(max_read_buffer_size);
+}
+
 const GURL& HttpFetcherImpl::GetOriginalURL() const {
   return core_->GetOriginalURL();
 }
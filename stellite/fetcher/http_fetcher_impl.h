@@ -101,6 +101,13 @@ class NET_EXPORT_PRIVATE HttpFetcherImpl : public net::URLFetcher {
 
   void Stop();
 
+  // See HttpFetcherCore::PauseStream().
+  void PauseStream();
+  void ResumeStream();
+
+  // See HttpFetcherCore::SetMaxReadBufferSize().
+  void SetMaxReadBufferSize(int max_read_buffer_size);
+
   static void CancelAll();
 
   static void SetIgnoreCertificateRequests(bool ignored);
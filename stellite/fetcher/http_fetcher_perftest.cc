@@ -0,0 +1,198 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "base/memory/weak_ptr.h"
+#include "base/run_loop.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/thread_task_runner_handle.h"
+#include "base/time/time.h"
+#include "net/base/ip_endpoint.h"
+#include "net/log/net_log_source.h"
+#include "net/server/http_server_request_info.h"
+#include "net/server/http_server_response_info.h"
+#include "net/socket/tcp_server_socket.h"
+#include "stellite/fetcher/http_fetcher.h"
+#include "stellite/fetcher/http_fetcher_task.h"
+#include "stellite/fetcher/http_request_context_getter.h"
+#include "stellite/fetcher/io_buffer_chain.h"
+#include "stellite/include/http_request.h"
+#include "stellite/server/test_tools/simple_http_server.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace stellite {
+
+namespace {
+
+const size_t kBodySize = 10 * 1024 * 1024;
+const int kIterations = 5;
+
+// Counts the deliveries, and the chunks in them, of a streamed response.
+class CountingVisitor : public HttpFetcherTask::Visitor {
+ public:
+  explicit CountingVisitor(base::RunLoop* run_loop)
+      : run_loop_(run_loop),
+        delivery_count_(0),
+        chunk_count_(0),
+        received_bytes_(0),
+        failed_(false),
+        weak_factory_(this) {
+  }
+
+  ~CountingVisitor() override {}
+
+  void OnTaskComplete(int request_id,
+                      const net::URLFetcher* source,
+                      const net::HttpResponseInfo* response_info) override {
+    run_loop_->Quit();
+  }
+
+  void OnTaskHeader(int request_id,
+                    const net::URLFetcher* source,
+                    const net::HttpResponseInfo* response_info) override {}
+
+  void OnTaskStream(int request_id,
+                    const char* data, size_t len, bool fin) override {
+    received_bytes_ += len;
+    if (fin) {
+      run_loop_->Quit();
+    }
+  }
+
+  void OnTaskStreamChain(int request_id, const IOBufferChain& chain) override {
+    ++delivery_count_;
+    chunk_count_ += chain.buffer_count();
+    received_bytes_ += chain.size();
+  }
+
+  void OnTaskError(int request_id,
+                   const net::URLFetcher* source,
+                   int error_code) override {
+    failed_ = true;
+    run_loop_->Quit();
+  }
+
+  base::WeakPtr<HttpFetcherTask::Visitor> GetWeakPtr() {
+    return weak_factory_.GetWeakPtr();
+  }
+
+  size_t delivery_count() const { return delivery_count_; }
+  size_t chunk_count() const { return chunk_count_; }
+  size_t received_bytes() const { return received_bytes_; }
+  bool failed() const { return failed_; }
+
+ private:
+  base::RunLoop* run_loop_;
+  size_t delivery_count_;
+  size_t chunk_count_;
+  size_t received_bytes_;
+  bool failed_;
+
+  base::WeakPtrFactory<CountingVisitor> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(CountingVisitor);
+};
+
+class HttpFetcherPerfTest : public testing::Test,
+                            public net::SimpleHttpServer::Delegate {
+ public:
+  HttpFetcherPerfTest() : body_(kBodySize, 'x') {}
+
+  void SetUp() override {
+    std::unique_ptr<net::ServerSocket> server_socket(
+        new net::TCPServerSocket(nullptr, net::NetLogSource()));
+    server_socket->ListenWithAddressAndPort("127.0.0.1", 0, 1);
+    http_server_.reset(
+        new net::SimpleHttpServer(std::move(server_socket), this));
+
+    net::IPEndPoint address;
+    http_server_->GetLocalAddress(&address);
+    url_ = base::StringPrintf("http://127.0.0.1:%d/", address.port());
+  }
+
+  // Implements net::SimpleHttpServer::Delegate
+  void OnConnect(int connection_id) override {}
+  void OnClose(int connection_id) override {}
+
+  void OnHttpRequest(int connection_id,
+                     const net::HttpServerRequestInfo& info) override {
+    net::HttpServerResponseInfo response(net::HTTP_OK);
+    response.SetContentHeaders(body_.size(), "application/octet-stream");
+    http_server_->SendRaw(connection_id, response.Serialize());
+    http_server_->SendRaw(connection_id, body_);
+  }
+
+  // Streams the body |kIterations| times through a fetcher whose read buffer
+  // may grow to |max_read_buffer_size|, and prints the deliveries and chunks
+  // per body and the throughput.
+  void RunFetch(const std::string& trace, int max_read_buffer_size) {
+    HttpRequestContextGetter::Params params;
+    params.max_read_buffer_size = max_read_buffer_size;
+    scoped_refptr<HttpRequestContextGetter> context_getter(
+        new HttpRequestContextGetter(params,
+                                     base::ThreadTaskRunnerHandle::Get()));
+    HttpFetcher fetcher(context_getter);
+
+    size_t delivery_count = 0;
+    size_t chunk_count = 0;
+    base::TimeDelta elapsed;
+    for (int i = 0; i < kIterations; ++i) {
+      HttpRequest request;
+      request.url = url_;
+      request.request_type = HttpRequest::GET;
+      request.is_stream_response = true;
+
+      base::RunLoop run_loop;
+      CountingVisitor visitor(&run_loop);
+      base::TimeTicks start = base::TimeTicks::Now();
+      fetcher.Request(request, 0, visitor.GetWeakPtr());
+      run_loop.Run();
+      elapsed += base::TimeTicks::Now() - start;
+
+      ASSERT_FALSE(visitor.failed());
+      ASSERT_EQ(kBodySize, visitor.received_bytes());
+      delivery_count += visitor.delivery_count();
+      chunk_count += visitor.chunk_count();
+    }
+
+    perf_test::PrintResult("fetch_stream_10mb", "", trace + "_deliveries",
+                           delivery_count / kIterations, "count", true);
+    perf_test::PrintResult("fetch_stream_10mb", "", trace + "_chunks",
+                           chunk_count / kIterations, "count", true);
+    perf_test::PrintResult(
+        "fetch_stream_10mb", "", trace + "_throughput",
+        kBodySize * kIterations / elapsed.InSecondsF() / (1024 * 1024),
+        "MB/s", true);
+  }
+
+ private:
+  const std::string body_;
+  std::unique_ptr<net::SimpleHttpServer> http_server_;
+  std::string url_;
+};
+
+}  // namespace
+
+TEST_F(HttpFetcherPerfTest, StreamReadBufferSize) {
+  // 4KB is the fixed read buffer HttpFetcherCore used to have.
+  RunFetch("fixed_4k", 4 * 1024);
+  RunFetch("adaptive_64k", 64 * 1024);
+  RunFetch("adaptive_256k", 256 * 1024);
+}
+
+}  // namespace stellite
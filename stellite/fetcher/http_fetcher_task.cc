@@ -14,13 +14,17 @@
 
 #include "stellite/fetcher/http_fetcher_task.h"
 
+#include "base/bind.h"
 #include "base/location.h"
+#include "base/logging.h"
 #include "base/single_thread_task_runner.h"
 #include "base/threading/thread.h"
 #include "base/time/time.h"
+#include "net/base/io_buffer.h"
 #include "stellite/fetcher/http_fetcher.h"
 #include "stellite/fetcher/http_fetcher_impl.h"
 #include "stellite/fetcher/http_request_context_getter.h"
+#include "stellite/fetcher/io_buffer_chain.h"
 
 namespace stellite {
 
@@ -33,19 +37,24 @@ HttpFetcherTask::HttpFetcherTask(HttpFetcher* http_fetcher, int request_id,
       state_(STATE_IDLE),
       is_chunked_upload_(false),
       is_stream_response_(false),
-      visitor_(delegate) {
+      paused_(false),
+      visitor_(delegate),
+      timeout_entry_(base::Bind(&HttpFetcherTask::OnFetchTimeout,
+                                base::Unretained(this))) {
 }
 
-HttpFetcherTask::~HttpFetcherTask() {
-  if (url_fetch_timeout_timer_.get()) {
-    url_fetch_timeout_timer_->Stop();
-  }
-}
+HttpFetcherTask::~HttpFetcherTask() {}
 
 void HttpFetcherTask::Start(const HttpRequest& request,
+                            const net::URLFetcher::CreateUploadStreamCallback&
+                                upload_stream_factory,
                             int64_t timeout_msec) {
   DCHECK_EQ(state_, STATE_IDLE);
   state_ = STATE_STARTED;
+  start_time_ = base::TimeTicks::Now();
+  if (http_fetcher_->observer()) {
+    http_fetcher_->observer()->OnRequestSent();
+  }
 
   GURL url(request.url);
   is_chunked_upload_ = request.is_chunked_upload;
@@ -74,12 +83,18 @@ void HttpFetcherTask::Start(const HttpRequest& request,
 
   // set net::URLRequestContextGetter
   url_fetcher_->SetRequestContext(http_fetcher_->context_getter());
+  url_fetcher_->SetMaxReadBufferSize(
+      http_fetcher_->context_getter()->max_read_buffer_size());
 
   // set payload
-  std::string payload(request.upload_stream.str());
-  DCHECK(!(payload.size() && is_chunked_upload_));
+  std::string payload;
+  bool has_upload_stream = !upload_stream_factory.is_null();
+  if (!has_upload_stream) {
+    payload = request.upload_stream.str();
+  }
+  DCHECK(!((payload.size() || has_upload_stream) && is_chunked_upload_));
 
-  if (is_chunked_upload_ || payload.size()) {
+  if (is_chunked_upload_ || payload.size() || has_upload_stream) {
     std::string content_type;
     if (!headers.GetHeader(net::HttpRequestHeaders::kContentType,
                            &content_type)) {
@@ -88,6 +103,9 @@ void HttpFetcherTask::Start(const HttpRequest& request,
 
     if (is_chunked_upload_) {
       url_fetcher_->SetChunkedUpload(content_type);
+    } else if (has_upload_stream) {
+      url_fetcher_->SetUploadStreamFactory(content_type,
+                                           upload_stream_factory);
     } else {
       url_fetcher_->SetUploadData(content_type, payload);
     }
@@ -109,30 +127,51 @@ void HttpFetcherTask::Stop() {
   DCHECK(url_fetcher_.get());
   url_fetcher_->Stop();
 
-  if (url_fetch_timeout_timer_.get()) {
-    url_fetch_timeout_timer_->Stop();
+  http_fetcher_->timing_wheel()->Cancel(&timeout_entry_);
+}
+
+void HttpFetcherTask::PauseStream() {
+  DCHECK(is_stream_response_);
+  if (state_ == STATE_COMPLETE || state_ == STATE_CANCEL) {
+    return;
+  }
+
+  url_fetcher_->PauseStream();
+  paused_ = true;
+  http_fetcher_->timing_wheel()->Cancel(&timeout_entry_);
+}
+
+void HttpFetcherTask::ResumeStream() {
+  if (state_ == STATE_COMPLETE || state_ == STATE_CANCEL) {
+    return;
   }
+
+  url_fetcher_->ResumeStream();
+  paused_ = false;
+  ResetTimeout();
 }
 
 void HttpFetcherTask::ResetTimeout(int64_t timeout_msec) {
-  if (url_fetch_timeout_timer_.get()) {
-    url_fetch_timeout_timer_->Stop();
+  // Reads ahead of a paused consumer don't restart the timeout; resuming
+  // does.
+  if (paused_) {
+    return;
   }
+  http_fetcher_->timing_wheel()->Schedule(
+      &timeout_entry_, base::TimeDelta::FromMilliseconds(timeout_msec));
+}
 
-  url_fetch_timeout_timer_.reset(new base::OneShotTimer());
-  url_fetch_timeout_timer_->Start(
-      FROM_HERE,
-      base::TimeDelta::FromMilliseconds(timeout_msec),
-      this,
-      &HttpFetcherTask::OnFetchTimeout);
+void HttpFetcherTask::Visitor::OnTaskStreamChain(int request_id,
+                                                 const IOBufferChain& chain) {
+  for (size_t i = 0; i < chain.buffer_count(); ++i) {
+    OnTaskStream(request_id, chain.buffer(i)->data(), chain.length(i), false);
+  }
 }
 
 void HttpFetcherTask::OnFetchComplete(
     const net::URLFetcher* source,
     const net::HttpResponseInfo* response_info) {
-  if (url_fetch_timeout_timer_.get()) {
-    url_fetch_timeout_timer_->Stop();
-  }
+  http_fetcher_->timing_wheel()->Cancel(&timeout_entry_);
 
   if (!visitor_.get()) {
     LOG(WARNING) << "visitor pass a fetcher response";
@@ -145,10 +184,14 @@ void HttpFetcherTask::OnFetchComplete(
     if (status.status() == net::URLRequestStatus::Status::FAILED) {
       LOG(ERROR) << "Fetch has failed, error(" << status.error() << ") "
           << source->GetURL() << " " << source->GetResponseCode();
+      if (http_fetcher_->observer()) {
+        http_fetcher_->observer()->OnRequestFailed(status.error());
+      }
       visitor_->OnTaskError(request_id_, source, status.error());
     } else if (is_stream_response_) {
       visitor_->OnTaskStream(request_id_, nullptr, 0, true);
     } else {
+      NotifyResponseReceived();
       visitor_->OnTaskComplete(request_id_, source, response_info);
     }
   } else {
@@ -166,12 +209,16 @@ void HttpFetcherTask::OnFetchStream(
   DCHECK(is_stream_response_);
 
   if (state_ == STATE_STARTED) {
+    NotifyResponseReceived();
     if (visitor_.get()) {
       visitor_->OnTaskHeader(request_id_, source, response_info);
     }
     state_ = STATE_STREAMING;
   } else {
-    DCHECK_EQ(state_, STATE_STREAMING);
+    // A timeout may have completed the task after the chunk was posted.
+    if (state_ != STATE_STREAMING) {
+      return;
+    }
     if (visitor_.get()) {
       visitor_->OnTaskStream(request_id_, data, len, fin);
     }
@@ -183,6 +230,20 @@ void HttpFetcherTask::OnFetchStream(
   }
 }
 
+void HttpFetcherTask::OnFetchStreamChain(
+    const net::URLFetcher* source,
+    const net::HttpResponseInfo* response_info,
+    const IOBufferChain& chain) {
+  DCHECK(is_stream_response_);
+  // Dropped when a timeout completed the task after the batch was posted.
+  if (state_ != STATE_STREAMING) {
+    return;
+  }
+  if (visitor_.get()) {
+    visitor_->OnTaskStreamChain(request_id_, chain);
+  }
+}
+
 void HttpFetcherTask::ResetTimeout() {
   if (timeout_msec_ > 0) {
     ResetTimeout(timeout_msec_);
@@ -190,6 +251,9 @@ void HttpFetcherTask::ResetTimeout() {
 }
 
 void HttpFetcherTask::OnFetchTimeout() {
+  if (http_fetcher_->observer()) {
+    http_fetcher_->observer()->OnRequestTimeout();
+  }
   if (visitor_.get()) {
     visitor_->OnTaskError(request_id_, url_fetcher(), net::ERR_TIMED_OUT);
   }
@@ -198,4 +262,11 @@ void HttpFetcherTask::OnFetchTimeout() {
   state_ = STATE_COMPLETE;
 }
 
+void HttpFetcherTask::NotifyResponseReceived() {
+  if (http_fetcher_->observer()) {
+    http_fetcher_->observer()->OnResponseReceived(
+        base::TimeTicks::Now() - start_time_);
+  }
+}
+
 } // namespace net
@@ -18,9 +18,10 @@
 #include <memory>
 
 #include "base/memory/weak_ptr.h"
-#include "base/timer/timer.h"
+#include "base/time/time.h"
 #include "net/url_request/url_fetcher.h"
 #include "stellite/fetcher/http_fetcher_delegate.h"
+#include "stellite/fetcher/timing_wheel.h"
 #include "stellite/include/http_request.h"
 #include "stellite/include/stellite_export.h"
 
@@ -31,6 +32,7 @@ class Time;
 namespace stellite {
 class HttpFetcher;
 class HttpFetcherImpl;
+class IOBufferChain;
 class HttpRequestHeaders;
 class URLRequestContextGetter;
 
@@ -51,20 +53,51 @@ class STELLITE_EXPORT HttpFetcherTask : public HttpFetcherDelegate {
     virtual void OnTaskStream(int request_id,
                               const char* data, size_t len, bool fin) = 0;
 
+    // Delivers the body chunks of a streamed response read since the last
+    // delivery. The default calls OnTaskStream() for each buffer; visitors
+    // that can take the buffers at once should override it. The end of the
+    // stream is still signaled through OnTaskStream().
+    virtual void OnTaskStreamChain(int request_id,
+                                   const IOBufferChain& chain);
+
     virtual void OnTaskError(int request_id,
                              const net::URLFetcher* source,
                              int error_code) = 0;
   };
 
+  // Watches the backend requests of every task of an HttpFetcher, e.g. to
+  // count them. Called on the thread running the tasks.
+  class Observer {
+   public:
+    virtual ~Observer() {}
+
+    virtual void OnRequestSent() = 0;
+
+    // The response header arrived |latency| after the request was sent.
+    virtual void OnResponseReceived(base::TimeDelta latency) = 0;
+
+    virtual void OnRequestTimeout() = 0;
+    virtual void OnRequestFailed(int error_code) = 0;
+  };
+
   HttpFetcherTask(HttpFetcher* http_fetcher, int request_id,
                   base::WeakPtr<Visitor> visitor);
 
   ~HttpFetcherTask() override;
 
-  // Fetch URL request
-  void Start(const HttpRequest& http_request, int64_t timeout_msec);
+  // Fetch URL request. If |upload_stream_factory| is set, the stream it makes
+  // is uploaded instead of |http_request.upload_stream|.
+  void Start(const HttpRequest& http_request,
+             const net::URLFetcher::CreateUploadStreamCallback&
+                 upload_stream_factory,
+             int64_t timeout_msec);
   void Stop();
 
+  // Pauses reading a streamed response. The fetch timeout doesn't run while
+  // paused, since the consumer is what holds the response back.
+  void PauseStream();
+  void ResumeStream();
+
   // Implementation for net::HttpFetcherDelegate
   void OnFetchComplete(const net::URLFetcher* source,
                        const net::HttpResponseInfo* response_info) override;
@@ -73,6 +106,10 @@ class STELLITE_EXPORT HttpFetcherTask : public HttpFetcherDelegate {
                      const net::HttpResponseInfo* response_info,
                      const char* data, size_t len, bool fin) override;
 
+  void OnFetchStreamChain(const net::URLFetcher* source,
+                          const net::HttpResponseInfo* response_info,
+                          const IOBufferChain& chain) override;
+
   void ResetTimeout() override;
 
   // timer
@@ -89,6 +126,9 @@ class STELLITE_EXPORT HttpFetcherTask : public HttpFetcherDelegate {
   }
 
  private:
+  // Reports the response header arriving from the backend.
+  void NotifyResponseReceived();
+
   enum State {
     STATE_IDLE,
     STATE_STARTED,
@@ -105,13 +145,18 @@ class STELLITE_EXPORT HttpFetcherTask : public HttpFetcherDelegate {
   bool is_chunked_upload_;
   bool is_stream_response_;
 
+  // Set while a streamed response is paused. The timeout is not scheduled
+  // meanwhile.
+  bool paused_;
+
   int64_t timeout_msec_;
 
   base::WeakPtr<Visitor> visitor_;
   std::unique_ptr<HttpFetcherImpl> url_fetcher_;
 
   base::TimeDelta timeout_;
-  std::unique_ptr<base::OneShotTimer> url_fetch_timeout_timer_;
+  base::TimeTicks start_time_;
+  TimingWheel::Entry timeout_entry_;
 
   DISALLOW_COPY_AND_ASSIGN(HttpFetcherTask);
 };
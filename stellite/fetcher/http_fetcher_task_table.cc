@@ -0,0 +1,198 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/fetcher/http_fetcher_task_table.h"
+
+#include <new>
+
+#include "base/logging.h"
+
+namespace stellite {
+
+namespace {
+
+// A request ID is a positive int: the slot index in the low bits and the
+// slot generation, which never is 0, in the bits above.
+const int kIndexBits = 16;
+const uint32_t kIndexMask = (1u << kIndexBits) - 1;
+const uint32_t kMaxGeneration = (1u << (31 - kIndexBits)) - 1;
+
+const uint32_t kSlabSize = 1024;
+const uint32_t kMaxSlabs = (kIndexMask + 1) / kSlabSize;
+
+// Freed slots are reused oldest first, and only while this many are free,
+// so an ID goes stale for at least this many releases times the
+// generations of a slot before it could name a live task again.
+const uint32_t kMinFreeSlots = kSlabSize;
+
+const uint32_t kNoSlot = 0xffffffff;
+
+}  // namespace
+
+// static
+const int HttpFetcherTaskTable::kInvalidRequestId;
+
+HttpFetcherTaskTable::Slot::Slot()
+    : generation(1),
+      next_free(kNoSlot),
+      live(false) {
+}
+
+HttpFetcherTaskTable::Slot::~Slot() {
+  if (live) {
+    task()->~HttpFetcherTask();
+  }
+}
+
+HttpFetcherTaskTable::HttpFetcherTaskTable()
+    : slabs_(new base::subtle::AtomicWord[kMaxSlabs]()),
+      free_head_(kNoSlot),
+      free_tail_(kNoSlot),
+      free_count_(0),
+      slot_count_(0),
+      live_count_(0) {
+}
+
+HttpFetcherTaskTable::~HttpFetcherTaskTable() {
+  for (uint32_t i = 0; i < kMaxSlabs; ++i) {
+    delete[] GetSlab(i * kSlabSize);
+  }
+}
+
+int HttpFetcherTaskTable::Reserve() {
+  base::AutoLock lock(lock_);
+
+  // The table grows until enough slots are free to reuse the oldest.
+  uint32_t index = slot_count_;
+  bool table_full = index > kIndexMask;
+  if (free_count_ >= kMinFreeSlots || (table_full && free_count_ > 0)) {
+    index = free_head_;
+    Slot* slot = &GetSlab(index)[index % kSlabSize];
+    free_head_ = slot->next_free;
+    if (free_head_ == kNoSlot) {
+      free_tail_ = kNoSlot;
+    }
+    --free_count_;
+    slot->next_free = kNoSlot;
+    return MakeRequestId(index, slot->generation);
+  }
+
+  if (table_full) {
+    LOG(ERROR) << "fetcher task table is full";
+    return kInvalidRequestId;
+  }
+
+  if (index % kSlabSize == 0) {
+    base::subtle::Release_Store(
+        &slabs_[index / kSlabSize],
+        reinterpret_cast<base::subtle::AtomicWord>(new Slot[kSlabSize]));
+  }
+  ++slot_count_;
+  return MakeRequestId(index, 1);
+}
+
+HttpFetcherTask* HttpFetcherTaskTable::Create(
+    int request_id,
+    HttpFetcher* http_fetcher,
+    base::WeakPtr<HttpFetcherTask::Visitor> visitor) {
+  Slot* slot = FindSlot(request_id);
+  DCHECK(slot);
+  DCHECK(!slot->live);
+
+  new (slot->storage.void_data())
+      HttpFetcherTask(http_fetcher, request_id, visitor);
+  slot->live = true;
+  ++live_count_;
+  return slot->task();
+}
+
+HttpFetcherTask* HttpFetcherTaskTable::Find(int request_id) const {
+  Slot* slot = FindSlot(request_id);
+  return slot && slot->live ? slot->task() : nullptr;
+}
+
+void HttpFetcherTaskTable::Release(int request_id) {
+  Slot* slot = FindSlot(request_id);
+  if (!slot) {
+    return;
+  }
+
+  if (slot->live) {
+    slot->live = false;
+    --live_count_;
+    slot->task()->~HttpFetcherTask();
+  }
+
+  // Stales every outstanding copy of |request_id|.
+  slot->generation =
+      slot->generation == kMaxGeneration ? 1 : slot->generation + 1;
+
+  base::AutoLock lock(lock_);
+  uint32_t index = static_cast<uint32_t>(request_id) & kIndexMask;
+  if (free_tail_ == kNoSlot) {
+    free_head_ = index;
+  } else {
+    GetSlab(free_tail_)[free_tail_ % kSlabSize].next_free = index;
+  }
+  free_tail_ = index;
+  ++free_count_;
+}
+
+void HttpFetcherTaskTable::GetRequestIds(std::vector<int>* request_ids) const {
+  uint32_t slot_count;
+  {
+    base::AutoLock lock(lock_);
+    slot_count = slot_count_;
+  }
+
+  for (uint32_t index = 0; index < slot_count; ++index) {
+    const Slot& slot = GetSlab(index)[index % kSlabSize];
+    if (slot.live) {
+      request_ids->push_back(MakeRequestId(index, slot.generation));
+    }
+  }
+}
+
+// static
+int HttpFetcherTaskTable::MakeRequestId(uint32_t index, uint32_t generation) {
+  DCHECK_LE(index, kIndexMask);
+  DCHECK_GT(generation, 0u);
+  DCHECK_LE(generation, kMaxGeneration);
+  return static_cast<int>((generation << kIndexBits) | index);
+}
+
+HttpFetcherTaskTable::Slot* HttpFetcherTaskTable::GetSlab(
+    uint32_t index) const {
+  return reinterpret_cast<Slot*>(
+      base::subtle::Acquire_Load(&slabs_[index / kSlabSize]));
+}
+
+HttpFetcherTaskTable::Slot* HttpFetcherTaskTable::FindSlot(
+    int request_id) const {
+  if (request_id <= 0) {
+    return nullptr;
+  }
+
+  uint32_t index = static_cast<uint32_t>(request_id) & kIndexMask;
+  uint32_t generation = static_cast<uint32_t>(request_id) >> kIndexBits;
+  Slot* slab = GetSlab(index);
+  if (!slab) {
+    return nullptr;
+  }
+
+  Slot* slot = &slab[index % kSlabSize];
+  return slot->generation == generation ? slot : nullptr;
+}
+
+}  // namespace stellite
@@ -0,0 +1,117 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_FETCHER_HTTP_FETCHER_TASK_TABLE_H_
+#define STELLITE_FETCHER_HTTP_FETCHER_TASK_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/macros.h"
+#include "base/memory/aligned_memory.h"
+#include "base/memory/weak_ptr.h"
+#include "base/synchronization/lock.h"
+#include "stellite/fetcher/http_fetcher_task.h"
+#include "stellite/include/stellite_export.h"
+
+namespace stellite {
+
+class HttpFetcher;
+
+// The tasks of an HttpFetcher, constructed in place in slabs of slots that
+// are recycled through a first-in first-out free list. A request ID is the
+// slot index tagged with the generation of the slot, so lookups are an index
+// and a compare, and an ID whose task was released no longer finds the task
+// that reuses its slot.
+//
+// Reserve() may be called on any thread. Everything else runs on the
+// thread the fetcher runs its tasks on, and only with IDs from Reserve().
+class STELLITE_EXPORT HttpFetcherTaskTable {
+ public:
+  static const int kInvalidRequestId = -1;
+
+  HttpFetcherTaskTable();
+  ~HttpFetcherTaskTable();
+
+  // Returns the ID of a free slot.
+  int Reserve();
+
+  // Constructs the task of a reserved |request_id|.
+  HttpFetcherTask* Create(int request_id,
+                          HttpFetcher* http_fetcher,
+                          base::WeakPtr<HttpFetcherTask::Visitor> visitor);
+
+  // Returns the task of |request_id|, or nullptr if it isn't created or was
+  // already released.
+  HttpFetcherTask* Find(int request_id) const;
+
+  // Destroys the task of |request_id|, if any, and frees its slot. Releasing
+  // an ID twice is harmless.
+  void Release(int request_id);
+
+  // Appends the IDs of the created tasks.
+  void GetRequestIds(std::vector<int>* request_ids) const;
+
+  size_t size() const { return live_count_; }
+
+ private:
+  struct Slot {
+    Slot();
+    ~Slot();
+
+    HttpFetcherTask* task() {
+      return storage.data_as<HttpFetcherTask>();
+    }
+
+    base::AlignedMemory<sizeof(HttpFetcherTask), alignof(HttpFetcherTask)>
+        storage;
+    uint32_t generation;
+    uint32_t next_free;
+    bool live;
+  };
+
+  static int MakeRequestId(uint32_t index, uint32_t generation);
+
+  // The slab holding slot |index|, or nullptr if it isn't allocated yet.
+  Slot* GetSlab(uint32_t index) const;
+
+  // Returns the slot |request_id| names, or nullptr if its generation is
+  // stale.
+  Slot* FindSlot(int request_id) const;
+
+  // Slot arrays, allocated as the table grows and freed with the table.
+  // Reserve() publishes a new slab with a release store, so a slot may be
+  // looked up on the task thread without |lock_|.
+  std::unique_ptr<base::subtle::AtomicWord[]> slabs_;
+
+  // Guards the free list and the growth of |slabs_|. Slots are freed at
+  // the tail and reused from the head.
+  mutable base::Lock lock_;
+  uint32_t free_head_;
+  uint32_t free_tail_;
+  uint32_t free_count_;
+  uint32_t slot_count_;
+
+  size_t live_count_;
+
+  DISALLOW_COPY_AND_ASSIGN(HttpFetcherTaskTable);
+};
+
+}  // namespace stellite
+
+#endif  // STELLITE_FETCHER_HTTP_FETCHER_TASK_TABLE_H_
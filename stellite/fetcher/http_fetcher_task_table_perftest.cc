@@ -0,0 +1,106 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/fetcher/http_fetcher_task_table.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/memory/ptr_util.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace stellite {
+
+namespace {
+
+// Requests in flight on one fetch thread, and how many are started and
+// released while that many are in flight.
+const size_t kConcurrentRequests = 20000;
+const size_t kRequestCount = 2000000;
+
+// Lookups per request: start, a few chunks or pause/resume, release.
+const size_t kLookupsPerRequest = 4;
+
+base::WeakPtr<HttpFetcherTask::Visitor> NoVisitor() {
+  return base::WeakPtr<HttpFetcherTask::Visitor>();
+}
+
+void PrintRequestsPerSecond(const std::string& trace, base::TimeDelta elapsed) {
+  perf_test::PrintResult("fetcher_task_table", "", trace,
+                         kRequestCount / elapsed.InSecondsF(),
+                         "requests/s", true);
+}
+
+}  // namespace
+
+// The request bookkeeping HttpFetcher did before the task table.
+TEST(HttpFetcherTaskTablePerfTest, Map) {
+  std::map<int, std::unique_ptr<HttpFetcherTask>> request_map;
+  std::vector<int> ring(kConcurrentRequests);
+  int last_request_id = 0;
+  size_t found = 0;
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t i = 0; i < kRequestCount + kConcurrentRequests; ++i) {
+    int& slot = ring[i % kConcurrentRequests];
+    if (i >= kConcurrentRequests) {
+      for (size_t j = 0; j < kLookupsPerRequest; ++j) {
+        found += request_map.find(slot) != request_map.end();
+      }
+      request_map.erase(slot);
+    }
+
+    if (i < kRequestCount) {
+      int request_id = ++last_request_id;
+      request_map.insert(std::make_pair(
+          request_id,
+          base::MakeUnique<HttpFetcherTask>(nullptr, request_id, NoVisitor())));
+      slot = request_id;
+    }
+  }
+  PrintRequestsPerSecond("map", base::TimeTicks::Now() - start);
+  EXPECT_EQ(kRequestCount * kLookupsPerRequest, found);
+}
+
+TEST(HttpFetcherTaskTablePerfTest, TaskTable) {
+  HttpFetcherTaskTable table;
+  std::vector<int> ring(kConcurrentRequests);
+  size_t found = 0;
+
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (size_t i = 0; i < kRequestCount + kConcurrentRequests; ++i) {
+    int& slot = ring[i % kConcurrentRequests];
+    if (i >= kConcurrentRequests) {
+      for (size_t j = 0; j < kLookupsPerRequest; ++j) {
+        found += table.Find(slot) != nullptr;
+      }
+      table.Release(slot);
+    }
+
+    if (i < kRequestCount) {
+      int request_id = table.Reserve();
+      table.Create(request_id, nullptr, NoVisitor());
+      slot = request_id;
+    }
+  }
+  PrintRequestsPerSecond("task_table", base::TimeTicks::Now() - start);
+  EXPECT_EQ(kRequestCount * kLookupsPerRequest, found);
+}
+
+}  // namespace stellite
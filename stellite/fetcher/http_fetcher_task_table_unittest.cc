@@ -0,0 +1,125 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/fetcher/http_fetcher_task_table.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace stellite {
+
+namespace {
+
+base::WeakPtr<HttpFetcherTask::Visitor> NoVisitor() {
+  return base::WeakPtr<HttpFetcherTask::Visitor>();
+}
+
+}  // namespace
+
+TEST(HttpFetcherTaskTableTest, CreateFindRelease) {
+  HttpFetcherTaskTable table;
+
+  int request_id = table.Reserve();
+  EXPECT_GT(request_id, 0);
+  EXPECT_EQ(nullptr, table.Find(request_id));
+
+  HttpFetcherTask* task = table.Create(request_id, nullptr, NoVisitor());
+  ASSERT_NE(nullptr, task);
+  EXPECT_EQ(task, table.Find(request_id));
+  EXPECT_EQ(1u, table.size());
+
+  table.Release(request_id);
+  EXPECT_EQ(nullptr, table.Find(request_id));
+  EXPECT_EQ(0u, table.size());
+
+  // A second release is a no-op.
+  table.Release(request_id);
+  EXPECT_EQ(0u, table.size());
+}
+
+TEST(HttpFetcherTaskTableTest, StaleIdAfterSlotReuse) {
+  HttpFetcherTaskTable table;
+
+  int old_id = table.Reserve();
+  table.Create(old_id, nullptr, NoVisitor());
+  table.Release(old_id);
+
+  int new_id = table.Reserve();
+  EXPECT_NE(old_id, new_id);
+  HttpFetcherTask* task = table.Create(new_id, nullptr, NoVisitor());
+
+  EXPECT_EQ(nullptr, table.Find(old_id));
+  EXPECT_EQ(task, table.Find(new_id));
+
+  // Releasing the stale ID leaves the new task alone.
+  table.Release(old_id);
+  EXPECT_EQ(task, table.Find(new_id));
+  EXPECT_EQ(1u, table.size());
+}
+
+TEST(HttpFetcherTaskTableTest, StaleIdAfterChurn) {
+  HttpFetcherTaskTable table;
+
+  int stale_id = table.Reserve();
+  table.Create(stale_id, nullptr, NoVisitor());
+  table.Release(stale_id);
+
+  // Many more requests than a slot has generations, one at a time.
+  for (int i = 0; i < 100000; ++i) {
+    int request_id = table.Reserve();
+    ASSERT_NE(stale_id, request_id);
+    table.Create(request_id, nullptr, NoVisitor());
+    table.Release(stale_id);
+    EXPECT_NE(nullptr, table.Find(request_id));
+    table.Release(request_id);
+  }
+  EXPECT_EQ(0u, table.size());
+}
+
+TEST(HttpFetcherTaskTableTest, InvalidIds) {
+  HttpFetcherTaskTable table;
+  EXPECT_EQ(nullptr, table.Find(HttpFetcherTaskTable::kInvalidRequestId));
+  EXPECT_EQ(nullptr, table.Find(0));
+  EXPECT_EQ(nullptr, table.Find(12345));
+  table.Release(12345);
+}
+
+TEST(HttpFetcherTaskTableTest, GrowsAcrossSlabs) {
+  HttpFetcherTaskTable table;
+  const size_t kTaskCount = 3000;
+
+  std::vector<int> request_ids;
+  for (size_t i = 0; i < kTaskCount; ++i) {
+    int request_id = table.Reserve();
+    table.Create(request_id, nullptr, NoVisitor());
+    request_ids.push_back(request_id);
+  }
+  EXPECT_EQ(kTaskCount, table.size());
+
+  std::vector<int> live_ids;
+  table.GetRequestIds(&live_ids);
+  std::sort(request_ids.begin(), request_ids.end());
+  std::sort(live_ids.begin(), live_ids.end());
+  EXPECT_EQ(request_ids, live_ids);
+
+  for (int request_id : request_ids) {
+    EXPECT_NE(nullptr, table.Find(request_id));
+    table.Release(request_id);
+  }
+  EXPECT_EQ(0u, table.size());
+}
+
+}  // namespace stellite
@@ -0,0 +1,202 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/fetcher/http_fetcher_task.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "base/callback.h"
+#include "base/location.h"
+#include "base/memory/weak_ptr.h"
+#include "base/run_loop.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/thread_task_runner_handle.h"
+#include "base/time/time.h"
+#include "net/base/ip_endpoint.h"
+#include "net/base/net_errors.h"
+#include "net/log/net_log_source.h"
+#include "net/server/http_server_request_info.h"
+#include "net/socket/tcp_server_socket.h"
+#include "stellite/fetcher/http_fetcher.h"
+#include "stellite/fetcher/http_request_context_getter.h"
+#include "stellite/include/http_request.h"
+#include "stellite/server/test_tools/simple_http_server.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace stellite {
+
+namespace {
+
+const int64_t kTimeoutMsec = 200;
+const int kChunkCount = 8;
+const char kChunk[] = "4\r\ndata\r\n";
+
+}  // namespace
+
+// Fetches a chunked response that the backend sends piece by piece, and
+// pauses it as soon as the header arrives.
+class HttpFetcherTaskTest : public testing::Test,
+                            public net::SimpleHttpServer::Delegate,
+                            public HttpFetcherTask::Visitor {
+ public:
+  HttpFetcherTaskTest()
+      : connection_id_(-1),
+        request_id_(-1),
+        error_code_(net::OK),
+        fin_(false),
+        weak_factory_(this) {
+  }
+
+  void SetUp() override {
+    context_getter_ = new HttpRequestContextGetter(
+        HttpRequestContextGetter::Params(),
+        base::ThreadTaskRunnerHandle::Get());
+    http_fetcher_.reset(new HttpFetcher(context_getter_));
+
+    std::unique_ptr<net::ServerSocket> server_socket(
+        new net::TCPServerSocket(nullptr, net::NetLogSource()));
+    server_socket->ListenWithAddressAndPort("127.0.0.1", 0, 1);
+    http_server_.reset(
+        new net::SimpleHttpServer(std::move(server_socket), this));
+  }
+
+  void StartRequest() {
+    net::IPEndPoint address;
+    http_server_->GetLocalAddress(&address);
+
+    HttpRequest request;
+    request.url = base::StringPrintf("http://127.0.0.1:%d/", address.port());
+    request.request_type = HttpRequest::GET;
+    request.is_stream_response = true;
+    request_id_ = http_fetcher_->Request(request, kTimeoutMsec,
+                                         weak_factory_.GetWeakPtr());
+  }
+
+  // Runs the message loop for |delay|, or until the response ends.
+  void RunFor(base::TimeDelta delay) {
+    base::RunLoop run_loop;
+    quit_closure_ = run_loop.QuitClosure();
+    base::ThreadTaskRunnerHandle::Get()->PostDelayedTask(
+        FROM_HERE, run_loop.QuitClosure(), delay);
+    run_loop.Run();
+    quit_closure_.Reset();
+  }
+
+  // Implements net::SimpleHttpServer::Delegate
+  void OnConnect(int connection_id) override {}
+  void OnClose(int connection_id) override {}
+
+  void OnHttpRequest(int connection_id,
+                     const net::HttpServerRequestInfo& info) override {
+    connection_id_ = connection_id;
+    http_server_->SendRaw(connection_id,
+                          "HTTP/1.1 200 OK\r\n"
+                          "Transfer-Encoding: chunked\r\n\r\n");
+  }
+
+  // Implements HttpFetcherTask::Visitor
+  void OnTaskComplete(int request_id,
+                      const net::URLFetcher* source,
+                      const net::HttpResponseInfo* response_info) override {}
+
+  void OnTaskHeader(int request_id,
+                    const net::URLFetcher* source,
+                    const net::HttpResponseInfo* response_info) override {
+    http_fetcher_->PauseStream(request_id);
+  }
+
+  void OnTaskStream(int request_id,
+                    const char* data, size_t len, bool fin) override {
+    if (len > 0) {
+      body_.append(data, len);
+    }
+    if (fin) {
+      fin_ = true;
+      Quit();
+    }
+  }
+
+  void OnTaskError(int request_id,
+                   const net::URLFetcher* source,
+                   int error_code) override {
+    error_code_ = error_code;
+    Quit();
+  }
+
+ protected:
+  void Quit() {
+    if (!quit_closure_.is_null()) {
+      quit_closure_.Run();
+    }
+  }
+
+  scoped_refptr<HttpRequestContextGetter> context_getter_;
+  std::unique_ptr<HttpFetcher> http_fetcher_;
+  std::unique_ptr<net::SimpleHttpServer> http_server_;
+  base::Closure quit_closure_;
+
+  int connection_id_;
+  int request_id_;
+  int error_code_;
+  bool fin_;
+  std::string body_;
+
+  base::WeakPtrFactory<HttpFetcherTaskTest> weak_factory_;
+};
+
+TEST_F(HttpFetcherTaskTest, PausedStreamDoesNotTimeOut) {
+  StartRequest();
+  RunFor(base::TimeDelta::FromMilliseconds(kTimeoutMsec / 2));
+  ASSERT_NE(-1, connection_id_);
+
+  // Reads keep arriving while the consumer holds the response back.
+  for (int i = 0; i < kChunkCount; ++i) {
+    http_server_->SendRaw(connection_id_, kChunk);
+    RunFor(base::TimeDelta::FromMilliseconds(kTimeoutMsec / 2));
+  }
+  RunFor(base::TimeDelta::FromMilliseconds(kTimeoutMsec * 4));
+  EXPECT_EQ(net::OK, error_code_);
+
+  // Only the first batch got through; it isn't acknowledged while paused,
+  // so the chunks read after it wait in the fetcher.
+  EXPECT_EQ(4u, body_.size());
+
+  // Resuming acknowledges the batch and the held chunks follow.
+  http_fetcher_->ResumeStream(request_id_);
+  RunFor(base::TimeDelta::FromMilliseconds(kTimeoutMsec / 2));
+  EXPECT_EQ(kChunkCount * 4u, body_.size());
+  EXPECT_FALSE(fin_);
+
+  http_server_->SendRaw(connection_id_, "0\r\n\r\n");
+  RunFor(base::TimeDelta::FromSeconds(5));
+  EXPECT_TRUE(fin_);
+  EXPECT_EQ(net::OK, error_code_);
+  EXPECT_EQ(kChunkCount * 4u, body_.size());
+}
+
+TEST_F(HttpFetcherTaskTest, ResumedStreamTimesOut) {
+  StartRequest();
+  RunFor(base::TimeDelta::FromMilliseconds(kTimeoutMsec / 2));
+  ASSERT_NE(-1, connection_id_);
+
+  // The backend stalls once the consumer reads again.
+  http_fetcher_->ResumeStream(request_id_);
+  RunFor(base::TimeDelta::FromMilliseconds(kTimeoutMsec * 4));
+  EXPECT_EQ(net::ERR_TIMED_OUT, error_code_);
+  EXPECT_FALSE(fin_);
+}
+
+}  // namespace stellite
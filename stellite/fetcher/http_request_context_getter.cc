@@ -34,6 +34,7 @@
 #include "net/cert/multi_log_ct_verifier.h"
 #include "net/cookies/cookie_monster.h"
 #include "net/dns/host_resolver.h"
+#include "net/filter/source_stream.h"
 #include "net/http/http_auth_handler_factory.h"
 #include "net/http/http_cache.h"
 #include "net/http/http_network_layer.h"
@@ -51,6 +52,7 @@
 #include "net/url_request/static_http_user_agent_settings.h"
 #include "net/url_request/url_request_context.h"
 #include "net/url_request/url_request_context_storage.h"
+#include "net/url_request/url_request_http_job.h"
 #include "net/url_request/url_request_intercepting_job_factory.h"
 #include "net/url_request/url_request_interceptor.h"
 #include "net/url_request/url_request_job_factory_impl.h"
@@ -82,6 +84,43 @@ ContainerHttpRequestContext::ContainerHttpRequestContext()
 
 ContainerHttpRequestContext::~ContainerHttpRequestContext() {}
 
+// An HTTP job without the decoding filters of the content-encoding.
+class RawBodyHttpJob : public net::URLRequestHttpJob {
+ public:
+  RawBodyHttpJob(net::URLRequest* request,
+                 net::NetworkDelegate* network_delegate)
+      : net::URLRequestHttpJob(
+            request, network_delegate,
+            request->context()->http_user_agent_settings()) {
+  }
+
+ private:
+  ~RawBodyHttpJob() override {}
+
+  // implements net::URLRequestJob
+  std::unique_ptr<net::SourceStream> SetUpSourceStream() override {
+    return net::URLRequestJob::SetUpSourceStream();
+  }
+
+  DISALLOW_COPY_AND_ASSIGN(RawBodyHttpJob);
+};
+
+class RawBodyProtocolHandler
+    : public net::URLRequestJobFactory::ProtocolHandler {
+ public:
+  RawBodyProtocolHandler() {}
+
+  // implements net::URLRequestJobFactory::ProtocolHandler
+  net::URLRequestJob* MaybeCreateJob(
+      net::URLRequest* request,
+      net::NetworkDelegate* network_delegate) const override {
+    return new RawBodyHttpJob(request, network_delegate);
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RawBodyProtocolHandler);
+};
+
 }  // namespace anonymous
 
 HttpRequestContextGetter::Params::Params()
@@ -97,13 +136,15 @@ HttpRequestContextGetter::Params::Params()
       quic_migrate_sessions_on_network_change(false),
       quic_prefer_aes(false),
       quic_race_cert_verification(false),
+      raw_response_body(false),
       sdch_enable(false),
       throttling_enable(false),
       using_disk_cache(false),
       using_memory_cache(false),
       cache_max_size(0),
       quic_idle_connection_timeout_seconds(60),
-      quic_max_server_configs_stored_in_properties(10) {
+      quic_max_server_configs_stored_in_properties(10),
+      max_read_buffer_size(64 * 1024) {
 }
 
 HttpRequestContextGetter::Params::Params(const Params& other)
@@ -122,6 +163,7 @@ HttpRequestContextGetter::Params::Params(const Params& other)
        other.quic_migrate_sessions_on_network_change),
    quic_prefer_aes(other.quic_prefer_aes),
    quic_race_cert_verification(other.quic_race_cert_verification),
+   raw_response_body(other.raw_response_body),
    sdch_enable(other.sdch_enable),
    throttling_enable(other.throttling_enable),
    using_disk_cache(other.using_disk_cache),
@@ -131,6 +173,7 @@ HttpRequestContextGetter::Params::Params(const Params& other)
        other.quic_idle_connection_timeout_seconds),
    quic_max_server_configs_stored_in_properties(
        other.quic_max_server_configs_stored_in_properties),
+   max_read_buffer_size(other.max_read_buffer_size),
    accept_language(other.accept_language),
    proxy_host(other.proxy_host),
    quic_user_agent_id(other.quic_user_agent_id),
@@ -323,7 +366,15 @@ bool HttpRequestContextGetter::BuildContext(Params params) {
             storage->http_network_session()));
   }
 
-  storage->set_job_factory(base::MakeUnique<net::URLRequestJobFactoryImpl>());
+  std::unique_ptr<net::URLRequestJobFactoryImpl> job_factory(
+      new net::URLRequestJobFactoryImpl());
+  if (params.raw_response_body) {
+    job_factory->SetProtocolHandler(
+        "http", base::MakeUnique<RawBodyProtocolHandler>());
+    job_factory->SetProtocolHandler(
+        "https", base::MakeUnique<RawBodyProtocolHandler>());
+  }
+  storage->set_job_factory(std::move(job_factory));
 
   context_ = std::move(context);
   return true;
@@ -49,6 +49,11 @@ class HttpRequestContextGetter : public net::URLRequestContextGetter {
     bool quic_migrate_sessions_on_network_change;
     bool quic_prefer_aes;
     bool quic_race_cert_verification;
+
+    // Delivers HTTP response bodies as they came off the wire, leaving the
+    // content-encoding to whoever the body is relayed to.
+    bool raw_response_body;
+
     bool sdch_enable;
     bool throttling_enable;
     bool using_disk_cache;
@@ -57,6 +62,11 @@ class HttpRequestContextGetter : public net::URLRequestContextGetter {
     int quic_idle_connection_timeout_seconds;
     int quic_max_server_configs_stored_in_properties;
 
+    // Upper bound of the buffer a response is read into. The buffer starts
+    // at 4KB and doubles every time a read fills it, so fast backends are
+    // delivered in fewer, larger chunks.
+    int max_read_buffer_size;
+
     std::string accept_language;
     std::string proxy_host;
     std::string quic_user_agent_id;
@@ -79,6 +89,10 @@ class HttpRequestContextGetter : public net::URLRequestContextGetter {
   void set_host_resolver(std::unique_ptr<net::HostResolver> host_resolver);
   void set_cert_verifier(std::unique_ptr<net::CertVerifier> cert_verifier);
 
+  int max_read_buffer_size() const {
+    return context_params_.max_read_buffer_size;
+  }
+
  private:
   ~HttpRequestContextGetter() override;
 
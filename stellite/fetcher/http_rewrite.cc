@@ -14,16 +14,25 @@
 
 #include "stellite/fetcher/http_rewrite.h"
 
+#include <set>
+#include <utility>
+
 #include "base/logging.h"
-#include "base/strings/string_number_conversions.h"
 #include "components/url_matcher/string_pattern.h"
-#include "components/url_matcher/url_matcher.h"
 #include "third_party/re2/src/re2/re2.h"
 
 namespace net {
 
+// Capture groups a replace format can refer to, counting the whole match.
 const int kMaxGroupCount = 16;
 
+HttpRewrite::Rule::Rule()
+    : max_group(0),
+      hit_count(0) {
+}
+
+HttpRewrite::Rule::~Rule() {}
+
 HttpRewrite::HttpRewrite() {
 }
 
@@ -32,23 +41,55 @@ HttpRewrite::~HttpRewrite() {}
 void HttpRewrite::AddRule(const std::string& pattern,
                           const std::string& replace) {
   url_matcher::StringPattern::ID id =
-      static_cast<url_matcher::StringPattern::ID>(pattern_list_.size());
-  url_matcher::StringPattern* string_pattern =
-      new url_matcher::StringPattern(pattern, id);
-  pattern_list_.push_back(string_pattern);
+      static_cast<url_matcher::StringPattern::ID>(rules_.size());
 
-  replace_format_.push_back(std::string(replace));
+  std::unique_ptr<Rule> rule(new Rule());
+  rule->pattern.reset(new url_matcher::StringPattern(pattern, id));
+  rule->replace = replace;
+  rules_.push_back(std::move(rule));
 }
 
 void HttpRewrite::RecompilePattern() {
+  std::vector<const url_matcher::StringPattern*> pattern_list;
+  for (const std::unique_ptr<Rule>& rule : rules_) {
+    rule->re.reset(new re2::RE2(rule->pattern->pattern()));
+    rule->segments.clear();
+    if (!rule->re->ok()) {
+      LOG(ERROR) << "Invalid rewrite pattern: " << rule->pattern->pattern();
+      rule->re.reset();
+      continue;
+    }
+
+    rule->max_group = ParseReplace(rule->replace,
+                                   rule->re->NumberOfCapturingGroups(),
+                                   &rule->segments);
+    if (rule->max_group >= kMaxGroupCount) {
+      LOG(ERROR) << "Overflow in rewriting matcher group count: "
+                 << rule->max_group;
+      rule->re.reset();
+      continue;
+    }
+
+    // The matcher only sees the valid rules.
+    pattern_list.push_back(rule->pattern.get());
+  }
+
   matcher_.ClearPatterns();
-  matcher_.AddPatterns(pattern_list_);
+  matcher_.AddPatterns(pattern_list);
 }
 
 void HttpRewrite::Clear() {
-  pattern_list_.clear();
-  replace_format_.clear();
   matcher_.ClearPatterns();
+  rules_.clear();
+}
+
+bool HttpRewrite::IsValid() const {
+  for (const std::unique_ptr<Rule>& rule : rules_) {
+    if (!rule->re) {
+      return false;
+    }
+  }
+  return true;
 }
 
 bool HttpRewrite::Rewrite(const std::string& origin_path,
@@ -60,52 +101,96 @@ bool HttpRewrite::Rewrite(const std::string& origin_path,
     return false;
   }
 
-  url_matcher::StringPattern::ID pattern_id = *result.begin();
-  const std::string& pattern();
+  const Rule& rule = *rules_[*result.begin()];
+  DCHECK(rule.re);
 
-  re2::RE2 re(pattern_list_[pattern_id]->pattern());
-  int group_count = re.NumberOfCapturingGroups();
-  if (group_count >= kMaxGroupCount) {
-    LOG(ERROR) << "Overflow in rewriting matcher group count: " << group_count;
+  re2::StringPiece group[kMaxGroupCount];
+  if (!rule.re->Match(origin_path, 0, origin_path.size(), re2::RE2::ANCHOR_BOTH,
+                      group, rule.max_group + 1)) {
     return false;
   }
 
-  re2::RE2::Arg argv[kMaxGroupCount];
-  std::vector<std::string> group(kMaxGroupCount);
-  for (uint32_t i = 0; i < arraysize(argv); ++i) {
-    argv[i] = &group[i];
-  }
-
-  const re2::RE2::Arg* const args[sizeof(argv)] = {
-    &argv[0], &argv[1], &argv[2], &argv[3],
-    &argv[4], &argv[5], &argv[6], &argv[7],
-    &argv[8], &argv[9], &argv[10], &argv[11],
-    &argv[12], &argv[13], &argv[14], &argv[15],
-  };
-
-  if (!re2::RE2::FullMatchN(origin_path, re, args, group_count)) {
-    return false;
-  }
+  ++rule.hit_count;
 
-  std::string replace = replace_format_[pattern_id];
-  for (int i = 0; i < group_count; ++i) {
-    std::string from(std::string("\\$") + base::IntToString(i + 1));
-    re2::RE2::GlobalReplace(&replace, from, group[i]);
+  replaced_path->clear();
+  for (const Segment& segment : rule.segments) {
+    replaced_path->append(segment.literal);
+    if (segment.group) {
+      replaced_path->append(group[segment.group].data(),
+                            group[segment.group].size());
+    }
   }
-  replaced_path->swap(replace);
 
   return true;
 }
 
+const std::string& HttpRewrite::pattern(size_t index) const {
+  return rules_[index]->pattern->pattern();
+}
+
 // Static
-HttpRewrite* HttpRewrite::Create(const RewriteRules& rules) {
-  std::unique_ptr<HttpRewrite> http_rewrite(new HttpRewrite());
+scoped_refptr<HttpRewrite> HttpRewrite::Create(const RewriteRules& rules) {
+  scoped_refptr<HttpRewrite> http_rewrite(new HttpRewrite());
   for (size_t i = 0; i < rules.size(); ++i) {
     http_rewrite->AddRule(rules[i].first, rules[i].second);
   }
   http_rewrite->RecompilePattern();
-  return http_rewrite.release();
+  return http_rewrite;
 }
 
+// Static
+int HttpRewrite::ParseReplace(const std::string& replace, int group_count,
+                              std::vector<Segment>* segments) {
+  int max_group = 0;
+  Segment segment;
+  segment.group = 0;
+
+  size_t pos = 0;
+  while (pos < replace.size()) {
+    size_t dollar = replace.find('$', pos);
+    if (dollar == std::string::npos) {
+      break;
+    }
+
+    // Longest run of digits naming an existing group, so that $12 is not
+    // read as $1 followed by "2" when the pattern has twelve groups.
+    size_t end = dollar + 1;
+    int group = 0;
+    size_t group_end = end;
+    while (end < replace.size() && replace[end] >= '0' &&
+           replace[end] <= '9') {
+      int value = group * 10 + (replace[end] - '0');
+      if (value > group_count) {
+        break;
+      }
+      group = value;
+      group_end = ++end;
+    }
+
+    if (group == 0) {
+      // Not a group reference: keep the '$' as is.
+      segment.literal.append(replace, pos, dollar + 1 - pos);
+      pos = dollar + 1;
+      continue;
+    }
+
+    segment.literal.append(replace, pos, dollar - pos);
+    segment.group = group;
+    segments->push_back(segment);
+    segment.literal.clear();
+    segment.group = 0;
+
+    if (group > max_group) {
+      max_group = group;
+    }
+    pos = group_end;
+  }
+
+  segment.literal.append(replace, pos, std::string::npos);
+  if (!segment.literal.empty() || segments->empty()) {
+    segments->push_back(segment);
+  }
+  return max_group;
+}
 
 } // namespace net
@@ -15,12 +15,21 @@
 #ifndef STELLITE_FETCHER_HTTP_REWRITE_H_
 #define STELLITE_FETCHER_HTTP_REWRITE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <memory>
-#include <set>
 #include <string>
 #include <vector>
 
+#include "base/macros.h"
+#include "base/memory/ref_counted.h"
 #include "components/url_matcher/regex_set_matcher.h"
+#include "stellite/include/stellite_export.h"
+
+namespace re2 {
+class RE2;
+}
 
 namespace url_matcher {
 class StringPattern;
@@ -30,24 +39,64 @@ namespace net {
 
 typedef std::vector<std::pair<std::string, std::string>> RewriteRules;
 
-class HttpRewrite {
+// Ref counted so that a config reload can replace the rules while requests
+// still hold the old ones. Left alone once compiled.
+class STELLITE_EXPORT HttpRewrite : public base::RefCounted<HttpRewrite> {
  public:
   HttpRewrite();
-  ~HttpRewrite();
 
+  // |replace| refers to the capture groups of |pattern| as $1, $2, ...
   void AddRule(const std::string& pattern, const std::string& replace);
   void RecompilePattern();
   void Clear();
 
-  // Rewrite if matching a rule
+  // Whether every rule compiled. A rule that didn't is skipped by
+  // Rewrite().
+  bool IsValid() const;
+
+  // Rewrite if matching a rule. Counts a hit on the rule; an instance is
+  // meant to be used on a single thread.
   bool Rewrite(const std::string& origin_path,
                std::string* replaced_path) const;
 
-  static HttpRewrite* Create(const RewriteRules& rules);
+  size_t rule_count() const { return rules_.size(); }
+  const std::string& pattern(size_t index) const;
+  uint64_t hit_count(size_t index) const { return rules_[index]->hit_count; }
+
+  static scoped_refptr<HttpRewrite> Create(const RewriteRules& rules);
 
  private:
-  std::vector<const url_matcher::StringPattern*> pattern_list_;
-  std::vector<std::string> replace_format_;
+  friend class base::RefCounted<HttpRewrite>;
+
+  ~HttpRewrite();
+
+  // Piece of a replace format: a literal followed by a capture group, if
+  // |group| is not 0.
+  struct Segment {
+    std::string literal;
+    int group;
+  };
+
+  struct Rule {
+    Rule();
+    ~Rule();
+
+    std::unique_ptr<url_matcher::StringPattern> pattern;
+    std::string replace;
+
+    // Built by RecompilePattern. |re| is null if the pattern is invalid.
+    std::unique_ptr<re2::RE2> re;
+    std::vector<Segment> segments;
+    int max_group;
+
+    mutable uint64_t hit_count;
+  };
+
+  // Splits |replace| into segments. Returns the highest group referenced.
+  static int ParseReplace(const std::string& replace, int group_count,
+                          std::vector<Segment>* segments);
+
+  std::vector<std::unique_ptr<Rule>> rules_;
   url_matcher::RegexSetMatcher matcher_;
 
   DISALLOW_COPY_AND_ASSIGN(HttpRewrite);
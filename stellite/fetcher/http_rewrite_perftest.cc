@@ -0,0 +1,69 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/fetcher/http_rewrite.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/strings/string_number_conversions.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "testing/perf/perf_test.h"
+
+namespace net {
+
+namespace {
+
+const int kRuleCount = 500;
+const int kRewriteCount = 200000;
+
+void BuildRules(RewriteRules* rules, std::vector<std::string>* paths) {
+  for (int i = 0; i < kRuleCount; ++i) {
+    std::string service = "service" + base::IntToString(i);
+    rules->push_back(std::make_pair(
+        "^/" + service + "/v(\\d+)/(\\w+)/(\\d+)$",
+        "/backend/$2?service=" + service + "&version=$1&id=$3"));
+    paths->push_back("/" + service + "/v2/items/" + base::IntToString(i * 7));
+  }
+  // A miss for every ten hits.
+  for (int i = 0; i < kRuleCount / 10; ++i) {
+    paths->push_back("/unknown" + base::IntToString(i) + "/v1/items/1");
+  }
+}
+
+}  // namespace
+
+TEST(HttpRewritePerfTest, Rewrite) {
+  RewriteRules rules;
+  std::vector<std::string> paths;
+  BuildRules(&rules, &paths);
+  scoped_refptr<HttpRewrite> http_rewrite = HttpRewrite::Create(rules);
+
+  std::string replaced;
+  int rewritten = 0;
+  base::TimeTicks start = base::TimeTicks::Now();
+  for (int i = 0; i < kRewriteCount; ++i) {
+    rewritten += http_rewrite->Rewrite(paths[i % paths.size()], &replaced);
+  }
+  base::TimeDelta elapsed = base::TimeTicks::Now() - start;
+
+  perf_test::PrintResult("http_rewrite", "", base::IntToString(kRuleCount),
+                         kRewriteCount / elapsed.InSecondsF(),
+                         "rewrites/s", true);
+  EXPECT_GT(rewritten, 0);
+}
+
+}  // namespace net
@@ -0,0 +1,90 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/fetcher/http_rewrite.h"
+
+#include <memory>
+#include <string>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+
+TEST(HttpRewriteTest, NoMatch) {
+  scoped_refptr<HttpRewrite> http_rewrite(new HttpRewrite());
+  http_rewrite->AddRule("^/v1/(.*)$", "/api/$1");
+  http_rewrite->RecompilePattern();
+
+  std::string replaced = "untouched";
+  EXPECT_FALSE(http_rewrite->Rewrite("/v2/users", &replaced));
+  EXPECT_EQ("untouched", replaced);
+}
+
+TEST(HttpRewriteTest, CaptureGroups) {
+  RewriteRules rules;
+  rules.push_back(std::make_pair("^/user/(\\w+)/photo/(\\d+)$",
+                                 "/photo?user=$1&id=$2"));
+  rules.push_back(std::make_pair("^/static/(.*)$", "/$1"));
+  scoped_refptr<HttpRewrite> http_rewrite = HttpRewrite::Create(rules);
+  EXPECT_TRUE(http_rewrite->IsValid());
+
+  std::string replaced;
+  EXPECT_TRUE(http_rewrite->Rewrite("/user/brown/photo/42", &replaced));
+  EXPECT_EQ("/photo?user=brown&id=42", replaced);
+
+  EXPECT_TRUE(http_rewrite->Rewrite("/static/a/b.png", &replaced));
+  EXPECT_EQ("/a/b.png", replaced);
+  EXPECT_TRUE(http_rewrite->Rewrite("/static/c.png", &replaced));
+
+  EXPECT_EQ(1u, http_rewrite->hit_count(0));
+  EXPECT_EQ(2u, http_rewrite->hit_count(1));
+}
+
+TEST(HttpRewriteTest, FirstRuleWins) {
+  RewriteRules rules;
+  rules.push_back(std::make_pair("^/a/(.*)$", "/first/$1"));
+  rules.push_back(std::make_pair("^/(.*)$", "/second/$1"));
+  scoped_refptr<HttpRewrite> http_rewrite = HttpRewrite::Create(rules);
+
+  std::string replaced;
+  EXPECT_TRUE(http_rewrite->Rewrite("/a/b", &replaced));
+  EXPECT_EQ("/first/b", replaced);
+}
+
+TEST(HttpRewriteTest, ReplaceFormat) {
+  RewriteRules rules;
+  // Twelve groups: $12 is the last one, $13 and $0 are not groups.
+  rules.push_back(std::make_pair(
+      "^(a)(b)(c)(d)(e)(f)(g)(h)(i)(j)(k)(l)$", "$12-$1-$13-$0-$-$$1"));
+  scoped_refptr<HttpRewrite> http_rewrite = HttpRewrite::Create(rules);
+
+  std::string replaced;
+  EXPECT_TRUE(http_rewrite->Rewrite("abcdefghijkl", &replaced));
+  EXPECT_EQ("l-a-a3-$0-$-$a", replaced);
+}
+
+TEST(HttpRewriteTest, InvalidPattern) {
+  RewriteRules rules;
+  rules.push_back(std::make_pair("^/(broken$", "/$1"));
+  rules.push_back(std::make_pair("^/fine/(.*)$", "/$1"));
+  scoped_refptr<HttpRewrite> http_rewrite = HttpRewrite::Create(rules);
+  EXPECT_FALSE(http_rewrite->IsValid());
+
+  std::string replaced;
+  EXPECT_FALSE(http_rewrite->Rewrite("/(broken", &replaced));
+  EXPECT_TRUE(http_rewrite->Rewrite("/fine/a", &replaced));
+  EXPECT_EQ("/a", replaced);
+}
+
+}  // namespace net
@@ -0,0 +1,96 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/fetcher/io_buffer_chain.h"
+
+#include <utility>
+
+#include "base/logging.h"
+#include "base/memory/ptr_util.h"
+#include "net/base/elements_upload_data_stream.h"
+#include "net/base/io_buffer.h"
+#include "net/base/upload_bytes_element_reader.h"
+
+namespace stellite {
+
+namespace {
+
+// UploadBytesElementReader over an IOBuffer it keeps alive.
+class UploadIOBufferElementReader : public net::UploadBytesElementReader {
+ public:
+  UploadIOBufferElementReader(scoped_refptr<net::IOBuffer> buffer,
+                              size_t length)
+      : net::UploadBytesElementReader(buffer->data(), length),
+        buffer_(std::move(buffer)) {
+  }
+
+  ~UploadIOBufferElementReader() override {}
+
+ private:
+  scoped_refptr<net::IOBuffer> buffer_;
+
+  DISALLOW_COPY_AND_ASSIGN(UploadIOBufferElementReader);
+};
+
+}  // namespace
+
+IOBufferChain::Slice::Slice(scoped_refptr<net::IOBuffer> buffer,
+                            size_t length)
+    : buffer(std::move(buffer)),
+      length(length) {
+}
+
+IOBufferChain::Slice::Slice(const Slice& other) = default;
+
+IOBufferChain::Slice::~Slice() {}
+
+IOBufferChain::IOBufferChain()
+    : size_(0) {
+}
+
+IOBufferChain::~IOBufferChain() {}
+
+void IOBufferChain::Append(scoped_refptr<net::IOBuffer> buffer,
+                           size_t length) {
+  if (length == 0) {
+    return;
+  }
+
+  slices_.push_back(Slice(std::move(buffer), length));
+  size_ += length;
+}
+
+net::IOBuffer* IOBufferChain::buffer(size_t index) const {
+  DCHECK_LT(index, slices_.size());
+  return slices_[index].buffer.get();
+}
+
+size_t IOBufferChain::length(size_t index) const {
+  DCHECK_LT(index, slices_.size());
+  return slices_[index].length;
+}
+
+std::unique_ptr<net::UploadDataStream>
+IOBufferChain::CreateUploadDataStream() const {
+  std::vector<std::unique_ptr<net::UploadElementReader>> readers;
+  readers.reserve(slices_.size());
+  for (const Slice& slice : slices_) {
+    readers.push_back(base::MakeUnique<UploadIOBufferElementReader>(
+        slice.buffer, slice.length));
+  }
+  return base::MakeUnique<net::ElementsUploadDataStream>(std::move(readers),
+                                                         0);
+}
+
+}  // namespace stellite
@@ -0,0 +1,82 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_FETCHER_IO_BUFFER_CHAIN_H_
+#define STELLITE_FETCHER_IO_BUFFER_CHAIN_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/memory/ref_counted.h"
+#include "stellite/include/stellite_export.h"
+
+namespace net {
+class IOBuffer;
+class UploadDataStream;
+}
+
+namespace stellite {
+
+// A body kept as the refcounted buffers it arrived in: a proxied request
+// body on its way to the backend, or a batch of response chunks on its way
+// back. Appending takes a reference instead of copying the bytes. A chain
+// handed to another thread must not be appended to anymore.
+class STELLITE_EXPORT IOBufferChain
+    : public base::RefCountedThreadSafe<IOBufferChain> {
+ public:
+  IOBufferChain();
+
+  void Append(scoped_refptr<net::IOBuffer> buffer, size_t length);
+
+  // Total bytes of all buffers.
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  size_t buffer_count() const { return slices_.size(); }
+
+  // The buffers in the order they were appended. Only the first
+  // |length(index)| bytes of |buffer(index)| belong to the chain.
+  net::IOBuffer* buffer(size_t index) const;
+  size_t length(size_t index) const;
+
+  // Returns an upload stream reading the buffers in place. It holds a
+  // reference to each buffer, so it may outlive the chain.
+  std::unique_ptr<net::UploadDataStream> CreateUploadDataStream() const;
+
+ private:
+  friend class base::RefCountedThreadSafe<IOBufferChain>;
+
+  struct Slice {
+    Slice(scoped_refptr<net::IOBuffer> buffer, size_t length);
+    Slice(const Slice& other);
+    ~Slice();
+
+    scoped_refptr<net::IOBuffer> buffer;
+    size_t length;
+  };
+
+  ~IOBufferChain();
+
+  std::vector<Slice> slices_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(IOBufferChain);
+};
+
+}  // namespace stellite
+
+#endif  // STELLITE_FETCHER_IO_BUFFER_CHAIN_H_
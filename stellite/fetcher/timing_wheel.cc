@@ -0,0 +1,204 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/fetcher/timing_wheel.h"
+
+#include <utility>
+
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/time/tick_clock.h"
+
+namespace stellite {
+
+// static
+const int TimingWheel::kWheelCount;
+const int TimingWheel::kSlotBits;
+const int TimingWheel::kSlotCount;
+
+TimingWheel::Entry::Entry(const base::Closure& callback)
+    : callback_(callback),
+      slot_tick_(0),
+      wheel_(nullptr) {
+}
+
+TimingWheel::Entry::~Entry() {
+  if (wheel_) {
+    wheel_->Cancel(this);
+  }
+}
+
+TimingWheel::TimingWheel(base::TimeDelta tick,
+                         std::unique_ptr<base::TickClock> clock)
+    : tick_(tick),
+      clock_(std::move(clock)),
+      origin_(clock_->NowTicks()),
+      current_tick_(0),
+      size_(0) {
+  DCHECK_GT(tick_, base::TimeDelta());
+}
+
+TimingWheel::~TimingWheel() {
+  for (int wheel = 0; wheel < kWheelCount; ++wheel) {
+    for (int index = 0; index < kSlotCount; ++index) {
+      base::LinkedList<Entry>& slot = slots_[wheel][index];
+      while (!slot.empty()) {
+        Entry* entry = slot.head()->value();
+        entry->RemoveFromList();
+        entry->wheel_ = nullptr;
+      }
+    }
+  }
+}
+
+void TimingWheel::Schedule(Entry* entry, base::TimeDelta delay) {
+  DCHECK(!entry->wheel_ || entry->wheel_ == this);
+  base::TimeTicks now = clock_->NowTicks();
+
+  // Nothing moved the wheel while it was empty.
+  if (size_ == 0) {
+    current_tick_ = ToTick(now);
+  }
+
+  entry->deadline_ = now + delay;
+  if (entry->wheel_) {
+    // Pushed back: the entry is moved when its slot comes up.
+    if (DueTick(entry->deadline_) >= entry->slot_tick_) {
+      return;
+    }
+    entry->RemoveFromList();
+  } else {
+    entry->wheel_ = this;
+    ++size_;
+  }
+
+  Insert(entry);
+
+  if (!timer_.IsRunning()) {
+    timer_.Start(FROM_HERE, tick_, this, &TimingWheel::Tick);
+  }
+}
+
+void TimingWheel::Cancel(Entry* entry) {
+  if (!entry->wheel_) {
+    return;
+  }
+  DCHECK_EQ(entry->wheel_, this);
+
+  entry->RemoveFromList();
+  entry->wheel_ = nullptr;
+  --size_;
+
+  if (size_ == 0) {
+    timer_.Stop();
+  }
+}
+
+void TimingWheel::Tick() {
+  int64_t now_tick = ToTick(clock_->NowTicks());
+  while (current_tick_ < now_tick && size_ > 0) {
+    ++current_tick_;
+
+    int index = static_cast<int>(current_tick_ & (kSlotCount - 1));
+    if (index == 0) {
+      for (int wheel = 1; wheel < kWheelCount && Cascade(wheel) == 0;
+           ++wheel) {
+      }
+    }
+
+    base::LinkedList<Entry>& slot = slots_[0][index];
+    while (!slot.empty()) {
+      Entry* entry = slot.head()->value();
+      entry->RemoveFromList();
+
+      if (DueTick(entry->deadline_) > current_tick_) {
+        // Pushed back since it was slotted.
+        Insert(entry);
+        continue;
+      }
+
+      entry->wheel_ = nullptr;
+      --size_;
+      entry->callback_.Run();
+    }
+  }
+
+  if (size_ == 0) {
+    timer_.Stop();
+    current_tick_ = now_tick;
+  }
+}
+
+int64_t TimingWheel::ToTick(base::TimeTicks time) const {
+  if (time <= origin_) {
+    return 0;
+  }
+  return (time - origin_).InMicroseconds() / tick_.InMicroseconds();
+}
+
+int64_t TimingWheel::DueTick(base::TimeTicks deadline) const {
+  int64_t tick = ToTick(deadline);
+  if ((deadline - origin_).InMicroseconds() % tick_.InMicroseconds() > 0) {
+    ++tick;
+  }
+  return tick;
+}
+
+void TimingWheel::Insert(Entry* entry) {
+  const int64_t kMaxDelta = (INT64_C(1) << (kWheelCount * kSlotBits)) - 1;
+
+  int64_t due_tick = DueTick(entry->deadline_);
+  int64_t delta = due_tick - current_tick_;
+  if (delta < 1) {
+    delta = 1;
+  } else if (delta > kMaxDelta) {
+    // Parked in the top wheel and moved on from there.
+    delta = kMaxDelta;
+  }
+  due_tick = current_tick_ + delta;
+
+  int wheel = 0;
+  while (wheel < kWheelCount - 1 &&
+         delta >= (INT64_C(1) << ((wheel + 1) * kSlotBits))) {
+    ++wheel;
+  }
+
+  int index = static_cast<int>((due_tick >> (wheel * kSlotBits)) &
+                               (kSlotCount - 1));
+  entry->slot_tick_ = due_tick;
+  slots_[wheel][index].Append(entry);
+}
+
+int TimingWheel::Cascade(int wheel) {
+  int index = static_cast<int>((current_tick_ >> (wheel * kSlotBits)) &
+                               (kSlotCount - 1));
+
+  // Detach the slot first: an entry may land in it again.
+  base::LinkedList<Entry> pending;
+  base::LinkedList<Entry>& slot = slots_[wheel][index];
+  while (!slot.empty()) {
+    Entry* entry = slot.head()->value();
+    entry->RemoveFromList();
+    pending.Append(entry);
+  }
+
+  while (!pending.empty()) {
+    Entry* entry = pending.head()->value();
+    entry->RemoveFromList();
+    Insert(entry);
+  }
+  return index;
+}
+
+}  // namespace stellite
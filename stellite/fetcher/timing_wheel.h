@@ -0,0 +1,116 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_FETCHER_TIMING_WHEEL_H_
+#define STELLITE_FETCHER_TIMING_WHEEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+
+#include "base/callback.h"
+#include "base/containers/linked_list.h"
+#include "base/macros.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "stellite/include/stellite_export.h"
+
+namespace base {
+class TickClock;
+}
+
+namespace stellite {
+
+// Coarse timeouts for many entries that are pushed back far more often than
+// they fire, like the fetch timeout that is reset on every chunk received.
+//
+// Entries hang off the slots of four wheels of 64 slots each, every wheel
+// 64 times coarser than the one below; an entry moves down a wheel as its
+// deadline gets near. Scheduling an entry again only stores the new deadline
+// when it is later than the slot the entry waits in: the entry is moved when
+// that slot comes up. A single repeating timer runs the wheel while it holds
+// entries. Deadlines are rounded up to the tick.
+class STELLITE_EXPORT TimingWheel {
+ public:
+  class STELLITE_EXPORT Entry : public base::LinkNode<Entry> {
+   public:
+    // |callback| runs on expiry. It may destroy the entry.
+    explicit Entry(const base::Closure& callback);
+    ~Entry();
+
+    bool IsScheduled() const { return wheel_ != nullptr; }
+
+   private:
+    friend class TimingWheel;
+
+    base::Closure callback_;
+    base::TimeTicks deadline_;
+
+    // Tick of the slot the entry is in.
+    int64_t slot_tick_;
+
+    TimingWheel* wheel_;
+
+    DISALLOW_COPY_AND_ASSIGN(Entry);
+  };
+
+  TimingWheel(base::TimeDelta tick, std::unique_ptr<base::TickClock> clock);
+  ~TimingWheel();
+
+  // Runs the callback of |entry| once |delay| has passed, replacing the
+  // deadline it had.
+  void Schedule(Entry* entry, base::TimeDelta delay);
+  void Cancel(Entry* entry);
+
+  // Runs the callbacks of the entries whose deadline has passed. Called by
+  // the timer every tick.
+  void Tick();
+
+  size_t size() const { return size_; }
+
+ private:
+  static const int kWheelCount = 4;
+  static const int kSlotBits = 6;
+  static const int kSlotCount = 1 << kSlotBits;
+
+  // The tick |time| falls in, and the first tick at or after |deadline|.
+  int64_t ToTick(base::TimeTicks time) const;
+  int64_t DueTick(base::TimeTicks deadline) const;
+
+  // Links |entry| into the slot for |entry->deadline_|.
+  void Insert(Entry* entry);
+
+  // Moves the entries of the current slot of |wheel| down. Returns the index
+  // of that slot.
+  int Cascade(int wheel);
+
+  base::TimeDelta tick_;
+  std::unique_ptr<base::TickClock> clock_;
+  base::TimeTicks origin_;
+
+  // Last tick processed.
+  int64_t current_tick_;
+
+  base::LinkedList<Entry> slots_[kWheelCount][kSlotCount];
+  size_t size_;
+
+  base::RepeatingTimer timer_;
+
+  DISALLOW_COPY_AND_ASSIGN(TimingWheel);
+};
+
+}  // namespace stellite
+
+#endif  // STELLITE_FETCHER_TIMING_WHEEL_H_
@@ -0,0 +1,172 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/fetcher/timing_wheel.h"
+
+#include <stdint.h>
+
+#include <memory>
+
+#include "base/bind.h"
+#include "base/memory/ptr_util.h"
+#include "base/test/simple_test_tick_clock.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace stellite {
+
+namespace {
+
+void Increment(int* count) {
+  ++(*count);
+}
+
+void DestroyEntry(std::unique_ptr<TimingWheel::Entry>* entry) {
+  entry->reset();
+}
+
+}  // namespace
+
+class TimingWheelTest : public testing::Test {
+ public:
+  TimingWheelTest()
+      : clock_(new base::SimpleTestTickClock()),
+        wheel_(base::TimeDelta::FromMilliseconds(100),
+               base::WrapUnique(clock_)) {
+  }
+
+  // Moves the clock by |ms| one tick at a time, as the timer would.
+  void Advance(int64_t ms) {
+    for (int64_t i = 0; i < ms / 100; ++i) {
+      clock_->Advance(base::TimeDelta::FromMilliseconds(100));
+      wheel_.Tick();
+    }
+  }
+
+ protected:
+  base::SimpleTestTickClock* clock_;  // owned by |wheel_|
+  TimingWheel wheel_;
+};
+
+TEST_F(TimingWheelTest, Fire) {
+  int fired = 0;
+  TimingWheel::Entry entry(base::Bind(&Increment, &fired));
+
+  wheel_.Schedule(&entry, base::TimeDelta::FromMilliseconds(250));
+  EXPECT_TRUE(entry.IsScheduled());
+  EXPECT_EQ(1u, wheel_.size());
+
+  Advance(200);
+  EXPECT_EQ(0, fired);
+
+  // Deadlines are rounded up to the tick.
+  Advance(100);
+  EXPECT_EQ(1, fired);
+  EXPECT_FALSE(entry.IsScheduled());
+  EXPECT_EQ(0u, wheel_.size());
+}
+
+TEST_F(TimingWheelTest, PushBack) {
+  int fired = 0;
+  TimingWheel::Entry entry(base::Bind(&Increment, &fired));
+
+  wheel_.Schedule(&entry, base::TimeDelta::FromMilliseconds(500));
+  for (int i = 0; i < 20; ++i) {
+    Advance(300);
+    wheel_.Schedule(&entry, base::TimeDelta::FromMilliseconds(500));
+  }
+  EXPECT_EQ(0, fired);
+
+  Advance(400);
+  EXPECT_EQ(0, fired);
+  Advance(100);
+  EXPECT_EQ(1, fired);
+}
+
+TEST_F(TimingWheelTest, BringForward) {
+  int fired = 0;
+  TimingWheel::Entry entry(base::Bind(&Increment, &fired));
+
+  wheel_.Schedule(&entry, base::TimeDelta::FromSeconds(60));
+  wheel_.Schedule(&entry, base::TimeDelta::FromMilliseconds(200));
+  Advance(200);
+  EXPECT_EQ(1, fired);
+}
+
+TEST_F(TimingWheelTest, Cancel) {
+  int fired = 0;
+  TimingWheel::Entry entry(base::Bind(&Increment, &fired));
+
+  wheel_.Schedule(&entry, base::TimeDelta::FromMilliseconds(200));
+  wheel_.Cancel(&entry);
+  EXPECT_FALSE(entry.IsScheduled());
+  EXPECT_EQ(0u, wheel_.size());
+
+  Advance(1000);
+  EXPECT_EQ(0, fired);
+
+  // Cancelling twice is harmless.
+  wheel_.Cancel(&entry);
+}
+
+TEST_F(TimingWheelTest, CascadeAcrossWheels) {
+  int fired[3] = {0, 0, 0};
+  // One entry per upper wheel: 64 ticks, 64^2 ticks and beyond.
+  TimingWheel::Entry near(base::Bind(&Increment, &fired[0]));
+  TimingWheel::Entry mid(base::Bind(&Increment, &fired[1]));
+  TimingWheel::Entry far(base::Bind(&Increment, &fired[2]));
+
+  wheel_.Schedule(&near, base::TimeDelta::FromMilliseconds(100 * 100));
+  wheel_.Schedule(&mid, base::TimeDelta::FromMilliseconds(5000 * 100));
+  wheel_.Schedule(&far, base::TimeDelta::FromMilliseconds(300000 * 100));
+
+  Advance(99 * 100);
+  EXPECT_EQ(0, fired[0]);
+  Advance(100);
+  EXPECT_EQ(1, fired[0]);
+
+  Advance(4899 * 100);
+  EXPECT_EQ(0, fired[1]);
+  Advance(100);
+  EXPECT_EQ(1, fired[1]);
+
+  Advance(294999 * 100);
+  EXPECT_EQ(0, fired[2]);
+  Advance(100);
+  EXPECT_EQ(1, fired[2]);
+  EXPECT_EQ(0u, wheel_.size());
+}
+
+TEST_F(TimingWheelTest, DestroyScheduledEntry) {
+  int fired = 0;
+  {
+    TimingWheel::Entry entry(base::Bind(&Increment, &fired));
+    wheel_.Schedule(&entry, base::TimeDelta::FromMilliseconds(200));
+    EXPECT_EQ(1u, wheel_.size());
+  }
+  EXPECT_EQ(0u, wheel_.size());
+
+  Advance(1000);
+  EXPECT_EQ(0, fired);
+}
+
+TEST_F(TimingWheelTest, CallbackDestroysEntry) {
+  std::unique_ptr<TimingWheel::Entry> entry;
+  entry.reset(new TimingWheel::Entry(base::Bind(&DestroyEntry, &entry)));
+  wheel_.Schedule(entry.get(), base::TimeDelta::FromMilliseconds(100));
+
+  Advance(100);
+  EXPECT_FALSE(entry);
+}
+
+}  // namespace stellite
@@ -0,0 +1,213 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/fetcher/upload_body_pipe.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/memory/ptr_util.h"
+#include "base/memory/weak_ptr.h"
+#include "base/single_thread_task_runner.h"
+#include "base/threading/thread_task_runner_handle.h"
+#include "net/base/io_buffer.h"
+#include "net/base/net_errors.h"
+#include "net/base/upload_data_stream.h"
+
+namespace stellite {
+
+namespace {
+
+class PipeUploadDataStream : public net::UploadDataStream {
+ public:
+  explicit PipeUploadDataStream(scoped_refptr<UploadBodyPipe> pipe)
+      : net::UploadDataStream(false, 0),
+        pipe_(std::move(pipe)),
+        pending_buf_len_(0),
+        weak_factory_(this) {
+  }
+
+  ~PipeUploadDataStream() override {}
+
+ private:
+  // net::UploadDataStream implementation
+  int InitInternal(const net::NetLogWithSource& net_log) override {
+    if (pipe_->bytes_read() > 0) {
+      return net::ERR_UPLOAD_STREAM_REWIND_NOT_SUPPORTED;
+    }
+    SetSize(pipe_->length());
+    return net::OK;
+  }
+
+  int ReadInternal(net::IOBuffer* buf, int buf_len) override {
+    int result = pipe_->Read(
+        buf, buf_len,
+        base::Bind(&PipeUploadDataStream::OnReadReady,
+                   weak_factory_.GetWeakPtr()));
+    if (result == net::ERR_IO_PENDING) {
+      pending_buf_ = buf;
+      pending_buf_len_ = buf_len;
+    }
+    return result;
+  }
+
+  void ResetInternal() override {
+    weak_factory_.InvalidateWeakPtrs();
+    pending_buf_ = nullptr;
+    pending_buf_len_ = 0;
+  }
+
+  void OnReadReady() {
+    scoped_refptr<net::IOBuffer> buf = std::move(pending_buf_);
+    int result = ReadInternal(buf.get(), pending_buf_len_);
+    if (result != net::ERR_IO_PENDING) {
+      OnReadCompleted(result);
+    }
+  }
+
+  scoped_refptr<UploadBodyPipe> pipe_;
+
+  scoped_refptr<net::IOBuffer> pending_buf_;
+  int pending_buf_len_;
+
+  base::WeakPtrFactory<PipeUploadDataStream> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(PipeUploadDataStream);
+};
+
+}  // namespace
+
+UploadBodyPipe::Slice::Slice(scoped_refptr<net::IOBuffer> buffer,
+                             size_t length)
+    : buffer(std::move(buffer)),
+      length(length),
+      offset(0) {
+}
+
+UploadBodyPipe::Slice::Slice(const Slice& other) = default;
+
+UploadBodyPipe::Slice::~Slice() {}
+
+UploadBodyPipe::UploadBodyPipe(uint64_t length,
+                               size_t capacity,
+                               const base::Closure& drain_callback)
+    : length_(length),
+      capacity_(capacity),
+      drain_callback_(drain_callback),
+      producer_task_runner_(base::ThreadTaskRunnerHandle::Get()),
+      buffered_bytes_(0),
+      bytes_read_(0),
+      producer_paused_(false),
+      aborted_(false) {
+  DCHECK_GT(capacity_, 0u);
+}
+
+UploadBodyPipe::~UploadBodyPipe() {}
+
+bool UploadBodyPipe::Write(scoped_refptr<net::IOBuffer> buffer, size_t len) {
+  DCHECK(producer_task_runner_->BelongsToCurrentThread());
+  base::AutoLock lock(lock_);
+  if (aborted_ || len == 0) {
+    return true;
+  }
+
+  slices_.push_back(Slice(std::move(buffer), len));
+  buffered_bytes_ += len;
+  NotifyReader();
+
+  if (buffered_bytes_ < capacity_) {
+    return true;
+  }
+
+  producer_paused_ = true;
+  return false;
+}
+
+void UploadBodyPipe::Abort() {
+  DCHECK(producer_task_runner_->BelongsToCurrentThread());
+  base::AutoLock lock(lock_);
+  if (aborted_ || bytes_read_ == length_) {
+    return;
+  }
+
+  aborted_ = true;
+  slices_.clear();
+  buffered_bytes_ = 0;
+  NotifyReader();
+}
+
+std::unique_ptr<net::UploadDataStream>
+UploadBodyPipe::CreateUploadDataStream() {
+  return base::MakeUnique<PipeUploadDataStream>(this);
+}
+
+int UploadBodyPipe::Read(net::IOBuffer* buf, int buf_len,
+                         const base::Closure& ready_callback) {
+  base::AutoLock lock(lock_);
+  if (aborted_) {
+    return net::ERR_ABORTED;
+  }
+
+  if (slices_.empty()) {
+    ready_callback_ = ready_callback;
+    reader_task_runner_ = base::ThreadTaskRunnerHandle::Get();
+    return net::ERR_IO_PENDING;
+  }
+
+  size_t copied = 0;
+  size_t capacity = static_cast<size_t>(buf_len);
+  while (copied < capacity && !slices_.empty()) {
+    Slice& slice = slices_.front();
+    size_t n = std::min(capacity - copied, slice.length - slice.offset);
+    memcpy(buf->data() + copied, slice.buffer->data() + slice.offset, n);
+    copied += n;
+    slice.offset += n;
+    if (slice.offset == slice.length) {
+      slices_.pop_front();
+    }
+  }
+
+  buffered_bytes_ -= copied;
+  bytes_read_ += copied;
+
+  if (producer_paused_ && buffered_bytes_ <= capacity_ / 2) {
+    producer_paused_ = false;
+    producer_task_runner_->PostTask(FROM_HERE, drain_callback_);
+  }
+
+  return static_cast<int>(copied);
+}
+
+uint64_t UploadBodyPipe::bytes_read() const {
+  base::AutoLock lock(lock_);
+  return bytes_read_;
+}
+
+void UploadBodyPipe::NotifyReader() {
+  lock_.AssertAcquired();
+  if (ready_callback_.is_null()) {
+    return;
+  }
+
+  reader_task_runner_->PostTask(FROM_HERE, ready_callback_);
+  ready_callback_.Reset();
+  reader_task_runner_ = nullptr;
+}
+
+}  // namespace stellite
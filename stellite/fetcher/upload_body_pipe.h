@@ -0,0 +1,118 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_FETCHER_UPLOAD_BODY_PIPE_H_
+#define STELLITE_FETCHER_UPLOAD_BODY_PIPE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <deque>
+#include <memory>
+
+#include "base/callback.h"
+#include "base/macros.h"
+#include "base/memory/ref_counted.h"
+#include "base/synchronization/lock.h"
+#include "stellite/include/stellite_export.h"
+
+namespace base {
+class SingleThreadTaskRunner;
+}
+
+namespace net {
+class IOBuffer;
+class UploadDataStream;
+}
+
+namespace stellite {
+
+// Streams a request body of a known length to the backend while it is still
+// arriving. The producer writes on its own thread and the upload stream
+// reads on the network thread. At most about |capacity| bytes wait in
+// between: past that Write() asks the producer to stop, and
+// |drain_callback| tells it to go on once half of them were read.
+class STELLITE_EXPORT UploadBodyPipe
+    : public base::RefCountedThreadSafe<UploadBodyPipe> {
+ public:
+  // |drain_callback| runs on the thread creating the pipe.
+  UploadBodyPipe(uint64_t length,
+                 size_t capacity,
+                 const base::Closure& drain_callback);
+
+  // Queues |len| bytes of |buffer|. Returns false when the pipe is full; the
+  // bytes are queued anyway, but the producer should hold further writes
+  // until |drain_callback| runs.
+  bool Write(scoped_refptr<net::IOBuffer> buffer, size_t len);
+
+  // Fails the upload, e.g. when the client went away before sending the
+  // whole body. Does nothing once the body was read in full.
+  void Abort();
+
+  // Returns the upload stream of the backend request. The body can only be
+  // read once, so the stream fails to rewind after the first byte.
+  std::unique_ptr<net::UploadDataStream> CreateUploadDataStream();
+
+  // Network thread side of the upload stream. Copies up to |buf_len| queued
+  // bytes into |buf|. Returns net::ERR_IO_PENDING when nothing is queued, in
+  // which case |ready_callback| is posted to the calling thread once more
+  // bytes arrive and the read should be retried.
+  int Read(net::IOBuffer* buf, int buf_len,
+           const base::Closure& ready_callback);
+
+  uint64_t length() const { return length_; }
+  uint64_t bytes_read() const;
+
+ private:
+  friend class base::RefCountedThreadSafe<UploadBodyPipe>;
+
+  struct Slice {
+    Slice(scoped_refptr<net::IOBuffer> buffer, size_t length);
+    Slice(const Slice& other);
+    ~Slice();
+
+    scoped_refptr<net::IOBuffer> buffer;
+    size_t length;
+    size_t offset;
+  };
+
+  ~UploadBodyPipe();
+
+  // Posts |ready_callback_|, if a read is waiting. Called with |lock_| held.
+  void NotifyReader();
+
+  const uint64_t length_;
+  const size_t capacity_;
+
+  const base::Closure drain_callback_;
+  const scoped_refptr<base::SingleThreadTaskRunner> producer_task_runner_;
+
+  mutable base::Lock lock_;
+
+  // Everything below is guarded by |lock_|.
+  std::deque<Slice> slices_;
+  size_t buffered_bytes_;
+  uint64_t bytes_read_;
+  bool producer_paused_;
+  bool aborted_;
+
+  base::Closure ready_callback_;
+  scoped_refptr<base::SingleThreadTaskRunner> reader_task_runner_;
+
+  DISALLOW_COPY_AND_ASSIGN(UploadBodyPipe);
+};
+
+}  // namespace stellite
+
+#endif  // STELLITE_FETCHER_UPLOAD_BODY_PIPE_H_
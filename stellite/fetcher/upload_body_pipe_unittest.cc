@@ -0,0 +1,301 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/fetcher/upload_body_pipe.h"
+
+#include <string.h>
+
+#include <memory>
+#include <string>
+
+#include "base/bind.h"
+#include "base/callback.h"
+#include "base/location.h"
+#include "base/run_loop.h"
+#include "base/single_thread_task_runner.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/thread.h"
+#include "net/base/io_buffer.h"
+#include "net/base/net_errors.h"
+#include "net/base/upload_data_stream.h"
+#include "net/log/net_log_with_source.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace stellite {
+
+namespace {
+
+const size_t kCapacity = 16;
+
+scoped_refptr<net::IOBuffer> MakeBuffer(const std::string& data) {
+  scoped_refptr<net::IOBuffer> buffer(new net::IOBuffer(data.size()));
+  memcpy(buffer->data(), data.data(), data.size());
+  return buffer;
+}
+
+void SaveResult(int* out, int result) {
+  *out = result;
+}
+
+void Increment(int* count) {
+  ++*count;
+}
+
+// The pipe stream initializes synchronously.
+void IgnoreResult(int result) {}
+
+// Reads a whole pipe through its upload stream on the thread it runs on.
+class PipeReader {
+ public:
+  PipeReader(scoped_refptr<UploadBodyPipe> pipe, base::WaitableEvent* done)
+      : pipe_(pipe),
+        buffer_(new net::IOBuffer(kReadSize)),
+        result_(net::OK),
+        done_(done) {
+  }
+
+  void Start() {
+    stream_ = pipe_->CreateUploadDataStream();
+    int rv = stream_->Init(base::Bind(&IgnoreResult),
+                           net::NetLogWithSource());
+    if (rv != net::OK) {
+      Finish(rv);
+      return;
+    }
+    ReadMore();
+  }
+
+  // The stream must go away on the thread that used it.
+  void Stop() {
+    stream_.reset();
+  }
+
+  const std::string& body() const { return body_; }
+  int result() const { return result_; }
+
+ private:
+  static const int kReadSize = 7;
+
+  void ReadMore() {
+    while (!stream_->IsEOF()) {
+      int rv = stream_->Read(buffer_.get(), kReadSize,
+                             base::Bind(&PipeReader::OnRead,
+                                        base::Unretained(this)));
+      if (rv == net::ERR_IO_PENDING) {
+        return;
+      }
+      if (!Consume(rv)) {
+        return;
+      }
+    }
+    Finish(net::OK);
+  }
+
+  void OnRead(int rv) {
+    if (Consume(rv)) {
+      ReadMore();
+    }
+  }
+
+  bool Consume(int rv) {
+    if (rv < 0) {
+      Finish(rv);
+      return false;
+    }
+    body_.append(buffer_->data(), rv);
+    return true;
+  }
+
+  void Finish(int result) {
+    result_ = result;
+    done_->Signal();
+  }
+
+  scoped_refptr<UploadBodyPipe> pipe_;
+  std::unique_ptr<net::UploadDataStream> stream_;
+  scoped_refptr<net::IOBuffer> buffer_;
+  std::string body_;
+  int result_;
+  base::WaitableEvent* done_;
+};
+
+}  // namespace
+
+class UploadBodyPipeTest : public testing::Test {
+ protected:
+  UploadBodyPipeTest() : drain_count_(0) {}
+
+  scoped_refptr<UploadBodyPipe> CreatePipe(uint64_t length) {
+    return new UploadBodyPipe(
+        length, kCapacity,
+        base::Bind(&UploadBodyPipeTest::OnDrain, base::Unretained(this)));
+  }
+
+  void OnDrain() {
+    ++drain_count_;
+    if (!quit_closure_.is_null()) {
+      quit_closure_.Run();
+    }
+  }
+
+  // Reads up to |length| bytes of |pipe| right away.
+  static std::string Read(UploadBodyPipe* pipe, int length) {
+    scoped_refptr<net::IOBuffer> buffer(new net::IOBuffer(length));
+    int rv = pipe->Read(buffer.get(), length, base::Closure());
+    return rv > 0 ? std::string(buffer->data(), rv) : std::string();
+  }
+
+  int drain_count_;
+  base::Closure quit_closure_;
+};
+
+TEST_F(UploadBodyPipeTest, WriteStopsAtCapacityAndDrainsAtHalf) {
+  scoped_refptr<UploadBodyPipe> pipe = CreatePipe(100);
+
+  EXPECT_TRUE(pipe->Write(MakeBuffer("01234567"), 8));
+  EXPECT_TRUE(pipe->Write(MakeBuffer("89abcde"), 7));
+
+  // the bytes of the refused write are queued all the same
+  EXPECT_FALSE(pipe->Write(MakeBuffer("fghi"), 4));
+
+  // 19 -> 11 buffered, still more than half the capacity
+  EXPECT_EQ("01234567", Read(pipe.get(), 8));
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(0, drain_count_);
+
+  // 11 -> 8 buffered, half the capacity
+  EXPECT_EQ("89a", Read(pipe.get(), 3));
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(1, drain_count_);
+
+  EXPECT_EQ("bcdefghi", Read(pipe.get(), 100));
+  EXPECT_EQ(19u, pipe->bytes_read());
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(1, drain_count_);
+}
+
+TEST_F(UploadBodyPipeTest, ReadWaitsForWrite) {
+  scoped_refptr<UploadBodyPipe> pipe = CreatePipe(4);
+
+  int ready_count = 0;
+  scoped_refptr<net::IOBuffer> buffer(new net::IOBuffer(4));
+  EXPECT_EQ(net::ERR_IO_PENDING,
+            pipe->Read(buffer.get(), 4, base::Bind(&Increment,
+                                                   &ready_count)));
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(0, ready_count);
+
+  EXPECT_TRUE(pipe->Write(MakeBuffer("body"), 4));
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(1, ready_count);
+  EXPECT_EQ("body", Read(pipe.get(), 4));
+}
+
+TEST_F(UploadBodyPipeTest, AbortFailsPendingRead) {
+  scoped_refptr<UploadBodyPipe> pipe = CreatePipe(8);
+  std::unique_ptr<net::UploadDataStream> stream =
+      pipe->CreateUploadDataStream();
+  ASSERT_EQ(net::OK, stream->Init(base::Bind(&IgnoreResult),
+                                  net::NetLogWithSource()));
+  EXPECT_EQ(8u, stream->size());
+
+  int result = net::OK;
+  scoped_refptr<net::IOBuffer> buffer(new net::IOBuffer(8));
+  EXPECT_EQ(net::ERR_IO_PENDING,
+            stream->Read(buffer.get(), 8, base::Bind(&SaveResult, &result)));
+
+  pipe->Abort();
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(net::ERR_ABORTED, result);
+
+  // later writes are dropped
+  EXPECT_TRUE(pipe->Write(MakeBuffer("body"), 4));
+  EXPECT_EQ(net::ERR_ABORTED, pipe->Read(buffer.get(), 8, base::Closure()));
+}
+
+TEST_F(UploadBodyPipeTest, AbortAfterFullReadIsIgnored) {
+  scoped_refptr<UploadBodyPipe> pipe = CreatePipe(4);
+  EXPECT_TRUE(pipe->Write(MakeBuffer("body"), 4));
+  EXPECT_EQ("body", Read(pipe.get(), 4));
+
+  pipe->Abort();
+  scoped_refptr<net::IOBuffer> buffer(new net::IOBuffer(4));
+  EXPECT_EQ(net::ERR_IO_PENDING,
+            pipe->Read(buffer.get(), 4, base::Closure()));
+}
+
+TEST_F(UploadBodyPipeTest, RewindFailsAfterFirstByte) {
+  scoped_refptr<UploadBodyPipe> pipe = CreatePipe(8);
+  std::unique_ptr<net::UploadDataStream> stream =
+      pipe->CreateUploadDataStream();
+
+  // nothing was read yet, so a retry may start over
+  ASSERT_EQ(net::OK, stream->Init(base::Bind(&IgnoreResult),
+                                  net::NetLogWithSource()));
+  ASSERT_EQ(net::OK, stream->Init(base::Bind(&IgnoreResult),
+                                  net::NetLogWithSource()));
+
+  EXPECT_TRUE(pipe->Write(MakeBuffer("body"), 4));
+  scoped_refptr<net::IOBuffer> buffer(new net::IOBuffer(8));
+  int result = net::OK;
+  EXPECT_EQ(4, stream->Read(buffer.get(), 8,
+                            base::Bind(&SaveResult, &result)));
+
+  EXPECT_EQ(net::ERR_UPLOAD_STREAM_REWIND_NOT_SUPPORTED,
+            stream->Init(base::Bind(&IgnoreResult), net::NetLogWithSource()));
+}
+
+// The producer writes on the test thread and waits for the drain callback
+// whenever the pipe is full, while the upload stream reads on another thread.
+TEST_F(UploadBodyPipeTest, StreamsAcrossThreads) {
+  std::string body;
+  for (int i = 0; i < 4096; ++i) {
+    body.push_back(static_cast<char>('a' + i % 26));
+  }
+  scoped_refptr<UploadBodyPipe> pipe = CreatePipe(body.size());
+
+  base::Thread reader_thread("upload reader");
+  ASSERT_TRUE(reader_thread.Start());
+  base::WaitableEvent done(base::WaitableEvent::ResetPolicy::MANUAL,
+                           base::WaitableEvent::InitialState::NOT_SIGNALED);
+  PipeReader reader(pipe, &done);
+  reader_thread.task_runner()->PostTask(
+      FROM_HERE, base::Bind(&PipeReader::Start, base::Unretained(&reader)));
+
+  const size_t kChunkSize = 5;
+  int pauses = 0;
+  for (size_t offset = 0; offset < body.size(); offset += kChunkSize) {
+    std::string chunk = body.substr(offset, kChunkSize);
+    if (pipe->Write(MakeBuffer(chunk), chunk.size())) {
+      continue;
+    }
+
+    ++pauses;
+    base::RunLoop run_loop;
+    quit_closure_ = run_loop.QuitClosure();
+    run_loop.Run();
+    quit_closure_.Reset();
+  }
+
+  done.Wait();
+  reader_thread.task_runner()->PostTask(
+      FROM_HERE, base::Bind(&PipeReader::Stop, base::Unretained(&reader)));
+  reader_thread.Stop();
+
+  EXPECT_EQ(net::OK, reader.result());
+  EXPECT_EQ(body, reader.body());
+  EXPECT_EQ(pauses, drain_count_);
+}
+
+}  // namespace stellite
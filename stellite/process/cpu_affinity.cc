@@ -0,0 +1,195 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/process/cpu_affinity.h"
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "build/build_config.h"
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace net {
+
+namespace {
+
+const char* kNumaPolicyNone = "none";
+const char* kNumaPolicyLocal = "local";
+const char* kNumaPolicyInterleave = "interleave";
+
+// CPUs a list may name, as many as a Linux cpu_set_t holds.
+const int kMaxCpuCount = 1024;
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+const char* kOnlineNodesPath = "/sys/devices/system/node/online";
+
+// set_mempolicy(2) modes, defined here to avoid depending on libnuma.
+const int kMpolPreferred = 1;
+const int kMpolInterleave = 3;
+
+// Number of nodes covered by the node mask passed to set_mempolicy(2).
+const int kMaxNumaNodes = 64;
+#endif
+
+}  // namespace
+
+bool ParseCpuList(const std::string& cpu_list, std::vector<int>* cpus) {
+  DCHECK(cpus);
+  cpus->clear();
+
+  std::vector<std::string> ranges = base::SplitString(
+      cpu_list, ",", base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+  for (const std::string& range : ranges) {
+    std::vector<std::string> bounds = base::SplitString(
+        range, "-", base::TRIM_WHITESPACE, base::SPLIT_WANT_ALL);
+    int first = 0;
+    int last = 0;
+    if (bounds.size() == 1) {
+      if (!base::StringToInt(bounds[0], &first)) {
+        return false;
+      }
+      last = first;
+    } else if (bounds.size() == 2) {
+      if (!base::StringToInt(bounds[0], &first) ||
+          !base::StringToInt(bounds[1], &last)) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+
+    if (first < 0 || last < first || last >= kMaxCpuCount) {
+      return false;
+    }
+
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus->push_back(cpu);
+    }
+  }
+
+  return !cpus->empty();
+}
+
+bool ParseNumaPolicy(const std::string& name, NumaPolicy* policy) {
+  DCHECK(policy);
+  if (name == kNumaPolicyNone) {
+    *policy = NUMA_POLICY_NONE;
+  } else if (name == kNumaPolicyLocal) {
+    *policy = NUMA_POLICY_LOCAL;
+  } else if (name == kNumaPolicyInterleave) {
+    *policy = NUMA_POLICY_INTERLEAVE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+
+bool SetCurrentThreadAffinity(int cpu) {
+  if (cpu < 0 || cpu >= CPU_SETSIZE) {
+    return false;
+  }
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0) {
+    PLOG(ERROR) << "sched_setaffinity() failed";
+    return false;
+  }
+  return true;
+}
+
+bool GetCurrentThreadPinnedCpu(int* cpu) {
+  DCHECK(cpu);
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) != 0 ||
+      CPU_COUNT(&cpu_set) != 1) {
+    return false;
+  }
+
+  for (int i = 0; i < CPU_SETSIZE; ++i) {
+    if (CPU_ISSET(i, &cpu_set)) {
+      *cpu = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SetCurrentThreadNumaPolicy(NumaPolicy policy) {
+  unsigned long node_mask = 0;
+  int mode = 0;
+  switch (policy) {
+    case NUMA_POLICY_NONE:
+      return true;
+
+    case NUMA_POLICY_LOCAL:
+      // MPOL_PREFERRED with an empty mask means "the local node".
+      mode = kMpolPreferred;
+      break;
+
+    case NUMA_POLICY_INTERLEAVE: {
+      std::string online;
+      std::vector<int> nodes;
+      if (!base::ReadFileToString(base::FilePath(kOnlineNodesPath), &online) ||
+          !ParseCpuList(online, &nodes)) {
+        LOG(ERROR) << "Failed to read online NUMA nodes";
+        return false;
+      }
+
+      for (int node : nodes) {
+        if (node < kMaxNumaNodes) {
+          node_mask |= 1UL << node;
+        }
+      }
+      mode = kMpolInterleave;
+      break;
+    }
+  }
+
+  if (syscall(SYS_set_mempolicy, mode, node_mask ? &node_mask : nullptr,
+              node_mask ? kMaxNumaNodes + 1 : 0) != 0) {
+    PLOG(ERROR) << "set_mempolicy() failed";
+    return false;
+  }
+  return true;
+}
+
+#else
+
+bool SetCurrentThreadAffinity(int cpu) {
+  return false;
+}
+
+bool GetCurrentThreadPinnedCpu(int* cpu) {
+  return false;
+}
+
+bool SetCurrentThreadNumaPolicy(NumaPolicy policy) {
+  return policy == NUMA_POLICY_NONE;
+}
+
+#endif
+
+}  // namespace net
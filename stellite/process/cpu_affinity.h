@@ -0,0 +1,58 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_PROCESS_CPU_AFFINITY_H_
+#define STELLITE_PROCESS_CPU_AFFINITY_H_
+
+#include <string>
+#include <vector>
+
+#include "net/base/net_export.h"
+
+namespace net {
+
+// Memory placement applied to the threads of a worker.
+enum NumaPolicy {
+  // Keep the kernel default.
+  NUMA_POLICY_NONE,
+
+  // Allocate on the node of the CPU the thread is running on.
+  NUMA_POLICY_LOCAL,
+
+  // Spread allocations over every online node.
+  NUMA_POLICY_INTERLEAVE,
+};
+
+// Parses a CPU list in the format of the Linux cpuset files, such as
+// "0-3,8,10-11", into |cpus| in the given order. Returns false if |cpu_list|
+// is malformed, empty or names a CPU past 1023.
+NET_EXPORT bool ParseCpuList(const std::string& cpu_list,
+                             std::vector<int>* cpus);
+
+// Parses "none", "local" or "interleave".
+NET_EXPORT bool ParseNumaPolicy(const std::string& name, NumaPolicy* policy);
+
+// Restricts the calling thread to |cpu|.
+NET_EXPORT bool SetCurrentThreadAffinity(int cpu);
+
+// Returns the only CPU the calling thread may run on in |cpu|, or false if
+// the thread isn't pinned to a single CPU.
+NET_EXPORT bool GetCurrentThreadPinnedCpu(int* cpu);
+
+// Applies |policy| to the memory allocated by the calling thread from now on.
+NET_EXPORT bool SetCurrentThreadNumaPolicy(NumaPolicy policy);
+
+}  // namespace net
+
+#endif  // STELLITE_PROCESS_CPU_AFFINITY_H_
@@ -0,0 +1,90 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/process/cpu_affinity.h"
+
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+
+namespace {
+
+struct CpuListCase {
+  const char* cpu_list;
+  bool valid;
+  std::vector<int> cpus;
+};
+
+}  // namespace
+
+TEST(CpuAffinityTest, ParseCpuList) {
+  const CpuListCase kCases[] = {
+    { "0", true, { 0 } },
+    { "3", true, { 3 } },
+    { "0-3", true, { 0, 1, 2, 3 } },
+    { "0-3,8,10-11", true, { 0, 1, 2, 3, 8, 10, 11 } },
+    { "8,0-1", true, { 8, 0, 1 } },
+    { " 1 , 2 - 3 ", true, { 1, 2, 3 } },
+    { "2-2", true, { 2 } },
+    { "0,,1", true, { 0, 1 } },
+    { "1023", true, { 1023 } },
+    { "", false, {} },
+    { ",", false, {} },
+    { "a", false, {} },
+    { "1a", false, {} },
+    { "3-1", false, {} },
+    { "-1", false, {} },
+    { "1-", false, {} },
+    { "-", false, {} },
+    { "1-2-3", false, {} },
+    { "0,a", false, {} },
+    { "1024", false, {} },
+    { "1000-1024", false, {} },
+    { "0-2147483647", false, {} },
+    { "99999999999", false, {} },
+  };
+
+  for (size_t i = 0; i < arraysize(kCases); ++i) {
+    SCOPED_TRACE(kCases[i].cpu_list);
+    std::vector<int> cpus;
+    EXPECT_EQ(kCases[i].valid, ParseCpuList(kCases[i].cpu_list, &cpus));
+    if (kCases[i].valid) {
+      EXPECT_EQ(kCases[i].cpus, cpus);
+    }
+  }
+}
+
+TEST(CpuAffinityTest, ParseNumaPolicy) {
+  NumaPolicy policy = NUMA_POLICY_NONE;
+  EXPECT_TRUE(ParseNumaPolicy("local", &policy));
+  EXPECT_EQ(NUMA_POLICY_LOCAL, policy);
+  EXPECT_TRUE(ParseNumaPolicy("interleave", &policy));
+  EXPECT_EQ(NUMA_POLICY_INTERLEAVE, policy);
+  EXPECT_TRUE(ParseNumaPolicy("none", &policy));
+  EXPECT_EQ(NUMA_POLICY_NONE, policy);
+
+  const char* kInvalid[] = { "", "Local", "interleaved", " none", "1" };
+  for (size_t i = 0; i < arraysize(kInvalid); ++i) {
+    SCOPED_TRACE(kInvalid[i]);
+    policy = NUMA_POLICY_LOCAL;
+    EXPECT_FALSE(ParseNumaPolicy(kInvalid[i], &policy));
+    EXPECT_EQ(NUMA_POLICY_LOCAL, policy);
+  }
+}
+
+}  // namespace net
@@ -0,0 +1,112 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/process/signal_watcher.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/posix/eintr_wrapper.h"
+
+namespace net {
+
+namespace {
+
+// Write end of the pipe of the running watcher, for the signal handler.
+int g_signal_write_fd = -1;
+
+}  // namespace
+
+SignalWatcher::SignalWatcher()
+    : signo_(0),
+      read_watcher_(FROM_HERE) {
+}
+
+SignalWatcher::~SignalWatcher() {
+  if (signo_ == 0) {
+    return;
+  }
+
+  signal(signo_, SIG_DFL);
+  g_signal_write_fd = -1;
+}
+
+bool SignalWatcher::Start(int signo, const base::Closure& callback) {
+  DCHECK_EQ(signo_, 0);
+  DCHECK_EQ(g_signal_write_fd, -1) << "one signal watcher per process";
+
+  int fds[2];
+  if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+    PLOG(ERROR) << "Failed to create the signal pipe";
+    return false;
+  }
+  read_fd_.reset(fds[0]);
+  write_fd_.reset(fds[1]);
+
+  if (!base::MessageLoopForIO::current()->WatchFileDescriptor(
+          read_fd_.get(), true, base::MessageLoopForIO::WATCH_READ,
+          &read_watcher_, this)) {
+    LOG(ERROR) << "Failed to watch the signal pipe";
+    return false;
+  }
+
+  g_signal_write_fd = write_fd_.get();
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = &SignalWatcher::OnSignal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(signo, &action, nullptr) != 0) {
+    PLOG(ERROR) << "Failed to install the handler of signal " << signo;
+    g_signal_write_fd = -1;
+    read_watcher_.StopWatchingFileDescriptor();
+    return false;
+  }
+
+  signo_ = signo;
+  callback_ = callback;
+  return true;
+}
+
+void SignalWatcher::OnFileCanReadWithoutBlocking(int fd) {
+  char buffer[64];
+  while (HANDLE_EINTR(read(fd, buffer, sizeof(buffer))) > 0) {
+  }
+
+  callback_.Run();
+}
+
+void SignalWatcher::OnFileCanWriteWithoutBlocking(int fd) {
+  NOTREACHED();
+}
+
+// static
+void SignalWatcher::OnSignal(int signo) {
+  // Only async-signal-safe calls from here on. A full pipe already has a
+  // wakeup pending, so a failed write is fine.
+  int saved_errno = errno;
+  char byte = 0;
+  if (g_signal_write_fd >= 0) {
+    ignore_result(write(g_signal_write_fd, &byte, 1));
+  }
+  errno = saved_errno;
+}
+
+}  // namespace net
@@ -0,0 +1,58 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_PROCESS_SIGNAL_WATCHER_H_
+#define STELLITE_PROCESS_SIGNAL_WATCHER_H_
+
+#include "base/callback.h"
+#include "base/files/scoped_file.h"
+#include "base/macros.h"
+#include "base/message_loop/message_loop.h"
+#include "net/base/net_export.h"
+
+namespace net {
+
+// Turns a signal into a task on the IO message loop of the thread that
+// started watching. The handler only writes a byte into a pipe the loop
+// watches, so the callback may do anything. Signals that arrive before the
+// loop gets to the pipe are coalesced into one callback.
+//
+// One watcher per process.
+class NET_EXPORT SignalWatcher : public base::MessageLoopForIO::Watcher {
+ public:
+  SignalWatcher();
+  ~SignalWatcher() override;
+
+  bool Start(int signo, const base::Closure& callback);
+
+  // Implements base::MessageLoopForIO::Watcher
+  void OnFileCanReadWithoutBlocking(int fd) override;
+  void OnFileCanWriteWithoutBlocking(int fd) override;
+
+ private:
+  static void OnSignal(int signo);
+
+  int signo_;
+  base::Closure callback_;
+
+  base::ScopedFD read_fd_;
+  base::ScopedFD write_fd_;
+  base::MessageLoopForIO::FileDescriptorWatcher read_watcher_;
+
+  DISALLOW_COPY_AND_ASSIGN(SignalWatcher);
+};
+
+}  // namespace net
+
+#endif  // STELLITE_PROCESS_SIGNAL_WATCHER_H_
@@ -0,0 +1,557 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/http_response_cache.h"
+
+#include <sys/mman.h>
+
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/bind.h"
+#include "base/containers/mru_cache.h"
+#include "base/files/file.h"
+#include "base/files/file_util.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/single_thread_task_runner.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
+#include "base/synchronization/lock.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/thread.h"
+#include "net/http/http_request_headers.h"
+#include "net/http/http_request_info.h"
+#include "net/http/http_response_headers.h"
+
+namespace net {
+
+namespace {
+
+const size_t kShardCount = 16;
+
+// A shard holds at least this many of its largest responses.
+const size_t kEntriesPerShard = 4;
+
+// Smaller bodies stay on the heap even with a body directory.
+const size_t kMinMappedBodySize = 16 * 1024;
+
+// Bodies past this many stay on the heap, short of the mappings a process
+// may have.
+const base::subtle::Atomic32 kMaxMappedBodies = 16 * 1024;
+
+// Mapped bodies of every cache. Raised only on the body threads.
+base::subtle::Atomic32 g_mapped_body_count = 0;
+
+HttpRequestInfo MakeRequestInfo(const HttpRequestHeaders& request_headers) {
+  HttpRequestInfo request_info;
+  request_info.method = "GET";
+  request_info.extra_headers = request_headers;
+  return request_info;
+}
+
+bool HasCacheDirective(const HttpRequestHeaders& request_headers,
+                       base::StringPiece directive) {
+  std::string cache_control;
+  if (!request_headers.GetHeader(HttpRequestHeaders::kCacheControl,
+                                 &cache_control)) {
+    return false;
+  }
+
+  for (base::StringPiece token :
+       base::SplitStringPiece(cache_control, ",", base::TRIM_WHITESPACE,
+                              base::SPLIT_WANT_NONEMPTY)) {
+    if (base::EqualsCaseInsensitiveASCII(token, directive)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+// A response body, on the heap or in a mapped file.
+class HttpResponseCache::Body : public base::RefCountedThreadSafe<Body> {
+ public:
+  static scoped_refptr<Body> Create(const std::string& data,
+                                    const base::FilePath& body_dir) {
+    scoped_refptr<Body> body(new Body());
+    if (!body_dir.empty() && data.size() >= kMinMappedBodySize &&
+        body->Map(data, body_dir)) {
+      return body;
+    }
+
+    body->data_ = data;
+    return body;
+  }
+
+  base::StringPiece data() const {
+    if (mapped_data_) {
+      return base::StringPiece(static_cast<const char*>(mapped_data_),
+                               mapped_length_);
+    }
+    return data_;
+  }
+
+ private:
+  friend class base::RefCountedThreadSafe<Body>;
+
+  Body()
+      : mapped_data_(nullptr),
+        mapped_length_(0) {
+  }
+
+  ~Body() {
+    if (mapped_data_) {
+      munmap(mapped_data_, mapped_length_);
+      base::subtle::NoBarrier_AtomicIncrement(&g_mapped_body_count, -1);
+    }
+  }
+
+  // Only the mapping is kept: the file is unlinked and closed once mapped,
+  // so a body holds no file descriptor and nothing is left behind by a
+  // crash.
+  bool Map(const std::string& data, const base::FilePath& body_dir) {
+    if (base::subtle::NoBarrier_Load(&g_mapped_body_count) >=
+        kMaxMappedBodies) {
+      return false;
+    }
+
+    base::FilePath path;
+    if (!base::CreateTemporaryFileInDir(body_dir, &path)) {
+      LOG(ERROR) << "Failed to create a cache body file in "
+                 << body_dir.value();
+      return false;
+    }
+
+    base::File file(path, base::File::FLAG_OPEN | base::File::FLAG_READ |
+                              base::File::FLAG_WRITE);
+    bool written = file.IsValid() &&
+        file.WriteAtCurrentPos(data.data(), static_cast<int>(data.size())) ==
+            static_cast<int>(data.size());
+    base::DeleteFile(path, false);
+    if (!written) {
+      LOG(ERROR) << "Failed to write a cache body file";
+      return false;
+    }
+
+    void* mapped_data = mmap(nullptr, data.size(), PROT_READ, MAP_SHARED,
+                             file.GetPlatformFile(), 0);
+    if (mapped_data == MAP_FAILED) {
+      PLOG(ERROR) << "Failed to map a cache body file";
+      return false;
+    }
+
+    mapped_data_ = mapped_data;
+    mapped_length_ = data.size();
+    base::subtle::NoBarrier_AtomicIncrement(&g_mapped_body_count, 1);
+    return true;
+  }
+
+  std::string data_;
+  void* mapped_data_;
+  size_t mapped_length_;
+
+  DISALLOW_COPY_AND_ASSIGN(Body);
+};
+
+struct HttpResponseCache::Shard {
+  // Every stored variant of a key. There is rarely more than one.
+  typedef std::vector<scoped_refptr<Entry>> Variants;
+  typedef base::HashingMRUCache<std::string, Variants> EntryMap;
+
+  // Stores of a key whose body is still being written.
+  struct PendingStores {
+    PendingStores() : count(0), removed_sequence(0) {}
+
+    size_t count;
+
+    // Sequence of the last Remove() of the key, which drops the stores
+    // started before it.
+    uint64_t removed_sequence;
+  };
+
+  Shard()
+      : entries(EntryMap::NO_AUTO_EVICT),
+        bytes(0),
+        sequence(0) {
+  }
+
+  base::Lock lock;
+  EntryMap entries;
+  size_t bytes;
+
+  // Orders the stores of mapped bodies and the removals of their keys.
+  uint64_t sequence;
+  std::unordered_map<std::string, PendingStores> pending_stores;
+};
+
+HttpResponseCache::Entry::Entry(scoped_refptr<HttpResponseHeaders> headers,
+                                scoped_refptr<Body> body,
+                                const HttpVaryData& vary_data,
+                                base::Time request_time,
+                                base::Time response_time)
+    : headers_(std::move(headers)),
+      body_(std::move(body)),
+      vary_data_(vary_data),
+      request_time_(request_time),
+      response_time_(response_time) {
+}
+
+HttpResponseCache::Entry::~Entry() {}
+
+base::StringPiece HttpResponseCache::Entry::body() const {
+  return body_->data();
+}
+
+bool HttpResponseCache::Entry::IsFresh(base::Time now) const {
+  return headers_->RequiresValidation(request_time_, response_time_, now) ==
+      VALIDATION_NONE;
+}
+
+base::TimeDelta HttpResponseCache::Entry::GetCurrentAge(
+    base::Time now) const {
+  return headers_->GetCurrentAge(request_time_, response_time_, now);
+}
+
+bool HttpResponseCache::Entry::AddValidators(
+    HttpRequestHeaders* request_headers) const {
+  bool added = false;
+
+  std::string etag;
+  if (headers_->EnumerateHeader(nullptr, "etag", &etag) && !etag.empty()) {
+    request_headers->SetHeader(HttpRequestHeaders::kIfNoneMatch, etag);
+    added = true;
+  }
+
+  std::string last_modified;
+  if (headers_->EnumerateHeader(nullptr, "last-modified", &last_modified) &&
+      !last_modified.empty()) {
+    request_headers->SetHeader(HttpRequestHeaders::kIfModifiedSince,
+                               last_modified);
+    added = true;
+  }
+
+  return added;
+}
+
+bool HttpResponseCache::Entry::MatchesRequest(
+    const HttpRequestInfo& request_info) const {
+  return !vary_data_.is_valid() ||
+      vary_data_.MatchesRequest(request_info, *headers_);
+}
+
+size_t HttpResponseCache::Entry::size() const {
+  return headers_->raw_headers().size() + body_->data().size();
+}
+
+HttpResponseCache::HttpResponseCache(size_t max_bytes,
+                                     const base::FilePath& body_dir)
+    : max_shard_bytes_(max_bytes / kShardCount),
+      max_entry_size_(max_shard_bytes_ / kEntriesPerShard),
+      body_dir_(body_dir),
+      shards_(new Shard[kShardCount]) {
+  if (body_dir_.empty()) {
+    return;
+  }
+
+  body_thread_.reset(new base::Thread("cache_body_writer"));
+  if (!body_thread_->Start()) {
+    LOG(ERROR) << "Failed to start the cache body thread";
+    body_thread_.reset();
+  }
+}
+
+HttpResponseCache::~HttpResponseCache() {
+  // the pending writes still insert into the shards
+  body_thread_.reset();
+}
+
+// static
+bool HttpResponseCache::IsCacheableRequest(
+    const HttpRequestHeaders& request_headers) {
+  // Partial and personalized responses are left to the backend.
+  if (request_headers.HasHeader(HttpRequestHeaders::kRange) ||
+      request_headers.HasHeader(HttpRequestHeaders::kAuthorization)) {
+    return false;
+  }
+
+  return !HasCacheDirective(request_headers, "no-store");
+}
+
+// static
+bool HttpResponseCache::RequiresValidation(
+    const HttpRequestHeaders& request_headers) {
+  std::string pragma;
+  if (request_headers.GetHeader(HttpRequestHeaders::kPragma, &pragma) &&
+      base::EqualsCaseInsensitiveASCII(pragma, "no-cache")) {
+    return true;
+  }
+
+  return HasCacheDirective(request_headers, "no-cache") ||
+      HasCacheDirective(request_headers, "max-age=0");
+}
+
+// static
+bool HttpResponseCache::IsStorableResponse(
+    const HttpResponseHeaders& headers) {
+  if (!IsShareableResponse(headers)) {
+    return false;
+  }
+
+  // Worth keeping if it stays fresh for a while or can be revalidated.
+  if (headers.HasHeader("etag") || headers.HasHeader("last-modified")) {
+    return true;
+  }
+  return headers.GetFreshnessLifetimes(base::Time::Now()).freshness >
+      base::TimeDelta();
+}
+
+// static
+bool HttpResponseCache::IsShareableResponse(
+    const HttpResponseHeaders& headers) {
+  switch (headers.response_code()) {
+    case 200:
+    case 203:
+    case 300:
+    case 301:
+    case 308:
+    case 404:
+    case 410:
+      break;
+    default:
+      return false;
+  }
+
+  if (headers.HasHeaderValue("cache-control", "no-store") ||
+      headers.HasHeaderValue("cache-control", "private") ||
+      headers.HasHeaderValue("cache-control", "no-cache") ||
+      headers.HasHeaderValue("vary", "*") ||
+      headers.HasHeader("set-cookie")) {
+    return false;
+  }
+  return true;
+}
+
+scoped_refptr<HttpResponseCache::Entry> HttpResponseCache::Lookup(
+    const std::string& key,
+    const HttpRequestHeaders& request_headers) {
+  HttpRequestInfo request_info = MakeRequestInfo(request_headers);
+
+  Shard* shard = GetShard(key);
+  base::AutoLock lock(shard->lock);
+  Shard::EntryMap::iterator it = shard->entries.Get(key);
+  if (it == shard->entries.end()) {
+    return nullptr;
+  }
+
+  for (const scoped_refptr<Entry>& entry : it->second) {
+    if (entry->MatchesRequest(request_info)) {
+      return entry;
+    }
+  }
+  return nullptr;
+}
+
+void HttpResponseCache::Store(const std::string& key,
+                              const HttpRequestHeaders& request_headers,
+                              scoped_refptr<HttpResponseHeaders> headers,
+                              const std::string& body,
+                              base::Time request_time,
+                              base::Time response_time) {
+  if (body.size() > max_entry_size_) {
+    return;
+  }
+
+  // Invalid without a Vary header.
+  HttpRequestInfo request_info = MakeRequestInfo(request_headers);
+  HttpVaryData vary_data;
+  vary_data.Init(request_info, *headers);
+
+  // a body to be mapped is stored once it is written, off the calling
+  // thread, unless the key is removed meanwhile
+  if (body_thread_ && body.size() >= kMinMappedBodySize) {
+    uint64_t store_sequence;
+    {
+      Shard* shard = GetShard(key);
+      base::AutoLock lock(shard->lock);
+      store_sequence = ++shard->sequence;
+      ++shard->pending_stores[key].count;
+    }
+
+    body_thread_->task_runner()->PostTask(
+        FROM_HERE,
+        base::Bind(&HttpResponseCache::StoreMappedBody, base::Unretained(this),
+                   key, request_info, headers, body, vary_data, request_time,
+                   response_time, store_sequence));
+    return;
+  }
+
+  Insert(key, request_info,
+         new Entry(std::move(headers), Body::Create(body, base::FilePath()),
+                   vary_data, request_time, response_time));
+}
+
+void HttpResponseCache::FlushBodyWritesForTesting() {
+  if (!body_thread_) {
+    return;
+  }
+
+  base::WaitableEvent done(base::WaitableEvent::ResetPolicy::AUTOMATIC,
+                           base::WaitableEvent::InitialState::NOT_SIGNALED);
+  body_thread_->task_runner()->PostTask(
+      FROM_HERE,
+      base::Bind(&base::WaitableEvent::Signal, base::Unretained(&done)));
+  done.Wait();
+}
+
+scoped_refptr<HttpResponseCache::Entry> HttpResponseCache::Refresh(
+    const std::string& key,
+    const HttpRequestHeaders& request_headers,
+    const Entry& entry,
+    const HttpResponseHeaders& not_modified,
+    base::Time request_time,
+    base::Time response_time) {
+  scoped_refptr<HttpResponseHeaders> headers(
+      new HttpResponseHeaders(entry.headers_->raw_headers()));
+  headers->Update(not_modified);
+
+  HttpRequestInfo request_info = MakeRequestInfo(request_headers);
+  HttpVaryData vary_data;
+  vary_data.Init(request_info, *headers);
+
+  return Insert(key, request_info,
+                new Entry(std::move(headers), entry.body_, vary_data,
+                          request_time, response_time));
+}
+
+void HttpResponseCache::Remove(const std::string& key) {
+  Shard* shard = GetShard(key);
+  base::AutoLock lock(shard->lock);
+
+  auto pending = shard->pending_stores.find(key);
+  if (pending != shard->pending_stores.end()) {
+    pending->second.removed_sequence = ++shard->sequence;
+  }
+
+  Shard::EntryMap::iterator it = shard->entries.Peek(key);
+  if (it == shard->entries.end()) {
+    return;
+  }
+
+  for (const scoped_refptr<Entry>& entry : it->second) {
+    shard->bytes -= entry->size();
+  }
+  shard->entries.Erase(it);
+}
+
+size_t HttpResponseCache::GetSize() const {
+  size_t bytes = 0;
+  for (size_t i = 0; i < kShardCount; ++i) {
+    base::AutoLock lock(shards_[i].lock);
+    bytes += shards_[i].bytes;
+  }
+  return bytes;
+}
+
+void HttpResponseCache::StoreMappedBody(
+    const std::string& key,
+    const HttpRequestInfo& request_info,
+    scoped_refptr<HttpResponseHeaders> headers,
+    const std::string& body,
+    const HttpVaryData& vary_data,
+    base::Time request_time,
+    base::Time response_time,
+    uint64_t store_sequence) {
+  DCHECK(body_thread_->task_runner()->BelongsToCurrentThread());
+  scoped_refptr<Entry> entry(
+      new Entry(std::move(headers), Body::Create(body, body_dir_), vary_data,
+                request_time, response_time));
+
+  Shard* shard = GetShard(key);
+  base::AutoLock lock(shard->lock);
+
+  auto pending = shard->pending_stores.find(key);
+  DCHECK(pending != shard->pending_stores.end());
+  bool removed = pending->second.removed_sequence > store_sequence;
+  if (--pending->second.count == 0) {
+    shard->pending_stores.erase(pending);
+  }
+
+  // an unsafe request changed the resource after this response was fetched
+  if (removed) {
+    return;
+  }
+
+  InsertLocked(shard, key, request_info, std::move(entry));
+}
+
+HttpResponseCache::Shard* HttpResponseCache::GetShard(
+    const std::string& key) const {
+  return &shards_[std::hash<std::string>()(key) % kShardCount];
+}
+
+scoped_refptr<HttpResponseCache::Entry> HttpResponseCache::Insert(
+    const std::string& key,
+    const HttpRequestInfo& request_info,
+    scoped_refptr<Entry> entry) {
+  Shard* shard = GetShard(key);
+  base::AutoLock lock(shard->lock);
+  return InsertLocked(shard, key, request_info, std::move(entry));
+}
+
+scoped_refptr<HttpResponseCache::Entry> HttpResponseCache::InsertLocked(
+    Shard* shard,
+    const std::string& key,
+    const HttpRequestInfo& request_info,
+    scoped_refptr<Entry> entry) {
+  shard->lock.AssertAcquired();
+
+  Shard::EntryMap::iterator it = shard->entries.Get(key);
+  if (it == shard->entries.end()) {
+    it = shard->entries.Put(key, Shard::Variants());
+  }
+
+  // A response replaces the variants its request would have selected, and all
+  // of them once it has no Vary header.
+  Shard::Variants& variants = it->second;
+  for (Shard::Variants::iterator variant = variants.begin();
+       variant != variants.end();) {
+    if (!entry->vary_data_.is_valid() ||
+        (*variant)->MatchesRequest(request_info)) {
+      shard->bytes -= (*variant)->size();
+      variant = variants.erase(variant);
+    } else {
+      ++variant;
+    }
+  }
+
+  variants.push_back(entry);
+  shard->bytes += entry->size();
+
+  while (shard->bytes > max_shard_bytes_ && !shard->entries.empty()) {
+    Shard::EntryMap::reverse_iterator oldest = shard->entries.rbegin();
+    for (const scoped_refptr<Entry>& evicted : oldest->second) {
+      shard->bytes -= evicted->size();
+    }
+    shard->entries.Erase(oldest);
+  }
+
+  return entry;
+}
+
+}  // namespace net
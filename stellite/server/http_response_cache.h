@@ -0,0 +1,199 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_SERVER_HTTP_RESPONSE_CACHE_H_
+#define STELLITE_SERVER_HTTP_RESPONSE_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include "base/files/file_path.h"
+#include "base/macros.h"
+#include "base/memory/ref_counted.h"
+#include "base/strings/string_piece.h"
+#include "base/time/time.h"
+#include "net/base/net_export.h"
+#include "net/http/http_vary_data.h"
+
+namespace base {
+class Thread;
+}
+
+namespace net {
+
+class HttpRequestHeaders;
+struct HttpRequestInfo;
+class HttpResponseHeaders;
+
+// Backend responses kept by the proxy to answer GET requests without a
+// backend round trip, following the RFC 7234 rules for a shared cache:
+// Cache-Control and Expires give the freshness, Vary selects among the
+// stored variants of a URL, and a stale response carrying an ETag or a
+// Last-Modified date is revalidated with a conditional request.
+//
+// Shared by every worker. The index is split into shards, each under its own
+// lock and evicting its least recently used responses. Stored responses are
+// immutable, so a stream keeps serving its entry after it is replaced or
+// evicted. Bodies may live in files mapped into memory instead of the heap;
+// those are written on a thread of the cache.
+class NET_EXPORT HttpResponseCache {
+ public:
+  class Body;
+
+  class NET_EXPORT Entry : public base::RefCountedThreadSafe<Entry> {
+   public:
+    const HttpResponseHeaders& headers() const { return *headers_; }
+    base::StringPiece body() const;
+
+    // Whether the response can be served without asking the backend.
+    bool IsFresh(base::Time now) const;
+
+    // Age of the response, for the Age header.
+    base::TimeDelta GetCurrentAge(base::Time now) const;
+
+    // Adds If-None-Match and If-Modified-Since for the validators of the
+    // response. Returns false if it has none.
+    bool AddValidators(HttpRequestHeaders* request_headers) const;
+
+   private:
+    friend class base::RefCountedThreadSafe<Entry>;
+    friend class HttpResponseCache;
+
+    Entry(scoped_refptr<HttpResponseHeaders> headers,
+          scoped_refptr<Body> body,
+          const HttpVaryData& vary_data,
+          base::Time request_time,
+          base::Time response_time);
+    ~Entry();
+
+    // Whether the response was selected by the Vary headers of a request
+    // like |request_info|.
+    bool MatchesRequest(const HttpRequestInfo& request_info) const;
+
+    // Bytes accounted to the entry.
+    size_t size() const;
+
+    scoped_refptr<HttpResponseHeaders> headers_;
+    scoped_refptr<Body> body_;
+
+    // Invalid if the response has no Vary header.
+    HttpVaryData vary_data_;
+
+    base::Time request_time_;
+    base::Time response_time_;
+
+    DISALLOW_COPY_AND_ASSIGN(Entry);
+  };
+
+  // Stores up to |max_bytes| of headers and bodies. Bodies go to files in
+  // |body_dir| mapped into memory, unless it is empty.
+  HttpResponseCache(size_t max_bytes, const base::FilePath& body_dir);
+  ~HttpResponseCache();
+
+  // Whether a GET with |request_headers| may be answered from the cache and
+  // its response stored.
+  static bool IsCacheableRequest(const HttpRequestHeaders& request_headers);
+
+  // Whether the request asks for its response to be revalidated.
+  static bool RequiresValidation(const HttpRequestHeaders& request_headers);
+
+  // Whether |headers| of a response to a cacheable request may be stored.
+  static bool IsStorableResponse(const HttpResponseHeaders& headers);
+
+  // Whether a response may answer other clients than the one it was sent
+  // to, however long it stays fresh.
+  static bool IsShareableResponse(const HttpResponseHeaders& headers);
+
+  // The stored response of |key| whose Vary matches |request_headers|, fresh
+  // or not. Null if there is none.
+  scoped_refptr<Entry> Lookup(const std::string& key,
+                              const HttpRequestHeaders& request_headers);
+
+  // Stores a response, replacing the variant of the same Vary. Bodies over
+  // max_entry_size() are not stored. A body to be mapped is stored once its
+  // file is written, a little later.
+  void Store(const std::string& key,
+             const HttpRequestHeaders& request_headers,
+             scoped_refptr<HttpResponseHeaders> headers,
+             const std::string& body,
+             base::Time request_time,
+             base::Time response_time);
+
+  // Merges the headers of a 304 answering the revalidation of |entry| into a
+  // new entry that replaces it, and returns that entry.
+  scoped_refptr<Entry> Refresh(const std::string& key,
+                               const HttpRequestHeaders& request_headers,
+                               const Entry& entry,
+                               const HttpResponseHeaders& not_modified,
+                               base::Time request_time,
+                               base::Time response_time);
+
+  // Drops every variant of |key|, after an unsafe request changed it, and
+  // the responses of |key| whose bodies are still being mapped.
+  void Remove(const std::string& key);
+
+  size_t max_entry_size() const { return max_entry_size_; }
+
+  // Bytes stored in all shards.
+  size_t GetSize() const;
+
+  // Waits until the bodies to be mapped that were passed to Store() are
+  // stored.
+  void FlushBodyWritesForTesting();
+
+ private:
+  struct Shard;
+
+  // Writes and maps |body| on |body_thread_|, then stores the response
+  // unless |key| was removed after the store numbered |store_sequence|
+  // began.
+  void StoreMappedBody(const std::string& key,
+                       const HttpRequestInfo& request_info,
+                       scoped_refptr<HttpResponseHeaders> headers,
+                       const std::string& body,
+                       const HttpVaryData& vary_data,
+                       base::Time request_time,
+                       base::Time response_time,
+                       uint64_t store_sequence);
+
+  Shard* GetShard(const std::string& key) const;
+
+  scoped_refptr<Entry> Insert(const std::string& key,
+                              const HttpRequestInfo& request_info,
+                              scoped_refptr<Entry> entry);
+
+  // Insert() with the lock of |shard| held.
+  scoped_refptr<Entry> InsertLocked(Shard* shard,
+                                    const std::string& key,
+                                    const HttpRequestInfo& request_info,
+                                    scoped_refptr<Entry> entry);
+
+  const size_t max_shard_bytes_;
+  const size_t max_entry_size_;
+  const base::FilePath body_dir_;
+
+  std::unique_ptr<Shard[]> shards_;
+
+  // Writes the bodies to be mapped. Null without |body_dir_|.
+  std::unique_ptr<base::Thread> body_thread_;
+
+  DISALLOW_COPY_AND_ASSIGN(HttpResponseCache);
+};
+
+}  // namespace net
+
+#endif  // STELLITE_SERVER_HTTP_RESPONSE_CACHE_H_
@@ -0,0 +1,235 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/http_response_cache.h"
+
+#include <string>
+
+#include "base/files/file_enumerator.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/strings/string_number_conversions.h"
+#include "net/http/http_request_headers.h"
+#include "net/http/http_response_headers.h"
+#include "net/http/http_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+
+namespace {
+
+const char kKey[] = "www.example.com/index.html";
+
+scoped_refptr<HttpResponseHeaders> MakeHeaders(const std::string& headers) {
+  return new HttpResponseHeaders(
+      HttpUtil::AssembleRawHeaders(headers.c_str(), headers.size()));
+}
+
+}  // namespace
+
+class HttpResponseCacheTest : public testing::Test {
+ public:
+  HttpResponseCacheTest()
+      : cache_(1024 * 1024, base::FilePath()),
+        now_(base::Time::Now()) {
+  }
+
+  void Store(const std::string& headers, const std::string& body) {
+    cache_.Store(kKey, request_headers_, MakeHeaders(headers), body, now_,
+                 now_);
+  }
+
+ protected:
+  HttpResponseCache cache_;
+  HttpRequestHeaders request_headers_;
+  base::Time now_;
+};
+
+TEST_F(HttpResponseCacheTest, StoreAndLookup) {
+  Store("HTTP/1.1 200 OK\nCache-Control: max-age=60\n\n", "hello");
+
+  scoped_refptr<HttpResponseCache::Entry> entry =
+      cache_.Lookup(kKey, request_headers_);
+  ASSERT_TRUE(entry);
+  EXPECT_EQ(200, entry->headers().response_code());
+  EXPECT_EQ("hello", entry->body());
+  EXPECT_TRUE(entry->IsFresh(now_ + base::TimeDelta::FromSeconds(30)));
+  EXPECT_FALSE(entry->IsFresh(now_ + base::TimeDelta::FromSeconds(90)));
+
+  EXPECT_FALSE(cache_.Lookup("www.example.com/other", request_headers_));
+
+  cache_.Remove(kKey);
+  EXPECT_FALSE(cache_.Lookup(kKey, request_headers_));
+  EXPECT_EQ(0u, cache_.GetSize());
+}
+
+TEST_F(HttpResponseCacheTest, StorableResponse) {
+  EXPECT_TRUE(HttpResponseCache::IsStorableResponse(
+      *MakeHeaders("HTTP/1.1 200 OK\nCache-Control: max-age=60\n\n")));
+  EXPECT_TRUE(HttpResponseCache::IsStorableResponse(
+      *MakeHeaders("HTTP/1.1 200 OK\nETag: \"abc\"\n\n")));
+
+  EXPECT_FALSE(HttpResponseCache::IsStorableResponse(
+      *MakeHeaders("HTTP/1.1 200 OK\n\n")));
+  EXPECT_FALSE(HttpResponseCache::IsStorableResponse(
+      *MakeHeaders("HTTP/1.1 200 OK\nCache-Control: no-store\n\n")));
+  EXPECT_FALSE(HttpResponseCache::IsStorableResponse(
+      *MakeHeaders("HTTP/1.1 200 OK\nCache-Control: private, max-age=60\n\n")));
+  EXPECT_FALSE(HttpResponseCache::IsStorableResponse(
+      *MakeHeaders("HTTP/1.1 200 OK\nCache-Control: max-age=60\n"
+                   "Set-Cookie: a=b\n\n")));
+  EXPECT_FALSE(HttpResponseCache::IsStorableResponse(
+      *MakeHeaders("HTTP/1.1 200 OK\nCache-Control: max-age=60\n"
+                   "Vary: *\n\n")));
+  EXPECT_FALSE(HttpResponseCache::IsStorableResponse(
+      *MakeHeaders("HTTP/1.1 500 Error\nCache-Control: max-age=60\n\n")));
+}
+
+TEST_F(HttpResponseCacheTest, CacheableRequest) {
+  EXPECT_TRUE(HttpResponseCache::IsCacheableRequest(request_headers_));
+  EXPECT_FALSE(HttpResponseCache::RequiresValidation(request_headers_));
+
+  HttpRequestHeaders no_cache;
+  no_cache.SetHeader(HttpRequestHeaders::kCacheControl, "no-cache");
+  EXPECT_TRUE(HttpResponseCache::IsCacheableRequest(no_cache));
+  EXPECT_TRUE(HttpResponseCache::RequiresValidation(no_cache));
+
+  HttpRequestHeaders no_store;
+  no_store.SetHeader(HttpRequestHeaders::kCacheControl, "max-age=0, no-store");
+  EXPECT_FALSE(HttpResponseCache::IsCacheableRequest(no_store));
+
+  HttpRequestHeaders authorization;
+  authorization.SetHeader(HttpRequestHeaders::kAuthorization, "Basic abc");
+  EXPECT_FALSE(HttpResponseCache::IsCacheableRequest(authorization));
+}
+
+TEST_F(HttpResponseCacheTest, Vary) {
+  request_headers_.SetHeader("Accept-Language", "en");
+  Store("HTTP/1.1 200 OK\nCache-Control: max-age=60\n"
+        "Vary: Accept-Language\n\n", "hello");
+
+  request_headers_.SetHeader("Accept-Language", "ko");
+  Store("HTTP/1.1 200 OK\nCache-Control: max-age=60\n"
+        "Vary: Accept-Language\n\n", "annyeong");
+
+  HttpRequestHeaders request_headers;
+  request_headers.SetHeader("Accept-Language", "en");
+  scoped_refptr<HttpResponseCache::Entry> entry =
+      cache_.Lookup(kKey, request_headers);
+  ASSERT_TRUE(entry);
+  EXPECT_EQ("hello", entry->body());
+
+  request_headers.SetHeader("Accept-Language", "ko");
+  entry = cache_.Lookup(kKey, request_headers);
+  ASSERT_TRUE(entry);
+  EXPECT_EQ("annyeong", entry->body());
+
+  request_headers.SetHeader("Accept-Language", "ja");
+  EXPECT_FALSE(cache_.Lookup(kKey, request_headers));
+}
+
+TEST_F(HttpResponseCacheTest, Revalidate) {
+  Store("HTTP/1.1 200 OK\nCache-Control: max-age=0\nETag: \"v1\"\n\n",
+        "hello");
+
+  scoped_refptr<HttpResponseCache::Entry> entry =
+      cache_.Lookup(kKey, request_headers_);
+  ASSERT_TRUE(entry);
+  EXPECT_FALSE(entry->IsFresh(now_));
+
+  HttpRequestHeaders conditional;
+  EXPECT_TRUE(entry->AddValidators(&conditional));
+  std::string etag;
+  EXPECT_TRUE(conditional.GetHeader(HttpRequestHeaders::kIfNoneMatch, &etag));
+  EXPECT_EQ("\"v1\"", etag);
+
+  scoped_refptr<HttpResponseHeaders> not_modified =
+      MakeHeaders("HTTP/1.1 304 Not Modified\nCache-Control: max-age=60\n\n");
+  scoped_refptr<HttpResponseCache::Entry> refreshed = cache_.Refresh(
+      kKey, request_headers_, *entry, *not_modified, now_, now_);
+  EXPECT_EQ(200, refreshed->headers().response_code());
+  EXPECT_EQ("hello", refreshed->body());
+  EXPECT_TRUE(refreshed->IsFresh(now_));
+
+  // The refreshed entry replaced the stale one.
+  EXPECT_EQ(refreshed.get(), cache_.Lookup(kKey, request_headers_).get());
+}
+
+TEST_F(HttpResponseCacheTest, EvictLeastRecentlyUsed) {
+  // 16 shards of 4KB each, 1KB per entry.
+  HttpResponseCache cache(64 * 1024, base::FilePath());
+  EXPECT_EQ(1024u, cache.max_entry_size());
+
+  scoped_refptr<HttpResponseHeaders> headers =
+      MakeHeaders("HTTP/1.1 200 OK\nCache-Control: max-age=60\n\n");
+  const std::string kBody(900, 'a');
+  for (int i = 0; i < 1000; ++i) {
+    cache.Store(kKey + base::IntToString(i), request_headers_, headers, kBody,
+                now_, now_);
+  }
+  EXPECT_LE(cache.GetSize(), 64u * 1024);
+  EXPECT_TRUE(cache.Lookup(kKey + base::IntToString(999), request_headers_));
+  EXPECT_FALSE(cache.Lookup(kKey + base::IntToString(0), request_headers_));
+
+  cache.Store("large", request_headers_, headers, std::string(2048, 'a'),
+              now_, now_);
+  EXPECT_FALSE(cache.Lookup("large", request_headers_));
+}
+
+TEST_F(HttpResponseCacheTest, MappedBody) {
+  base::ScopedTempDir body_dir;
+  ASSERT_TRUE(body_dir.CreateUniqueTempDir());
+  HttpResponseCache cache(16 * 1024 * 1024, body_dir.path());
+
+  const std::string kBody(64 * 1024, 'a');
+  cache.Store(kKey, request_headers_,
+              MakeHeaders("HTTP/1.1 200 OK\nCache-Control: max-age=60\n\n"),
+              kBody, now_, now_);
+  cache.FlushBodyWritesForTesting();
+
+  scoped_refptr<HttpResponseCache::Entry> entry =
+      cache.Lookup(kKey, request_headers_);
+  ASSERT_TRUE(entry);
+  EXPECT_EQ(kBody, entry->body());
+
+  // The file is gone once mapped.
+  base::FileEnumerator files(body_dir.path(), false,
+                             base::FileEnumerator::FILES);
+  EXPECT_TRUE(files.Next().empty());
+}
+
+TEST_F(HttpResponseCacheTest, RemoveDropsPendingMappedBody) {
+  base::ScopedTempDir body_dir;
+  ASSERT_TRUE(body_dir.CreateUniqueTempDir());
+  HttpResponseCache cache(16 * 1024 * 1024, body_dir.path());
+
+  // The body is still being written when an unsafe request removes the key.
+  const std::string kBody(64 * 1024, 'a');
+  cache.Store(kKey, request_headers_,
+              MakeHeaders("HTTP/1.1 200 OK\nCache-Control: max-age=60\n\n"),
+              kBody, now_, now_);
+  cache.Remove(kKey);
+  cache.FlushBodyWritesForTesting();
+
+  EXPECT_FALSE(cache.Lookup(kKey, request_headers_));
+  EXPECT_EQ(0u, cache.GetSize());
+
+  // A store started after the removal is kept.
+  cache.Store(kKey, request_headers_,
+              MakeHeaders("HTTP/1.1 200 OK\nCache-Control: max-age=60\n\n"),
+              kBody, now_, now_);
+  cache.FlushBodyWritesForTesting();
+  EXPECT_TRUE(cache.Lookup(kKey, request_headers_));
+}
+
+}  // namespace net
@@ -6,43 +6,113 @@
 
 #include <utility>
 
+#include "base/logging.h"
 #include "base/memory/ptr_util.h"
 #include "net/quic/chromium/quic_chromium_connection_helper.h"
 #include "net/quic/core/crypto/quic_random.h"
 #include "stellite/fetcher/http_fetcher.h"
 #include "stellite/fetcher/http_request_context_getter.h"
+#include "stellite/fetcher/http_rewrite.h"
 #include "stellite/server/quic_proxy_session.h"
+#include "stellite/server/request_collapser.h"
+#include "stellite/server/response_compressor.h"
 #include "stellite/server/server_packet_writer.h"
 #include "stellite/server/server_per_connection_packet_writer.h"
 #include "stellite/server/server_session_helper.h"
+#include "stellite/server/upstream_group.h"
+#include "stellite/stats/server_stats_macro.h"
 
 namespace net {
 
 class QuicServerSessionBase;
 
 QuicProxyDispatcher::QuicProxyDispatcher(
-    const stellite::HttpRequestContextGetter::Params& fetcher_params,
-    scoped_refptr<base::SingleThreadTaskRunner> http_fetcher_task_runner,
+    scoped_refptr<stellite::HttpRequestContextGetter>
+        http_request_context_getter,
     const QuicConfig& quic_config,
     const QuicCryptoServerConfig* crypto_config,
     const ServerConfig& server_config,
+    uint32_t worker_index,
+    uint32_t worker_count,
     QuicVersionManager* version_manager,
     QuicConnectionHelperInterface* helper,
     QuicAlarmFactory* alarm_factory)
     : QuicDispatcher(
         quic_config, crypto_config, version_manager,
         base::WrapUnique(helper),
-        base::WrapUnique(new ServerSessionHelper(QuicRandom::GetInstance())),
+        base::WrapUnique(new ServerSessionHelper(QuicRandom::GetInstance(),
+                                                 worker_index,
+                                                 worker_count)),
         base::WrapUnique(alarm_factory)),
       server_config_(server_config),
-      http_request_context_getter_(
-          new stellite::HttpRequestContextGetter(
-              fetcher_params, http_fetcher_task_runner)),
+      http_request_context_getter_(http_request_context_getter),
       http_fetcher_(
-          new stellite::HttpFetcher(http_request_context_getter_.get())) {
+          new stellite::HttpFetcher(http_request_context_getter_.get())),
+      response_cache_(nullptr) {
+  http_fetcher_->set_observer(&backend_fetch_stats_);
+
+  if (server_config_.collapse_requests()) {
+    request_collapser_.reset(new RequestCollapser(http_fetcher_.get()));
+  }
+
+  if (server_config_.gzip_level() > 0 || server_config_.brotli_level() > 0) {
+    compressor_pool_.reset(new ResponseCompressorPool(
+        server_config_.gzip_level(), server_config_.brotli_level(),
+        server_config_.compression_window_bits(),
+        server_config_.compression_types()));
+  }
+
+  UpdateProxyConfig(BackendUpstream(server_config_),
+                    server_config_.rewrite_rules());
+}
+
+QuicProxyDispatcher::~QuicProxyDispatcher() {
+  LogRewriteHits();
+}
+
+scoped_refptr<const HttpRewrite> QuicProxyDispatcher::http_rewrite() const {
+  return http_rewrite_;
+}
+
+void QuicProxyDispatcher::UpdateProxyConfig(const UpstreamConfig& upstream,
+                                            const RewriteRules& rewrite_rules) {
+  // Streams only hold a weak pointer to the group, so the old one can go
+  // right away; its requests in flight are not reported back.
+  upstream_group_.reset(new UpstreamGroup(upstream, http_fetcher_.get()));
+  upstream_group_->Start();
+
+  LogRewriteHits();
+  http_rewrite_ = nullptr;
+  if (!rewrite_rules.empty()) {
+    http_rewrite_ = HttpRewrite::Create(rewrite_rules);
+  }
 }
 
-QuicProxyDispatcher::~QuicProxyDispatcher() {}
+// static
+UpstreamConfig QuicProxyDispatcher::BackendUpstream(
+    const ServerConfig& server_config) {
+  UpstreamConfig upstream_config = server_config.upstream();
+  if (upstream_config.servers.empty()) {
+    upstream_config.servers.push_back(
+        UpstreamConfig::Server(server_config.proxy_pass(), 1));
+  }
+  return upstream_config;
+}
+
+void QuicProxyDispatcher::LogRewriteHits() {
+  if (!http_rewrite_) {
+    return;
+  }
+
+  for (size_t i = 0; i < http_rewrite_->rule_count(); ++i) {
+    VLOG(1) << "rewrite rule " << http_rewrite_->pattern(i) << " hit "
+            << http_rewrite_->hit_count(i) << " times";
+  }
+}
+
+bool QuicProxyDispatcher::HasSession(QuicConnectionId connection_id) const {
+  return session_map().find(connection_id) != session_map().end();
+}
 
 QuicServerSessionBase* QuicProxyDispatcher::CreateQuicSession(
     QuicConnectionId connection_id,
@@ -57,12 +127,28 @@ QuicServerSessionBase* QuicProxyDispatcher::CreateQuicSession(
   QuicProxySession* session =
       new QuicProxySession(config(), connection, this, session_helper(),
                            crypto_config(), compressed_certs_cache(),
-                           http_fetcher_.get(), server_config_.proxy_pass());
+                           http_fetcher_.get(), this, server_config_);
   session->Initialize();
+  SERVER_STAT_ADD(STAT_SESSION_CREATED, 1);
 
   return static_cast<QuicServerSessionBase*>(session);
 }
 
+void QuicProxyDispatcher::OnConnectionClosed(
+    QuicConnectionId connection_id,
+    QuicErrorCode error,
+    const std::string& error_details) {
+  SessionMap::const_iterator it = session_map().find(connection_id);
+  if (it != session_map().end()) {
+    const QuicConnectionStats& stats = it->second->connection()->GetStats();
+    SERVER_STAT_ADD(STAT_SESSION_CLOSED, 1);
+    SERVER_STAT_ADD(STAT_PACKETS_LOST, stats.packets_lost);
+    SERVER_STAT_ADD(STAT_PACKETS_RETRANSMITTED, stats.packets_retransmitted);
+  }
+
+  QuicDispatcher::OnConnectionClosed(connection_id, error, error_details);
+}
+
 QuicPacketWriter* QuicProxyDispatcher::CreatePerConnectionWriter() {
   return new ServerPerConnectionPacketWriter(
       static_cast<ServerPacketWriter*>(writer()));
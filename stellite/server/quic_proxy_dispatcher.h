@@ -21,6 +21,7 @@
 #include "net/tools/quic/quic_dispatcher.h"
 #include "stellite/fetcher/http_request_context_getter.h"
 #include "stellite/server/server_config.h"
+#include "stellite/stats/backend_fetch_stats.h"
 
 namespace base {
 class SingleThreadTaskRunner;
@@ -32,7 +33,12 @@ class HttpFetcher;
 
 namespace net {
 class QuicConfig;
+class HttpResponseCache;
+class HttpRewrite;
+class RequestCollapser;
+class ResponseCompressorPool;
 class QuicCryptoServerConfig;
+class UpstreamGroup;
 
 // net::QuicProxyDispatcher inherits from net::QuicDispatcher.
 // Stellite is necessary for proxy server to convert QUIC requests to
@@ -40,12 +46,19 @@ class QuicCryptoServerConfig;
 // net::QuicServerSessionBase::SendResponse to backend fetching
 class NET_EXPORT QuicProxyDispatcher : public QuicDispatcher {
  public:
+  // Backend requests go through |http_request_context_getter|, which may be
+  // shared with the dispatchers of other workers.
+  // |worker_index| and |worker_count| locate the owning worker among the
+  // workers steered by connection ID. Pass 0 and 1 when packets are not
+  // steered.
   QuicProxyDispatcher(
-      const stellite::HttpRequestContextGetter::Params& fetcher_params,
-      scoped_refptr<base::SingleThreadTaskRunner> fetcher_task_runner,
+      scoped_refptr<stellite::HttpRequestContextGetter>
+          http_request_context_getter,
       const QuicConfig& quic_config,
       const QuicCryptoServerConfig* crypto_config,
       const ServerConfig& server_config,
+      uint32_t worker_index,
+      uint32_t worker_count,
       QuicVersionManager* version_manager,
       QuicConnectionHelperInterface* helper,
       QuicAlarmFactory* alarm_factory);
@@ -54,6 +67,42 @@ class NET_EXPORT QuicProxyDispatcher : public QuicDispatcher {
 
   const ServerConfig& server_config() { return server_config_; }
 
+  // Backend origins of new requests, and rewrite rules of new streams;
+  // |http_rewrite| is null without rules. Streams keep their rules across
+  // UpdateProxyConfig(), and requests in flight their origin.
+  UpstreamGroup* upstream_group() { return upstream_group_.get(); }
+  scoped_refptr<const HttpRewrite> http_rewrite() const;
+
+  // Replaces the upstream group and rewrite rules. Open connections stay, and
+  // their requests in flight finish on the origins they started with.
+  void UpdateProxyConfig(const UpstreamConfig& upstream,
+                         const RewriteRules& rewrite_rules);
+
+  // |server_config|'s upstream, or its proxy_pass if none is set.
+  static UpstreamConfig BackendUpstream(const ServerConfig& server_config);
+
+  // Cache of proxied responses shared by the workers, or null. Not owned.
+  HttpResponseCache* response_cache() { return response_cache_; }
+  void set_response_cache(HttpResponseCache* response_cache) {
+    response_cache_ = response_cache;
+  }
+
+  // Shares backend fetches among the streams of this dispatcher, or null if
+  // requests aren't collapsed.
+  RequestCollapser* request_collapser() { return request_collapser_.get(); }
+
+  // Compressors of the plain responses of this dispatcher, or null if
+  // responses aren't compressed.
+  ResponseCompressorPool* compressor_pool() { return compressor_pool_.get(); }
+
+  // Returns true if a session of |connection_id| lives on this dispatcher.
+  bool HasSession(QuicConnectionId connection_id) const;
+
+  // implements QuicSession::Visitor
+  void OnConnectionClosed(QuicConnectionId connection_id,
+                          QuicErrorCode error,
+                          const std::string& error_details) override;
+
  protected:
   QuicServerSessionBase* CreateQuicSession(
       QuicConnectionId connection_id,
@@ -62,6 +111,9 @@ class NET_EXPORT QuicProxyDispatcher : public QuicDispatcher {
   QuicPacketWriter* CreatePerConnectionWriter() override;
 
  private:
+  // Logs the hits of the rules of |http_rewrite_|.
+  void LogRewriteHits();
+
   const ServerConfig& server_config_;
 
   // Used by the helper_ to time alarms.
@@ -71,8 +123,26 @@ class NET_EXPORT QuicProxyDispatcher : public QuicDispatcher {
   scoped_refptr<stellite::HttpRequestContextGetter>
       http_request_context_getter_;
 
+  // Observes |http_fetcher_|, so it is declared before it.
+  BackendFetchStats backend_fetch_stats_;
+
   std::unique_ptr<stellite::HttpFetcher> http_fetcher_;
 
+  // Sends with |http_fetcher_|, so it is declared after it.
+  std::unique_ptr<RequestCollapser> request_collapser_;
+
+  std::unique_ptr<ResponseCompressorPool> compressor_pool_;
+
+  // Backend origins of proxy_pass. Declared after |http_fetcher_| so it stops
+  // its health checks before the fetcher goes away.
+  std::unique_ptr<UpstreamGroup> upstream_group_;
+
+  // Compiled rewrite rules shared by the sessions of this dispatcher, or null
+  // without rules.
+  scoped_refptr<HttpRewrite> http_rewrite_;
+
+  HttpResponseCache* response_cache_;
+
   DISALLOW_COPY_AND_ASSIGN(QuicProxyDispatcher);
 };
 
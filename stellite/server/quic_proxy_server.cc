@@ -14,17 +14,60 @@
 
 #include "stellite/server/quic_proxy_server.h"
 
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/location.h"
 #include "base/memory/ptr_util.h"
+#include "base/single_thread_task_runner.h"
 #include "base/threading/thread.h"
 #include "net/quic/chromium/crypto/proof_source_chromium.h"
 #include "stellite/crypto/quic_ephemeral_key_source.h"
+#include "stellite/fetcher/http_rewrite.h"
+#include "stellite/process/cpu_affinity.h"
+#include "stellite/server/http_response_cache.h"
+#include "stellite/server/quic_proxy_dispatcher.h"
 #include "stellite/server/quic_proxy_worker.h"
+#include "stellite/server/worker_packet_handoff.h"
+#include "stellite/server/worker_thread_topology.h"
+#include "stellite/stats/server_stats_recorder.h"
 
 namespace net {
 
 class ServerPacketWriter;
-const char* kWorkerThread = "worker thread";
-const char* kFetcherThread = "fetcher thread";
+
+// Connection IDs are steered by a single byte.
+const size_t kMaxSteeredWorkers = 256;
+
+namespace {
+
+// Runs first on every worker thread. |cpu| is negative if the thread isn't
+// pinned. Pinning comes first so that a local NUMA policy means the node of
+// that CPU.
+void SetUpWorkerThread(int cpu, NumaPolicy numa_policy) {
+  if (cpu >= 0 && !SetCurrentThreadAffinity(cpu)) {
+    LOG(WARNING) << "Failed to pin a worker thread to CPU " << cpu;
+  }
+
+  if (!SetCurrentThreadNumaPolicy(numa_policy)) {
+    LOG(WARNING) << "Failed to set the NUMA policy of a worker thread";
+  }
+}
+
+void PostSetUpWorkerThread(base::Thread* thread,
+                           const std::vector<int>& cpus,
+                           size_t index,
+                           NumaPolicy numa_policy) {
+  int cpu = cpus.empty() ? -1 : cpus[index % cpus.size()];
+  if (cpu < 0 && numa_policy == NUMA_POLICY_NONE) {
+    return;
+  }
+
+  thread->task_runner()->PostTask(
+      FROM_HERE, base::Bind(&SetUpWorkerThread, cpu, numa_policy));
+}
+
+}  // namespace
 
 QuicProxyServer::QuicProxyServer(const QuicConfig& quic_config,
                                  const ServerConfig& server_config,
@@ -39,6 +82,52 @@ QuicProxyServer::~QuicProxyServer() {}
 bool QuicProxyServer::Start(size_t worker_size,
     const IPEndPoint& quic_address,
     std::vector<QuicServerConfigProtobuf*> serialized_config) {
+  if (server_config_.reuseport_steering() &&
+      worker_size > kMaxSteeredWorkers) {
+    LOG(ERROR) << "reuseport_steering supports up to " << kMaxSteeredWorkers
+               << " workers";
+    return false;
+  }
+
+  if (server_config_.reuseport_steering() && worker_size > 1) {
+    packet_handoff_.reset(new WorkerPacketHandoff(worker_size));
+  }
+
+  if (server_config_.cache_size() > 0) {
+    response_cache_.reset(new HttpResponseCache(
+        static_cast<size_t>(server_config_.cache_size()) * 1024 * 1024,
+        server_config_.cache_dir()));
+  }
+
+  thread_topology_.reset(new WorkerThreadTopology(
+      server_config_.fetch_thread_layout(), worker_size,
+      server_config_.fetch_thread_count()));
+  if (!thread_topology_->Start()) {
+    return false;
+  }
+
+  for (size_t i = 0; i < worker_size; ++i) {
+    PostSetUpWorkerThread(thread_topology_->dispatch_thread(i),
+                          server_config_.cpu_affinity(), i,
+                          server_config_.numa_policy());
+  }
+
+  for (size_t i = 0; i < thread_topology_->fetch_thread_count(); ++i) {
+    PostSetUpWorkerThread(thread_topology_->fetch_thread(i),
+                          server_config_.fetch_cpu_affinity(), i,
+                          server_config_.numa_policy());
+  }
+
+  // Shared context k lives on the fetch thread of worker k and serves every
+  // worker i with i % count == k. URLFetcher already hands requests over to
+  // the network thread of its context, so workers only share the getter.
+  size_t backend_context_count =
+      std::min<size_t>(server_config_.backend_context_count(), worker_size);
+  for (size_t i = 0; i < backend_context_count; ++i) {
+    backend_contexts_.push_back(new stellite::HttpRequestContextGetter(
+        QuicProxyWorker::BackendContextParams(server_config_),
+        thread_topology_->fetch_task_runner(i)));
+  }
 
   for (size_t i = 0; i < worker_size; ++i) {
     std::unique_ptr<ProofSourceChromium> proof_source(
@@ -50,16 +139,12 @@ bool QuicProxyServer::Start(size_t worker_size,
       return false;
     }
 
-    base::Thread::Options io_options(base::MessageLoop::TYPE_IO, 0);
-    base::Thread* dispatch_thread = new base::Thread(kWorkerThread);
-    dispatch_thread->StartWithOptions(io_options);
-
-    base::Thread* fetch_thread = new base::Thread(kFetcherThread);
-    fetch_thread->StartWithOptions(io_options);
-
     QuicProxyWorker* worker = new QuicProxyWorker(
-        fetch_thread->task_runner(),
-        dispatch_thread->task_runner(),
+        *thread_topology_,
+        static_cast<uint32_t>(i),
+        packet_handoff_.get(),
+        backend_contexts_.empty() ?
+            nullptr : backend_contexts_[i % backend_contexts_.size()],
         quic_address,
         quic_config_,
         server_config_,
@@ -71,22 +156,38 @@ bool QuicProxyServer::Start(size_t worker_size,
     // Ephemeral key source, owned by worker
     worker->SetEphemeralKeySource(new QuicEphemeralKeySource());
 
+    worker->SetResponseCache(response_cache_.get());
+
     if (!worker->Initialize(serialized_config)) {
       LOG(ERROR) << "failed to parse quic server config";
       return false;
     }
 
-    dispatch_thread_list_.push_back(base::WrapUnique(dispatch_thread));
-    fetch_thread_list_.push_back(base::WrapUnique(fetch_thread));
     worker_list_.push_back(base::WrapUnique(worker));
 
     worker->Start();
+
+    // The steering program picks workers by SO_REUSEPORT group position,
+    // which follows the bind order.
+    if (server_config_.reuseport_steering()) {
+      worker->WaitUntilListening();
+    }
+  }
+
+  if (server_config_.stats_interval() > 0) {
+    stats_timer_.Start(
+        FROM_HERE,
+        base::TimeDelta::FromSeconds(server_config_.stats_interval()),
+        base::Bind(&ServerStatsRecorder::LogStats,
+                   base::Unretained(ServerStatsRecorder::GetInstance())));
   }
 
   return true;
 }
 
 bool QuicProxyServer::Shutdown() {
+  stats_timer_.Stop();
+
   for (size_t i = 0; i < worker_list_.size(); ++i) {
     worker_list_[i]->Stop();
   }
@@ -95,6 +196,24 @@ bool QuicProxyServer::Shutdown() {
   return true;
 }
 
+bool QuicProxyServer::ReloadConfig(const ServerConfig& server_config) {
+  // a reload that would serve some paths unrewritten is rejected as a whole
+  if (!HttpRewrite::Create(server_config.rewrite_rules())->IsValid()) {
+    LOG(ERROR) << "Invalid rewrite rule, keeping the current config";
+    return false;
+  }
+
+  UpstreamConfig upstream =
+      QuicProxyDispatcher::BackendUpstream(server_config);
+  for (size_t i = 0; i < worker_list_.size(); ++i) {
+    worker_list_[i]->UpdateProxyConfig(upstream,
+                                       server_config.rewrite_rules());
+  }
+  LOG(INFO) << "Reloaded upstream and rewrite rules on "
+            << worker_list_.size() << " workers";
+  return true;
+}
+
 bool QuicProxyServer::Initialize() {
   // If an initial flow control window has not explicitly been set, then use a
   // sensible value for a server: 1 MB for session, 64 KB for each stream.
@@ -20,9 +20,11 @@
 #include <vector>
 
 #include "base/threading/platform_thread.h"
+#include "base/timer/timer.h"
 #include "net/base/ip_endpoint.h"
 #include "net/quic/core/quic_clock.h"
 #include "net/quic/core/quic_config.h"
+#include "stellite/fetcher/http_request_context_getter.h"
 #include "stellite/include/stellite_export.h"
 #include "stellite/server/server_config.h"
 
@@ -31,9 +33,12 @@ class Thread;
 } // namespace thread
 
 namespace net {
+class HttpResponseCache;
 class QuicServerConfigProtobuf;
 class SharedSessionManager;
 class QuicProxyWorker;
+class WorkerPacketHandoff;
+class WorkerThreadTopology;
 
 class STELLITE_EXPORT QuicProxyServer {
  public:
@@ -49,10 +54,14 @@ class STELLITE_EXPORT QuicProxyServer {
 
   bool Shutdown();
 
+  // Hands the upstream/proxy_pass and rewrite settings of |server_config| to
+  // every worker. Other settings only take effect on restart. Returns false
+  // and keeps the current settings if a rewrite rule doesn't compile.
+  bool ReloadConfig(const ServerConfig& server_config);
+
  private:
   typedef std::map<QuicConnectionId, base::PlatformThreadId> ConnectionMap;
   typedef std::vector<std::unique_ptr<QuicProxyWorker>> WorkerList;
-  typedef std::vector<std::unique_ptr<base::Thread>> ThreadVector;
 
   // QUIC clock
   QuicClock clock_;
@@ -66,17 +75,30 @@ class STELLITE_EXPORT QuicProxyServer {
   // List of supported QUIC versions
   QuicVersionVector supported_versions_;
 
+  // Moves misrouted packets between workers steered by connection ID. Has to
+  // outlive the worker threads.
+  std::unique_ptr<WorkerPacketHandoff> packet_handoff_;
+
+  // Proxied responses shared by the workers, null when caching is off. Has
+  // to outlive the worker threads.
+  std::unique_ptr<HttpResponseCache> response_cache_;
+
   // Worker container
   WorkerList worker_list_;
 
   // Connection container
   ConnectionMap connection_map_;
 
-  // threads for worker
-  ThreadVector dispatch_thread_list_;
+  // Backend fetch contexts shared by the workers; empty when every worker
+  // has its own.
+  std::vector<scoped_refptr<stellite::HttpRequestContextGetter>>
+      backend_contexts_;
+
+  // Dispatch and fetch threads of the workers
+  std::unique_ptr<WorkerThreadTopology> thread_topology_;
 
-  // threads for fetcher
-  ThreadVector fetch_thread_list_;
+  // Logs the server stats every stats_interval seconds.
+  base::RepeatingTimer stats_timer_;
 
   DISALLOW_COPY_AND_ASSIGN(QuicProxyServer);
 };
@@ -38,6 +38,7 @@
 #include "stellite/fetcher/http_request_context_getter.h"
 #include "stellite/server/quic_proxy_worker.h"
 #include "stellite/server/server_config.h"
+#include "stellite/server/worker_thread_topology.h"
 #include "testing/gtest/include/gtest/gtest.h"
 
 namespace net {
@@ -80,6 +81,7 @@ class QuicProxyServerTest : public testing::Test,
   QuicConfig quic_config_;
   ServerConfig server_config_;
   QuicVersionVector version_vector_;
+  std::unique_ptr<WorkerThreadTopology> thread_topology_;
   std::unique_ptr<QuicProxyWorker> proxy_worker_;
 
   // http fetcher
@@ -113,6 +115,10 @@ void QuicProxyServerTest::TearDown() {
   if (proxy_worker_.get()) {
     proxy_worker_->Stop();
   }
+
+  if (thread_topology_.get()) {
+    thread_topology_->Stop();
+  }
 }
 
 void QuicProxyServerTest::OnTaskComplete(
@@ -208,9 +214,13 @@ bool QuicProxyServerTest::Initialize(int port) {
       "http://127.0.0.1:" +
       base::IntToString(test_server_->host_port_pair().port()));
 
+  thread_topology_.reset(new WorkerThreadTopology(
+          WorkerThreadTopology::FETCH_LAYOUT_INLINE, 1, 0));
+  EXPECT_EQ(thread_topology_->Start(), true);
+
   proxy_worker_.reset(new QuicProxyWorker(
-          base::ThreadTaskRunnerHandle::Get(),
-          base::ThreadTaskRunnerHandle::Get(),
+          *thread_topology_,
+          0, nullptr, nullptr,
           bind_address,
           quic_config_,
           server_config_,
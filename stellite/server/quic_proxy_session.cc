@@ -14,8 +14,13 @@
 
 #include "stellite/server/quic_proxy_session.h"
 
+#include "base/bind.h"
 #include "base/memory/ptr_util.h"
+#include "stellite/fetcher/http_rewrite.h"
+#include "stellite/server/quic_proxy_dispatcher.h"
 #include "stellite/server/quic_proxy_stream.h"
+#include "stellite/server/server_config.h"
+#include "stellite/server/upstream_group.h"
 
 namespace net {
 
@@ -27,7 +32,8 @@ QuicProxySession::QuicProxySession(
     const QuicCryptoServerConfig* crypto_config,
     QuicCompressedCertsCache* compressed_certs_cache,
     stellite::HttpFetcher* http_fetcher,
-    GURL proxy_pass)
+    QuicProxyDispatcher* dispatcher,
+    const ServerConfig& server_config)
     : QuicServerSession(quic_config,
                         connection,
                         visitor,
@@ -35,7 +41,8 @@ QuicProxySession::QuicProxySession(
                         crypto_config,
                         compressed_certs_cache),
       proxy_fetcher_(http_fetcher),
-      proxy_pass_(proxy_pass) {
+      dispatcher_(dispatcher),
+      server_config_(server_config) {
 }
 
 QuicProxySession::~QuicProxySession() {
@@ -47,8 +54,7 @@ QuicSpdyStream* QuicProxySession::CreateIncomingDynamicStream(QuicStreamId id) {
     return nullptr;
   }
 
-  QuicSpdyStream* stream = new QuicProxyStream(id, this, proxy_fetcher_,
-                                               proxy_pass_);
+  QuicSpdyStream* stream = CreateProxyStream(id);
   ActivateStream(base::WrapUnique(stream));
   return stream;
 }
@@ -59,12 +65,29 @@ QuicSpdyStream* QuicProxySession::CreateOutgoingDynamicStream(
     return nullptr;
   }
 
-  QuicSpdyStream* stream = new QuicProxyStream(GetNextOutgoingStreamId(),
-                                               this, proxy_fetcher_,
-                                               proxy_pass_);
+  QuicSpdyStream* stream = CreateProxyStream(GetNextOutgoingStreamId());
   stream->SetPriority(priority);
   ActivateStream(base::WrapUnique(stream));
   return stream;
 }
 
+QuicProxyStream* QuicProxySession::CreateProxyStream(QuicStreamId id) {
+  // the dispatcher outlives its sessions
+  QuicProxyStream* stream = new QuicProxyStream(
+      id, this, proxy_fetcher_,
+      base::Bind(&QuicProxyDispatcher::upstream_group,
+                 base::Unretained(dispatcher_)));
+  stream->set_response_buffer_size(server_config_.response_buffer_size());
+  stream->set_http_rewrite(dispatcher_->http_rewrite());
+  stream->set_response_cache(dispatcher_->response_cache());
+  stream->set_request_collapser(dispatcher_->request_collapser());
+  stream->set_passthrough_content_encoding(
+      server_config_.passthrough_content_encoding());
+  stream->set_compressor_pool(dispatcher_->compressor_pool());
+  if (server_config_.streaming_upload()) {
+    stream->EnableStreamingUpload(server_config_.upload_buffer_size());
+  }
+  return stream;
+}
+
 }  // namespace net
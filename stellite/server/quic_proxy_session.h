@@ -16,7 +16,6 @@
 #define STELLITE_SERVER_QUIC_PROXY_SESSION_H_
 
 #include "stellite/server/quic_server_session.h"
-#include "url/gurl.h"
 
 namespace stellite {
 class HttpFetcher;
@@ -24,6 +23,10 @@ class HttpFetcher;
 
 namespace net {
 
+class QuicProxyDispatcher;
+class QuicProxyStream;
+class ServerConfig;
+
 class NET_EXPORT QuicProxySession : public QuicServerSession {
  public:
   QuicProxySession(
@@ -34,7 +37,8 @@ class NET_EXPORT QuicProxySession : public QuicServerSession {
       const QuicCryptoServerConfig* crypto_config,
       QuicCompressedCertsCache* compressed_certs_cache,
       stellite::HttpFetcher* http_fetcher,
-      GURL proxy_pass);
+      QuicProxyDispatcher* dispatcher,
+      const ServerConfig& server_config);
 
   ~QuicProxySession() override;
 
@@ -43,8 +47,13 @@ class NET_EXPORT QuicProxySession : public QuicServerSession {
   QuicSpdyStream* CreateOutgoingDynamicStream(SpdyPriority priority) override;
 
  private:
+  QuicProxyStream* CreateProxyStream(QuicStreamId id);
+
   stellite::HttpFetcher* proxy_fetcher_;
-  GURL proxy_pass_;
+  // Hands out the upstream group and rewrite rules of new streams, which
+  // change on config reloads. Not owned.
+  QuicProxyDispatcher* dispatcher_;
+  const ServerConfig& server_config_;
 
   DISALLOW_COPY_AND_ASSIGN(QuicProxySession);
 };
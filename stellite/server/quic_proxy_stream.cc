@@ -14,12 +14,25 @@
 
 #include "stellite/server/quic_proxy_stream.h"
 
+#include <utility>
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "net/base/io_buffer.h"
 #include "net/http/http_response_headers.h"
+#include "net/quic/core/quic_connection.h"
 #include "net/quic/core/quic_session.h"
 #include "net/quic/core/spdy_utils.h"
 #include "net/spdy/spdy_http_utils.h"
 #include "stellite/fetcher/http_fetcher.h"
+#include "stellite/fetcher/http_rewrite.h"
+#include "stellite/fetcher/io_buffer_chain.h"
 #include "stellite/fetcher/spdy_utils.h"
+#include "stellite/fetcher/upload_body_pipe.h"
+#include "stellite/server/upstream_group.h"
+#include "stellite/stats/server_stats_macro.h"
 
 
 using stellite::HttpRequest;
@@ -34,26 +47,102 @@ const char* kHeaderXFH = "x-forwarded-host";
 const char* kHeaderTransferEncoding = "transfer-encoding";
 const char* kHeaderContentLength = "content-length";
 const char* kHeaderServer = "server";
+const char* kHeaderAuthority = ":authority";
+const char* kHeaderAge = "age";
+const char* kHeaderContentEncoding = "content-encoding";
+const char* kHeaderVary = "vary";
 const char* kBadRequest = "Bad Request";
 const int64_t kBackendRequestTimeout = 60 * 1000; // 60 sec
 const int kInvalidRequestId = -1;
 
+// requests are cached and collapsed per authority and rewritten path
+std::string GetResourceKey(const SpdyHeaderBlock& headers,
+                        const std::string& path) {
+  SpdyHeaderBlock::const_iterator it = headers.find(kHeaderAuthority);
+  if (it == headers.end()) {
+    it = headers.find(kHeaderHost);
+  }
+
+  std::string key;
+  if (it != headers.end()) {
+    key = it->second.as_string();
+  }
+  return key + path;
+}
+
 }  // anonymous namespace
 
 QuicProxyStream::QuicProxyStream(QuicStreamId id, QuicSpdySession* session,
                                  stellite::HttpFetcher* http_fetcher,
                                  GURL proxy_pass)
+    : QuicProxyStream(id, session, http_fetcher, UpstreamGroupGetter()) {
+  proxy_pass_ = proxy_pass.GetOrigin();
+}
+
+QuicProxyStream::QuicProxyStream(QuicStreamId id, QuicSpdySession* session,
+                                 stellite::HttpFetcher* http_fetcher,
+                                 const UpstreamGroupGetter& upstream_group)
     : QuicServerStream(id, session),
       is_chunked_upload_(false),
       backend_request_id_(kInvalidRequestId),
-      proxy_pass_(proxy_pass.GetOrigin()),
+      upload_body_(new stellite::IOBufferChain()),
+      streaming_upload_buffer_size_(0),
+      response_buffer_size_(0),
+      response_paused_(false),
+      passthrough_content_encoding_(false),
+      upstream_group_getter_(upstream_group),
+      upstream_index_(0),
+      upstream_acquired_(false),
       http_fetcher_(http_fetcher),
+      response_cache_(nullptr),
+      invalidates_cache_(false),
+      served_from_cache_(false),
+      request_collapser_(nullptr),
+      collapsed_(false),
+      joined_collapsed_fetch_(false),
+      compressor_pool_(nullptr),
+      created_time_(base::TimeTicks::Now()),
       weak_factory_(this) {
+  SERVER_STAT_ADD(STAT_STREAM_CREATED, 1);
 }
 
-QuicProxyStream::~QuicProxyStream() {}
+QuicProxyStream::~QuicProxyStream() {
+  // stop the backend request before its origin is released, so the origin
+  // isn't counted idle while it still works on it. The ID of a finished
+  // request is stale, and cancelling it does nothing.
+  if (backend_request_id_ != kInvalidRequestId) {
+    http_fetcher_->Cancel(backend_request_id_);
+  }
 
-void QuicProxyStream::SendRequest(const std::string& body) {
+  // don't leave the backend waiting for the rest of the body
+  if (upload_pipe_) {
+    upload_pipe_->Abort();
+  }
+
+  // the shared fetch is cancelled once nobody waits for it
+  if (collapsed_fetch_) {
+    collapsed_fetch_->RemoveSubscriber(this);
+  }
+
+  // the client went away or the request was rejected; not the backend's fault
+  ReleaseUpstream(true);
+
+  SERVER_STAT_ADD(STAT_STREAM_CLOSED, 1);
+  SERVER_HISTOGRAM_ADD(
+      HISTOGRAM_STREAM_DURATION,
+      (base::TimeTicks::Now() - created_time_).InMilliseconds());
+}
+
+void QuicProxyStream::set_http_rewrite(
+    scoped_refptr<const HttpRewrite> http_rewrite) {
+  http_rewrite_ = http_rewrite;
+}
+
+void QuicProxyStream::EnableStreamingUpload(size_t buffer_size) {
+  streaming_upload_buffer_size_ = buffer_size;
+}
+
+void QuicProxyStream::SendRequest() {
   DCHECK_EQ(backend_request_id_, kInvalidRequestId);
 
   stellite::HttpRequest backend_request;
@@ -69,6 +158,69 @@ void QuicProxyStream::SendRequest(const std::string& body) {
   HttpRequest::RequestType method = ParseMethod(*spdy_headers, HTTP2);
   backend_request.request_type = method;
 
+  std::string path;
+  if (!GetRequestPath(*spdy_headers, &path)) {
+    SendErrorResponse(400, kBadRequest);
+    return;
+  }
+
+  // check upload
+  bool has_payload = !upload_body_->empty() || is_chunked_upload_ ||
+                     upload_pipe_;
+  bool is_upload_request = (method == HttpRequest::PUT ||
+                            method == HttpRequest::POST ||
+                            method == HttpRequest::PATCH);
+  if (is_upload_request && !has_payload) {
+    SendErrorResponse(400, kBadRequest);
+    return;
+  }
+
+  if  (!is_upload_request && has_payload) {
+    SendErrorResponse(400, kBadRequest);
+    return;
+  }
+
+  // the encoding the response may be compressed in
+  if (compressor_pool_ && method != HttpRequest::HEAD) {
+    backend_headers.GetHeader(HttpRequestHeaders::kAcceptEncoding,
+                              &accept_encoding_);
+  }
+
+  // the backend would be asked for an encoding the client may not decode
+  if (passthrough_content_encoding_ &&
+      !backend_headers.HasHeader(HttpRequestHeaders::kAcceptEncoding)) {
+    backend_headers.SetHeader(HttpRequestHeaders::kAcceptEncoding, "identity");
+  }
+
+  // answer from the cache, or drop what the request is about to change
+  if (response_cache_) {
+    if (method == HttpRequest::GET) {
+      if (MaybeServeFromCache(*spdy_headers, path, &backend_headers)) {
+        return;
+      }
+    } else if (method != HttpRequest::HEAD) {
+      cache_key_ = GetResourceKey(*spdy_headers, path);
+      invalidates_cache_ = true;
+    }
+  }
+
+  // share the fetch of the same resource in flight
+  std::string collapse_key;
+  if (request_collapser_ && method == HttpRequest::GET) {
+    collapse_key = RequestCollapser::GetKey(
+        GetResourceKey(*spdy_headers, path), backend_headers);
+  }
+
+  if (!collapse_key.empty()) {
+    collapsed_fetch_ = request_collapser_->Join(collapse_key,
+                                                weak_factory_.GetWeakPtr());
+    if (collapsed_fetch_) {
+      collapsed_ = true;
+      joined_collapsed_fetch_ = true;
+      return;
+    }
+  }
+
   // set x-forwarded-for header
   net::IPEndPoint remote_address = session()->connection()->peer_address();
   std::string remote_ip = remote_address.address().ToString();
@@ -86,8 +238,19 @@ void QuicProxyStream::SendRequest(const std::string& body) {
     backend_headers.SetHeader(kHeaderXFH, host);
   }
 
+  // pick the backend origin from the current group; a request sent long
+  // after the headers, on a retry or at the end of its body, may outlive
+  // the group of the stream's creation
+  if (!upstream_group_getter_.is_null() && !upstream_acquired_) {
+    UpstreamGroup* upstream_group = upstream_group_getter_.Run();
+    upstream_group_ = upstream_group->GetWeakPtr();
+    upstream_index_ = upstream_group->Acquire();
+    upstream_acquired_ = true;
+    proxy_pass_ = upstream_group->origin(upstream_index_);
+  }
+
   // set url
-  GURL backend_request_url = GetProxyRequestURL(*spdy_headers);
+  GURL backend_request_url = GetProxyRequestURL(path);
   if (!backend_request_url.is_valid()) {
     SendErrorResponse(400, kBadRequest);
     return;
@@ -100,28 +263,10 @@ void QuicProxyStream::SendRequest(const std::string& body) {
   // set stop when response are redirect
   backend_request.is_stop_on_redirect = true;
 
-  // check upload
-  bool has_payload = bool(body.size()) || is_chunked_upload_;
-  bool is_upload_request = (method == HttpRequest::PUT ||
-                            method == HttpRequest::POST ||
-                            method == HttpRequest::PATCH);
-  if (is_upload_request && !has_payload) {
-    SendErrorResponse(400, kBadRequest);
-    return;
-  }
-
-  if  (!is_upload_request && has_payload) {
-    SendErrorResponse(400, kBadRequest);
-    return;
-  }
-
-  // set upload content
+  // set upload content; a fixed length body is passed as |upload_body_| or
+  // streamed through |upload_pipe_|
   if (is_upload_request) {
-    if (is_chunked_upload_) {
-      backend_request.is_chunked_upload = true;
-    } else {
-      backend_request.upload_stream.write(body.data(), body.size());
-    }
+    backend_request.is_chunked_upload = is_chunked_upload_;
   } else {
     // erase content-length header
     backend_headers.RemoveHeader(kHeaderContentLength);
@@ -133,10 +278,29 @@ void QuicProxyStream::SendRequest(const std::string& body) {
   // copy to backend_request
   backend_request.headers.SetRawHeader(backend_headers.ToString());
 
-  backend_request_id_ = http_fetcher_->Request(backend_request,
-                                               kBackendRequestTimeout,
-                                               weak_factory_.GetWeakPtr());
-  DCHECK_NE(backend_request_id_, kInvalidRequestId);
+  net::URLFetcher::CreateUploadStreamCallback upload_stream_factory;
+  if (upload_pipe_) {
+    upload_stream_factory = base::Bind(
+        &stellite::UploadBodyPipe::CreateUploadDataStream, upload_pipe_);
+  } else if (!upload_body_->empty()) {
+    upload_stream_factory = base::Bind(
+        &stellite::IOBufferChain::CreateUploadDataStream, upload_body_);
+  }
+
+  if (!collapse_key.empty()) {
+    // the fetch releases the upstream when it ends
+    collapsed_ = true;
+    collapsed_fetch_ = request_collapser_->Start(
+        collapse_key, backend_request, kBackendRequestTimeout,
+        upstream_group_, upstream_index_, weak_factory_.GetWeakPtr());
+    upstream_acquired_ = false;
+    return;
+  }
+
+  backend_request_id_ = http_fetcher_->Request(
+      backend_request, upload_stream_factory, kBackendRequestTimeout,
+      weak_factory_.GetWeakPtr());
+  // A full task table returns kInvalidRequestId and posts OnTaskError.
 }
 
 void QuicProxyStream::AppendChunkToUpload(const char* data, size_t len,
@@ -154,24 +318,46 @@ void QuicProxyStream::OnHeaderAvailable(bool fin) {
       transfer_encoding.find("chunked") != base::StringPiece::npos;
 
   if (fin || content_length() == 0 || is_chunked_upload_) {
-    SendRequest(std::string());
+    SendRequest();
+    return;
+  }
+
+  if (streaming_upload_buffer_size_ > 0 && content_length() > 0) {
+    upload_pipe_ = new stellite::UploadBodyPipe(
+        static_cast<uint64_t>(content_length()),
+        streaming_upload_buffer_size_,
+        base::Bind(&QuicProxyStream::OnUploadPipeDrained,
+                   weak_factory_.GetWeakPtr()));
+    SendRequest();
   }
 }
 
-void QuicProxyStream::OnContentAvailable(const char* data, size_t len,
-                                         bool fin) {
+void QuicProxyStream::OnBodyAvailable(scoped_refptr<IOBuffer> buffer,
+                                      size_t len, bool fin) {
   if (is_chunked_upload_) {
-    DCHECK_NE(backend_request_id_, kInvalidRequestId);
-    AppendChunkToUpload(data, len, fin);
+    // Without a request ID the posted OnTaskError answers the client.
+    if (backend_request_id_ != kInvalidRequestId) {
+      AppendChunkToUpload(buffer->data(), len, fin);
+    }
     return;
   }
 
-  if (len > 0) {
-    payload_stream_.write(data, len);
+  if (upload_pipe_) {
+    if (!upload_pipe_->Write(std::move(buffer), len) && !fin) {
+      PauseBodyReading();
+    }
+
+    // a body shorter than its content-length would stall the backend
+    if (fin && content_received() != content_length()) {
+      upload_pipe_->Abort();
+    }
+    return;
   }
 
+  upload_body_->Append(std::move(buffer), len);
+
   if (fin) {
-    SendRequest(payload_stream_.str());
+    SendRequest();
   }
 }
 
@@ -197,46 +383,404 @@ void QuicProxyStream::OnTaskHeader(int request_id,
     return;
   }
 
+  OnResponseHeader(std::move(headers));
+}
+
+// backend -> quic server
+void QuicProxyStream::OnTaskStream(int request_id,
+                                   const char* data, size_t len, bool fin) {
+  DCHECK_EQ(request_id, backend_request_id_);
+  OnResponseStream(base::StringPiece(data, len), fin);
+}
+
+void QuicProxyStream::OnCollapsedHeader(
+    scoped_refptr<HttpResponseHeaders> headers) {
+  OnResponseHeader(std::move(headers));
+}
+
+void QuicProxyStream::OnCollapsedStream(base::StringPiece data, bool fin) {
+  OnResponseStream(data, fin);
+}
+
+void QuicProxyStream::OnCollapsedError() {
+  OnResponseError();
+}
+
+void QuicProxyStream::OnCollapsedRetry() {
+  collapsed_fetch_.reset();
+  collapsed_ = false;
+  joined_collapsed_fetch_ = false;
+
+  // the same key would likely get a personal response again
+  request_collapser_ = nullptr;
+  SendRequest();
+}
+
+void QuicProxyStream::OnResponseHeader(
+    scoped_refptr<HttpResponseHeaders> headers) {
+  if (!cache_key_.empty()) {
+    response_time_ = base::Time::Now();
+
+    if (invalidates_cache_) {
+      if (headers->response_code() < 400) {
+        response_cache_->Remove(cache_key_);
+      }
+    } else if (revalidated_entry_ && headers->response_code() == 304) {
+      // the stored response is still good; the backend sends no body
+      scoped_refptr<HttpResponseCache::Entry> entry = response_cache_->Refresh(
+          cache_key_, cache_request_headers_, *revalidated_entry_, *headers,
+          request_time_, response_time_);
+      revalidated_entry_ = nullptr;
+      served_from_cache_ = true;
+      SendCachedResponse(*entry);
+      return;
+    } else if (!joined_collapsed_fetch_ &&
+               HttpResponseCache::IsStorableResponse(*headers)) {
+      // the stream that started a shared fetch stores it for all
+      recorded_headers_ = headers;
+
+      // an encoded body only suits the requests accepting that encoding
+      if (passthrough_content_encoding_ &&
+          headers->HasHeader(kHeaderContentEncoding) &&
+          !headers->HasHeaderValue("vary", "accept-encoding")) {
+        recorded_headers_ = new HttpResponseHeaders(headers->raw_headers());
+        recorded_headers_->AddHeader("Vary: Accept-Encoding");
+      }
+    }
+    revalidated_entry_ = nullptr;
+  }
+
   SpdyHeaderBlock res_headers;
   CreateSpdyHeadersFromHttpResponse(*headers, &res_headers);
 
   // set Server header
   res_headers[kHeaderServer] = "stellite/1.0";
 
-  // because of proxy response content are plain-text, erase content-encoindg
-  res_headers.erase("content-encoding");
+  // proxy response content are plain-text unless the encoding is passed
+  // through, erase content-encoding
+  if (!passthrough_content_encoding_) {
+    res_headers.erase(kHeaderContentEncoding);
+  }
+
+  if (res_headers.find(kHeaderContentEncoding) == res_headers.end()) {
+    MaybeStartCompression(*headers, &res_headers);
+  }
 
   int64_t content_length = headers->GetContentLength();
   bool send_fin = !(headers->IsChunkEncoded() || content_length > 0);
   WriteHeaders(std::move(res_headers), send_fin, nullptr);
 }
 
-// backend -> quic server
-void QuicProxyStream::OnTaskStream(int request_id,
-                                   const char* data, size_t len, bool fin) {
+void QuicProxyStream::OnResponseStream(base::StringPiece body, bool fin) {
+  if (served_from_cache_) {
+    if (fin) {
+      ReleaseUpstream(true);
+    }
+    return;
+  }
+
+  RecordResponseBody(body, fin);
+  if (!WriteResponseBody(body, fin)) {
+    return;
+  }
+
+  if (fin) {
+    ReleaseUpstream(true);
+    return;
+  }
+
+  MaybePauseResponse();
+}
+
+void QuicProxyStream::OnTaskStreamChain(int request_id,
+                                        const stellite::IOBufferChain& chain) {
   DCHECK_EQ(request_id, backend_request_id_);
-  base::StringPiece body(data, len);
-  WriteOrBufferData(body, fin, nullptr);
+  if (served_from_cache_) {
+    return;
+  }
+
+  // Write the whole batch before the connection flushes, so a chunk boundary
+  // doesn't end a packet that the next chunk could have filled.
+  QuicConnection::ScopedPacketBundler bundler(session()->connection(),
+                                              QuicConnection::NO_ACK);
+  for (size_t i = 0; i < chain.buffer_count(); ++i) {
+    base::StringPiece body(chain.buffer(i)->data(), chain.length(i));
+    RecordResponseBody(body, false);
+    if (!WriteResponseBody(body, false)) {
+      return;
+    }
+  }
+
+  MaybePauseResponse();
+}
+
+void QuicProxyStream::OnCanWrite() {
+  QuicServerStream::OnCanWrite();
+
+  if (response_paused_ && queued_data_bytes() <= response_buffer_size_ / 2) {
+    response_paused_ = false;
+    http_fetcher_->ResumeStream(backend_request_id_);
+  }
 }
 
 void QuicProxyStream::OnTaskError(int request_id,
                                   const URLFetcher* source,
                                   int error_code) {
   DCHECK_EQ(request_id, backend_request_id_);
-  SendErrorResponse();
+  OnResponseError();
 }
 
-GURL QuicProxyStream::GetProxyRequestURL(const SpdyHeaderBlock& headers) {
-  GURL request_url(proxy_pass_);
+void QuicProxyStream::OnResponseError() {
+  ReleaseUpstream(false);
+
+  recorded_headers_ = nullptr;
+  if (served_from_cache_) {
+    return;
+  }
+  SendErrorResponse();
+}
 
+bool QuicProxyStream::GetRequestPath(const SpdyHeaderBlock& headers,
+                                     std::string* path) {
   SpdyHeaderBlock::const_iterator it = headers.find(":path");
   if (it == headers.end()) {
-    return GURL();
+    return false;
   }
 
+  *path = it->second.as_string();
+  std::string rewritten_path;
+  if (http_rewrite_ && http_rewrite_->Rewrite(*path, &rewritten_path)) {
+    path->swap(rewritten_path);
+  }
+  return true;
+}
+
+GURL QuicProxyStream::GetProxyRequestURL(const std::string& path) {
+  GURL request_url(proxy_pass_);
+
+  // the query is a component of its own; a path would escape its '?'
+  size_t query_pos = path.find('?');
+
   GURL::Replacements repl;
-  repl.SetPathStr(it->second.as_string());
+  std::string path_str = path.substr(0, query_pos);
+  repl.SetPathStr(path_str);
+
+  std::string query;
+  if (query_pos != std::string::npos) {
+    query = path.substr(query_pos + 1);
+    repl.SetQueryStr(query);
+  }
   return request_url.ReplaceComponents(repl);
 }
 
+bool QuicProxyStream::MaybeServeFromCache(
+    const SpdyHeaderBlock& headers,
+    const std::string& path,
+    HttpRequestHeaders* backend_headers) {
+  if (!HttpResponseCache::IsCacheableRequest(*backend_headers)) {
+    return false;
+  }
+
+  cache_key_ = GetResourceKey(headers, path);
+  cache_request_headers_.CopyFrom(*backend_headers);
+  request_time_ = base::Time::Now();
+
+  // a conditional request of the client goes to the backend as it is
+  if (backend_headers->HasHeader(HttpRequestHeaders::kIfNoneMatch) ||
+      backend_headers->HasHeader(HttpRequestHeaders::kIfModifiedSince)) {
+    return false;
+  }
+
+  scoped_refptr<HttpResponseCache::Entry> entry =
+      response_cache_->Lookup(cache_key_, *backend_headers);
+  if (!entry) {
+    return false;
+  }
+
+  if (!HttpResponseCache::RequiresValidation(*backend_headers) &&
+      entry->IsFresh(request_time_)) {
+    served_from_cache_ = true;
+    SendCachedResponse(*entry);
+    return true;
+  }
+
+  if (entry->AddValidators(backend_headers)) {
+    revalidated_entry_ = entry;
+  }
+  return false;
+}
+
+void QuicProxyStream::SendCachedResponse(
+    const HttpResponseCache::Entry& entry) {
+  SpdyHeaderBlock res_headers;
+  CreateSpdyHeadersFromHttpResponse(entry.headers(), &res_headers);
+
+  res_headers[kHeaderServer] = "stellite/1.0";
+  res_headers[kHeaderAge] =
+      base::Int64ToString(entry.GetCurrentAge(base::Time::Now()).InSeconds());
+
+  // the stored body is as the backend response was relayed
+  base::StringPiece body = entry.body();
+  if (!passthrough_content_encoding_) {
+    res_headers.erase(kHeaderContentEncoding);
+  }
+  res_headers.erase(kHeaderTransferEncoding);
+
+  std::string compressed;
+  if (res_headers.find(kHeaderContentEncoding) == res_headers.end()) {
+    MaybeStartCompression(entry.headers(), &res_headers);
+  }
+  if (compressor_) {
+    if (!compressor_->Compress(body, true, &compressed)) {
+      LOG(ERROR) << "Failed to compress a cached response";
+      compressor_.reset();
+      Reset(QUIC_ERROR_PROCESSING_STREAM);
+      return;
+    }
+    compressor_pool_->Release(std::move(compressor_));
+    body = compressed;
+  }
+  res_headers[kHeaderContentLength] = base::SizeTToString(body.size());
+
+  WriteHeaders(std::move(res_headers), body.empty(), nullptr);
+  if (!body.empty()) {
+    WriteOrBufferData(body, true, nullptr);
+  }
+}
+
+void QuicProxyStream::RecordResponseBody(base::StringPiece data, bool fin) {
+  if (!recorded_headers_) {
+    return;
+  }
+
+  if (recorded_body_.size() + data.size() > response_cache_->max_entry_size()) {
+    recorded_headers_ = nullptr;
+    std::string().swap(recorded_body_);
+    return;
+  }
+
+  data.AppendToString(&recorded_body_);
+  if (fin) {
+    response_cache_->Store(cache_key_, cache_request_headers_,
+                           std::move(recorded_headers_), recorded_body_,
+                           request_time_, response_time_);
+    recorded_headers_ = nullptr;
+    std::string().swap(recorded_body_);
+  }
+}
+
+void QuicProxyStream::MaybeStartCompression(
+    const HttpResponseHeaders& headers,
+    SpdyHeaderBlock* response_headers) {
+  if (!compressor_pool_ || accept_encoding_.empty() ||
+      !compressor_pool_->ShouldCompress(headers)) {
+    return;
+  }
+
+  ResponseCompressor::Encoding encoding =
+      compressor_pool_->ChooseEncoding(accept_encoding_);
+  if (encoding == ResponseCompressor::ENCODING_NONE) {
+    return;
+  }
+
+  compressor_ = compressor_pool_->Acquire(encoding);
+  (*response_headers)[kHeaderContentEncoding] =
+      ResponseCompressor::GetEncodingName(encoding);
+  response_headers->erase(kHeaderContentLength);
+
+  // caches on the way keep a copy per encoding
+  SpdyHeaderBlock::iterator vary = response_headers->find(kHeaderVary);
+  if (vary == response_headers->end()) {
+    (*response_headers)[kHeaderVary] = "Accept-Encoding";
+  } else if (!headers.HasHeaderValue(kHeaderVary, "accept-encoding")) {
+    (*response_headers)[kHeaderVary] =
+        vary->second.as_string() + ", Accept-Encoding";
+  }
+}
+
+bool QuicProxyStream::WriteResponseBody(base::StringPiece data, bool fin) {
+  if (!compressor_) {
+    WriteOrBufferData(data, fin, nullptr);
+    return true;
+  }
+
+  std::string compressed;
+  if (!compressor_->Compress(data, fin, &compressed)) {
+    OnCompressorError();
+    return false;
+  }
+
+  if (fin) {
+    flush_timer_.Stop();
+    compressor_pool_->Release(std::move(compressor_));
+  } else if (compressor_->HasUnflushedInput() && !flush_timer_.IsRunning()) {
+    // a streamed response may pause for long after a small chunk
+    flush_timer_.Start(
+        FROM_HERE, base::TimeDelta::FromMilliseconds(
+            ResponseCompressor::kMaxFlushDelayMs),
+        base::Bind(&QuicProxyStream::FlushResponseBody,
+                   base::Unretained(this)));
+  }
+
+  if (!compressed.empty() || fin) {
+    WriteOrBufferData(compressed, fin, nullptr);
+  }
+  return true;
+}
+
+void QuicProxyStream::FlushResponseBody() {
+  if (!compressor_ || write_side_closed()) {
+    return;
+  }
+
+  std::string compressed;
+  if (!compressor_->Flush(&compressed)) {
+    OnCompressorError();
+    return;
+  }
+
+  if (!compressed.empty()) {
+    WriteOrBufferData(compressed, false, nullptr);
+  }
+}
+
+void QuicProxyStream::OnCompressorError() {
+  // the client can't make sense of the rest of the body
+  LOG(ERROR) << "Failed to compress a response";
+  flush_timer_.Stop();
+  compressor_.reset();
+  if (!collapsed_) {
+    http_fetcher_->Cancel(backend_request_id_);
+  }
+  Reset(QUIC_ERROR_PROCESSING_STREAM);
+}
+
+void QuicProxyStream::MaybePauseResponse() {
+  // a shared fetch keeps its pace for the other streams
+  if (collapsed_) {
+    return;
+  }
+
+  if (!response_paused_ && response_buffer_size_ > 0 &&
+      queued_data_bytes() > response_buffer_size_) {
+    response_paused_ = true;
+    http_fetcher_->PauseStream(backend_request_id_);
+  }
+}
+
+void QuicProxyStream::OnUploadPipeDrained() {
+  ResumeBodyReading();
+}
+
+void QuicProxyStream::ReleaseUpstream(bool success) {
+  if (!upstream_acquired_) {
+    return;
+  }
+  upstream_acquired_ = false;
+
+  if (upstream_group_) {
+    upstream_group_->Release(upstream_index_, success);
+  }
+}
+
 }  // namespace net
@@ -15,30 +15,99 @@
 #ifndef STELLITE_SERVER_QUIC_PROXY_STREAM_H_
 #define STELLITE_SERVER_QUIC_PROXY_STREAM_H_
 
+#include <memory>
+#include <string>
+
+#include "base/callback.h"
+#include "base/memory/ref_counted.h"
 #include "base/memory/weak_ptr.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "net/http/http_request_headers.h"
+#include "stellite/server/http_response_cache.h"
 #include "stellite/server/quic_server_stream.h"
+#include "stellite/server/request_collapser.h"
+#include "stellite/server/response_compressor.h"
 #include "stellite/fetcher/http_fetcher_task.h"
 
 namespace stellite {
 class HttpFetcher;
+class IOBufferChain;
+class UploadBodyPipe;
 }  // namespace stellite
 
 namespace net {
 
+class HttpRewrite;
+class UpstreamGroup;
+
 class QuicProxyStream : public QuicServerStream,
-                        public stellite::HttpFetcherTask::Visitor {
+                        public stellite::HttpFetcherTask::Visitor,
+                        public RequestCollapser::Subscriber {
  public:
   QuicProxyStream(QuicStreamId id, QuicSpdySession* session,
                   stellite::HttpFetcher* http_fetcher,
                   GURL proxy_pass);
+
+  // Returns the upstream group in use, which a config reload may replace.
+  typedef base::Callback<UpstreamGroup*()> UpstreamGroupGetter;
+
+  // Sends each request to an origin picked by the group |upstream_group|
+  // returns when the request starts, so a request that starts after a
+  // config reload goes to the new origins.
+  QuicProxyStream(QuicStreamId id, QuicSpdySession* session,
+                  stellite::HttpFetcher* http_fetcher,
+                  const UpstreamGroupGetter& upstream_group);
   ~QuicProxyStream() override;
 
-  void SendRequest(const std::string& body);
+  // Starts the backend request of a fixed length body as soon as the headers
+  // arrive, and streams the body to it with at most |buffer_size| bytes held
+  // in between. Otherwise the whole body is read before the request starts.
+  void EnableStreamingUpload(size_t buffer_size);
+
+  // Pauses reading the backend response while more than |buffer_size| bytes
+  // of it wait to be sent to the client. 0 never pauses.
+  void set_response_buffer_size(size_t buffer_size) {
+    response_buffer_size_ = buffer_size;
+  }
+
+  // Rewrites :path with |http_rewrite| before it goes to the backend.
+  void set_http_rewrite(scoped_refptr<const HttpRewrite> http_rewrite);
+
+  // Answers GET requests from |response_cache| when it can, and stores the
+  // backend responses it may keep. Not owned.
+  void set_response_cache(HttpResponseCache* response_cache) {
+    response_cache_ = response_cache;
+  }
+
+  // Shares the backend fetch of a GET with the concurrent requests for the
+  // same resource through |request_collapser|. Not owned.
+  void set_request_collapser(RequestCollapser* request_collapser) {
+    request_collapser_ = request_collapser;
+  }
+
+  // Relays the backend response body in its content-encoding, as delivered
+  // by a backend context built with |raw_response_body|.
+  void set_passthrough_content_encoding(bool passthrough) {
+    passthrough_content_encoding_ = passthrough;
+  }
+
+  // Compresses plain responses for the clients accepting it with the
+  // compressors of |compressor_pool|. Not owned.
+  void set_compressor_pool(ResponseCompressorPool* compressor_pool) {
+    compressor_pool_ = compressor_pool;
+  }
+
+  void SendRequest();
   void AppendChunkToUpload(const char* data, size_t len, bool fin);
 
+  // implements ReliableQuicStream
+  void OnCanWrite() override;
+
   // implements QuicServerStream: quic client -> quic server
   void OnHeaderAvailable(bool fin) override;
-  void OnContentAvailable(const char* data, size_t len, bool fin) override;
+  void OnBodyAvailable(scoped_refptr<IOBuffer> buffer, size_t len,
+                       bool fin) override;
 
   // implements HttpFetcherTask::Visitor: backend -> quic server
   void OnTaskComplete(int request_id,
@@ -49,21 +118,125 @@ class QuicProxyStream : public QuicServerStream,
                     const HttpResponseInfo* response_info) override;
   void OnTaskStream(int request_id,
                     const char* data, size_t len, bool fin) override;
+  void OnTaskStreamChain(int request_id,
+                         const stellite::IOBufferChain& chain) override;
   void OnTaskError(int request_id,
                    const URLFetcher* source,
                    int error_code) override;
 
+  // implements RequestCollapser::Subscriber: shared backend -> quic server
+  void OnCollapsedHeader(scoped_refptr<HttpResponseHeaders> headers) override;
+  void OnCollapsedStream(base::StringPiece data, bool fin) override;
+  void OnCollapsedError() override;
+  void OnCollapsedRetry() override;
+
  private:
-  GURL GetProxyRequestURL(const SpdyHeaderBlock& headers);
+  // Relays the backend response, whether fetched for this stream alone or
+  // shared with others.
+  void OnResponseHeader(scoped_refptr<HttpResponseHeaders> headers);
+  void OnResponseStream(base::StringPiece data, bool fin);
+  void OnResponseError();
+
+  // The :path of |headers| after the rewrite rules. False if there is none.
+  bool GetRequestPath(const SpdyHeaderBlock& headers, std::string* path);
+  GURL GetProxyRequestURL(const std::string& path);
+
+  // Sends the response of a GET from the cache if it is fresh there. A stale
+  // response is revalidated with |backend_headers|.
+  bool MaybeServeFromCache(const SpdyHeaderBlock& headers,
+                           const std::string& path,
+                           HttpRequestHeaders* backend_headers);
+  void SendCachedResponse(const HttpResponseCache::Entry& entry);
+
+  // Keeps the response body being recorded for the cache, and stores the
+  // response on |fin|.
+  void RecordResponseBody(base::StringPiece data, bool fin);
+
+  // Compresses the response with |headers| from here on if the client
+  // accepts an encoding it is worth compressing with.
+  void MaybeStartCompression(const HttpResponseHeaders& headers,
+                             SpdyHeaderBlock* response_headers);
+
+  // Writes |data| of the response body, compressed if the response is.
+  // Returns false if the stream was reset on a compressor error.
+  bool WriteResponseBody(base::StringPiece data, bool fin);
+
+  // Writes the compressed output held back for more input, once the backend
+  // stayed quiet for ResponseCompressor::kMaxFlushDelayMs.
+  void FlushResponseBody();
+
+  // Resets the stream after |compressor_| failed.
+  void OnCompressorError();
+
+  // Reports the end of the backend request to the upstream group, once.
+  void ReleaseUpstream(bool success);
+
+  // Stops reading the backend while the client is slower than it.
+  void MaybePauseResponse();
+
+  // Called once the backend read enough of |upload_pipe_| to take more.
+  void OnUploadPipeDrained();
 
   bool is_chunked_upload_;
 
   int backend_request_id_;
   GURL proxy_pass_;
-  std::stringstream payload_stream_;
+  scoped_refptr<const HttpRewrite> http_rewrite_;
+
+  UpstreamGroupGetter upstream_group_getter_;
+
+  // The group the origin of the request was acquired from.
+  base::WeakPtr<UpstreamGroup> upstream_group_;
+  size_t upstream_index_;
+  bool upstream_acquired_;
+  scoped_refptr<stellite::IOBufferChain> upload_body_;
+
+  size_t streaming_upload_buffer_size_;
+  scoped_refptr<stellite::UploadBodyPipe> upload_pipe_;
+
+  size_t response_buffer_size_;
+  bool response_paused_;
+  bool passthrough_content_encoding_;
 
   stellite::HttpFetcher* http_fetcher_;
 
+  HttpResponseCache* response_cache_;
+
+  // Empty unless the request may use the cache.
+  std::string cache_key_;
+  HttpRequestHeaders cache_request_headers_;
+  bool invalidates_cache_;
+
+  // The stale response being revalidated, and whether the backend confirmed
+  // it so that the rest of the backend response is dropped.
+  scoped_refptr<HttpResponseCache::Entry> revalidated_entry_;
+  bool served_from_cache_;
+
+  // The backend response being recorded for the cache.
+  scoped_refptr<HttpResponseHeaders> recorded_headers_;
+  std::string recorded_body_;
+
+  base::Time request_time_;
+  base::Time response_time_;
+
+  RequestCollapser* request_collapser_;
+
+  // The shared fetch the response comes from, if any, and whether this
+  // stream joined it rather than started it.
+  base::WeakPtr<RequestCollapser::Fetch> collapsed_fetch_;
+  bool collapsed_;
+  bool joined_collapsed_fetch_;
+
+  ResponseCompressorPool* compressor_pool_;
+
+  // The accept-encoding of the client, and the compressor of the response
+  // while it is being compressed.
+  std::string accept_encoding_;
+  std::unique_ptr<ResponseCompressor> compressor_;
+  base::OneShotTimer flush_timer_;
+
+  base::TimeTicks created_time_;
+
   base::WeakPtrFactory<QuicProxyStream> weak_factory_;
 
   DISALLOW_COPY_AND_ASSIGN(QuicProxyStream);
@@ -26,6 +26,7 @@
 #include "net/tools/quic/test_tools/mock_quic_server_session_visitor.h"
 #include "stellite/fetcher/http_fetcher.h"
 #include "stellite/fetcher/http_request_context_getter.h"
+#include "stellite/fetcher/http_rewrite.h"
 #include "stellite/server/quic_proxy_session.h"
 #include "stellite/server/quic_proxy_stream.h"
 #include "stellite/server/test_tools/simple_http_server.h"
@@ -314,6 +315,27 @@ TEST_F(QuicProxyStreamTest, SendProxyRequestToBackendWithGetMethod) {
   ASSERT_EQ(backend_request_info_.path, "/get");
 }
 
+TEST_F(QuicProxyStreamTest, RewriteRequestPath) {
+  RewriteRules rules;
+  rules.push_back(std::make_pair("^/old/(\\w+)(.*)$", "/new/$1$2"));
+  scoped_refptr<HttpRewrite> http_rewrite = HttpRewrite::Create(rules);
+  stream()->set_http_rewrite(http_rewrite);
+
+  SpdyHeaderBlock request_headers;
+  request_headers[":host"] = "";
+  request_headers[":authority"] = "www.example.com";
+  request_headers[":path"] = "/old/get?key=value";
+  request_headers[":method"] = "GET";
+  request_headers[":version"] = "HTTP/1.1";
+
+  PushRequestHeader(request_headers, true);
+
+  run_loop_.Run();
+
+  ASSERT_EQ(backend_request_info_.path, "/new/get?key=value");
+  ASSERT_EQ(1u, http_rewrite->hit_count(0));
+}
+
 TEST_F(QuicProxyStreamTest, SendProxyGetWithPayload) {
   SpdyHeaderBlock request_headers;
   request_headers[":host"] = "";
@@ -16,6 +16,7 @@
 
 #include "base/single_thread_task_runner.h"
 #include "base/threading/thread.h"
+#include "base/threading/thread_task_runner_handle.h"
 #include "net/base/net_errors.h"
 #include "net/quic/chromium/quic_chromium_alarm_factory.h"
 #include "net/quic/chromium/quic_chromium_connection_helper.h"
@@ -25,28 +26,43 @@
 #include "net/tools/quic/quic_dispatcher.h"
 #include "stellite/crypto/quic_ephemeral_key_source.h"
 #include "stellite/fetcher/http_request_context_getter.h"
+#include "stellite/process/cpu_affinity.h"
 #include "stellite/server/quic_proxy_dispatcher.h"
 #include "stellite/server/server_config.h"
 #include "stellite/server/server_packet_writer.h"
+#include "stellite/server/server_session_helper.h"
+#include "stellite/server/worker_thread_topology.h"
+#include "stellite/socket/quic_udp_recv_batch.h"
 #include "stellite/socket/quic_udp_server_socket.h"
+#include "stellite/stats/server_stats_macro.h"
 
 namespace net {
 
 const int kReadBufferSize = 2 * kMaxPacketSize;
+const size_t kNumPacketsPerReadCall = 16;
 const size_t kNumSessionsToCreatePerSocketEvent = 16;
 const char* kSourceAddressTokenSecret = "secret";
 
 QuicProxyWorker::QuicProxyWorker(
-    scoped_refptr<base::SingleThreadTaskRunner> dispatch_task_runner,
-    scoped_refptr<base::SingleThreadTaskRunner> http_fetch_task_runner,
+    const WorkerThreadTopology& thread_topology,
+    uint32_t worker_index,
+    WorkerPacketHandoff* packet_handoff,
+    scoped_refptr<stellite::HttpRequestContextGetter> backend_context_getter,
     const IPEndPoint& bind_address,
     const QuicConfig& quic_config,
     const ServerConfig& server_config,
     const QuicVersionVector& supported_versions,
     std::unique_ptr<ProofSource> proof_source)
     : dispatch_continuity_(server_config.dispatch_continuity()),
-      dispatch_task_runner_(dispatch_task_runner),
-      http_fetch_task_runner_(http_fetch_task_runner),
+      worker_index_(worker_index),
+      worker_count_(static_cast<uint32_t>(thread_topology.worker_count())),
+      listening_event_(base::WaitableEvent::ResetPolicy::MANUAL,
+                       base::WaitableEvent::InitialState::NOT_SIGNALED),
+      packet_handoff_(packet_handoff),
+      response_cache_(nullptr),
+      backend_context_getter_(backend_context_getter),
+      dispatch_task_runner_(thread_topology.dispatch_task_runner(worker_index)),
+      http_fetch_task_runner_(thread_topology.fetch_task_runner(worker_index)),
       bind_address_(bind_address),
       quic_config_(quic_config),
       crypto_config_(kSourceAddressTokenSecret,
@@ -56,10 +72,14 @@ QuicProxyWorker::QuicProxyWorker(
       version_manager_(supported_versions),
       read_pending_(false),
       synchronous_read_count_(0),
-      read_buffer_(new IOBufferWithSize(kReadBufferSize)),
+      read_batch_(new QuicUDPRecvBatch(kNumPacketsPerReadCall,
+                                       kReadBufferSize)),
+      recorded_drop_count_(0),
       weak_factory_(this) {
   CHECK(dispatch_continuity_ >= 1 && dispatch_continuity_ <= 64) <<
       "keep dispatch_continuity range [1, 64]";
+  CHECK_LT(worker_index_, worker_count_);
+  CHECK(!packet_handoff_ || packet_handoff_->worker_count() == worker_count_);
 }
 
 QuicProxyWorker::~QuicProxyWorker() {}
@@ -95,6 +115,10 @@ void QuicProxyWorker::SetEphemeralKeySource(EphemeralKeySource* key_source) {
   crypto_config_.SetEphemeralKeySource(key_source);
 }
 
+void QuicProxyWorker::SetResponseCache(HttpResponseCache* response_cache) {
+  response_cache_ = response_cache;
+}
+
 void QuicProxyWorker::Start() {
   DCHECK(crypto_config_.NumberOfConfigs() > 0);
   dispatch_task_runner_->PostTask(
@@ -103,6 +127,23 @@ void QuicProxyWorker::Start() {
                  weak_factory_.GetWeakPtr()));
 }
 
+// static
+stellite::HttpRequestContextGetter::Params
+QuicProxyWorker::BackendContextParams(const ServerConfig& server_config) {
+  stellite::HttpRequestContextGetter::Params params;
+  params.enable_http2 = true;
+  params.enable_quic = false;
+  params.ignore_certificate_errors = false;
+  params.using_disk_cache = false;
+  params.max_read_buffer_size = server_config.read_buffer_size();
+  params.raw_response_body = server_config.passthrough_content_encoding();
+  return params;
+}
+
+void QuicProxyWorker::WaitUntilListening() {
+  listening_event_.Wait();
+}
+
 void QuicProxyWorker::StartOnBackground() {
   DCHECK(dispatch_task_runner_->BelongsToCurrentThread());
 
@@ -139,6 +180,41 @@ void QuicProxyWorker::StartOnBackground() {
     exit(1);
   }
 
+  // The program is shared by the whole SO_REUSEPORT group; every worker
+  // attaches the same one so the last bound socket doesn't matter. Without
+  // it the kernel picks workers by client address, and the packets of a
+  // connection that moved to another address are handed over in software.
+  if (server_config().reuseport_steering()) {
+    res = socket->AttachReusePortConnectionIdSteering(worker_count_);
+    if (res < 0) {
+      LOG(WARNING) << "AttachReusePortConnectionIdSteering() failed, "
+                   << "forwarding packets between workers: "
+                   << ErrorToString(res);
+    }
+  }
+  listening_event_.Signal();
+
+  // Lets the kernel pick this socket for packets whose interrupt was taken
+  // on the CPU this thread is pinned to.
+  int cpu;
+  if (GetCurrentThreadPinnedCpu(&cpu)) {
+    res = socket->SetIncomingCpu(cpu);
+    if (res < 0) {
+      LOG(WARNING) << "SetIncomingCpu() failed: " << ErrorToString(res);
+    }
+  }
+
+  // Kernel receive timestamps keep event loop delays out of RTT samples.
+  res = socket->EnableReceiveTimestamps();
+  if (res < 0) {
+    LOG(WARNING) << "EnableReceiveTimestamps() failed: " << ErrorToString(res);
+  }
+
+  res = socket->EnableReceiveDropCount();
+  if (res < 0) {
+    LOG(WARNING) << "EnableReceiveDropCount() failed: " << ErrorToString(res);
+  }
+
   res = socket->GetLocalAddress(&server_address_);
   if (res < 0) {
     LOG(ERROR) << "GetLocalAddress() failed: " << ErrorToString(res);
@@ -149,21 +225,38 @@ void QuicProxyWorker::StartOnBackground() {
 
   socket_.swap(socket);
 
-  stellite::HttpRequestContextGetter::Params fetcher_params;
-  fetcher_params.enable_http2 = true;
-  fetcher_params.enable_quic = false;
-  fetcher_params.ignore_certificate_errors = false;
-  fetcher_params.using_disk_cache = false;
+  if (!backend_context_getter_) {
+    backend_context_getter_ = new stellite::HttpRequestContextGetter(
+        BackendContextParams(server_config_), http_fetch_task_runner());
+  }
 
+  // connection IDs name their worker whenever packets are steered, by the
+  // kernel or by |packet_handoff_|
+  bool steered = server_config().reuseport_steering();
   dispatcher_.reset(
-      new QuicProxyDispatcher(fetcher_params, http_fetch_task_runner(),
+      new QuicProxyDispatcher(backend_context_getter_,
                               quic_config(), crypto_config(), server_config(),
+                              steered ? worker_index_ : 0,
+                              steered ? worker_count_ : 1,
                               &version_manager_, helper_, alarm_factory_));
-
-  ServerPacketWriter* writer = new ServerPacketWriter(socket_.get(),
-                                                      dispatcher_.get());
+  dispatcher_->set_response_cache(response_cache_);
+
+  ServerPacketWriter* writer = new ServerPacketWriter(
+      socket_.get(), dispatcher_.get(),
+      server_config().write_queue_packets(),
+      server_config().write_queue_bytes());
+  if (server_config().batch_write()) {
+    writer->EnableBatching(server_config().udp_segmentation());
+  }
   dispatcher_->InitializeWithWriter(writer);
 
+  if (packet_handoff_) {
+    packet_handoff_->RegisterWorker(
+        worker_index_, base::ThreadTaskRunnerHandle::Get(),
+        base::Bind(&QuicProxyWorker::DrainForwardedPackets,
+                   weak_factory_.GetWeakPtr()));
+  }
+
   StartReading();
 }
 
@@ -174,6 +267,23 @@ void QuicProxyWorker::Stop() {
                  weak_factory_.GetWeakPtr()));
 }
 
+void QuicProxyWorker::UpdateProxyConfig(const UpstreamConfig& upstream,
+                                        const RewriteRules& rewrite_rules) {
+  dispatch_task_runner_->PostTask(
+      FROM_HERE,
+      base::Bind(&QuicProxyWorker::UpdateProxyConfigOnBackground,
+                 weak_factory_.GetWeakPtr(), upstream, rewrite_rules));
+}
+
+void QuicProxyWorker::UpdateProxyConfigOnBackground(
+    const UpstreamConfig& upstream,
+    const RewriteRules& rewrite_rules) {
+  if (!dispatcher_) {
+    return;
+  }
+  dispatcher_->UpdateProxyConfig(upstream, rewrite_rules);
+}
+
 void QuicProxyWorker::StartReading() {
   if (synchronous_read_count_ == 0) {
     dispatcher_->ProcessBufferedChlos(kNumSessionsToCreatePerSocketEvent);
@@ -184,10 +294,8 @@ void QuicProxyWorker::StartReading() {
   }
   read_pending_ = true;
 
-  int result = socket_->RecvFrom(
-      read_buffer_.get(),
-      read_buffer_->size(),
-      &client_address_,
+  int result = socket_->RecvMultipleFrom(
+      read_batch_.get(),
       base::Bind(&QuicProxyWorker::OnReadComplete, base::Unretained(this)));
 
   if (result == ERR_IO_PENDING) {
@@ -233,11 +341,98 @@ void QuicProxyWorker::OnReadComplete(int result) {
     return;
   }
 
-  QuicReceivedPacket packet(read_buffer_->data(), result,
-                            helper_->GetClock()->Now(), false);
-  dispatcher_->ProcessPacket(server_address_, client_address_, packet);
+  RecordDropCount();
+
+  // |result| is the number of datagrams in |read_batch_|. Packets without a
+  // kernel receive time share the time the batch was read.
+  QuicTime now = helper_->GetClock()->Now();
+  size_t packet_count = 0;
+  for (size_t i = 0; i < read_batch_->size(); ++i) {
+    if (read_batch_->length(i) == 0) {
+      continue;
+    }
+    ++packet_count;
+
+    QuicTime receipt_time = now;
+    QuicWallTime receive_time = read_batch_->receive_time(i);
+    if (!receive_time.IsZero()) {
+      receipt_time =
+          helper_->GetClock()->ConvertWallTimeToQuicTime(receive_time);
+    }
+
+    if (MaybeForwardPacket(read_batch_->data(i), read_batch_->length(i),
+                           read_batch_->address(i), receipt_time)) {
+      continue;
+    }
+
+    QuicReceivedPacket packet(read_batch_->data(i), read_batch_->length(i),
+                              receipt_time, false);
+    dispatcher_->ProcessPacket(server_address_, read_batch_->address(i),
+                               packet);
+  }
+  SERVER_STAT_ADD(STAT_UDP_PACKETS_RECEIVED, packet_count);
 
   StartReading();
 }
 
+bool QuicProxyWorker::MaybeForwardPacket(const char* data,
+                                         size_t length,
+                                         const IPEndPoint& peer_address,
+                                         QuicTime receipt_time) {
+  if (!packet_handoff_) {
+    return false;
+  }
+
+  QuicConnectionId connection_id;
+  if (!ServerSessionHelper::ReadConnectionId(data, length, &connection_id)) {
+    return false;
+  }
+
+  uint32_t owner =
+      ServerSessionHelper::GetWorkerIndex(connection_id, worker_count_);
+  if (owner == worker_index_ || dispatcher_->HasSession(connection_id)) {
+    return false;
+  }
+
+  // A full ring drops the packet rather than letting this worker answer for
+  // a connection it doesn't own; the peer retransmits.
+  if (packet_handoff_->Forward(worker_index_, owner, data, length,
+                               server_address_, peer_address,
+                               receipt_time)) {
+    SERVER_STAT_ADD(STAT_PACKET_FORWARDED, 1);
+  } else {
+    SERVER_STAT_ADD(STAT_PACKET_FORWARD_DROPPED, 1);
+  }
+  return true;
+}
+
+void QuicProxyWorker::DrainForwardedPackets() {
+  if (!dispatcher_) {
+    return;
+  }
+
+  packet_handoff_->Drain(
+      worker_index_,
+      base::Bind(&QuicProxyWorker::OnForwardedPacket, base::Unretained(this)));
+}
+
+void QuicProxyWorker::OnForwardedPacket(
+    const PacketHandoffRing::Packet& packet) {
+  QuicReceivedPacket received_packet(packet.data, packet.length,
+                                     packet.receipt_time, false);
+  dispatcher_->ProcessPacket(packet.self_address, packet.peer_address,
+                             received_packet);
+}
+
+void QuicProxyWorker::RecordDropCount() {
+  // The kernel counter is cumulative and wraps around.
+  uint32_t drop_count = read_batch_->drop_count();
+  if (drop_count == recorded_drop_count_) {
+    return;
+  }
+
+  SERVER_STAT_ADD(STAT_UDP_RECV_DROPPED, drop_count - recorded_drop_count_);
+  recorded_drop_count_ = drop_count;
+}
+
 } // namespace net
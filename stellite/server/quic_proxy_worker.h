@@ -19,12 +19,15 @@
 
 #include "base/memory/ref_counted.h"
 #include "base/memory/weak_ptr.h"
+#include "base/synchronization/waitable_event.h"
 #include "net/base/ip_endpoint.h"
 #include "net/quic/core/crypto/quic_crypto_server_config.h"
 #include "net/quic/core/quic_clock.h"
 #include "net/quic/core/quic_config.h"
 #include "net/quic/core/quic_protocol.h"
+#include "stellite/fetcher/http_request_context_getter.h"
 #include "stellite/server/server_config.h"
+#include "stellite/server/worker_packet_handoff.h"
 
 namespace base {
 class SingleThreadTaskRunner;
@@ -33,13 +36,15 @@ class Thread;
 
 namespace net {
 class EphemeralKeySource;
-class IOBufferWithSize;
 class QuicChromiumAlarmFactory;
+class HttpResponseCache;
 class QuicChromiumConnectionHelper;
 class QuicProxyDispatcher;
 class QuicServerConfig;
 class QuicServerConfigProtobuf;
+class QuicUDPRecvBatch;
 class QuicUDPServerSocket;
+class WorkerThreadTopology;
 
 namespace test {
 class QuicProxyWorkerPeer;
@@ -47,13 +52,19 @@ class QuicProxyWorkerPeer;
 
 // net::QuicProxyWorker has two thread and UDP server socket.
 // One is QUIC dispatching thread, last one is backend fetching thread.
-// The other role of net::QuicProxyWorker is to read datagram and hand-over
-// datagram to quic_dispatcher.
+// The other role of net::QuicProxyWorker is to read datagrams in batches and
+// hand-over each datagram of a batch to quic_dispatcher.
 class NET_EXPORT QuicProxyWorker {
  public:
+  // The worker runs on the dispatch and fetch threads |thread_topology|
+  // assigns to |worker_index|. |backend_context_getter| is the backend fetch
+  // context shared with other workers; if null the worker builds its own on
+  // its fetch thread.
   QuicProxyWorker(
-      scoped_refptr<base::SingleThreadTaskRunner> dispatch_task_runner,
-      scoped_refptr<base::SingleThreadTaskRunner> http_fetch_task_runner,
+      const WorkerThreadTopology& thread_topology,
+      uint32_t worker_index,
+      WorkerPacketHandoff* packet_handoff,
+      scoped_refptr<stellite::HttpRequestContextGetter> backend_context_getter,
       const IPEndPoint& bind_address,
       const QuicConfig& quic_config,
       const ServerConfig& server_config,
@@ -67,9 +78,27 @@ class NET_EXPORT QuicProxyWorker {
   void SetStrikeRegisterNoStartupPeriod();
   void SetEphemeralKeySource(EphemeralKeySource* key_source);
 
+  // Proxied responses cache shared by every worker. Must be set before
+  // Start() and outlive the worker. Not owned.
+  void SetResponseCache(HttpResponseCache* response_cache);
+
   void Start();
   void Stop();
 
+  // Replaces the backend origins and rewrite rules on the dispatch thread.
+  // Connections and crypto state stay as they are.
+  void UpdateProxyConfig(const UpstreamConfig& upstream,
+                         const RewriteRules& rewrite_rules);
+
+  // Parameters of the backend fetch contexts.
+  static stellite::HttpRequestContextGetter::Params BackendContextParams(
+      const ServerConfig& server_config);
+
+  // Blocks until the worker socket is bound. Workers steered by connection ID
+  // must join the SO_REUSEPORT group in |worker_index| order, since the
+  // steering program selects a socket by its position in the group.
+  void WaitUntilListening();
+
  protected:
   const QuicConfig& quic_config() {
     return quic_config_;
@@ -98,10 +127,46 @@ class NET_EXPORT QuicProxyWorker {
   void StartReading();
   void StopReading();
 
+  void UpdateProxyConfigOnBackground(const UpstreamConfig& upstream,
+                                     const RewriteRules& rewrite_rules);
+
   void OnReadComplete(int result);
 
+  // Hands a datagram whose connection ID is steered to another worker, and
+  // which no session of this worker owns, over to that worker. This catches
+  // the packets the kernel sent here while the SO_REUSEPORT group filled
+  // up, and every packet of a migrated connection if the steering program
+  // couldn't be attached. Returns false if the packet should be dispatched
+  // here.
+  bool MaybeForwardPacket(const char* data,
+                          size_t length,
+                          const IPEndPoint& peer_address,
+                          QuicTime receipt_time);
+
+  // Dispatches the packets other workers forwarded to this one.
+  void DrainForwardedPackets();
+  void OnForwardedPacket(const PacketHandoffRing::Packet& packet);
+
+  // Adds the datagrams the kernel dropped since the last read to the server
+  // stats.
+  void RecordDropCount();
+
   const int dispatch_continuity_;
 
+  // Position of this worker among the workers sharing the listening port.
+  const uint32_t worker_index_;
+  const uint32_t worker_count_;
+
+  // Signaled once |socket_| is bound.
+  base::WaitableEvent listening_event_;
+
+  // Shared by every worker, may be null. Not owned.
+  WorkerPacketHandoff* packet_handoff_;
+  HttpResponseCache* response_cache_;
+
+  // Backend fetch context, possibly shared with other workers.
+  scoped_refptr<stellite::HttpRequestContextGetter> backend_context_getter_;
+
   // Worker thread
   scoped_refptr<base::SingleThreadTaskRunner> dispatch_task_runner_;
 
@@ -149,11 +214,12 @@ class NET_EXPORT QuicProxyWorker {
   // synchronously and without posting a new task to the message loop.
   int synchronous_read_count_;
 
-  // The target buffer of the current read.
-  scoped_refptr<IOBufferWithSize> read_buffer_;
+  // The target datagram slots of the current batched read.
+  std::unique_ptr<QuicUDPRecvBatch> read_batch_;
 
-  // The source address of the current read.
-  IPEndPoint client_address_;
+  // The socket drop counter reported by the kernel when it was last added to
+  // the server stats.
+  uint32_t recorded_drop_count_;
 
   base::WeakPtrFactory<QuicProxyWorker> weak_factory_;
 
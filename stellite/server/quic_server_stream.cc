@@ -14,7 +14,12 @@
 
 #include "stellite/server/quic_server_stream.h"
 
+#include <string.h>
+
+#include <utility>
+
 #include "net/quic/core/spdy_utils.h"
+#include "base/macros.h"
 #include "base/strings/string_number_conversions.h"
 
 namespace net {
@@ -23,11 +28,15 @@ const char* kErrorResponseBody = "internal error";
 const char* kHeaderStatus = ":status";
 const char* kHeaderContentLength = ":content-length";
 
+// Readable regions gathered into one buffer per OnBodyAvailable() call.
+const size_t kMaxReadableRegions = 16;
+
 QuicServerStream::QuicServerStream(QuicStreamId id,
                                    QuicSpdySession* session)
     : QuicSpdyStream(id, session),
       content_length_(-1),
-      content_received_(0) {
+      content_received_(0),
+      body_reading_paused_(false) {
 }
 
 QuicServerStream:: ~QuicServerStream() {}
@@ -98,31 +107,62 @@ void QuicServerStream::OnDataAvailable() {
     return;
   }
 
-  while (HasBytesToRead()) {
-    struct iovec iov;
-    if (GetReadableRegions(&iov, 1) == 0) {
+  while (!body_reading_paused_ && HasBytesToRead()) {
+    struct iovec iov[kMaxReadableRegions];
+    int num_regions = GetReadableRegions(iov, arraysize(iov));
+    if (num_regions == 0) {
       break;
     }
-    content_received_ += iov.iov_len;
+
+    size_t len = 0;
+    for (int i = 0; i < num_regions; ++i) {
+      len += iov[i].iov_len;
+    }
+
+    content_received_ += len;
     if (content_length_ >= 0 && content_received_ > content_length_) {
       SendErrorResponse();
       return;
     }
 
-    std::string buffer(static_cast<char*>(iov.iov_base), iov.iov_len);
-    MarkConsumed(iov.iov_len);
+    // The sequencer reuses its blocks once consumed, so this one copy is
+    // what lets the body outlive MarkConsumed().
+    scoped_refptr<IOBuffer> buffer(new IOBuffer(len));
+    char* dest = buffer->data();
+    for (int i = 0; i < num_regions; ++i) {
+      memcpy(dest, iov[i].iov_base, iov[i].iov_len);
+      dest += iov[i].iov_len;
+    }
+    MarkConsumed(len);
 
-    OnContentAvailable(buffer.data(), buffer.size(), sequencer()->IsClosed());
+    OnBodyAvailable(std::move(buffer), len, sequencer()->IsClosed());
   }
 
   if (!sequencer()->IsClosed()) {
-    sequencer()->SetUnblocked();
+    if (!body_reading_paused_) {
+      sequencer()->SetUnblocked();
+    }
     return;
   }
 
   OnFinRead();
 }
 
+void QuicServerStream::PauseBodyReading() {
+  body_reading_paused_ = true;
+}
+
+void QuicServerStream::ResumeBodyReading() {
+  if (!body_reading_paused_) {
+    return;
+  }
+
+  body_reading_paused_ = false;
+  if (!reading_stopped() && !sequencer()->IsClosed()) {
+    OnDataAvailable();
+  }
+}
+
 void QuicServerStream::SendErrorResponse() {
   SendErrorResponse(500, "internal error");
 }
@@ -172,4 +212,9 @@ void QuicServerStream::OnHeaderAvailable(bool fin) {}
 void QuicServerStream::OnContentAvailable(const char* data, size_t len,
                                           bool fin) {}
 
+void QuicServerStream::OnBodyAvailable(scoped_refptr<IOBuffer> buffer,
+                                       size_t len, bool fin) {
+  OnContentAvailable(buffer->data(), len, fin);
+}
+
 }  // namespace net
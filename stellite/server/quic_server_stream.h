@@ -15,6 +15,8 @@
 #ifndef STELLITE_SERVER_QUIC_SERVER_STREAM_H_
 #define STELLITE_SERVER_QUIC_SERVER_STREAM_H_
 
+#include "base/memory/ref_counted.h"
+#include "net/base/io_buffer.h"
 #include "net/quic/core/quic_spdy_stream.h"
 
 namespace net {
@@ -45,6 +47,17 @@ class QuicServerStream : public QuicSpdyStream {
   virtual void OnHeaderAvailable(bool fin);
   virtual void OnContentAvailable(const char* data, size_t len, bool fin);
 
+  // Called with the body bytes read by one OnDataAvailable() pass, copied
+  // once out of the sequencer. Override to keep |buffer| instead of copying
+  // it again. The default calls OnContentAvailable().
+  virtual void OnBodyAvailable(scoped_refptr<IOBuffer> buffer, size_t len,
+                               bool fin);
+
+  // Stops consuming body bytes. The stream's flow control window then stops
+  // growing, so the client blocks once it has sent that much.
+  void PauseBodyReading();
+  void ResumeBodyReading();
+
   SpdyHeaderBlock* request_headers() { return &request_headers_; }
   int64_t content_length() { return content_length_; }
   int64_t content_received() { return content_received_; }
@@ -63,6 +76,7 @@ class QuicServerStream : public QuicSpdyStream {
   SpdyHeaderBlock request_headers_;
   int64_t content_length_;
   int64_t content_received_;
+  bool body_reading_paused_;
 
   DISALLOW_COPY_AND_ASSIGN(QuicServerStream);
 };
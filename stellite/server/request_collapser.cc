@@ -0,0 +1,329 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/request_collapser.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "base/logging.h"
+#include "base/strings/string_util.h"
+#include "net/base/net_errors.h"
+#include "net/http/http_request_headers.h"
+#include "net/http/http_response_headers.h"
+#include "net/url_request/url_fetcher.h"
+#include "stellite/fetcher/http_fetcher.h"
+#include "stellite/include/http_request.h"
+#include "stellite/server/http_response_cache.h"
+#include "stellite/server/upstream_group.h"
+
+namespace net {
+
+namespace {
+
+const int kInvalidRequestId = -1;
+
+// Body bytes kept to replay to late subscribers. Past this a fetch takes no
+// new subscribers, and later requests start a fetch of their own.
+const size_t kMaxReplayBytes = 1024 * 1024;
+
+// Requests with these headers are answered for their client alone.
+const char* const kPersonalHeaders[] = {
+  HttpRequestHeaders::kAuthorization,
+  HttpRequestHeaders::kCookie,
+};
+
+// Headers a response may be negotiated or made conditional by.
+const char* const kKeyHeaders[] = {
+  HttpRequestHeaders::kAccept,
+  HttpRequestHeaders::kAcceptEncoding,
+  HttpRequestHeaders::kAcceptLanguage,
+  HttpRequestHeaders::kIfModifiedSince,
+  HttpRequestHeaders::kIfNoneMatch,
+  HttpRequestHeaders::kRange,
+};
+
+// Whether a response may go to every request of the same key: it must be
+// fit for a shared cache, and vary by no header the key leaves out.
+bool IsShareableResponse(const HttpResponseHeaders& headers) {
+  if (!HttpResponseCache::IsShareableResponse(headers)) {
+    return false;
+  }
+
+  size_t iter = 0;
+  std::string name;
+  while (headers.EnumerateHeader(&iter, "vary", &name)) {
+    bool is_key_header = false;
+    for (const char* header : kKeyHeaders) {
+      if (base::EqualsCaseInsensitiveASCII(name, header)) {
+        is_key_header = true;
+        break;
+      }
+    }
+    if (!is_key_header) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+RequestCollapser::Fetch::Fetch(RequestCollapser* collapser,
+                               const std::string& key,
+                               base::WeakPtr<UpstreamGroup> upstream_group,
+                               size_t upstream_index)
+    : collapser_(collapser),
+      key_(key),
+      starter_(nullptr),
+      request_id_(kInvalidRequestId),
+      upstream_group_(upstream_group),
+      upstream_index_(upstream_index),
+      joinable_(true),
+      weak_factory_(this) {
+}
+
+RequestCollapser::Fetch::~Fetch() {
+  if (request_id_ != kInvalidRequestId) {
+    collapser_->http_fetcher_->Cancel(request_id_);
+  }
+
+  // the subscribers went away; not the backend's fault
+  if (upstream_group_) {
+    upstream_group_->Release(upstream_index_, true);
+  }
+}
+
+void RequestCollapser::Fetch::RemoveSubscriber(Subscriber* subscriber) {
+  if (subscriber == starter_) {
+    starter_ = nullptr;
+  }
+
+  subscribers_.erase(
+      std::remove_if(subscribers_.begin(), subscribers_.end(),
+                     [subscriber](const base::WeakPtr<Subscriber>& other) {
+                       return !other || other.get() == subscriber;
+                     }),
+      subscribers_.end());
+
+  if (subscribers_.empty()) {
+    collapser_->DeleteFetch(this);
+  }
+}
+
+void RequestCollapser::Fetch::OnTaskComplete(
+    int request_id,
+    const URLFetcher* source,
+    const HttpResponseInfo* response_info) {
+  NOTREACHED();
+}
+
+void RequestCollapser::Fetch::OnTaskHeader(
+    int request_id,
+    const URLFetcher* source,
+    const HttpResponseInfo* response_info) {
+  DCHECK_EQ(request_id, request_id_);
+
+  scoped_refptr<HttpResponseHeaders> headers;
+  if (source) {
+    headers = source->GetResponseHeaders();
+  }
+
+  if (!headers) {
+    // the cancel is posted, so the task outlives this call
+    collapser_->http_fetcher_->Cancel(request_id_);
+    OnTaskError(request_id, source, ERR_FAILED);
+    return;
+  }
+
+  if (!IsShareableResponse(*headers) && !DropJoinedSubscribers()) {
+    return;
+  }
+
+  headers_ = headers;
+  for (size_t i = 0; i < subscribers_.size(); ++i) {
+    if (subscribers_[i]) {
+      subscribers_[i]->OnCollapsedHeader(headers);
+    }
+  }
+}
+
+void RequestCollapser::Fetch::OnTaskStream(int request_id,
+                                           const char* data, size_t len,
+                                           bool fin) {
+  DCHECK_EQ(request_id, request_id_);
+
+  base::StringPiece chunk(data, len);
+  if (joinable_) {
+    if (body_.size() + len > kMaxReplayBytes) {
+      collapser_->CloseFetch(this);
+      std::string().swap(body_);
+    } else {
+      chunk.AppendToString(&body_);
+    }
+  }
+
+  for (size_t i = 0; i < subscribers_.size(); ++i) {
+    if (subscribers_[i]) {
+      subscribers_[i]->OnCollapsedStream(chunk, fin);
+    }
+  }
+
+  if (fin) {
+    // the task is done and releases itself
+    request_id_ = kInvalidRequestId;
+    Finish(true);
+  }
+}
+
+void RequestCollapser::Fetch::OnTaskError(int request_id,
+                                          const URLFetcher* source,
+                                          int error_code) {
+  DCHECK_EQ(request_id, request_id_);
+  request_id_ = kInvalidRequestId;
+
+  for (size_t i = 0; i < subscribers_.size(); ++i) {
+    if (subscribers_[i]) {
+      subscribers_[i]->OnCollapsedError();
+    }
+  }
+  Finish(false);
+}
+
+void RequestCollapser::Fetch::AddSubscriber(
+    base::WeakPtr<Subscriber> subscriber) {
+  DCHECK(joinable_);
+  if (headers_) {
+    subscriber->OnCollapsedHeader(headers_);
+    if (!body_.empty()) {
+      subscriber->OnCollapsedStream(body_, false);
+    }
+  }
+  subscribers_.push_back(subscriber);
+}
+
+bool RequestCollapser::Fetch::DropJoinedSubscribers() {
+  collapser_->CloseFetch(this);
+
+  std::vector<base::WeakPtr<Subscriber>> starter;
+  std::vector<base::WeakPtr<Subscriber>> joined;
+  for (size_t i = 0; i < subscribers_.size(); ++i) {
+    if (!subscribers_[i]) {
+      continue;
+    }
+    if (subscribers_[i].get() == starter_) {
+      starter.push_back(subscribers_[i]);
+    } else {
+      joined.push_back(subscribers_[i]);
+    }
+  }
+  subscribers_.swap(starter);
+
+  // the retries may start fetches of their own, so let go of this one first
+  bool deleted = subscribers_.empty();
+  if (deleted) {
+    collapser_->DeleteFetch(this);
+  }
+
+  for (size_t i = 0; i < joined.size(); ++i) {
+    if (joined[i]) {
+      joined[i]->OnCollapsedRetry();
+    }
+  }
+  return !deleted;
+}
+
+void RequestCollapser::Fetch::Finish(bool success) {
+  if (upstream_group_) {
+    upstream_group_->Release(upstream_index_, success);
+    upstream_group_.reset();
+  }
+  collapser_->DeleteFetch(this);
+}
+
+RequestCollapser::RequestCollapser(stellite::HttpFetcher* http_fetcher)
+    : http_fetcher_(http_fetcher) {
+}
+
+RequestCollapser::~RequestCollapser() {}
+
+// static
+std::string RequestCollapser::GetKey(
+    const std::string& resource,
+    const HttpRequestHeaders& request_headers) {
+  for (const char* header : kPersonalHeaders) {
+    if (request_headers.HasHeader(header)) {
+      return std::string();
+    }
+  }
+
+  std::string key = resource;
+  for (const char* header : kKeyHeaders) {
+    std::string value;
+    request_headers.GetHeader(header, &value);
+    key.append("\n");
+    key.append(value);
+  }
+  return key;
+}
+
+base::WeakPtr<RequestCollapser::Fetch> RequestCollapser::Join(
+    const std::string& key,
+    base::WeakPtr<Subscriber> subscriber) {
+  std::map<std::string, Fetch*>::iterator it = joinable_fetches_.find(key);
+  if (it == joinable_fetches_.end()) {
+    return base::WeakPtr<Fetch>();
+  }
+
+  Fetch* fetch = it->second;
+  fetch->AddSubscriber(subscriber);
+  return fetch->weak_factory_.GetWeakPtr();
+}
+
+base::WeakPtr<RequestCollapser::Fetch> RequestCollapser::Start(
+    const std::string& key,
+    const stellite::HttpRequest& request,
+    int64_t timeout,
+    base::WeakPtr<UpstreamGroup> upstream_group,
+    size_t upstream_index,
+    base::WeakPtr<Subscriber> subscriber) {
+  Fetch* fetch = new Fetch(this, key, upstream_group, upstream_index);
+  fetches_[fetch] = std::unique_ptr<Fetch>(fetch);
+
+  // a fetch already running for |key| stays with its subscribers
+  joinable_fetches_[key] = fetch;
+
+  fetch->starter_ = subscriber.get();
+  fetch->subscribers_.push_back(subscriber);
+  fetch->request_id_ = http_fetcher_->Request(
+      request, timeout, fetch->weak_factory_.GetWeakPtr());
+  return fetch->weak_factory_.GetWeakPtr();
+}
+
+void RequestCollapser::CloseFetch(Fetch* fetch) {
+  fetch->joinable_ = false;
+
+  std::map<std::string, Fetch*>::iterator it =
+      joinable_fetches_.find(fetch->key_);
+  if (it != joinable_fetches_.end() && it->second == fetch) {
+    joinable_fetches_.erase(it);
+  }
+}
+
+void RequestCollapser::DeleteFetch(Fetch* fetch) {
+  CloseFetch(fetch);
+  fetches_.erase(fetch);
+}
+
+}  // namespace net
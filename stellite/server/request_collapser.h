@@ -0,0 +1,187 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_SERVER_REQUEST_COLLAPSER_H_
+#define STELLITE_SERVER_REQUEST_COLLAPSER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/memory/ref_counted.h"
+#include "base/memory/weak_ptr.h"
+#include "base/strings/string_piece.h"
+#include "net/base/net_export.h"
+#include "stellite/fetcher/http_fetcher_task.h"
+
+namespace stellite {
+class HttpFetcher;
+struct HttpRequest;
+}
+
+namespace net {
+
+class HttpRequestHeaders;
+class HttpResponseHeaders;
+class UpstreamGroup;
+
+// Lets concurrent GET requests for the same resource share one backend
+// fetch, so that a burst of clients asking for a hot URL costs the backend a
+// single request. The response is fanned out to every stream subscribed to
+// the fetch. A stream joining after the response started gets the headers
+// and the body received so far replayed first, as long as the body seen is
+// small enough to be kept. A response meant for its client alone, like one
+// setting a cookie, only goes to the stream that started the fetch; the
+// streams that joined send requests of their own.
+//
+// Lives on the dispatch thread, next to the HttpFetcher it sends with.
+class NET_EXPORT RequestCollapser {
+ public:
+  // Receives the response of a collapsed fetch.
+  class NET_EXPORT Subscriber {
+   public:
+    virtual ~Subscriber() {}
+
+    virtual void OnCollapsedHeader(
+        scoped_refptr<HttpResponseHeaders> headers) = 0;
+    virtual void OnCollapsedStream(base::StringPiece data, bool fin) = 0;
+    virtual void OnCollapsedError() = 0;
+
+    // The response may not be shared, so a subscriber that joined the fetch
+    // has to send a request of its own. It is no longer subscribed.
+    virtual void OnCollapsedRetry() = 0;
+  };
+
+  // A backend fetch shared by its subscribers. Deletes itself through the
+  // collapser once the response is done or every subscriber left.
+  class NET_EXPORT Fetch : public stellite::HttpFetcherTask::Visitor {
+   public:
+    ~Fetch() override;
+
+    // Stops delivering to |subscriber|. The backend request is cancelled
+    // when nobody is left.
+    void RemoveSubscriber(Subscriber* subscriber);
+
+    // implements HttpFetcherTask::Visitor
+    void OnTaskComplete(int request_id,
+                        const URLFetcher* source,
+                        const HttpResponseInfo* response_info) override;
+    void OnTaskHeader(int request_id,
+                      const URLFetcher* source,
+                      const HttpResponseInfo* response_info) override;
+    void OnTaskStream(int request_id,
+                      const char* data, size_t len, bool fin) override;
+    void OnTaskError(int request_id,
+                     const URLFetcher* source,
+                     int error_code) override;
+
+   private:
+    friend class RequestCollapser;
+
+    Fetch(RequestCollapser* collapser,
+          const std::string& key,
+          base::WeakPtr<UpstreamGroup> upstream_group,
+          size_t upstream_index);
+
+    // Replays the response received so far to |subscriber| and adds it.
+    void AddSubscriber(base::WeakPtr<Subscriber> subscriber);
+
+    // Hands the subscribers that joined a response that may not be shared
+    // back to send their own requests. Returns false if the fetch was
+    // deleted since nobody is left.
+    bool DropJoinedSubscribers();
+
+    // Ends the backend request and hands the fetch back to the collapser to
+    // be deleted. Nothing may touch the fetch after this.
+    void Finish(bool success);
+
+    RequestCollapser* collapser_;
+    const std::string key_;
+
+    // The subscriber that started the fetch, while it is subscribed.
+    Subscriber* starter_;
+
+    int request_id_;
+
+    // The origin the request went to, released when the fetch ends.
+    base::WeakPtr<UpstreamGroup> upstream_group_;
+    size_t upstream_index_;
+
+    // What late subscribers are replayed. |body_| is dropped, and no one
+    // may join anymore, once it grows over the replay limit.
+    scoped_refptr<HttpResponseHeaders> headers_;
+    std::string body_;
+    bool joinable_;
+
+    std::vector<base::WeakPtr<Subscriber>> subscribers_;
+
+    base::WeakPtrFactory<Fetch> weak_factory_;
+
+    DISALLOW_COPY_AND_ASSIGN(Fetch);
+  };
+
+  // Sends with |http_fetcher|, which must outlive the collapser.
+  explicit RequestCollapser(stellite::HttpFetcher* http_fetcher);
+  ~RequestCollapser();
+
+  // Identifies a GET of |resource| with |request_headers|, or returns an
+  // empty key if the request is personal to its client and must get its
+  // own fetch. The key covers the headers the response may be negotiated
+  // by.
+  static std::string GetKey(const std::string& resource,
+                            const HttpRequestHeaders& request_headers);
+
+  // Subscribes to the fetch of |key| if there is one to join, replaying
+  // its response so far. Returns null otherwise.
+  base::WeakPtr<Fetch> Join(const std::string& key,
+                            base::WeakPtr<Subscriber> subscriber);
+
+  // Sends |request| to the backend for |subscriber| and for whoever joins
+  // later. The fetch releases the origin |upstream_index| of
+  // |upstream_group| when it ends.
+  base::WeakPtr<Fetch> Start(const std::string& key,
+                             const stellite::HttpRequest& request,
+                             int64_t timeout,
+                             base::WeakPtr<UpstreamGroup> upstream_group,
+                             size_t upstream_index,
+                             base::WeakPtr<Subscriber> subscriber);
+
+  // Number of fetches in flight.
+  size_t size() const { return fetches_.size(); }
+
+ private:
+  typedef std::map<Fetch*, std::unique_ptr<Fetch>> FetchMap;
+
+  // Stops |fetch| from taking new subscribers.
+  void CloseFetch(Fetch* fetch);
+  void DeleteFetch(Fetch* fetch);
+
+  stellite::HttpFetcher* http_fetcher_;
+
+  FetchMap fetches_;
+
+  // Fetches new requests may join, by key.
+  std::map<std::string, Fetch*> joinable_fetches_;
+
+  DISALLOW_COPY_AND_ASSIGN(RequestCollapser);
+};
+
+}  // namespace net
+
+#endif  // STELLITE_SERVER_REQUEST_COLLAPSER_H_
@@ -0,0 +1,326 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/request_collapser.h"
+
+#include <memory>
+#include <string>
+
+#include "base/callback_helpers.h"
+#include "base/memory/weak_ptr.h"
+#include "base/run_loop.h"
+#include "base/strings/stringprintf.h"
+#include "base/threading/thread_task_runner_handle.h"
+#include "net/http/http_request_headers.h"
+#include "net/http/http_response_headers.h"
+#include "net/server/http_server_request_info.h"
+#include "net/socket/tcp_server_socket.h"
+#include "stellite/fetcher/http_fetcher.h"
+#include "stellite/fetcher/http_request_context_getter.h"
+#include "stellite/include/http_request.h"
+#include "stellite/server/test_tools/simple_http_server.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+
+namespace {
+
+const int64_t kTimeout = 10 * 1000;
+const char kKey[] = "www.example.com/hot";
+
+class TestSubscriber : public RequestCollapser::Subscriber {
+ public:
+  TestSubscriber()
+      : response_code_(0),
+        finished_(false),
+        error_(false),
+        retried_(false),
+        weak_factory_(this) {
+  }
+
+  // Runs until the next body chunk, the end of the response, an error or a
+  // retry.
+  void Wait() {
+    base::RunLoop run_loop;
+    quit_closure_ = run_loop.QuitClosure();
+    run_loop.Run();
+  }
+
+  void WaitForFinish() {
+    while (!finished_ && !error_) {
+      Wait();
+    }
+  }
+
+  // implements RequestCollapser::Subscriber
+  void OnCollapsedHeader(scoped_refptr<HttpResponseHeaders> headers) override {
+    response_code_ = headers->response_code();
+  }
+
+  void OnCollapsedStream(base::StringPiece data, bool fin) override {
+    data.AppendToString(&body_);
+    finished_ = fin;
+    Quit();
+  }
+
+  void OnCollapsedError() override {
+    error_ = true;
+    Quit();
+  }
+
+  void OnCollapsedRetry() override {
+    retried_ = true;
+    Quit();
+  }
+
+  base::WeakPtr<RequestCollapser::Subscriber> GetWeakPtr() {
+    return weak_factory_.GetWeakPtr();
+  }
+
+  int response_code() const { return response_code_; }
+  const std::string& body() const { return body_; }
+  bool finished() const { return finished_; }
+  bool error() const { return error_; }
+  bool retried() const { return retried_; }
+
+ private:
+  void Quit() {
+    if (!quit_closure_.is_null()) {
+      base::ResetAndReturn(&quit_closure_).Run();
+    }
+  }
+
+  int response_code_;
+  std::string body_;
+  bool finished_;
+  bool error_;
+  bool retried_;
+
+  base::Closure quit_closure_;
+
+  base::WeakPtrFactory<TestSubscriber> weak_factory_;
+};
+
+}  // namespace
+
+class RequestCollapserTest : public testing::Test,
+                             public SimpleHttpServer::Delegate {
+ public:
+  RequestCollapserTest()
+      : backend_request_count_(0),
+        backend_connection_id_(-1) {
+  }
+
+  void SetUp() override {
+    context_getter_ = new stellite::HttpRequestContextGetter(
+        stellite::HttpRequestContextGetter::Params(),
+        base::ThreadTaskRunnerHandle::Get());
+    fetcher_.reset(new stellite::HttpFetcher(context_getter_));
+    collapser_.reset(new RequestCollapser(fetcher_.get()));
+
+    std::unique_ptr<ServerSocket> server_socket(
+        new TCPServerSocket(nullptr, NetLogSource()));
+    server_socket->ListenWithAddressAndPort("127.0.0.1", 0, 1);
+    http_server_.reset(new SimpleHttpServer(std::move(server_socket), this));
+    http_server_->GetLocalAddress(&server_address_);
+  }
+
+  // implements SimpleHttpServer::Delegate; responses are sent by the tests
+  void OnConnect(int connection_id) override {}
+  void OnClose(int connection_id) override {}
+  void OnHttpRequest(int connection_id,
+                     const HttpServerRequestInfo& request) override {
+    ++backend_request_count_;
+    backend_connection_id_ = connection_id;
+    if (!backend_quit_closure_.is_null()) {
+      base::ResetAndReturn(&backend_quit_closure_).Run();
+    }
+  }
+
+  base::WeakPtr<RequestCollapser::Fetch> Start(TestSubscriber* subscriber) {
+    stellite::HttpRequest request;
+    request.url = base::StringPrintf("http://127.0.0.1:%d/hot",
+                                     server_address_.port());
+    request.request_type = stellite::HttpRequest::GET;
+    request.is_stream_response = true;
+    return collapser_->Start(kKey, request, kTimeout,
+                             base::WeakPtr<UpstreamGroup>(),
+                             0, subscriber->GetWeakPtr());
+  }
+
+  void WaitForBackendRequest() {
+    base::RunLoop run_loop;
+    backend_quit_closure_ = run_loop.QuitClosure();
+    run_loop.Run();
+  }
+
+  void SendBackend(const std::string& data) {
+    http_server_->SendRaw(backend_connection_id_, data);
+  }
+
+ protected:
+  scoped_refptr<stellite::HttpRequestContextGetter> context_getter_;
+  std::unique_ptr<stellite::HttpFetcher> fetcher_;
+  std::unique_ptr<RequestCollapser> collapser_;
+
+  std::unique_ptr<SimpleHttpServer> http_server_;
+  IPEndPoint server_address_;
+
+  int backend_request_count_;
+  int backend_connection_id_;
+  base::Closure backend_quit_closure_;
+};
+
+TEST_F(RequestCollapserTest, GetKey) {
+  HttpRequestHeaders request_headers;
+  request_headers.SetHeader(HttpRequestHeaders::kAcceptEncoding, "gzip");
+  std::string key = RequestCollapser::GetKey(kKey, request_headers);
+  EXPECT_FALSE(key.empty());
+
+  // Negotiated headers tell requests apart, others don't.
+  HttpRequestHeaders other_headers;
+  other_headers.CopyFrom(request_headers);
+  other_headers.SetHeader(HttpRequestHeaders::kUserAgent, "test");
+  EXPECT_EQ(key, RequestCollapser::GetKey(kKey, other_headers));
+
+  other_headers.SetHeader(HttpRequestHeaders::kAcceptEncoding, "br");
+  EXPECT_NE(key, RequestCollapser::GetKey(kKey, other_headers));
+
+  // Personal requests are never collapsed.
+  other_headers.SetHeader(HttpRequestHeaders::kCookie, "a=b");
+  EXPECT_TRUE(RequestCollapser::GetKey(kKey, other_headers).empty());
+}
+
+TEST_F(RequestCollapserTest, ShareFetch) {
+  TestSubscriber first;
+  TestSubscriber second;
+
+  EXPECT_FALSE(collapser_->Join(kKey, first.GetWeakPtr()));
+  EXPECT_TRUE(Start(&first));
+  WaitForBackendRequest();
+
+  // Joins before the response starts.
+  EXPECT_TRUE(collapser_->Join(kKey, second.GetWeakPtr()));
+  EXPECT_EQ(1u, collapser_->size());
+
+  SendBackend("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello");
+  first.WaitForFinish();
+  second.WaitForFinish();
+
+  EXPECT_EQ(1, backend_request_count_);
+  EXPECT_EQ(200, first.response_code());
+  EXPECT_EQ("hello", first.body());
+  EXPECT_EQ(200, second.response_code());
+  EXPECT_EQ("hello", second.body());
+
+  // Done fetches are gone.
+  EXPECT_EQ(0u, collapser_->size());
+  EXPECT_FALSE(collapser_->Join(kKey, second.GetWeakPtr()));
+}
+
+TEST_F(RequestCollapserTest, JoinMidStream) {
+  TestSubscriber first;
+  TestSubscriber late;
+
+  Start(&first);
+  WaitForBackendRequest();
+
+  SendBackend("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nhello");
+  first.Wait();
+  ASSERT_EQ("hello", first.body());
+
+  // The late subscriber is replayed what arrived so far.
+  EXPECT_TRUE(collapser_->Join(kKey, late.GetWeakPtr()));
+  EXPECT_EQ(200, late.response_code());
+  EXPECT_EQ("hello", late.body());
+
+  SendBackend("world");
+  first.WaitForFinish();
+  late.WaitForFinish();
+
+  EXPECT_EQ(1, backend_request_count_);
+  EXPECT_EQ("helloworld", first.body());
+  EXPECT_EQ("helloworld", late.body());
+}
+
+TEST_F(RequestCollapserTest, PersonalResponseGoesToStarterOnly) {
+  TestSubscriber first;
+  TestSubscriber second;
+
+  Start(&first);
+  WaitForBackendRequest();
+  EXPECT_TRUE(collapser_->Join(kKey, second.GetWeakPtr()));
+
+  SendBackend("HTTP/1.1 200 OK\r\nSet-Cookie: session=first\r\n"
+              "Content-Length: 5\r\n\r\nhello");
+  first.WaitForFinish();
+
+  EXPECT_EQ(200, first.response_code());
+  EXPECT_EQ("hello", first.body());
+
+  // The joiner is sent back to fetch for itself, and saw nothing.
+  EXPECT_TRUE(second.retried());
+  EXPECT_EQ(0, second.response_code());
+  EXPECT_TRUE(second.body().empty());
+  EXPECT_EQ(0u, collapser_->size());
+}
+
+TEST_F(RequestCollapserTest, PersonalResponseAfterStarterLeft) {
+  TestSubscriber first;
+  TestSubscriber second;
+
+  base::WeakPtr<RequestCollapser::Fetch> fetch = Start(&first);
+  WaitForBackendRequest();
+  EXPECT_TRUE(collapser_->Join(kKey, second.GetWeakPtr()));
+  fetch->RemoveSubscriber(&first);
+  ASSERT_TRUE(fetch);
+
+  // Nobody is left to take the response.
+  SendBackend("HTTP/1.1 200 OK\r\nCache-Control: private\r\n"
+              "Content-Length: 5\r\n\r\nhello");
+  second.Wait();
+  EXPECT_TRUE(second.retried());
+  EXPECT_FALSE(fetch);
+  EXPECT_EQ(0, second.response_code());
+  EXPECT_EQ(0u, collapser_->size());
+}
+
+TEST_F(RequestCollapserTest, VaryOutsideKey) {
+  TestSubscriber first;
+  TestSubscriber second;
+
+  Start(&first);
+  WaitForBackendRequest();
+  EXPECT_TRUE(collapser_->Join(kKey, second.GetWeakPtr()));
+
+  SendBackend("HTTP/1.1 200 OK\r\nVary: User-Agent\r\n"
+              "Content-Length: 5\r\n\r\nhello");
+  first.WaitForFinish();
+  EXPECT_EQ("hello", first.body());
+  EXPECT_TRUE(second.retried());
+}
+
+TEST_F(RequestCollapserTest, LastSubscriberLeaves) {
+  TestSubscriber first;
+
+  base::WeakPtr<RequestCollapser::Fetch> fetch = Start(&first);
+  WaitForBackendRequest();
+
+  fetch->RemoveSubscriber(&first);
+  EXPECT_FALSE(fetch);
+  EXPECT_EQ(0u, collapser_->size());
+  EXPECT_FALSE(collapser_->Join(kKey, first.GetWeakPtr()));
+}
+
+}  // namespace net
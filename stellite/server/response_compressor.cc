@@ -0,0 +1,477 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/response_compressor.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+#include "base/logging.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
+#include "base/strings/string_util.h"
+#include "base/time/time.h"
+#include "net/http/http_response_headers.h"
+#include "net/http/http_util.h"
+#include "third_party/zlib/zlib.h"
+
+#if defined(STELLITE_ENABLE_BROTLI_ENCODER)
+#include "third_party/brotli/include/brotli/encode.h"
+#endif
+
+namespace net {
+
+namespace {
+
+const size_t kOutputChunkSize = 16 * 1024;
+
+// Compressors kept per encoding for the next streams.
+const size_t kMaxIdleCompressors = 16;
+
+// Bodies known to be shorter than this gain nothing from compression.
+const int64_t kMinCompressLength = 256;
+
+// Decides when the chunks fed to a compressor are flushed to the client.
+class FlushSchedule {
+ public:
+  FlushSchedule() : unflushed_(0) {}
+
+  // Adds |length| bytes of input and returns true if the output should be
+  // flushed.
+  bool AddInput(size_t length) {
+    base::TimeTicks now = base::TimeTicks::Now();
+    if (last_flush_.is_null()) {
+      last_flush_ = now;
+    }
+
+    unflushed_ += length;
+    if (unflushed_ < ResponseCompressor::kFlushThreshold &&
+        now - last_flush_ < base::TimeDelta::FromMilliseconds(
+            ResponseCompressor::kMaxFlushDelayMs)) {
+      return false;
+    }
+
+    unflushed_ = 0;
+    last_flush_ = now;
+    return true;
+  }
+
+  // Records a flush forced before the schedule asked for one.
+  void OnFlush() {
+    unflushed_ = 0;
+    last_flush_ = base::TimeTicks::Now();
+  }
+
+  bool has_unflushed_input() const { return unflushed_ > 0; }
+
+  void Reset() {
+    unflushed_ = 0;
+    last_flush_ = base::TimeTicks();
+  }
+
+ private:
+  size_t unflushed_;
+  base::TimeTicks last_flush_;
+};
+
+class GzipCompressor : public ResponseCompressor {
+ public:
+  GzipCompressor(int level, int window_bits)
+      : initialized_(false) {
+    memset(&stream_, 0, sizeof(stream_));
+
+    // 16 more window bits ask for the gzip wrapper
+    initialized_ = deflateInit2(&stream_, level, Z_DEFLATED, window_bits + 16,
+                                window_bits - 7, Z_DEFAULT_STRATEGY) == Z_OK;
+  }
+
+  ~GzipCompressor() override {
+    if (initialized_) {
+      deflateEnd(&stream_);
+    }
+  }
+
+  bool Compress(base::StringPiece data, bool fin,
+                std::string* output) override {
+    if (!initialized_) {
+      return false;
+    }
+
+    if (data.empty() && !fin) {
+      return true;
+    }
+
+    int flush = Z_NO_FLUSH;
+    if (fin) {
+      flush = Z_FINISH;
+    } else if (flush_schedule_.AddInput(data.size())) {
+      flush = Z_SYNC_FLUSH;
+    }
+    return Deflate(data, flush, output);
+  }
+
+  bool Flush(std::string* output) override {
+    if (!initialized_) {
+      return false;
+    }
+
+    if (!flush_schedule_.has_unflushed_input()) {
+      return true;
+    }
+
+    flush_schedule_.OnFlush();
+    return Deflate(base::StringPiece(), Z_SYNC_FLUSH, output);
+  }
+
+  bool HasUnflushedInput() const override {
+    return flush_schedule_.has_unflushed_input();
+  }
+
+  void Reset() override {
+    if (initialized_) {
+      initialized_ = deflateReset(&stream_) == Z_OK;
+    }
+    flush_schedule_.Reset();
+  }
+
+  Encoding encoding() const override {
+    return ENCODING_GZIP;
+  }
+
+ private:
+  bool Deflate(base::StringPiece data, int flush, std::string* output) {
+    stream_.next_in =
+        reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    stream_.avail_in = static_cast<uInt>(data.size());
+
+    do {
+      char buffer[kOutputChunkSize];
+      stream_.next_out = reinterpret_cast<Bytef*>(buffer);
+      stream_.avail_out = sizeof(buffer);
+
+      // Z_BUF_ERROR only means nothing was left to do
+      if (deflate(&stream_, flush) == Z_STREAM_ERROR) {
+        return false;
+      }
+      output->append(buffer, sizeof(buffer) - stream_.avail_out);
+    } while (stream_.avail_out == 0);
+
+    DCHECK_EQ(stream_.avail_in, 0u);
+    return true;
+  }
+
+  z_stream stream_;
+  bool initialized_;
+  FlushSchedule flush_schedule_;
+
+  DISALLOW_COPY_AND_ASSIGN(GzipCompressor);
+};
+
+#if defined(STELLITE_ENABLE_BROTLI_ENCODER)
+class BrotliCompressor : public ResponseCompressor {
+ public:
+  BrotliCompressor(int level, int window_bits)
+      : level_(level),
+        window_bits_(std::max(window_bits, BROTLI_MIN_WINDOW_BITS)),
+        state_(nullptr) {
+    CreateState();
+  }
+
+  ~BrotliCompressor() override {
+    if (state_) {
+      BrotliEncoderDestroyInstance(state_);
+    }
+  }
+
+  bool Compress(base::StringPiece data, bool fin,
+                std::string* output) override {
+    if (!state_) {
+      return false;
+    }
+
+    if (data.empty() && !fin) {
+      return true;
+    }
+
+    BrotliEncoderOperation operation = BROTLI_OPERATION_PROCESS;
+    if (fin) {
+      operation = BROTLI_OPERATION_FINISH;
+    } else if (flush_schedule_.AddInput(data.size())) {
+      operation = BROTLI_OPERATION_FLUSH;
+    }
+    return CompressStream(data, operation, output);
+  }
+
+  bool Flush(std::string* output) override {
+    if (!state_) {
+      return false;
+    }
+
+    if (!flush_schedule_.has_unflushed_input()) {
+      return true;
+    }
+
+    flush_schedule_.OnFlush();
+    return CompressStream(base::StringPiece(), BROTLI_OPERATION_FLUSH,
+                          output);
+  }
+
+  bool HasUnflushedInput() const override {
+    return flush_schedule_.has_unflushed_input();
+  }
+
+  // the encoder has no reset; a new state costs no more than resetting it
+  void Reset() override {
+    if (state_) {
+      BrotliEncoderDestroyInstance(state_);
+    }
+    CreateState();
+    flush_schedule_.Reset();
+  }
+
+  Encoding encoding() const override {
+    return ENCODING_BROTLI;
+  }
+
+ private:
+  bool CompressStream(base::StringPiece data,
+                      BrotliEncoderOperation operation,
+                      std::string* output) {
+    const uint8_t* next_in = reinterpret_cast<const uint8_t*>(data.data());
+    size_t available_in = data.size();
+    do {
+      uint8_t buffer[kOutputChunkSize];
+      uint8_t* next_out = buffer;
+      size_t available_out = sizeof(buffer);
+      if (!BrotliEncoderCompressStream(state_, operation, &available_in,
+                                       &next_in, &available_out, &next_out,
+                                       nullptr)) {
+        return false;
+      }
+      output->append(reinterpret_cast<const char*>(buffer),
+                     sizeof(buffer) - available_out);
+    } while (available_in > 0 || BrotliEncoderHasMoreOutput(state_));
+
+    return true;
+  }
+
+  void CreateState() {
+    state_ = BrotliEncoderCreateInstance(nullptr, nullptr, nullptr);
+    if (!state_) {
+      return;
+    }
+    BrotliEncoderSetParameter(state_, BROTLI_PARAM_QUALITY, level_);
+    BrotliEncoderSetParameter(state_, BROTLI_PARAM_LGWIN, window_bits_);
+    BrotliEncoderSetParameter(state_, BROTLI_PARAM_MODE, BROTLI_MODE_TEXT);
+  }
+
+  int level_;
+  int window_bits_;
+  BrotliEncoderState* state_;
+  FlushSchedule flush_schedule_;
+
+  DISALLOW_COPY_AND_ASSIGN(BrotliCompressor);
+};
+#endif  // defined(STELLITE_ENABLE_BROTLI_ENCODER)
+
+// The q-value of one accept-encoding element; 1 when absent.
+double GetQValue(const std::vector<base::StringPiece>& params) {
+  for (size_t i = 1; i < params.size(); ++i) {
+    base::StringPiece param = params[i];
+    if (param.size() < 2 ||
+        !base::EqualsCaseInsensitiveASCII(param.substr(0, 2), "q=")) {
+      continue;
+    }
+
+    double q_value = 0;
+    if (!base::StringToDouble(param.substr(2).as_string(), &q_value)) {
+      return 0;
+    }
+    return q_value;
+  }
+  return 1;
+}
+
+}  // anonymous namespace
+
+// static
+const size_t ResponseCompressor::kFlushThreshold;
+const int64_t ResponseCompressor::kMaxFlushDelayMs;
+
+// static
+const char* ResponseCompressor::GetEncodingName(Encoding encoding) {
+  switch (encoding) {
+    case ENCODING_GZIP:
+      return "gzip";
+    case ENCODING_BROTLI:
+      return "br";
+    case ENCODING_NONE:
+      break;
+  }
+  return "identity";
+}
+
+// static
+bool ResponseCompressor::IsBrotliSupported() {
+#if defined(STELLITE_ENABLE_BROTLI_ENCODER)
+  return true;
+#else
+  return false;
+#endif
+}
+
+ResponseCompressorPool::ResponseCompressorPool(
+    int gzip_level, int brotli_level, int window_bits,
+    const std::vector<std::string>& mime_types)
+    : gzip_level_(gzip_level),
+      brotli_level_(brotli_level),
+      window_bits_(window_bits),
+      mime_types_(mime_types) {
+  if (brotli_level_ > 0 && !ResponseCompressor::IsBrotliSupported()) {
+    LOG(WARNING) << "brotli encoding is not built in, brotli is disabled";
+    brotli_level_ = 0;
+  }
+
+  for (std::string& mime_type : mime_types_) {
+    mime_type = base::ToLowerASCII(mime_type);
+  }
+}
+
+ResponseCompressorPool::~ResponseCompressorPool() {}
+
+ResponseCompressor::Encoding ResponseCompressorPool::ChooseEncoding(
+    const std::string& accept_encoding) const {
+  bool accepts_gzip = false;
+  bool accepts_brotli = false;
+
+  HttpUtil::ValuesIterator it(accept_encoding.begin(), accept_encoding.end(),
+                              ',');
+  while (it.GetNext()) {
+    std::vector<base::StringPiece> params = base::SplitStringPiece(
+        it.value_piece(), ";", base::TRIM_WHITESPACE,
+        base::SPLIT_WANT_NONEMPTY);
+    if (params.empty() || GetQValue(params) <= 0) {
+      continue;
+    }
+
+    base::StringPiece coding = params[0];
+    if (base::EqualsCaseInsensitiveASCII(coding, "gzip") ||
+        base::EqualsCaseInsensitiveASCII(coding, "x-gzip") ||
+        coding == "*") {
+      accepts_gzip = true;
+    }
+    if (base::EqualsCaseInsensitiveASCII(coding, "br")) {
+      accepts_brotli = true;
+    }
+  }
+
+  if (accepts_brotli && brotli_level_ > 0) {
+    return ResponseCompressor::ENCODING_BROTLI;
+  }
+  if (accepts_gzip && gzip_level_ > 0) {
+    return ResponseCompressor::ENCODING_GZIP;
+  }
+  return ResponseCompressor::ENCODING_NONE;
+}
+
+bool ResponseCompressorPool::ShouldCompress(
+    const HttpResponseHeaders& headers) const {
+  // no body, or a part of one
+  int response_code = headers.response_code();
+  if (response_code < 200 || response_code == 204 || response_code == 206 ||
+      response_code == 304) {
+    return false;
+  }
+
+  if (headers.HasHeaderValue("cache-control", "no-transform")) {
+    return false;
+  }
+
+  int64_t content_length = headers.GetContentLength();
+  if (content_length >= 0 && content_length < kMinCompressLength) {
+    return false;
+  }
+
+  std::string mime_type;
+  if (!headers.GetMimeType(&mime_type)) {
+    return false;
+  }
+  mime_type = base::ToLowerASCII(mime_type);
+
+  for (const std::string& allowed : mime_types_) {
+    if (allowed == mime_type) {
+      return true;
+    }
+
+    // "text/*" takes any text
+    if (base::EndsWith(allowed, "/*", base::CompareCase::SENSITIVE) &&
+        base::StartsWith(mime_type, allowed.substr(0, allowed.size() - 1),
+                         base::CompareCase::SENSITIVE)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::unique_ptr<ResponseCompressor> ResponseCompressorPool::Acquire(
+    ResponseCompressor::Encoding encoding) {
+  std::vector<std::unique_ptr<ResponseCompressor>>* idle = nullptr;
+  switch (encoding) {
+    case ResponseCompressor::ENCODING_GZIP:
+      idle = &idle_gzip_;
+      break;
+    case ResponseCompressor::ENCODING_BROTLI:
+      idle = &idle_brotli_;
+      break;
+    case ResponseCompressor::ENCODING_NONE:
+      return nullptr;
+  }
+
+  if (!idle->empty()) {
+    std::unique_ptr<ResponseCompressor> compressor = std::move(idle->back());
+    idle->pop_back();
+    return compressor;
+  }
+
+  if (encoding == ResponseCompressor::ENCODING_GZIP) {
+    return std::unique_ptr<ResponseCompressor>(
+        new GzipCompressor(gzip_level_, window_bits_));
+  }
+
+#if defined(STELLITE_ENABLE_BROTLI_ENCODER)
+  return std::unique_ptr<ResponseCompressor>(
+      new BrotliCompressor(brotli_level_, window_bits_));
+#else
+  NOTREACHED();
+  return nullptr;
+#endif
+}
+
+void ResponseCompressorPool::Release(
+    std::unique_ptr<ResponseCompressor> compressor) {
+  std::vector<std::unique_ptr<ResponseCompressor>>* idle =
+      compressor->encoding() == ResponseCompressor::ENCODING_GZIP ?
+      &idle_gzip_ : &idle_brotli_;
+  if (idle->size() >= kMaxIdleCompressors) {
+    return;
+  }
+
+  compressor->Reset();
+  idle->push_back(std::move(compressor));
+}
+
+}  // namespace net
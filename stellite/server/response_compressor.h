@@ -0,0 +1,125 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_SERVER_RESPONSE_COMPRESSOR_H_
+#define STELLITE_SERVER_RESPONSE_COMPRESSOR_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/strings/string_piece.h"
+#include "net/base/net_export.h"
+
+namespace net {
+
+class HttpResponseHeaders;
+
+// Compresses a response body as it streams to the client. Every flush costs
+// a few bytes and restarts the block, so small chunks are gathered and the
+// output is flushed once kFlushThreshold bytes of input came in, or on the
+// first chunk kMaxFlushDelayMs after the last flush, and at the end. A
+// stream whose backend goes quiet calls Flush() kMaxFlushDelayMs after
+// leaving input unflushed, so the client isn't kept waiting for the next
+// chunk.
+class NET_EXPORT ResponseCompressor {
+ public:
+  enum Encoding {
+    ENCODING_NONE,
+    ENCODING_GZIP,
+    ENCODING_BROTLI,
+  };
+
+  static const size_t kFlushThreshold = 16 * 1024;
+  static const int64_t kMaxFlushDelayMs = 200;
+
+  virtual ~ResponseCompressor() {}
+
+  // Appends the compressed |data| to |output|. |fin| ends the stream.
+  // Returns false on a compressor error.
+  virtual bool Compress(base::StringPiece data, bool fin,
+                        std::string* output) = 0;
+
+  // Appends the output of the input gathered since the last flush to
+  // |output|. Returns false on a compressor error.
+  virtual bool Flush(std::string* output) = 0;
+
+  // Whether input was compressed but not flushed yet.
+  virtual bool HasUnflushedInput() const = 0;
+
+  // Readies the compressor for another stream.
+  virtual void Reset() = 0;
+
+  virtual Encoding encoding() const = 0;
+
+  // The content-encoding token of |encoding|.
+  static const char* GetEncodingName(Encoding encoding);
+
+  // Whether brotli was built in; see the stellite_enable_brotli_encoder GN
+  // argument.
+  static bool IsBrotliSupported();
+};
+
+// Hands out the compressors of a worker and keeps the ones given back for
+// the next streams, which saves setting up the compressor state on every
+// response. Compressor memory is bounded by |window_bits|: a gzip stream
+// holds about 2^(window_bits + 3) bytes.
+//
+// Lives on the dispatch thread.
+class NET_EXPORT ResponseCompressorPool {
+ public:
+  // A level of 0 disables the encoding. |mime_types| lists the content
+  // types compressed.
+  ResponseCompressorPool(int gzip_level, int brotli_level, int window_bits,
+                         const std::vector<std::string>& mime_types);
+  ~ResponseCompressorPool();
+
+  // The encoding to compress with for a request sent with
+  // |accept_encoding|, brotli first.
+  ResponseCompressor::Encoding ChooseEncoding(
+      const std::string& accept_encoding) const;
+
+  // Whether the body of the response with |headers| is worth compressing.
+  // A response already in a content-encoding is left to the caller.
+  bool ShouldCompress(const HttpResponseHeaders& headers) const;
+
+  std::unique_ptr<ResponseCompressor> Acquire(
+      ResponseCompressor::Encoding encoding);
+
+  // Takes back a compressor once its stream has ended.
+  void Release(std::unique_ptr<ResponseCompressor> compressor);
+
+  size_t idle_count() const {
+    return idle_gzip_.size() + idle_brotli_.size();
+  }
+
+ private:
+  int gzip_level_;
+  int brotli_level_;
+  int window_bits_;
+  std::vector<std::string> mime_types_;
+
+  std::vector<std::unique_ptr<ResponseCompressor>> idle_gzip_;
+  std::vector<std::unique_ptr<ResponseCompressor>> idle_brotli_;
+
+  DISALLOW_COPY_AND_ASSIGN(ResponseCompressorPool);
+};
+
+}  // namespace net
+
+#endif  // STELLITE_SERVER_RESPONSE_COMPRESSOR_H_
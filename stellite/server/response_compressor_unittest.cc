@@ -0,0 +1,262 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/response_compressor.h"
+
+#include <string.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "net/http/http_response_headers.h"
+#include "net/http/http_util.h"
+#include "testing/gtest/include/gtest/gtest.h"
+#include "third_party/zlib/zlib.h"
+
+namespace net {
+
+namespace {
+
+const int kGzipLevel = 6;
+const int kWindowBits = 15;
+
+scoped_refptr<HttpResponseHeaders> MakeHeaders(const std::string& headers) {
+  return new HttpResponseHeaders(
+      HttpUtil::AssembleRawHeaders(headers.c_str(), headers.size()));
+}
+
+bool Gunzip(const std::string& input, std::string* output) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit2(&stream, kWindowBits + 16) != Z_OK) {
+    return false;
+  }
+
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  stream.avail_in = static_cast<uInt>(input.size());
+
+  int result = Z_OK;
+  while (result == Z_OK) {
+    char buffer[4096];
+    stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream.avail_out = sizeof(buffer);
+    result = inflate(&stream, Z_NO_FLUSH);
+    output->append(buffer, sizeof(buffer) - stream.avail_out);
+  }
+  inflateEnd(&stream);
+  return result == Z_STREAM_END;
+}
+
+// Inflates the flushed part of a gzip stream that hasn't ended.
+bool GunzipFlushed(const std::string& input, std::string* output) {
+  z_stream stream;
+  memset(&stream, 0, sizeof(stream));
+  if (inflateInit2(&stream, kWindowBits + 16) != Z_OK) {
+    return false;
+  }
+
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  stream.avail_in = static_cast<uInt>(input.size());
+
+  int result = Z_OK;
+  while (result == Z_OK && stream.avail_in > 0) {
+    char buffer[4096];
+    stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream.avail_out = sizeof(buffer);
+    result = inflate(&stream, Z_SYNC_FLUSH);
+    output->append(buffer, sizeof(buffer) - stream.avail_out);
+  }
+  inflateEnd(&stream);
+  return result == Z_OK;
+}
+
+std::string MakeText(size_t size) {
+  std::string text;
+  while (text.size() < size) {
+    text += "stellite proxies QUIC requests to HTTP backends. ";
+  }
+  text.resize(size);
+  return text;
+}
+
+}  // namespace
+
+class ResponseCompressorTest : public testing::Test {
+ public:
+  ResponseCompressorTest()
+      : pool_(kGzipLevel, 0, kWindowBits,
+              std::vector<std::string>({"text/html", "application/*"})) {
+  }
+
+ protected:
+  ResponseCompressorPool pool_;
+};
+
+TEST_F(ResponseCompressorTest, ChooseEncoding) {
+  EXPECT_EQ(ResponseCompressor::ENCODING_GZIP,
+            pool_.ChooseEncoding("gzip, deflate"));
+  EXPECT_EQ(ResponseCompressor::ENCODING_GZIP,
+            pool_.ChooseEncoding("deflate;q=1.0, GZIP;q=0.5"));
+  EXPECT_EQ(ResponseCompressor::ENCODING_GZIP, pool_.ChooseEncoding("*"));
+  EXPECT_EQ(ResponseCompressor::ENCODING_NONE,
+            pool_.ChooseEncoding("gzip;q=0, deflate"));
+  EXPECT_EQ(ResponseCompressor::ENCODING_NONE,
+            pool_.ChooseEncoding("identity"));
+
+  // brotli is off in |pool_|
+  EXPECT_EQ(ResponseCompressor::ENCODING_GZIP,
+            pool_.ChooseEncoding("br, gzip"));
+  EXPECT_EQ(ResponseCompressor::ENCODING_NONE, pool_.ChooseEncoding("br"));
+
+  if (ResponseCompressor::IsBrotliSupported()) {
+    ResponseCompressorPool pool(kGzipLevel, 5, kWindowBits,
+                                std::vector<std::string>());
+    EXPECT_EQ(ResponseCompressor::ENCODING_BROTLI,
+              pool.ChooseEncoding("gzip, br"));
+    EXPECT_EQ(ResponseCompressor::ENCODING_GZIP,
+              pool.ChooseEncoding("gzip, br;q=0"));
+  }
+}
+
+TEST_F(ResponseCompressorTest, ShouldCompress) {
+  EXPECT_TRUE(pool_.ShouldCompress(*MakeHeaders(
+      "HTTP/1.1 200 OK\nContent-Type: text/html; charset=utf-8\n\n")));
+  EXPECT_TRUE(pool_.ShouldCompress(*MakeHeaders(
+      "HTTP/1.1 404 Not Found\nContent-Type: application/json\n\n")));
+
+  // not in the MIME types
+  EXPECT_FALSE(pool_.ShouldCompress(*MakeHeaders(
+      "HTTP/1.1 200 OK\nContent-Type: image/png\n\n")));
+  EXPECT_FALSE(pool_.ShouldCompress(*MakeHeaders("HTTP/1.1 200 OK\n\n")));
+
+  // no body, a part of one, or too short a body
+  EXPECT_FALSE(pool_.ShouldCompress(*MakeHeaders(
+      "HTTP/1.1 304 Not Modified\nContent-Type: text/html\n\n")));
+  EXPECT_FALSE(pool_.ShouldCompress(*MakeHeaders(
+      "HTTP/1.1 206 Partial Content\nContent-Type: text/html\n\n")));
+  EXPECT_FALSE(pool_.ShouldCompress(*MakeHeaders(
+      "HTTP/1.1 200 OK\nContent-Type: text/html\nContent-Length: 10\n\n")));
+
+  EXPECT_FALSE(pool_.ShouldCompress(*MakeHeaders(
+      "HTTP/1.1 200 OK\nContent-Type: text/html\n"
+      "Cache-Control: no-transform\n\n")));
+}
+
+TEST_F(ResponseCompressorTest, GzipStream) {
+  std::string body = MakeText(100 * 1024);
+  std::unique_ptr<ResponseCompressor> compressor =
+      pool_.Acquire(ResponseCompressor::ENCODING_GZIP);
+  ASSERT_TRUE(compressor);
+
+  std::string compressed;
+  const size_t kChunkSize = ResponseCompressor::kFlushThreshold;
+  for (size_t offset = 0; offset < body.size(); offset += kChunkSize) {
+    size_t before = compressed.size();
+    ASSERT_TRUE(compressor->Compress(
+        base::StringPiece(body).substr(offset, kChunkSize), false,
+        &compressed));
+
+    // a chunk of the flush threshold is flushed to the client
+    EXPECT_GT(compressed.size(), before);
+  }
+  ASSERT_TRUE(compressor->Compress(base::StringPiece(), true, &compressed));
+  EXPECT_LT(compressed.size(), body.size());
+
+  std::string decompressed;
+  ASSERT_TRUE(Gunzip(compressed, &decompressed));
+  EXPECT_EQ(body, decompressed);
+}
+
+TEST_F(ResponseCompressorTest, GzipGathersSmallChunks) {
+  std::string body = MakeText(8 * 1024);
+  std::unique_ptr<ResponseCompressor> compressor =
+      pool_.Acquire(ResponseCompressor::ENCODING_GZIP);
+
+  std::string whole;
+  ASSERT_TRUE(compressor->Compress(body, true, &whole));
+  compressor->Reset();
+
+  std::string compressed;
+  const size_t kChunkSize = 128;
+  for (size_t offset = 0; offset < body.size(); offset += kChunkSize) {
+    ASSERT_TRUE(compressor->Compress(
+        base::StringPiece(body).substr(offset, kChunkSize), false,
+        &compressed));
+  }
+  ASSERT_TRUE(compressor->Compress(base::StringPiece(), true, &compressed));
+
+  // A flush per chunk would add at least 5 bytes to each of the 64 chunks.
+  // Allow for a few flushes of the delay on a slow machine.
+  EXPECT_LT(compressed.size(), whole.size() + 64);
+
+  std::string decompressed;
+  ASSERT_TRUE(Gunzip(compressed, &decompressed));
+  EXPECT_EQ(body, decompressed);
+}
+
+TEST_F(ResponseCompressorTest, GzipFlushAfterSilence) {
+  std::unique_ptr<ResponseCompressor> compressor =
+      pool_.Acquire(ResponseCompressor::ENCODING_GZIP);
+
+  // A small event of a streamed response, then nothing for a while.
+  const std::string kEvent = "data: stellite\n\n";
+  std::string compressed;
+  ASSERT_TRUE(compressor->Compress(kEvent, false, &compressed));
+  EXPECT_TRUE(compressor->HasUnflushedInput());
+
+  std::string decompressed;
+  ASSERT_TRUE(GunzipFlushed(compressed, &decompressed));
+  EXPECT_TRUE(decompressed.empty());
+
+  // The stream flushes once the delay passed without more input.
+  ASSERT_TRUE(compressor->Flush(&compressed));
+  EXPECT_FALSE(compressor->HasUnflushedInput());
+  ASSERT_TRUE(GunzipFlushed(compressed, &decompressed));
+  EXPECT_EQ(kEvent, decompressed);
+
+  // Nothing more to flush.
+  size_t flushed_size = compressed.size();
+  ASSERT_TRUE(compressor->Flush(&compressed));
+  EXPECT_EQ(flushed_size, compressed.size());
+
+  ASSERT_TRUE(compressor->Compress(base::StringPiece(), true, &compressed));
+  decompressed.clear();
+  ASSERT_TRUE(Gunzip(compressed, &decompressed));
+  EXPECT_EQ(kEvent, decompressed);
+}
+
+TEST_F(ResponseCompressorTest, ReuseReleased) {
+  std::unique_ptr<ResponseCompressor> compressor =
+      pool_.Acquire(ResponseCompressor::ENCODING_GZIP);
+  std::string first;
+  ASSERT_TRUE(compressor->Compress("first response", true, &first));
+
+  ResponseCompressor* released = compressor.get();
+  pool_.Release(std::move(compressor));
+  EXPECT_EQ(1u, pool_.idle_count());
+
+  compressor = pool_.Acquire(ResponseCompressor::ENCODING_GZIP);
+  EXPECT_EQ(released, compressor.get());
+  EXPECT_EQ(0u, pool_.idle_count());
+
+  // the state of the first response is gone
+  std::string second;
+  ASSERT_TRUE(compressor->Compress("second response", true, &second));
+  std::string decompressed;
+  ASSERT_TRUE(Gunzip(second, &decompressed));
+  EXPECT_EQ("second response", decompressed);
+}
+
+}  // namespace net
@@ -22,6 +22,7 @@
 #include "base/files/file_util.h"
 #include "base/logging.h"
 #include "base/strings/string_number_conversions.h"
+#include "base/strings/string_split.h"
 #include "base/values.h"
 #include "stellite/server/parse_util.h"
 #include "url/gurl.h"
@@ -33,27 +34,66 @@ const int kDefaultQuicPort = 6121;
 const int kDefaultRecvBufferSize = 1024 * 1024; // 1MB
 const int kQuicMaxPacketSize = 1452;
 const int kDefaultSendBufferSize = kQuicMaxPacketSize * 30;
+const int kDefaultWriteQueuePackets = 128;
+const int kDefaultWriteQueueBytes = kQuicMaxPacketSize * 128;
+const int kDefaultUploadBufferSize = 256 * 1024; // 256KB
+const int kDefaultResponseBufferSize = 256 * 1024; // 256KB
+const int kDefaultReadBufferSize = 64 * 1024; // 64KB
+const int kDefaultCompressionWindowBits = 15;
+const int kMaxGzipLevel = 9;
+const int kMaxBrotliLevel = 11;
+const int kMinCompressionWindowBits = 9;
+const int kMaxCompressionWindowBits = 15;
+const char* kDefaultCompressionTypes =
+    "text/html,text/plain,text/css,text/xml,application/javascript,"
+    "application/json,application/xml,image/svg+xml";
 const int kUpperBoundPort =
     static_cast<int>(std::numeric_limits<uint16_t>::max());
 
+const char* kBackendContextCount = "backend_context_count";
+const char* kBatchWrite = "batch_write";
 const char* kBindAddress = "bind_address";
+const char* kBrotliLevel = "brotli_level";
+const char* kCacheDir = "cache_dir";
+const char* kCacheSize = "cache_size";
 const char* kCertfile = "certfile";
+const char* kCollapseRequests = "collapse_requests";
+const char* kCompressionTypes = "compression_types";
+const char* kCompressionWindowBits = "compression_window_bits";
 const char* kConfig = "config";
+const char* kCpuAffinity = "cpu_affinity";
 const char* kDaemon = "daemon";
 const char* kDefaultBindAddress = "::";
 const char* kDispatchContinuity = "dispatch_continuity";
+const char* kFetchCpuAffinity = "fetch_cpu_affinity";
+const char* kFetchThreadCount = "fetch_thread_count";
+const char* kFetchThreadLayout = "fetch_thread_layout";
 const char* kFileLogging = "file_logging";
+const char* kGzipLevel = "gzip_level";
 const char* kKeyfile = "keyfile";
 const char* kLogDir = "log_dir";
 const char* kLogging = "logging";
+const char* kNumaPolicy = "numa_policy";
+const char* kPassthroughContentEncoding = "passthrough_content_encoding";
 const char* kProxyPass = "proxy_pass";
 const char* kProxyTimeout = "proxy_timeout";
 const char* kQuicPort = "quic_port";
+const char* kReadBufferSize = "read_buffer_size";
 const char* kRecvBufferSize = "recv_buffer_size";
+const char* kResponseBufferSize = "response_buffer_size";
+const char* kReusePortSteering = "reuseport_steering";
 const char* kRewrite = "rewrite";
 const char* kSendBufferSize = "send_buffer_size";
+const char* kStatsInterval = "stats_interval";
 const char* kStop = "stop";
+const char* kStreamingUpload = "streaming_upload";
+const char* kUdpSegmentation = "udp_segmentation";
+const char* kUpstream = "upstream";
+const char* kUpstreamBalance = "upstream_balance";
+const char* kUploadBufferSize = "upload_buffer_size";
 const char* kWorkerCount = "worker_count";
+const char* kWriteQueueBytes = "write_queue_bytes";
+const char* kWriteQueuePackets = "write_queue_packets";
 
 ServerConfig::ServerConfig()
   : daemon_(false),
@@ -64,6 +104,29 @@ ServerConfig::ServerConfig()
     dispatch_continuity_(kDefaultDispatchContinuity),
     send_buffer_size_(kDefaultSendBufferSize),
     recv_buffer_size_(kDefaultRecvBufferSize),
+    write_queue_packets_(kDefaultWriteQueuePackets),
+    write_queue_bytes_(kDefaultWriteQueueBytes),
+    batch_write_(false),
+    udp_segmentation_(false),
+    reuseport_steering_(false),
+    numa_policy_(NUMA_POLICY_NONE),
+    fetch_thread_layout_(WorkerThreadTopology::FETCH_LAYOUT_PER_WORKER),
+    fetch_thread_count_(1),
+    backend_context_count_(0),
+    streaming_upload_(false),
+    upload_buffer_size_(kDefaultUploadBufferSize),
+    response_buffer_size_(kDefaultResponseBufferSize),
+    read_buffer_size_(kDefaultReadBufferSize),
+    cache_size_(0),
+    collapse_requests_(false),
+    passthrough_content_encoding_(false),
+    gzip_level_(0),
+    brotli_level_(0),
+    compression_window_bits_(kDefaultCompressionWindowBits),
+    compression_types_(base::SplitString(
+        kDefaultCompressionTypes, ",", base::TRIM_WHITESPACE,
+        base::SPLIT_WANT_NONEMPTY)),
+    stats_interval_(0),
     proxy_timeout_(kDefaultHttpRequestTimeout),
     quic_port_(kDefaultQuicPort),
     proxy_pass_(),
@@ -89,10 +152,75 @@ void ServerConfig::PrintHelpMessages() {
     "                               default size was 1452 * 30\n"
     "--recv_buffer_size=<size>      Specify the recv buffer size\n"
     "                               default size was 256 KB\n"
+    "--write_queue_packets=<count>  Specify the number of packets a worker\n"
+    "                               queues while the socket is not writable\n"
+    "                               default count is 128\n"
+    "--write_queue_bytes=<size>     Specify the bytes a worker queues while\n"
+    "                               the socket is not writable\n"
+    "                               default size is 1452 * 128\n"
+    "--batch_write                  Flush packets of a dispatch loop turn\n"
+    "                               together with sendmmsg()\n"
+    "--udp_segmentation             Coalesce packets to the same peer with\n"
+    "                               UDP GSO (requires --batch_write)\n"
+    "--reuseport_steering           Steer packets to workers by connection\n"
+    "                               ID instead of by client address\n"
+    "--cpu_affinity=<cpus>          Pin the dispatch thread of each worker\n"
+    "                               to a CPU of the list, e.g. 0-7,16-23\n"
+    "--fetch_cpu_affinity=<cpus>    Pin the fetch thread of each worker\n"
+    "                               to a CPU of the list\n"
+    "--numa_policy=<policy>         Memory policy of the worker threads\n"
+    "                               none, local or interleave\n"
+    "--fetch_thread_layout=<layout> Threads backend fetching runs on\n"
+    "                               per_worker, shared_pool or inline\n"
+    "                               default is per_worker\n"
+    "--fetch_thread_count=<count>   Specify the fetch thread count of\n"
+    "                               the shared_pool layout, default is 1\n"
+    "--backend_context_count=<n>    Share this many backend connection\n"
+    "                               pools among the workers, default is 0\n"
+    "                               (one pool per worker)\n"
+    "--streaming_upload             Stream request bodies of a known length\n"
+    "                               to the backend as they arrive\n"
+    "--upload_buffer_size=<size>    Body bytes a streaming upload holds\n"
+    "                               before pushing back on the client\n"
+    "                               default size is 256 KB\n"
+    "--response_buffer_size=<size>  Response bytes queued for a slow client\n"
+    "                               before the backend read pauses\n"
+    "                               default size is 256 KB, 0 is unbounded\n"
+    "--read_buffer_size=<size>      Largest buffer a backend response is\n"
+    "                               read into at once\n"
+    "                               default size is 64 KB\n"
+    "--cache_size=<megabytes>       Cache proxied GET responses in memory\n"
+    "                               default size is 0 (no cache)\n"
+    "--cache_dir=<dir>              Keep large cached bodies in files of\n"
+    "                               this directory mapped into memory\n"
+    "--collapse_requests            Share one backend fetch among concurrent\n"
+    "                               GET requests for the same resource\n"
+    "--passthrough_content_encoding Relay backend responses in the\n"
+    "                               content-encoding the backend sent\n"
+    "--gzip_level=<level>           Gzip plain responses for the clients\n"
+    "                               accepting it, range [0, 9]\n"
+    "                               default is 0 (no gzip)\n"
+    "--brotli_level=<level>         Brotli plain responses for the clients\n"
+    "                               accepting it, range [0, 11]\n"
+    "                               default is 0 (no brotli)\n"
+    "--compression_window_bits=<n>  Compressor window of a response,\n"
+    "                               range [9, 15], default is 15\n"
+    "--compression_types=<types>    Comma separated MIME types compressed\n"
+    "                               default is text/html,text/plain,\n"
+    "                               text/css,text/xml,application/javascript,\n"
+    "                               application/json,application/xml,\n"
+    "                               image/svg+xml\n"
+    "--stats_interval=<second>      Log the server stats of every thread\n"
+    "                               this often, default is 0 (never)\n"
     "--daemon                       Daemonize a process\n"
     "--stop                         Stop a QUIC daemon process\n"
     "--proxy_pass=<url>             Reverse proxy URL\n"
     "                               Example: http://example.com:8080\n"
+    "--upstream=<urls>              Balance requests over these backend\n"
+    "                               URLs instead of proxy_pass\n"
+    "                               Example: http://a:8080,http://b:8080\n"
+    "--upstream_balance=<balance>   round_robin or least_outstanding\n"
+    "                               default is round_robin\n"
     "--config=<config_file_path>    Specify the QUIC server config file path\n"
     "--keyfile=<key_file_path>      Specify the SSL key file path\n"
     "--certfile=<cert_file_path>    Specify the SSL certificate file path\n"
@@ -135,6 +263,178 @@ bool ServerConfig::ParseConfigFile(const base::FilePath& config_path) {
     return false;
   }
 
+  if (!server_config->GetInteger(kWriteQueuePackets, &write_queue_packets_)) {
+    write_queue_packets_ = kDefaultWriteQueuePackets;
+  }
+
+  if (!server_config->GetInteger(kWriteQueueBytes, &write_queue_bytes_)) {
+    write_queue_bytes_ = kDefaultWriteQueueBytes;
+  }
+
+  if (write_queue_packets_ <= 0 || write_queue_bytes_ < kQuicMaxPacketSize) {
+    LOG(ERROR) << "Server config: write queue limits are invalid";
+    return false;
+  }
+
+  if (!server_config->GetBoolean(kBatchWrite, &batch_write_)) {
+    batch_write_ = false;
+  }
+
+  if (!server_config->GetBoolean(kUdpSegmentation, &udp_segmentation_)) {
+    udp_segmentation_ = false;
+  }
+
+  if (!server_config->GetBoolean(kReusePortSteering, &reuseport_steering_)) {
+    reuseport_steering_ = false;
+  }
+
+  std::string cpu_list;
+  if (server_config->GetString(kCpuAffinity, &cpu_list) &&
+      !ParseCpuList(cpu_list, &cpu_affinity_)) {
+    LOG(ERROR) << "Server config: cpu_affinity is not a valid CPU list";
+    return false;
+  }
+
+  if (server_config->GetString(kFetchCpuAffinity, &cpu_list) &&
+      !ParseCpuList(cpu_list, &fetch_cpu_affinity_)) {
+    LOG(ERROR) << "Server config: fetch_cpu_affinity is not a valid CPU list";
+    return false;
+  }
+
+  std::string numa_policy;
+  if (server_config->GetString(kNumaPolicy, &numa_policy) &&
+      !ParseNumaPolicy(numa_policy, &numa_policy_)) {
+    LOG(ERROR) << "Server config: numa_policy is invalid";
+    return false;
+  }
+
+  std::string fetch_thread_layout;
+  if (server_config->GetString(kFetchThreadLayout, &fetch_thread_layout) &&
+      !WorkerThreadTopology::ParseFetchLayout(fetch_thread_layout,
+                                              &fetch_thread_layout_)) {
+    LOG(ERROR) << "Server config: fetch_thread_layout is invalid";
+    return false;
+  }
+
+  if (!server_config->GetInteger(kFetchThreadCount, &fetch_thread_count_)) {
+    fetch_thread_count_ = 1;
+  }
+
+  if (fetch_thread_count_ <= 0) {
+    LOG(ERROR) << "Server config: fetch_thread_count is invalid";
+    return false;
+  }
+
+  if (!server_config->GetInteger(kBackendContextCount,
+                                 &backend_context_count_)) {
+    backend_context_count_ = 0;
+  }
+
+  if (backend_context_count_ < 0) {
+    LOG(ERROR) << "Server config: backend_context_count is invalid";
+    return false;
+  }
+
+  if (!server_config->GetBoolean(kStreamingUpload, &streaming_upload_)) {
+    streaming_upload_ = false;
+  }
+
+  if (!server_config->GetInteger(kUploadBufferSize, &upload_buffer_size_)) {
+    upload_buffer_size_ = kDefaultUploadBufferSize;
+  }
+
+  if (upload_buffer_size_ <= 0) {
+    LOG(ERROR) << "Server config: upload_buffer_size is invalid";
+    return false;
+  }
+
+  if (!server_config->GetInteger(kResponseBufferSize,
+                                 &response_buffer_size_)) {
+    response_buffer_size_ = kDefaultResponseBufferSize;
+  }
+
+  if (response_buffer_size_ < 0) {
+    LOG(ERROR) << "Server config: response_buffer_size is invalid";
+    return false;
+  }
+
+  if (!server_config->GetInteger(kReadBufferSize, &read_buffer_size_)) {
+    read_buffer_size_ = kDefaultReadBufferSize;
+  }
+
+  if (read_buffer_size_ <= 0) {
+    LOG(ERROR) << "Server config: read_buffer_size is invalid";
+    return false;
+  }
+
+  if (!server_config->GetInteger(kCacheSize, &cache_size_)) {
+    cache_size_ = 0;
+  }
+
+  if (cache_size_ < 0) {
+    LOG(ERROR) << "Server config: cache_size is invalid";
+    return false;
+  }
+
+  std::string cache_dir;
+  if (server_config->GetString(kCacheDir, &cache_dir)) {
+    cache_dir_ = base::FilePath(cache_dir);
+  }
+
+  if (!server_config->GetBoolean(kCollapseRequests, &collapse_requests_)) {
+    collapse_requests_ = false;
+  }
+
+  if (!server_config->GetBoolean(kPassthroughContentEncoding,
+                                 &passthrough_content_encoding_)) {
+    passthrough_content_encoding_ = false;
+  }
+
+  if (!server_config->GetInteger(kGzipLevel, &gzip_level_)) {
+    gzip_level_ = 0;
+  }
+
+  if (gzip_level_ < 0 || gzip_level_ > kMaxGzipLevel) {
+    LOG(ERROR) << "Server config: gzip_level is invalid";
+    return false;
+  }
+
+  if (!server_config->GetInteger(kBrotliLevel, &brotli_level_)) {
+    brotli_level_ = 0;
+  }
+
+  if (brotli_level_ < 0 || brotli_level_ > kMaxBrotliLevel) {
+    LOG(ERROR) << "Server config: brotli_level is invalid";
+    return false;
+  }
+
+  if (!server_config->GetInteger(kCompressionWindowBits,
+                                 &compression_window_bits_)) {
+    compression_window_bits_ = kDefaultCompressionWindowBits;
+  }
+
+  if (compression_window_bits_ < kMinCompressionWindowBits ||
+      compression_window_bits_ > kMaxCompressionWindowBits) {
+    LOG(ERROR) << "Server config: compression_window_bits is invalid";
+    return false;
+  }
+
+  std::string compression_types;
+  if (server_config->GetString(kCompressionTypes, &compression_types)) {
+    compression_types_ = base::SplitString(
+        compression_types, ",", base::TRIM_WHITESPACE,
+        base::SPLIT_WANT_NONEMPTY);
+  }
+
+  if (!server_config->GetInteger(kStatsInterval, &stats_interval_)) {
+    stats_interval_ = 0;
+  }
+
+  if (stats_interval_ < 0) {
+    LOG(ERROR) << "Server config: stats_interval is invalid";
+    return false;
+  }
+
   int quic_port;
   if (!server_config->GetInteger(kQuicPort, &quic_port)) {
     LOG(ERROR) << "Server config: quic_port option is not set";
@@ -142,13 +442,20 @@ bool ServerConfig::ParseConfigFile(const base::FilePath& config_path) {
   }
   quic_port_ = static_cast<uint16_t>(quic_port);
 
-  std::string proxy_pass_url;
-  if (!server_config->GetString(kProxyPass, &proxy_pass_url)) {
-    LOG(ERROR) << "Server config: proxy_pass option is not set";
+  base::DictionaryValue* upstream = nullptr;
+  if (server_config->GetDictionary(kUpstream, &upstream) &&
+      !upstream_.ParseFromDictionary(*upstream)) {
+    LOG(ERROR) << "Server config: upstream option is invalid";
     return false;
   }
 
-  if (!proxy_pass(proxy_pass_url)) {
+  std::string proxy_pass_url;
+  if (!server_config->GetString(kProxyPass, &proxy_pass_url)) {
+    if (upstream_.servers.empty()) {
+      LOG(ERROR) << "Server config: proxy_pass option is not set";
+      return false;
+    }
+  } else if (!proxy_pass(proxy_pass_url)) {
     LOG(ERROR) << "proxy_pass: proxy_pass URL scheme is invalid";
     return false;
   }
@@ -209,7 +516,13 @@ bool ServerConfig::ParseCommandLine(const base::CommandLine* command_line) {
   daemon_ = command_line->HasSwitch(kDaemon);
   stop_ = command_line->HasSwitch(kStop);
   logging_ = command_line->HasSwitch(kLogging);
-
+  batch_write_ = command_line->HasSwitch(kBatchWrite);
+  udp_segmentation_ = command_line->HasSwitch(kUdpSegmentation);
+  reuseport_steering_ = command_line->HasSwitch(kReusePortSteering);
+  streaming_upload_ = command_line->HasSwitch(kStreamingUpload);
+  collapse_requests_ = command_line->HasSwitch(kCollapseRequests);
+  passthrough_content_encoding_ =
+      command_line->HasSwitch(kPassthroughContentEncoding);
 
   if (command_line->HasSwitch(kCertfile)) {
     certfile_ = command_line->GetSwitchValuePath(kCertfile);
@@ -274,6 +587,33 @@ bool ServerConfig::ParseCommandLine(const base::CommandLine* command_line) {
     }
   }
 
+  if (command_line->HasSwitch(kWriteQueuePackets)) {
+    if (!base::StringToInt(
+            command_line->GetSwitchValueASCII(kWriteQueuePackets),
+            &write_queue_packets_)) {
+      LOG(ERROR) << "--write_queue_packets is not in a digit format";
+      return false;
+    }
+
+    if (write_queue_packets_ <= 0) {
+      LOG(ERROR) << "--write_queue_packets range is invalid";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kWriteQueueBytes)) {
+    if (!base::StringToInt(command_line->GetSwitchValueASCII(kWriteQueueBytes),
+                           &write_queue_bytes_)) {
+      LOG(ERROR) << "--write_queue_bytes is not in a digit format";
+      return false;
+    }
+
+    if (write_queue_bytes_ < kQuicMaxPacketSize) {
+      LOG(ERROR) << "--write_queue_bytes range is invalid";
+      return false;
+    }
+  }
+
   if (command_line->HasSwitch(kProxyPass)) {
     std::string proxy_pass_url = command_line->GetSwitchValueASCII(kProxyPass);
     if (!proxy_pass(proxy_pass_url)) {
@@ -282,6 +622,23 @@ bool ServerConfig::ParseCommandLine(const base::CommandLine* command_line) {
     }
   }
 
+  if (command_line->HasSwitch(kUpstream)) {
+    if (!upstream_.ParseServerList(
+            command_line->GetSwitchValueASCII(kUpstream))) {
+      LOG(ERROR) << "--upstream is not a valid URL list";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kUpstreamBalance)) {
+    if (!UpstreamConfig::ParseBalance(
+            command_line->GetSwitchValueASCII(kUpstreamBalance),
+            &upstream_.balance)) {
+      LOG(ERROR) << "--upstream_balance is invalid";
+      return false;
+    }
+  }
+
   if (command_line->HasSwitch(kBindAddress)) {
     bind_address_ = command_line->GetSwitchValueASCII(kBindAddress);
   }
@@ -313,6 +670,185 @@ bool ServerConfig::ParseCommandLine(const base::CommandLine* command_line) {
     }
   }
 
+  if (command_line->HasSwitch(kCpuAffinity)) {
+    if (!ParseCpuList(command_line->GetSwitchValueASCII(kCpuAffinity),
+                      &cpu_affinity_)) {
+      LOG(ERROR) << "--cpu_affinity is not a valid CPU list";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kFetchCpuAffinity)) {
+    if (!ParseCpuList(command_line->GetSwitchValueASCII(kFetchCpuAffinity),
+                      &fetch_cpu_affinity_)) {
+      LOG(ERROR) << "--fetch_cpu_affinity is not a valid CPU list";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kNumaPolicy)) {
+    if (!ParseNumaPolicy(command_line->GetSwitchValueASCII(kNumaPolicy),
+                         &numa_policy_)) {
+      LOG(ERROR) << "--numa_policy is invalid";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kFetchThreadLayout)) {
+    if (!WorkerThreadTopology::ParseFetchLayout(
+            command_line->GetSwitchValueASCII(kFetchThreadLayout),
+            &fetch_thread_layout_)) {
+      LOG(ERROR) << "--fetch_thread_layout is invalid";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kFetchThreadCount)) {
+    if (!base::StringToInt(
+            command_line->GetSwitchValueASCII(kFetchThreadCount),
+            &fetch_thread_count_)) {
+      LOG(ERROR) << "fetch_thread_count is not in a valid digit format";
+      return false;
+    }
+
+    if (fetch_thread_count_ <= 0) {
+      LOG(ERROR) << "--fetch_thread_count range is invalid";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kBackendContextCount)) {
+    if (!base::StringToInt(
+            command_line->GetSwitchValueASCII(kBackendContextCount),
+            &backend_context_count_)) {
+      LOG(ERROR) << "backend_context_count is not in a valid digit format";
+      return false;
+    }
+
+    if (backend_context_count_ < 0) {
+      LOG(ERROR) << "--backend_context_count range is invalid";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kUploadBufferSize)) {
+    if (!base::StringToInt(
+            command_line->GetSwitchValueASCII(kUploadBufferSize),
+            &upload_buffer_size_)) {
+      LOG(ERROR) << "upload_buffer_size is not in a valid digit format";
+      return false;
+    }
+
+    if (upload_buffer_size_ <= 0) {
+      LOG(ERROR) << "--upload_buffer_size range is invalid";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kResponseBufferSize)) {
+    if (!base::StringToInt(
+            command_line->GetSwitchValueASCII(kResponseBufferSize),
+            &response_buffer_size_)) {
+      LOG(ERROR) << "response_buffer_size is not in a valid digit format";
+      return false;
+    }
+
+    if (response_buffer_size_ < 0) {
+      LOG(ERROR) << "--response_buffer_size range is invalid";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kReadBufferSize)) {
+    if (!base::StringToInt(command_line->GetSwitchValueASCII(kReadBufferSize),
+                           &read_buffer_size_)) {
+      LOG(ERROR) << "read_buffer_size is not in a valid digit format";
+      return false;
+    }
+
+    if (read_buffer_size_ <= 0) {
+      LOG(ERROR) << "--read_buffer_size range is invalid";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kCacheSize)) {
+    if (!base::StringToInt(command_line->GetSwitchValueASCII(kCacheSize),
+                           &cache_size_)) {
+      LOG(ERROR) << "cache_size is not in a valid digit format";
+      return false;
+    }
+
+    if (cache_size_ < 0) {
+      LOG(ERROR) << "--cache_size range is invalid";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kCacheDir)) {
+    cache_dir_ = command_line->GetSwitchValuePath(kCacheDir);
+  }
+
+  if (command_line->HasSwitch(kGzipLevel)) {
+    if (!base::StringToInt(command_line->GetSwitchValueASCII(kGzipLevel),
+                           &gzip_level_)) {
+      LOG(ERROR) << "gzip_level is not in a valid digit format";
+      return false;
+    }
+
+    if (gzip_level_ < 0 || gzip_level_ > kMaxGzipLevel) {
+      LOG(ERROR) << "--gzip_level range is invalid";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kBrotliLevel)) {
+    if (!base::StringToInt(command_line->GetSwitchValueASCII(kBrotliLevel),
+                           &brotli_level_)) {
+      LOG(ERROR) << "brotli_level is not in a valid digit format";
+      return false;
+    }
+
+    if (brotli_level_ < 0 || brotli_level_ > kMaxBrotliLevel) {
+      LOG(ERROR) << "--brotli_level range is invalid";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kCompressionWindowBits)) {
+    if (!base::StringToInt(
+            command_line->GetSwitchValueASCII(kCompressionWindowBits),
+            &compression_window_bits_)) {
+      LOG(ERROR) << "compression_window_bits is not in a valid digit format";
+      return false;
+    }
+
+    if (compression_window_bits_ < kMinCompressionWindowBits ||
+        compression_window_bits_ > kMaxCompressionWindowBits) {
+      LOG(ERROR) << "--compression_window_bits range is invalid";
+      return false;
+    }
+  }
+
+  if (command_line->HasSwitch(kCompressionTypes)) {
+    compression_types_ = base::SplitString(
+        command_line->GetSwitchValueASCII(kCompressionTypes), ",",
+        base::TRIM_WHITESPACE, base::SPLIT_WANT_NONEMPTY);
+  }
+
+  if (command_line->HasSwitch(kStatsInterval)) {
+    if (!base::StringToInt(command_line->GetSwitchValueASCII(kStatsInterval),
+                           &stats_interval_)) {
+      LOG(ERROR) << "stats_interval is not in a valid digit format";
+      return false;
+    }
+
+    if (stats_interval_ < 0) {
+      LOG(ERROR) << "--stats_interval range is invalid";
+      return false;
+    }
+  }
+
   if (logging_ && command_line->HasSwitch(kLogDir)) {
     log_dir_ = command_line->GetSwitchValuePath(kLogDir);
   }
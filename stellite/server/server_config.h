@@ -15,9 +15,15 @@
 #ifndef QUIC_SERVER_QUIC_SERVER_CONFIG_H_
 #define QUIC_SERVER_QUIC_SERVER_CONFIG_H_
 
+#include <string>
+#include <vector>
+
 #include "base/files/file_path.h"
 #include "base/values.h"
 #include "stellite/fetcher/http_rewrite.h"
+#include "stellite/process/cpu_affinity.h"
+#include "stellite/server/upstream_group.h"
+#include "stellite/server/worker_thread_topology.h"
 #include "url/gurl.h"
 #include "net/base/net_export.h"
 
@@ -73,6 +79,128 @@ class NET_EXPORT ServerConfig {
     return static_cast<uint32_t>(recv_buffer_size_);
   }
 
+  uint32_t write_queue_packets() const {
+    return static_cast<uint32_t>(write_queue_packets_);
+  }
+
+  uint32_t write_queue_bytes() const {
+    return static_cast<uint32_t>(write_queue_bytes_);
+  }
+
+  bool batch_write() const {
+    return batch_write_;
+  }
+
+  bool udp_segmentation() const {
+    return udp_segmentation_;
+  }
+
+  bool reuseport_steering() const {
+    return reuseport_steering_;
+  }
+
+  // CPUs the dispatch threads of the workers are pinned to, in worker order.
+  // Empty if they aren't pinned.
+  const std::vector<int>& cpu_affinity() const {
+    return cpu_affinity_;
+  }
+
+  // CPUs the fetch threads of the workers are pinned to, in worker order.
+  // Empty if they aren't pinned.
+  const std::vector<int>& fetch_cpu_affinity() const {
+    return fetch_cpu_affinity_;
+  }
+
+  NumaPolicy numa_policy() const {
+    return numa_policy_;
+  }
+
+  WorkerThreadTopology::FetchLayout fetch_thread_layout() const {
+    return fetch_thread_layout_;
+  }
+
+  // Size of the fetch thread pool of the shared_pool layout
+  uint32_t fetch_thread_count() const {
+    return static_cast<uint32_t>(fetch_thread_count_);
+  }
+
+  // Number of backend fetch contexts shared by the workers, each with its own
+  // connection pools and DNS cache. 0 gives every worker its own context.
+  uint32_t backend_context_count() const {
+    return static_cast<uint32_t>(backend_context_count_);
+  }
+
+  // Streams fixed length request bodies to the backend instead of reading
+  // them whole first, holding up to upload_buffer_size() bytes per stream.
+  bool streaming_upload() const {
+    return streaming_upload_;
+  }
+
+  uint32_t upload_buffer_size() const {
+    return static_cast<uint32_t>(upload_buffer_size_);
+  }
+
+  // Response bytes a stream queues for a slow client before it stops reading
+  // the backend. 0 never stops.
+  uint32_t response_buffer_size() const {
+    return static_cast<uint32_t>(response_buffer_size_);
+  }
+
+  // Largest buffer a backend response is read into at once.
+  int read_buffer_size() const {
+    return read_buffer_size_;
+  }
+
+  // Megabytes of proxied responses cached for all workers. 0 disables the
+  // cache.
+  int cache_size() const {
+    return cache_size_;
+  }
+
+  // Directory of the mapped files holding large cached bodies, or empty to
+  // keep them on the heap.
+  const base::FilePath& cache_dir() const {
+    return cache_dir_;
+  }
+
+  // Lets concurrent GET requests for the same resource share a backend
+  // fetch.
+  bool collapse_requests() const {
+    return collapse_requests_;
+  }
+
+  // Relays backend response bodies still in their content-encoding instead
+  // of decoding them on the fetch thread.
+  bool passthrough_content_encoding() const {
+    return passthrough_content_encoding_;
+  }
+
+  // Compression levels of the plain responses sent to the clients accepting
+  // gzip or brotli. 0 disables the encoding.
+  int gzip_level() const {
+    return gzip_level_;
+  }
+
+  int brotli_level() const {
+    return brotli_level_;
+  }
+
+  // Bounds the compressor memory of a response to about
+  // 2^(compression_window_bits + 3) bytes.
+  int compression_window_bits() const {
+    return compression_window_bits_;
+  }
+
+  // MIME types of the responses worth compressing. "text/*" takes any text.
+  const std::vector<std::string>& compression_types() const {
+    return compression_types_;
+  }
+
+  // Seconds between two logs of the server stats. 0 never logs them.
+  int stats_interval() const {
+    return stats_interval_;
+  }
+
   uint16_t quic_port() const {
     return static_cast<uint16_t>(quic_port_);
   }
@@ -94,6 +222,11 @@ class NET_EXPORT ServerConfig {
     return proxy_pass_;
   }
 
+  // Backend origins replacing proxy_pass when set
+  const UpstreamConfig& upstream() const {
+    return upstream_;
+  }
+
   void set_bind_address(const std::string bind_address) {
     bind_address_ = bind_address;
   }
@@ -159,11 +292,44 @@ class NET_EXPORT ServerConfig {
   int send_buffer_size_;
   int recv_buffer_size_;
 
+  int write_queue_packets_;
+  int write_queue_bytes_;
+
+  bool batch_write_;
+  bool udp_segmentation_;
+  bool reuseport_steering_;
+
+  std::vector<int> cpu_affinity_;
+  std::vector<int> fetch_cpu_affinity_;
+  NumaPolicy numa_policy_;
+
+  WorkerThreadTopology::FetchLayout fetch_thread_layout_;
+  int fetch_thread_count_;
+  int backend_context_count_;
+
+  bool streaming_upload_;
+  int upload_buffer_size_;
+  int response_buffer_size_;
+  int read_buffer_size_;
+
+  int cache_size_;
+  base::FilePath cache_dir_;
+  bool collapse_requests_;
+  bool passthrough_content_encoding_;
+
+  int gzip_level_;
+  int brotli_level_;
+  int compression_window_bits_;
+  std::vector<std::string> compression_types_;
+
+  int stats_interval_;
+
   int proxy_timeout_;
 
   uint16_t quic_port_;
 
   GURL proxy_pass_;
+  UpstreamConfig upstream_;
   std::string bind_address_;
 
   base::FilePath keyfile_;
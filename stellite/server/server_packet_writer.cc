@@ -4,23 +4,48 @@
 
 #include "stellite/server/server_packet_writer.h"
 
-#include "base/callback_helpers.h"
 #include "base/location.h"
 #include "base/logging.h"
 #include "base/metrics/sparse_histogram.h"
+#include "base/threading/thread_task_runner_handle.h"
+#include "stellite/socket/quic_udp_send_batch.h"
 #include "stellite/socket/quic_udp_server_socket.h"
+#include "stellite/stats/server_stats_macro.h"
 #include "net/base/io_buffer.h"
 #include "net/base/net_errors.h"
 
 namespace net {
 
+ServerPacketWriter::QueuedPacket::QueuedPacket(scoped_refptr<IOBuffer> buffer,
+                                               size_t length,
+                                               const IPEndPoint& peer_address,
+                                               WriteCallback callback)
+    : buffer(buffer),
+      length(length),
+      peer_address(peer_address),
+      callback(callback) {}
+
+ServerPacketWriter::QueuedPacket::QueuedPacket(const QueuedPacket& other) =
+    default;
+
+ServerPacketWriter::QueuedPacket::~QueuedPacket() {}
+
 ServerPacketWriter::ServerPacketWriter(
     QuicUDPServerSocket* socket,
-    QuicBlockedWriterInterface* blocked_writer)
+    QuicBlockedWriterInterface* blocked_writer,
+    size_t max_queued_packets,
+    size_t max_queued_bytes)
     : socket_(socket),
       blocked_writer_(blocked_writer),
-      write_blocked_(false),
-      weak_factory_(this) {}
+      max_queued_packets_(max_queued_packets),
+      max_queued_bytes_(max_queued_bytes),
+      write_pending_(false),
+      write_queue_bytes_(0),
+      flush_scheduled_(false),
+      weak_factory_(this) {
+  DCHECK_GT(max_queued_packets_, 0u);
+  DCHECK_GE(max_queued_bytes_, static_cast<size_t>(kMaxPacketSize));
+}
 
 ServerPacketWriter::~ServerPacketWriter() {}
 
@@ -31,35 +56,237 @@ WriteResult ServerPacketWriter::WritePacketWithCallback(
     const IPEndPoint& peer_address,
     PerPacketOptions* options,
     WriteCallback callback) {
-  DCHECK(callback_.is_null());
-  callback_ = callback;
+  if (buf_len > static_cast<size_t>(kMaxPacketSize)) {
+    return WriteResult(WRITE_STATUS_ERROR, ERR_MSG_TOO_BIG);
+  }
+
+  // A packet that doesn't fit is not buffered: the connection keeps it and
+  // retries from OnCanWrite().
+  if (IsWriteBlocked()) {
+    return WriteResult(WRITE_STATUS_BLOCKED, ERR_IO_PENDING);
+  }
+
   WriteResult result =
-      WritePacket(buffer, buf_len, self_address, peer_address, options);
-  if (result.status != WRITE_STATUS_BLOCKED) {
-    callback_.Reset();
+      send_batch_ ? BufferPacket(buffer, buf_len, peer_address, callback) :
+                    QueuePacket(buffer, buf_len, peer_address, callback);
+  if (result.status == WRITE_STATUS_OK) {
+    SERVER_STAT_ADD(STAT_UDP_PACKETS_SENT, 1);
   }
   return result;
 }
 
+void ServerPacketWriter::EnableBatching(bool use_udp_segmentation) {
+  DCHECK(!send_batch_);
+  DCHECK(write_queue_.empty());
+  send_batch_.reset(new QuicUDPSendBatch(max_queued_packets_,
+                                         kMaxPacketSize));
+
+  if (use_udp_segmentation) {
+    if (socket_->SupportsUDPSegmentation()) {
+      send_batch_->set_use_segmentation(true);
+    } else {
+      LOG(WARNING) << "UDP_SEGMENT is not supported by the kernel";
+    }
+  }
+}
+
+size_t ServerPacketWriter::queued_packets() const {
+  return send_batch_ ? send_batch_->unsent() : write_queue_.size();
+}
+
+size_t ServerPacketWriter::queued_bytes() const {
+  return send_batch_ ? send_batch_->unsent_bytes() : write_queue_bytes_;
+}
+
+WriteResult ServerPacketWriter::QueuePacket(const char* buffer,
+                                            size_t buf_len,
+                                            const IPEndPoint& peer_address,
+                                            WriteCallback callback) {
+  scoped_refptr<StringIOBuffer> buf(
+      new StringIOBuffer(std::string(buffer, buf_len)));
+
+  if (write_pending_) {
+    write_queue_.push_back(QueuedPacket(buf, buf_len, peer_address,
+                                        callback));
+    write_queue_bytes_ += buf_len;
+    return WriteResult(WRITE_STATUS_OK, static_cast<int>(buf_len));
+  }
+
+  DCHECK(write_queue_.empty());
+  int rv = socket_->SendTo(
+      buf.get(), static_cast<int>(buf_len), peer_address,
+      base::Bind(&ServerPacketWriter::OnWriteComplete,
+                 weak_factory_.GetWeakPtr()));
+  if (rv == ERR_IO_PENDING) {
+    // The socket keeps the buffer until the write completes.
+    write_pending_ = true;
+    in_flight_callback_ = callback;
+    return WriteResult(WRITE_STATUS_OK, static_cast<int>(buf_len));
+  }
+
+  if (rv < 0) {
+    UMA_HISTOGRAM_SPARSE_SLOWLY("Net.QuicSession.WriteError", -rv);
+    return WriteResult(WRITE_STATUS_ERROR, rv);
+  }
+
+  return WriteResult(WRITE_STATUS_OK, rv);
+}
+
+void ServerPacketWriter::DrainQueue() {
+  while (!write_pending_ && !write_queue_.empty()) {
+    QueuedPacket packet = write_queue_.front();
+    write_queue_.pop_front();
+    write_queue_bytes_ -= packet.length;
+
+    int rv = socket_->SendTo(
+        packet.buffer.get(), static_cast<int>(packet.length),
+        packet.peer_address,
+        base::Bind(&ServerPacketWriter::OnWriteComplete,
+                   weak_factory_.GetWeakPtr()));
+    if (rv == ERR_IO_PENDING) {
+      write_pending_ = true;
+      in_flight_callback_ = packet.callback;
+      return;
+    }
+
+    if (rv < 0) {
+      UMA_HISTOGRAM_SPARSE_SLOWLY("Net.QuicSession.WriteError", -rv);
+      RunWriteErrorCallback(packet.callback, rv);
+    }
+  }
+}
+
 void ServerPacketWriter::OnWriteComplete(int rv) {
   DCHECK_NE(rv, ERR_IO_PENDING);
-  write_blocked_ = false;
-  WriteResult result(rv < 0 ? WRITE_STATUS_ERROR : WRITE_STATUS_OK, rv);
-  base::ResetAndReturn(&callback_).Run(result);
-  blocked_writer_->OnCanWrite();
+  write_pending_ = false;
+
+  WriteCallback callback;
+  callback.swap(in_flight_callback_);
+  if (rv < 0) {
+    UMA_HISTOGRAM_SPARSE_SLOWLY("Net.QuicSession.WriteError", -rv);
+    RunWriteErrorCallback(callback, rv);
+  }
+
+  DrainQueue();
+  if (!IsWriteBlocked()) {
+    blocked_writer_->OnCanWrite();
+  }
+}
+
+WriteResult ServerPacketWriter::BufferPacket(const char* buffer,
+                                             size_t buf_len,
+                                             const IPEndPoint& peer_address,
+                                             WriteCallback callback) {
+  if (send_batch_->full()) {
+    // Reclaim the slots of packets that were already sent.
+    size_t discarded = send_batch_->Compact();
+    batch_callbacks_.erase(batch_callbacks_.begin(),
+                           batch_callbacks_.begin() + discarded);
+  }
+
+  if (!send_batch_->Append(buffer, buf_len, peer_address)) {
+    return WriteResult(WRITE_STATUS_BLOCKED, ERR_IO_PENDING);
+  }
+  batch_callbacks_.push_back(callback);
+
+  if (!flush_scheduled_ && !write_pending_) {
+    flush_scheduled_ = true;
+    base::ThreadTaskRunnerHandle::Get()->PostTask(
+        FROM_HERE,
+        base::Bind(&ServerPacketWriter::FlushBatch,
+                   weak_factory_.GetWeakPtr()));
+  }
+
+  return WriteResult(WRITE_STATUS_OK, static_cast<int>(buf_len));
+}
+
+void ServerPacketWriter::FlushBatch() {
+  flush_scheduled_ = false;
+
+  while (!write_pending_ && !send_batch_->empty()) {
+    int rv = socket_->SendMultipleTo(
+        send_batch_.get(),
+        base::Bind(&ServerPacketWriter::OnBatchWriteComplete,
+                   weak_factory_.GetWeakPtr()));
+    if (rv == ERR_IO_PENDING) {
+      write_pending_ = true;
+      return;
+    }
+
+    if (rv < 0) {
+      OnBatchWriteError(rv);
+    }
+  }
+
+  if (send_batch_->empty()) {
+    send_batch_->Clear();
+    batch_callbacks_.clear();
+  }
+
+  // Connections may have found the batch full during this loop turn.
+  if (!IsWriteBlocked()) {
+    blocked_writer_->OnCanWrite();
+  }
+}
+
+void ServerPacketWriter::OnBatchWriteComplete(int rv) {
+  DCHECK_NE(rv, ERR_IO_PENDING);
+  write_pending_ = false;
+
+  if (rv < 0) {
+    OnBatchWriteError(rv);
+  }
+
+  FlushBatch();
+}
+
+void ServerPacketWriter::OnBatchWriteError(int rv) {
+  if (send_batch_->use_segmentation() &&
+      (rv == ERR_FAILED || rv == ERR_INVALID_ARGUMENT)) {
+    // The device can't offload segmentation. Retry the same packets one
+    // datagram per message.
+    LOG(WARNING) << "UDP_SEGMENT send failed, disable segmentation: "
+                 << ErrorToString(rv);
+    send_batch_->set_use_segmentation(false);
+    return;
+  }
+
+  UMA_HISTOGRAM_SPARSE_SLOWLY("Net.QuicSession.WriteError", -rv);
+
+  size_t first = send_batch_->sent();
+  size_t dropped = send_batch_->DropFirstMessage();
+
+  // Callbacks may write again, so run copies of them.
+  std::vector<WriteCallback> callbacks(
+      batch_callbacks_.begin() + first,
+      batch_callbacks_.begin() + first + dropped);
+  for (const WriteCallback& callback : callbacks) {
+    RunWriteErrorCallback(callback, rv);
+  }
+}
+
+// static
+void ServerPacketWriter::RunWriteErrorCallback(const WriteCallback& callback,
+                                               int rv) {
+  if (!callback.is_null()) {
+    callback.Run(WriteResult(WRITE_STATUS_ERROR, rv));
+  }
 }
 
 bool ServerPacketWriter::IsWriteBlockedDataBuffered() const {
-  // UDPServerSocket::SendTo buffers the data until the Write is permitted.
-  return true;
+  // Queued packets are owned by the writer, but a packet refused because the
+  // queue is full stays with the connection.
+  return false;
 }
 
 bool ServerPacketWriter::IsWriteBlocked() const {
-  return write_blocked_;
+  return queued_packets() >= max_queued_packets_ ||
+         queued_bytes() + kMaxPacketSize > max_queued_bytes_;
 }
 
 void ServerPacketWriter::SetWritable() {
-  write_blocked_ = false;
+  // Blocking follows the queue length, which only shrinks as the socket
+  // accepts packets.
 }
 
 WriteResult ServerPacketWriter::WritePacket(
@@ -68,31 +295,8 @@ WriteResult ServerPacketWriter::WritePacket(
     const IPAddress& self_address,
     const IPEndPoint& peer_address,
     PerPacketOptions* options) {
-  scoped_refptr<StringIOBuffer> buf(
-      new StringIOBuffer(std::string(buffer, buf_len)));
-  DCHECK(!IsWriteBlocked());
-  // DCHECK(!callback_.is_null());
-  int rv;
-  if (buf_len <= static_cast<size_t>(std::numeric_limits<int>::max())) {
-    rv = socket_->SendTo(
-        buf.get(), static_cast<int>(buf_len), peer_address,
-        base::Bind(&ServerPacketWriter::OnWriteComplete,
-                   weak_factory_.GetWeakPtr()));
-  } else {
-    rv = ERR_MSG_TOO_BIG;
-  }
-  WriteStatus status = WRITE_STATUS_OK;
-  if (rv < 0) {
-    if (rv != ERR_IO_PENDING) {
-      UMA_HISTOGRAM_SPARSE_SLOWLY("Net.QuicSession.WriteError", -rv);
-      status = WRITE_STATUS_ERROR;
-    } else {
-      status = WRITE_STATUS_BLOCKED;
-      write_blocked_ = true;
-    }
-  }
-
-  return WriteResult(status, rv);
+  return WritePacketWithCallback(buffer, buf_len, self_address, peer_address,
+                                 options, WriteCallback());
 }
 
 QuicByteCount ServerPacketWriter::GetMaxPacketSize(
@@ -7,9 +7,13 @@
 
 #include <stddef.h>
 
+#include <deque>
+#include <memory>
+
 #include "base/callback.h"
 #include "base/macros.h"
 #include "base/memory/weak_ptr.h"
+#include "net/base/io_buffer.h"
 #include "net/base/ip_endpoint.h"
 #include "net/quic/core/quic_connection.h"
 #include "net/quic/core/quic_packet_writer.h"
@@ -20,23 +24,33 @@ namespace net {
 
 class IPAddress;
 class QuicBlockedWriterInterface;
+class QuicUDPSendBatch;
 class UDPServerSocket;
 struct WriteResult;
 
 
 // Chrome specific packet writer which uses a UDPServerSocket for writing
 // data.
+//
+// The writer is shared by every connection of a worker. Packets that can't be
+// sent right away are kept in a bounded queue which drains as the socket
+// becomes writable, so one pending write doesn't block every connection. The
+// writer only reports itself blocked once the queue is full.
 class NET_EXPORT ServerPacketWriter : public QuicPacketWriter {
  public:
   typedef base::Callback<void(WriteResult)> WriteCallback;
 
+  // |max_queued_packets| and |max_queued_bytes| bound the packets waiting for
+  // the socket to become writable.
   ServerPacketWriter(QuicUDPServerSocket* socket,
-                     QuicBlockedWriterInterface* blocked_writer);
+                     QuicBlockedWriterInterface* blocked_writer,
+                     size_t max_queued_packets,
+                     size_t max_queued_bytes);
   ~ServerPacketWriter() override;
 
   // Use this method to write packets rather than WritePacket:
-  // ServerPacketWriter requires a callback to exist for every
-  // write, which will be called once the write is complete.
+  // |callback| is called with the error if a queued packet fails to be
+  // written later on.
   virtual WriteResult WritePacketWithCallback(const char* buffer,
                                               size_t buf_len,
                                               const IPAddress& self_address,
@@ -44,7 +58,15 @@ class NET_EXPORT ServerPacketWriter : public QuicPacketWriter {
                                               PerPacketOptions* options,
                                               WriteCallback callback);
 
-  void OnWriteComplete(int rv);
+  // Switches the writer to batching mode. Packets written during one message
+  // loop turn are buffered and flushed together with sendmmsg(), and
+  // consecutive packets to the same peer are coalesced into UDP_SEGMENT (GSO)
+  // messages if |use_udp_segmentation| is set and the kernel supports it.
+  // Must be called before the first write.
+  void EnableBatching(bool use_udp_segmentation);
+
+  size_t queued_packets() const;
+  size_t queued_bytes() const;
 
   // QuicPacketWriter implementation:
   bool IsWriteBlockedDataBuffered() const override;
@@ -53,7 +75,6 @@ class NET_EXPORT ServerPacketWriter : public QuicPacketWriter {
   QuicByteCount GetMaxPacketSize(const IPEndPoint& peer_address) const override;
 
  protected:
-  // Do not call WritePacket on its own -- use WritePacketWithCallback
   WriteResult WritePacket(const char* buffer,
                           size_t buf_len,
                           const IPAddress& self_address,
@@ -61,16 +82,74 @@ class NET_EXPORT ServerPacketWriter : public QuicPacketWriter {
                           PerPacketOptions* options) override;
 
  private:
+  struct QueuedPacket {
+    QueuedPacket(scoped_refptr<IOBuffer> buffer,
+                 size_t length,
+                 const IPEndPoint& peer_address,
+                 WriteCallback callback);
+    QueuedPacket(const QueuedPacket& other);
+    ~QueuedPacket();
+
+    scoped_refptr<IOBuffer> buffer;
+    size_t length;
+    IPEndPoint peer_address;
+    WriteCallback callback;
+  };
+
+  // Sends the packet right away if the socket is idle, queues it otherwise.
+  WriteResult QueuePacket(const char* buffer,
+                          size_t buf_len,
+                          const IPEndPoint& peer_address,
+                          WriteCallback callback);
+
+  // Sends queued packets until the queue drains or the socket blocks.
+  void DrainQueue();
+
+  void OnWriteComplete(int rv);
+
+  // Buffers a packet in |send_batch_| and makes sure a flush is scheduled.
+  WriteResult BufferPacket(const char* buffer,
+                           size_t buf_len,
+                           const IPEndPoint& peer_address,
+                           WriteCallback callback);
+
+  // Sends the buffered packets until |send_batch_| drains or the socket
+  // blocks.
+  void FlushBatch();
+
+  void OnBatchWriteComplete(int rv);
+
+  // Handles an error of the first unsent message of |send_batch_|.
+  void OnBatchWriteError(int rv);
+
+  // Reports a failed write to the connection that wrote the packet.
+  static void RunWriteErrorCallback(const WriteCallback& callback, int rv);
+
   QuicUDPServerSocket* socket_;
 
-  // To be notified after every successful asynchronous write.
+  // To be notified once the socket has drained some of the queue.
   QuicBlockedWriterInterface* blocked_writer_;
 
-  // To call once the write is complete.
-  WriteCallback callback_;
+  const size_t max_queued_packets_;
+  const size_t max_queued_bytes_;
+
+  // Whether a socket write is currently in-flight.
+  bool write_pending_;
+
+  // Packets waiting behind the in-flight write, and the callback of the
+  // in-flight packet itself.
+  std::deque<QueuedPacket> write_queue_;
+  size_t write_queue_bytes_;
+  WriteCallback in_flight_callback_;
+
+  // Packets waiting to be flushed in batching mode, and the callbacks of each
+  // packet by index. NULL unless batching is enabled; used instead of
+  // |write_queue_| then.
+  std::unique_ptr<QuicUDPSendBatch> send_batch_;
+  std::deque<WriteCallback> batch_callbacks_;
 
-  // Whether a write is currently in-flight.
-  bool write_blocked_;
+  // Whether a FlushBatch() task has been posted.
+  bool flush_scheduled_;
 
   base::WeakPtrFactory<ServerPacketWriter> weak_factory_;
 
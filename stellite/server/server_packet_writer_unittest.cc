@@ -0,0 +1,227 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/server_packet_writer.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/bind.h"
+#include "net/base/completion_callback.h"
+#include "net/base/io_buffer.h"
+#include "net/base/ip_address.h"
+#include "net/base/ip_endpoint.h"
+#include "net/base/net_errors.h"
+#include "net/quic/core/quic_blocked_writer_interface.h"
+#include "net/quic/core/quic_protocol.h"
+#include "stellite/socket/quic_udp_server_socket.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+
+namespace {
+
+// Records the datagrams sent, and while blocked leaves every write pending
+// until CompleteWrite().
+class FakeServerSocket : public QuicUDPServerSocket {
+ public:
+  FakeServerSocket() : blocked_(false) {}
+  ~FakeServerSocket() override {}
+
+  int SendTo(IOBuffer* buf,
+             int buf_len,
+             const IPEndPoint& address,
+             const CompletionCallback& callback) override {
+    EXPECT_TRUE(pending_callback_.is_null());
+    sent_.push_back(std::string(buf->data(), buf_len));
+    if (blocked_) {
+      pending_callback_ = callback;
+      return ERR_IO_PENDING;
+    }
+    return buf_len;
+  }
+
+  void set_blocked(bool blocked) { blocked_ = blocked; }
+
+  bool write_pending() const { return !pending_callback_.is_null(); }
+
+  void CompleteWrite(int rv) {
+    CompletionCallback callback = pending_callback_;
+    pending_callback_.Reset();
+    callback.Run(rv);
+  }
+
+  const std::vector<std::string>& sent() const { return sent_; }
+
+ private:
+  bool blocked_;
+  CompletionCallback pending_callback_;
+  std::vector<std::string> sent_;
+};
+
+class CountingBlockedWriter : public QuicBlockedWriterInterface {
+ public:
+  CountingBlockedWriter() : can_write_count_(0) {}
+
+  void OnCanWrite() override { ++can_write_count_; }
+
+  int can_write_count() const { return can_write_count_; }
+
+ private:
+  int can_write_count_;
+};
+
+void SaveWriteResult(WriteResult* out, WriteResult result) {
+  *out = result;
+}
+
+}  // namespace
+
+class ServerPacketWriterTest : public testing::Test {
+ protected:
+  ServerPacketWriterTest()
+      : peer_address_(IPAddress::IPv4Localhost(), 443) {}
+
+  void CreateWriter(size_t max_queued_packets, size_t max_queued_bytes) {
+    writer_.reset(new ServerPacketWriter(&socket_, &blocked_writer_,
+                                         max_queued_packets,
+                                         max_queued_bytes));
+  }
+
+  WriteResult Write(const std::string& packet) {
+    return writer_->WritePacketWithCallback(
+        packet.data(), packet.size(), IPAddress::IPv4Localhost(),
+        peer_address_, nullptr, ServerPacketWriter::WriteCallback());
+  }
+
+  // A packet of |length| bytes filled with |tag|.
+  static std::string MakePacket(char tag, size_t length) {
+    return std::string(length, tag);
+  }
+
+  FakeServerSocket socket_;
+  CountingBlockedWriter blocked_writer_;
+  IPEndPoint peer_address_;
+  std::unique_ptr<ServerPacketWriter> writer_;
+};
+
+TEST_F(ServerPacketWriterTest, SendsRightAwayWhileIdle) {
+  CreateWriter(4, 4 * kMaxPacketSize);
+
+  WriteResult result = Write(MakePacket('a', 100));
+  EXPECT_EQ(WRITE_STATUS_OK, result.status);
+  EXPECT_EQ(100, result.bytes_written);
+  EXPECT_EQ(1u, socket_.sent().size());
+  EXPECT_EQ(0u, writer_->queued_packets());
+  EXPECT_FALSE(writer_->IsWriteBlocked());
+}
+
+TEST_F(ServerPacketWriterTest, DrainsInOrder) {
+  CreateWriter(8, 8 * kMaxPacketSize);
+  socket_.set_blocked(true);
+
+  // the first packet is in flight, the others wait behind it
+  for (char tag = 'a'; tag <= 'e'; ++tag) {
+    EXPECT_EQ(WRITE_STATUS_OK, Write(MakePacket(tag, 10)).status);
+  }
+  EXPECT_EQ(1u, socket_.sent().size());
+  EXPECT_EQ(4u, writer_->queued_packets());
+  EXPECT_EQ(40u, writer_->queued_bytes());
+
+  socket_.set_blocked(false);
+  socket_.CompleteWrite(10);
+
+  ASSERT_EQ(5u, socket_.sent().size());
+  for (size_t i = 0; i < socket_.sent().size(); ++i) {
+    EXPECT_EQ(MakePacket('a' + i, 10), socket_.sent()[i]);
+  }
+  EXPECT_EQ(0u, writer_->queued_packets());
+  EXPECT_EQ(0u, writer_->queued_bytes());
+  EXPECT_EQ(1, blocked_writer_.can_write_count());
+}
+
+TEST_F(ServerPacketWriterTest, BlockedAtPacketLimit) {
+  const size_t kMaxPackets = 3;
+  CreateWriter(kMaxPackets, 100 * kMaxPacketSize);
+  socket_.set_blocked(true);
+
+  EXPECT_EQ(WRITE_STATUS_OK, Write(MakePacket('a', 10)).status);
+  for (size_t i = 0; i < kMaxPackets; ++i) {
+    EXPECT_FALSE(writer_->IsWriteBlocked());
+    EXPECT_EQ(WRITE_STATUS_OK, Write(MakePacket('b' + i, 10)).status);
+  }
+  EXPECT_TRUE(writer_->IsWriteBlocked());
+
+  // the connection keeps the refused packet
+  WriteResult result = Write(MakePacket('z', 10));
+  EXPECT_EQ(WRITE_STATUS_BLOCKED, result.status);
+  EXPECT_EQ(kMaxPackets, writer_->queued_packets());
+
+  // the next packet goes in flight, which makes room for one more
+  socket_.CompleteWrite(10);
+  EXPECT_TRUE(socket_.write_pending());
+  EXPECT_EQ(kMaxPackets - 1, writer_->queued_packets());
+  EXPECT_FALSE(writer_->IsWriteBlocked());
+  EXPECT_EQ(1, blocked_writer_.can_write_count());
+}
+
+TEST_F(ServerPacketWriterTest, BlockedAtByteLimit) {
+  CreateWriter(100, 3 * kMaxPacketSize);
+  socket_.set_blocked(true);
+
+  EXPECT_EQ(WRITE_STATUS_OK, Write(MakePacket('a', kMaxPacketSize)).status);
+
+  // a full size packet must still fit in the queue
+  EXPECT_EQ(WRITE_STATUS_OK, Write(MakePacket('b', kMaxPacketSize)).status);
+  EXPECT_EQ(WRITE_STATUS_OK, Write(MakePacket('c', kMaxPacketSize)).status);
+  EXPECT_FALSE(writer_->IsWriteBlocked());
+  EXPECT_EQ(WRITE_STATUS_OK, Write(MakePacket('d', 1)).status);
+  EXPECT_TRUE(writer_->IsWriteBlocked());
+  EXPECT_EQ(WRITE_STATUS_BLOCKED, Write(MakePacket('e', 1)).status);
+
+  socket_.set_blocked(false);
+  socket_.CompleteWrite(static_cast<int>(kMaxPacketSize));
+  EXPECT_EQ(4u, socket_.sent().size());
+  EXPECT_FALSE(writer_->IsWriteBlocked());
+  EXPECT_EQ(1, blocked_writer_.can_write_count());
+}
+
+TEST_F(ServerPacketWriterTest, QueuedWriteErrorReachesItsCallback) {
+  CreateWriter(4, 4 * kMaxPacketSize);
+  socket_.set_blocked(true);
+
+  WriteResult first_result(WRITE_STATUS_OK, 0);
+  WriteResult second_result(WRITE_STATUS_OK, 0);
+  std::string packet = MakePacket('a', 10);
+  writer_->WritePacketWithCallback(
+      packet.data(), packet.size(), IPAddress::IPv4Localhost(),
+      peer_address_, nullptr, base::Bind(&SaveWriteResult, &first_result));
+  writer_->WritePacketWithCallback(
+      packet.data(), packet.size(), IPAddress::IPv4Localhost(),
+      peer_address_, nullptr, base::Bind(&SaveWriteResult, &second_result));
+
+  // the in-flight packet fails, then so does the queued one
+  socket_.CompleteWrite(ERR_ADDRESS_UNREACHABLE);
+  EXPECT_EQ(WRITE_STATUS_ERROR, first_result.status);
+  EXPECT_EQ(ERR_ADDRESS_UNREACHABLE, first_result.error_code);
+  EXPECT_TRUE(socket_.write_pending());
+
+  socket_.CompleteWrite(ERR_ADDRESS_UNREACHABLE);
+  EXPECT_EQ(WRITE_STATUS_ERROR, second_result.status);
+  EXPECT_EQ(0u, writer_->queued_packets());
+  EXPECT_EQ(2, blocked_writer_.can_write_count());
+}
+
+}  // namespace net
@@ -39,6 +39,8 @@ bool ServerPerConnectionPacketWriter::IsWriteBlockedDataBuffered() const {
 }
 
 bool ServerPerConnectionPacketWriter::IsWriteBlocked() const {
+  // The shared writer queues packets behind a pending write and only blocks
+  // once its queue is full.
   return shared_writer_->IsWriteBlocked();
 }
 
@@ -14,19 +14,68 @@
 
 #include "stellite/server/server_session_helper.h"
 
+#include <string.h>
+
+#include "base/logging.h"
 #include "net/quic/core/crypto/quic_random.h"
 
 namespace net {
 
-ServerSessionHelper::ServerSessionHelper(QuicRandom* random)
-    : random_(random) {
+namespace {
+
+// Number of distinct values of the connection ID byte read by the steering
+// program.
+const uint32_t kSteeringByteValues = 256;
+
+}  // namespace
+
+ServerSessionHelper::ServerSessionHelper(QuicRandom* random,
+                                         uint32_t worker_index,
+                                         uint32_t worker_count)
+    : random_(random),
+      worker_index_(worker_index),
+      worker_count_(worker_count) {
+  DCHECK_GT(worker_count_, 0u);
+  DCHECK_LE(worker_count_, kSteeringByteValues);
+  DCHECK_LT(worker_index_, worker_count_);
 }
 
 ServerSessionHelper::~ServerSessionHelper() {}
 
+// static
+uint32_t ServerSessionHelper::GetWorkerIndex(QuicConnectionId connection_id,
+                                             uint32_t worker_count) {
+  DCHECK_GT(worker_count, 0u);
+  return static_cast<uint32_t>(connection_id & 0xff) % worker_count;
+}
+
+// static
+bool ServerSessionHelper::ReadConnectionId(const char* data,
+                                           size_t length,
+                                           QuicConnectionId* connection_id) {
+  if (length < 1 + sizeof(QuicConnectionId) ||
+      !(data[0] & PACKET_PUBLIC_FLAGS_8BYTE_CONNECTION_ID)) {
+    return false;
+  }
+  memcpy(connection_id, data + 1, sizeof(QuicConnectionId));
+  return true;
+}
+
 QuicConnectionId ServerSessionHelper::GenerateConnectionIdForReject(
     QuicConnectionId connection_id) const {
-  return random_->RandUint64();
+  QuicConnectionId new_connection_id = random_->RandUint64();
+  if (worker_count_ == 1) {
+    return new_connection_id;
+  }
+
+  // Pick a random byte value that maps to this worker so the lowest byte
+  // keeps as much entropy as the worker count allows.
+  uint32_t choices =
+      (kSteeringByteValues - 1 - worker_index_) / worker_count_ + 1;
+  uint32_t low_byte =
+      worker_index_ + (new_connection_id & 0xff) % choices * worker_count_;
+  return (new_connection_id & ~static_cast<QuicConnectionId>(0xff)) |
+      low_byte;
 }
 
 bool ServerSessionHelper::CanAcceptClientHello(
@@ -15,16 +15,37 @@
 #ifndef STELLITE_SERVER_SERVER_SESSION_HELPER_H_
 #define STELLITE_SERVER_SERVER_SESSION_HELPER_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "net/quic/core/quic_server_session_base.h"
 
 namespace net {
 class QuicRandom;
 
+// Connection IDs generated by a worker carry its index in their lowest byte,
+// which is the byte the SO_REUSEPORT steering program of
+// QuicUDPSocketPosix::AttachReusePortConnectionIdSteering() looks at, so the
+// kernel keeps delivering the connection to the same worker.
 class ServerSessionHelper : public QuicCryptoServerStream::Helper {
  public:
-  ServerSessionHelper(QuicRandom* random);
+  ServerSessionHelper(QuicRandom* random,
+                      uint32_t worker_index,
+                      uint32_t worker_count);
   ~ServerSessionHelper() override;
 
+  // Returns the index of the worker that packets of |connection_id| are
+  // steered to among |worker_count| workers.
+  static uint32_t GetWorkerIndex(QuicConnectionId connection_id,
+                                 uint32_t worker_count);
+
+  // Reads the connection ID of the public header in |data|. QUIC versions
+  // up to 36 put it on the wire in little-endian order right after the
+  // public flags. Returns false if the header has none.
+  static bool ReadConnectionId(const char* data,
+                               size_t length,
+                               QuicConnectionId* connection_id);
+
   QuicConnectionId GenerateConnectionIdForReject(
       QuicConnectionId connection_id) const override;
 
@@ -34,6 +55,8 @@ class ServerSessionHelper : public QuicCryptoServerStream::Helper {
 
  private:
   QuicRandom* random_;
+  const uint32_t worker_index_;
+  const uint32_t worker_count_;
 
   DISALLOW_COPY_AND_ASSIGN(ServerSessionHelper);
 };
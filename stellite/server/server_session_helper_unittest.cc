@@ -0,0 +1,119 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/server_session_helper.h"
+
+#include <stdint.h>
+
+#include <memory>
+
+#include "net/quic/core/crypto/quic_random.h"
+#include "net/quic/core/quic_framer.h"
+#include "net/quic/core/quic_protocol.h"
+#include "stellite/socket/quic_udp_socket_posix.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+
+namespace {
+
+// Worker counts to check, including ones that don't divide 256.
+const uint32_t kWorkerCounts[] = {1, 2, 3, 4, 5, 7, 8, 12, 16, 100, 255, 256};
+
+// Where the steering program sends a datagram among |worker_count| sockets.
+uint32_t SteerPacket(const QuicEncryptedPacket& packet,
+                     uint32_t worker_count) {
+  EXPECT_TRUE(packet.data()[QuicUDPSocketPosix::kQuicPublicFlagsOffset] &
+              PACKET_PUBLIC_FLAGS_8BYTE_CONNECTION_ID);
+  uint8_t steering_byte = static_cast<uint8_t>(
+      packet.data()[QuicUDPSocketPosix::kQuicConnectionIdLowByteOffset]);
+  return steering_byte % worker_count;
+}
+
+}  // namespace
+
+TEST(ServerSessionHelperTest, GeneratedIdsStayWithTheWorker) {
+  QuicRandom* random = QuicRandom::GetInstance();
+  for (uint32_t worker_count : kWorkerCounts) {
+    for (uint32_t worker_index = 0; worker_index < worker_count;
+         ++worker_index) {
+      ServerSessionHelper helper(random, worker_index, worker_count);
+      for (int i = 0; i < 64; ++i) {
+        QuicConnectionId connection_id =
+            helper.GenerateConnectionIdForReject(random->RandUint64());
+        ASSERT_EQ(worker_index, ServerSessionHelper::GetWorkerIndex(
+                                    connection_id, worker_count))
+            << "worker " << worker_index << " of " << worker_count;
+      }
+    }
+  }
+}
+
+TEST(ServerSessionHelperTest, EveryLowByteIsReachable) {
+  // Each low byte value belongs to exactly one worker and can be generated
+  // by it, so the steering byte keeps all the entropy it can.
+  QuicRandom* random = QuicRandom::GetInstance();
+  for (uint32_t worker_count : {3u, 7u, 100u}) {
+    bool seen[256] = {};
+    for (uint32_t worker_index = 0; worker_index < worker_count;
+         ++worker_index) {
+      ServerSessionHelper helper(random, worker_index, worker_count);
+      for (int i = 0; i < 4096; ++i) {
+        seen[helper.GenerateConnectionIdForReject(0) & 0xff] = true;
+      }
+    }
+    for (uint32_t low_byte = 0; low_byte < 256; ++low_byte) {
+      EXPECT_TRUE(seen[low_byte])
+          << low_byte << " with " << worker_count << " workers";
+    }
+  }
+}
+
+TEST(ServerSessionHelperTest, SteeringByteMatchesWireOrder) {
+  QuicRandom* random = QuicRandom::GetInstance();
+  for (uint32_t worker_count : kWorkerCounts) {
+    ServerSessionHelper helper(random, worker_count - 1, worker_count);
+    QuicConnectionId connection_id =
+        helper.GenerateConnectionIdForReject(random->RandUint64());
+
+    // The packet a client sends carries the connection ID as framed.
+    std::unique_ptr<QuicEncryptedPacket> packet(
+        QuicFramer::BuildVersionNegotiationPacket(connection_id,
+                                                  AllSupportedVersions()));
+    ASSERT_TRUE(packet);
+
+    QuicConnectionId read_connection_id = 0;
+    ASSERT_TRUE(ServerSessionHelper::ReadConnectionId(
+        packet->data(), packet->length(), &read_connection_id));
+    EXPECT_EQ(connection_id, read_connection_id);
+
+    // The kernel and the worker agree on the owner.
+    EXPECT_EQ(worker_count - 1, SteerPacket(*packet, worker_count));
+    EXPECT_EQ(worker_count - 1, ServerSessionHelper::GetWorkerIndex(
+                                    read_connection_id, worker_count));
+  }
+}
+
+TEST(ServerSessionHelperTest, ReadConnectionIdNeedsFullId) {
+  QuicConnectionId connection_id = 0;
+  const char kNoConnectionId[16] = {0};
+  EXPECT_FALSE(ServerSessionHelper::ReadConnectionId(
+      kNoConnectionId, sizeof(kNoConnectionId), &connection_id));
+
+  const char kTruncated[4] = {PACKET_PUBLIC_FLAGS_8BYTE_CONNECTION_ID};
+  EXPECT_FALSE(ServerSessionHelper::ReadConnectionId(
+      kTruncated, sizeof(kTruncated), &connection_id));
+}
+
+}  // namespace net
@@ -0,0 +1,379 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/upstream_group.h"
+
+#include "base/logging.h"
+#include "base/strings/string_split.h"
+#include "base/values.h"
+#include "net/url_request/url_fetcher.h"
+#include "stellite/fetcher/http_fetcher.h"
+#include "stellite/include/http_request.h"
+
+namespace net {
+
+namespace {
+
+const char* kServers = "servers";
+const char* kUrl = "url";
+const char* kWeight = "weight";
+const char* kBalance = "balance";
+const char* kMaxFails = "max_fails";
+const char* kFailTimeout = "fail_timeout";
+const char* kHealthCheckPath = "health_check_path";
+const char* kHealthCheckInterval = "health_check_interval";
+
+const char* kBalanceRoundRobin = "round_robin";
+const char* kBalanceLeastOutstanding = "least_outstanding";
+
+const int kDefaultMaxFails = 1;
+const int kDefaultFailTimeout = 10;
+const int kDefaultHealthCheckInterval = 5;
+
+bool ParseServer(const std::string& url, int weight,
+                 UpstreamConfig::Server* server) {
+  GURL origin = GURL(url).GetOrigin();
+  if (!origin.is_valid() || !origin.SchemeIsHTTPOrHTTPS() || weight <= 0) {
+    return false;
+  }
+
+  server->origin = origin;
+  server->weight = weight;
+  return true;
+}
+
+}  // namespace
+
+UpstreamConfig::Server::Server()
+    : weight(1) {
+}
+
+UpstreamConfig::Server::Server(const GURL& origin, int weight)
+    : origin(origin),
+      weight(weight) {
+}
+
+UpstreamConfig::Server::~Server() {}
+
+UpstreamConfig::UpstreamConfig()
+    : balance(BALANCE_ROUND_ROBIN),
+      max_fails(kDefaultMaxFails),
+      fail_timeout(base::TimeDelta::FromSeconds(kDefaultFailTimeout)),
+      health_check_interval(
+          base::TimeDelta::FromSeconds(kDefaultHealthCheckInterval)) {
+}
+
+UpstreamConfig::UpstreamConfig(const UpstreamConfig& other) = default;
+
+UpstreamConfig::~UpstreamConfig() {}
+
+bool UpstreamConfig::ParseFromDictionary(
+    const base::DictionaryValue& dictionary) {
+  const base::ListValue* server_list = nullptr;
+  if (!dictionary.GetList(kServers, &server_list) || server_list->empty()) {
+    LOG(ERROR) << "upstream: servers are not set";
+    return false;
+  }
+
+  servers.clear();
+  for (size_t i = 0; i < server_list->GetSize(); ++i) {
+    std::string url;
+    int weight = 1;
+    const base::DictionaryValue* entry = nullptr;
+    if (server_list->GetDictionary(i, &entry)) {
+      if (!entry->GetString(kUrl, &url)) {
+        LOG(ERROR) << "upstream: server url is not set";
+        return false;
+      }
+      entry->GetInteger(kWeight, &weight);
+    } else if (!server_list->GetString(i, &url)) {
+      LOG(ERROR) << "upstream: server entry is invalid";
+      return false;
+    }
+
+    Server server;
+    if (!ParseServer(url, weight, &server)) {
+      LOG(ERROR) << "upstream: server " << url << " is invalid";
+      return false;
+    }
+    servers.push_back(server);
+  }
+
+  std::string balance_name;
+  if (dictionary.GetString(kBalance, &balance_name) &&
+      !ParseBalance(balance_name, &balance)) {
+    LOG(ERROR) << "upstream: balance is invalid";
+    return false;
+  }
+
+  if (dictionary.GetInteger(kMaxFails, &max_fails) && max_fails <= 0) {
+    LOG(ERROR) << "upstream: max_fails is invalid";
+    return false;
+  }
+
+  int seconds;
+  if (dictionary.GetInteger(kFailTimeout, &seconds)) {
+    if (seconds < 0) {
+      LOG(ERROR) << "upstream: fail_timeout is invalid";
+      return false;
+    }
+    fail_timeout = base::TimeDelta::FromSeconds(seconds);
+  }
+
+  dictionary.GetString(kHealthCheckPath, &health_check_path);
+
+  if (dictionary.GetInteger(kHealthCheckInterval, &seconds)) {
+    if (seconds <= 0) {
+      LOG(ERROR) << "upstream: health_check_interval is invalid";
+      return false;
+    }
+    health_check_interval = base::TimeDelta::FromSeconds(seconds);
+  }
+
+  return true;
+}
+
+bool UpstreamConfig::ParseServerList(const std::string& server_list) {
+  servers.clear();
+  for (const std::string& url : base::SplitString(
+           server_list, ",", base::TRIM_WHITESPACE,
+           base::SPLIT_WANT_NONEMPTY)) {
+    Server server;
+    if (!ParseServer(url, 1, &server)) {
+      return false;
+    }
+    servers.push_back(server);
+  }
+  return !servers.empty();
+}
+
+// static
+bool UpstreamConfig::ParseBalance(const std::string& name, Balance* balance) {
+  if (name == kBalanceRoundRobin) {
+    *balance = BALANCE_ROUND_ROBIN;
+  } else if (name == kBalanceLeastOutstanding) {
+    *balance = BALANCE_LEAST_OUTSTANDING;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+UpstreamGroup::ServerState::ServerState()
+    : weight(1),
+      current_weight(0),
+      outstanding(0),
+      consecutive_fails(0),
+      healthy(true),
+      health_check_pending(false) {
+}
+
+UpstreamGroup::ServerState::~ServerState() {}
+
+UpstreamGroup::UpstreamGroup(const UpstreamConfig& config,
+                             stellite::HttpFetcher* http_fetcher)
+    : config_(config),
+      next_scan_start_(0),
+      http_fetcher_(http_fetcher),
+      weak_factory_(this) {
+  DCHECK(!config_.servers.empty());
+  for (const UpstreamConfig::Server& server : config_.servers) {
+    ServerState state;
+    state.origin = server.origin;
+    state.weight = server.weight;
+    servers_.push_back(state);
+  }
+}
+
+UpstreamGroup::~UpstreamGroup() {
+  // A config reload replaces the group while its checks may be in flight.
+  for (const auto& health_check : health_checks_) {
+    http_fetcher_->Cancel(health_check.first);
+  }
+}
+
+void UpstreamGroup::Start() {
+  if (config_.health_check_path.empty()) {
+    return;
+  }
+
+  health_check_timer_.Start(FROM_HERE, config_.health_check_interval, this,
+                            &UpstreamGroup::SendHealthChecks);
+  SendHealthChecks();
+}
+
+size_t UpstreamGroup::Acquire() {
+  base::TimeTicks now = base::TimeTicks::Now();
+  bool any_available = false;
+  for (const ServerState& server : servers_) {
+    if (IsAvailable(server, now)) {
+      any_available = true;
+      break;
+    }
+  }
+
+  size_t index = config_.balance == UpstreamConfig::BALANCE_ROUND_ROBIN ?
+      PickRoundRobin(any_available, now) :
+      PickLeastOutstanding(any_available, now);
+  ++servers_[index].outstanding;
+  return index;
+}
+
+void UpstreamGroup::Release(size_t index, bool success) {
+  DCHECK_LT(index, servers_.size());
+  ServerState& server = servers_[index];
+  DCHECK_GT(server.outstanding, 0u);
+  --server.outstanding;
+
+  if (success) {
+    server.consecutive_fails = 0;
+    return;
+  }
+
+  if (++server.consecutive_fails >= config_.max_fails) {
+    LOG(WARNING) << "Upstream " << server.origin.spec()
+                 << " is taken out of rotation for "
+                 << config_.fail_timeout.InSeconds() << " seconds";
+    server.consecutive_fails = 0;
+    server.ejected_until = base::TimeTicks::Now() + config_.fail_timeout;
+  }
+}
+
+const GURL& UpstreamGroup::origin(size_t index) const {
+  DCHECK_LT(index, servers_.size());
+  return servers_[index].origin;
+}
+
+base::WeakPtr<UpstreamGroup> UpstreamGroup::GetWeakPtr() {
+  return weak_factory_.GetWeakPtr();
+}
+
+bool UpstreamGroup::IsAvailable(const ServerState& server,
+                                base::TimeTicks now) const {
+  return server.healthy && server.ejected_until <= now;
+}
+
+size_t UpstreamGroup::PickRoundRobin(bool available_only,
+                                     base::TimeTicks now) {
+  size_t best = servers_.size();
+  int total_weight = 0;
+  for (size_t i = 0; i < servers_.size(); ++i) {
+    ServerState& server = servers_[i];
+    if (available_only && !IsAvailable(server, now)) {
+      continue;
+    }
+
+    server.current_weight += server.weight;
+    total_weight += server.weight;
+    if (best == servers_.size() ||
+        server.current_weight > servers_[best].current_weight) {
+      best = i;
+    }
+  }
+
+  DCHECK_LT(best, servers_.size());
+  servers_[best].current_weight -= total_weight;
+  return best;
+}
+
+size_t UpstreamGroup::PickLeastOutstanding(bool available_only,
+                                           base::TimeTicks now) {
+  size_t best = servers_.size();
+  for (size_t n = 0; n < servers_.size(); ++n) {
+    size_t i = (next_scan_start_ + n) % servers_.size();
+    const ServerState& server = servers_[i];
+    if (available_only && !IsAvailable(server, now)) {
+      continue;
+    }
+
+    // outstanding / weight, compared without division.
+    if (best == servers_.size() ||
+        server.outstanding * servers_[best].weight <
+            servers_[best].outstanding * server.weight) {
+      best = i;
+    }
+  }
+
+  DCHECK_LT(best, servers_.size());
+  next_scan_start_ = (next_scan_start_ + 1) % servers_.size();
+  return best;
+}
+
+void UpstreamGroup::SendHealthChecks() {
+  for (size_t i = 0; i < servers_.size(); ++i) {
+    ServerState& server = servers_[i];
+    if (server.health_check_pending) {
+      continue;
+    }
+
+    stellite::HttpRequest request;
+    request.url = server.origin.Resolve(config_.health_check_path).spec();
+    request.request_type = stellite::HttpRequest::GET;
+    request.is_stream_response = false;
+    request.is_stop_on_redirect = true;
+
+    int request_id = http_fetcher_->Request(
+        request, config_.health_check_interval.InMilliseconds(),
+        weak_factory_.GetWeakPtr());
+    // the fetcher is full; probe again on the next round
+    if (request_id == stellite::HttpFetcherTaskTable::kInvalidRequestId) {
+      continue;
+    }
+    health_checks_[request_id] = i;
+    server.health_check_pending = true;
+  }
+}
+
+void UpstreamGroup::OnHealthCheckDone(int request_id, bool healthy) {
+  std::map<int, size_t>::iterator it = health_checks_.find(request_id);
+  if (it == health_checks_.end()) {
+    return;
+  }
+
+  ServerState& server = servers_[it->second];
+  health_checks_.erase(it);
+  server.health_check_pending = false;
+
+  if (server.healthy != healthy) {
+    LOG(WARNING) << "Upstream " << server.origin.spec() << " is "
+                 << (healthy ? "healthy" : "unhealthy");
+  }
+  server.healthy = healthy;
+}
+
+void UpstreamGroup::OnTaskComplete(int request_id,
+                                   const URLFetcher* source,
+                                   const HttpResponseInfo* response_info) {
+  int response_code = source ? source->GetResponseCode() : -1;
+  OnHealthCheckDone(request_id, response_code >= 200 && response_code < 400);
+}
+
+void UpstreamGroup::OnTaskHeader(int request_id,
+                                 const URLFetcher* source,
+                                 const HttpResponseInfo* response_info) {
+  NOTREACHED();
+}
+
+void UpstreamGroup::OnTaskStream(int request_id,
+                                 const char* data, size_t len, bool fin) {
+  NOTREACHED();
+}
+
+void UpstreamGroup::OnTaskError(int request_id,
+                                const URLFetcher* source,
+                                int error_code) {
+  OnHealthCheckDone(request_id, false);
+}
+
+}  // namespace net
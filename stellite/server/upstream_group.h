@@ -0,0 +1,181 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_SERVER_UPSTREAM_GROUP_H_
+#define STELLITE_SERVER_UPSTREAM_GROUP_H_
+
+#include <stddef.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/memory/weak_ptr.h"
+#include "base/time/time.h"
+#include "base/timer/timer.h"
+#include "net/base/net_export.h"
+#include "stellite/fetcher/http_fetcher_task.h"
+#include "url/gurl.h"
+
+namespace base {
+class DictionaryValue;
+}
+
+namespace stellite {
+class HttpFetcher;
+}
+
+namespace net {
+
+// Backend origins a QUIC worker proxies requests to, and how to spread
+// requests over them.
+struct NET_EXPORT UpstreamConfig {
+  enum Balance {
+    // Smooth weighted round-robin.
+    BALANCE_ROUND_ROBIN,
+
+    // The origin with the fewest requests in flight relative to its weight.
+    BALANCE_LEAST_OUTSTANDING,
+  };
+
+  struct NET_EXPORT Server {
+    Server();
+    Server(const GURL& origin, int weight);
+    ~Server();
+
+    GURL origin;
+    int weight;
+  };
+
+  UpstreamConfig();
+  UpstreamConfig(const UpstreamConfig& other);
+  ~UpstreamConfig();
+
+  // Parses the "upstream" dictionary of the server config file:
+  //   {
+  //     "servers": [ "http://10.0.0.1:8080",
+  //                  { "url": "http://10.0.0.2:8080", "weight": 2 } ],
+  //     "balance": "round_robin" | "least_outstanding",
+  //     "max_fails": 1,
+  //     "fail_timeout": 10,
+  //     "health_check_path": "/health",
+  //     "health_check_interval": 5
+  //   }
+  // Every key but "servers" is optional.
+  bool ParseFromDictionary(const base::DictionaryValue& dictionary);
+
+  // Parses a comma separated list of origins, all with weight 1.
+  bool ParseServerList(const std::string& server_list);
+
+  static bool ParseBalance(const std::string& name, Balance* balance);
+
+  std::vector<Server> servers;
+  Balance balance;
+
+  // Consecutive errors after which an origin is taken out of rotation for
+  // |fail_timeout|.
+  int max_fails;
+  base::TimeDelta fail_timeout;
+
+  // Active health checks are off if |health_check_path| is empty. An origin
+  // failing a check stays out of rotation until a check succeeds.
+  std::string health_check_path;
+  base::TimeDelta health_check_interval;
+};
+
+// Picks the backend origin of each proxied request. Lives on the dispatch
+// thread of a worker.
+class NET_EXPORT UpstreamGroup : public stellite::HttpFetcherTask::Visitor {
+ public:
+  UpstreamGroup(const UpstreamConfig& config,
+                stellite::HttpFetcher* http_fetcher);
+  ~UpstreamGroup() override;
+
+  // Starts the active health checks, if configured.
+  void Start();
+
+  // Picks the origin of a new request. Every Acquire() must be balanced by a
+  // Release() of the returned index. Origins taken out of rotation are only
+  // picked when every origin is out.
+  size_t Acquire();
+
+  // Reports the end of a request sent to |index|. A failed request counts
+  // towards the passive ejection of the origin.
+  void Release(size_t index, bool success);
+
+  const GURL& origin(size_t index) const;
+  size_t size() const { return servers_.size(); }
+
+  base::WeakPtr<UpstreamGroup> GetWeakPtr();
+
+  // Implements stellite::HttpFetcherTask::Visitor for health checks
+  void OnTaskComplete(int request_id,
+                      const URLFetcher* source,
+                      const HttpResponseInfo* response_info) override;
+  void OnTaskHeader(int request_id,
+                    const URLFetcher* source,
+                    const HttpResponseInfo* response_info) override;
+  void OnTaskStream(int request_id,
+                    const char* data, size_t len, bool fin) override;
+  void OnTaskError(int request_id,
+                   const URLFetcher* source,
+                   int error_code) override;
+
+ private:
+  struct ServerState {
+    ServerState();
+    ~ServerState();
+
+    GURL origin;
+    int weight;
+
+    // Smooth weighted round-robin credit.
+    int current_weight;
+
+    size_t outstanding;
+    int consecutive_fails;
+    base::TimeTicks ejected_until;
+    bool healthy;
+    bool health_check_pending;
+  };
+
+  bool IsAvailable(const ServerState& server, base::TimeTicks now) const;
+
+  size_t PickRoundRobin(bool available_only, base::TimeTicks now);
+  size_t PickLeastOutstanding(bool available_only, base::TimeTicks now);
+
+  void SendHealthChecks();
+  void OnHealthCheckDone(int request_id, bool healthy);
+
+  const UpstreamConfig config_;
+  std::vector<ServerState> servers_;
+
+  // Rotates the start of the least-outstanding scan so ties are shared.
+  size_t next_scan_start_;
+
+  stellite::HttpFetcher* http_fetcher_; /* not owned */
+
+  // Health check request id to origin index.
+  std::map<int, size_t> health_checks_;
+  base::RepeatingTimer health_check_timer_;
+
+  base::WeakPtrFactory<UpstreamGroup> weak_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(UpstreamGroup);
+};
+
+}  // namespace net
+
+#endif  // STELLITE_SERVER_UPSTREAM_GROUP_H_
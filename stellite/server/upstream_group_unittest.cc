@@ -0,0 +1,118 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/upstream_group.h"
+
+#include <memory>
+
+#include "base/json/json_reader.h"
+#include "base/values.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+namespace test {
+
+namespace {
+
+const char* kOriginA = "http://10.0.0.1:8080/";
+const char* kOriginB = "http://10.0.0.2:8080/";
+
+UpstreamConfig CreateConfig(UpstreamConfig::Balance balance,
+                            int weight_a, int weight_b) {
+  UpstreamConfig config;
+  config.balance = balance;
+  config.servers.push_back(UpstreamConfig::Server(GURL(kOriginA), weight_a));
+  config.servers.push_back(UpstreamConfig::Server(GURL(kOriginB), weight_b));
+  return config;
+}
+
+}  // namespace
+
+TEST(UpstreamConfigTest, ParseFromDictionary) {
+  std::unique_ptr<base::DictionaryValue> dictionary =
+      base::DictionaryValue::From(base::JSONReader::Read(
+          "{\"servers\": [\"http://10.0.0.1:8080/path\","
+          "               {\"url\": \"http://10.0.0.2:8080\", \"weight\": 3}],"
+          " \"balance\": \"least_outstanding\","
+          " \"max_fails\": 2,"
+          " \"health_check_path\": \"/health\"}"));
+  ASSERT_TRUE(dictionary);
+
+  UpstreamConfig config;
+  ASSERT_TRUE(config.ParseFromDictionary(*dictionary));
+  ASSERT_EQ(2u, config.servers.size());
+  EXPECT_EQ(GURL(kOriginA), config.servers[0].origin);
+  EXPECT_EQ(1, config.servers[0].weight);
+  EXPECT_EQ(GURL(kOriginB), config.servers[1].origin);
+  EXPECT_EQ(3, config.servers[1].weight);
+  EXPECT_EQ(UpstreamConfig::BALANCE_LEAST_OUTSTANDING, config.balance);
+  EXPECT_EQ(2, config.max_fails);
+  EXPECT_EQ("/health", config.health_check_path);
+
+  EXPECT_FALSE(config.ParseServerList("ftp://10.0.0.1"));
+  EXPECT_TRUE(config.ParseServerList(" http://10.0.0.1:8080 ,"));
+  EXPECT_EQ(1u, config.servers.size());
+}
+
+TEST(UpstreamGroupTest, WeightedRoundRobin) {
+  UpstreamGroup group(
+      CreateConfig(UpstreamConfig::BALANCE_ROUND_ROBIN, 1, 2), nullptr);
+
+  // Smooth weighted round-robin interleaves instead of bursting: B A B.
+  size_t picks[3];
+  for (size_t& pick : picks) {
+    pick = group.Acquire();
+    group.Release(pick, true);
+  }
+  EXPECT_EQ(1u, picks[0]);
+  EXPECT_EQ(0u, picks[1]);
+  EXPECT_EQ(1u, picks[2]);
+}
+
+TEST(UpstreamGroupTest, LeastOutstanding) {
+  UpstreamGroup group(
+      CreateConfig(UpstreamConfig::BALANCE_LEAST_OUTSTANDING, 1, 1), nullptr);
+
+  size_t first = group.Acquire();
+  size_t second = group.Acquire();
+  EXPECT_NE(first, second);
+
+  group.Release(first, true);
+  EXPECT_EQ(first, group.Acquire());
+}
+
+TEST(UpstreamGroupTest, PassiveEjection) {
+  UpstreamGroup group(
+      CreateConfig(UpstreamConfig::BALANCE_ROUND_ROBIN, 1, 1), nullptr);
+
+  size_t failed = group.Acquire();
+  group.Release(failed, false);
+
+  // The failed origin sits out |fail_timeout| while another one is up.
+  for (int i = 0; i < 4; ++i) {
+    size_t index = group.Acquire();
+    EXPECT_NE(failed, index);
+    group.Release(index, true);
+  }
+
+  // With every origin out, requests still go somewhere.
+  size_t other = group.Acquire();
+  group.Release(other, false);
+  size_t index = group.Acquire();
+  EXPECT_LT(index, group.size());
+  group.Release(index, true);
+}
+
+}  // namespace test
+}  // namespace net
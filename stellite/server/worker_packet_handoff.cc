@@ -0,0 +1,204 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/worker_packet_handoff.h"
+
+#include <string.h>
+
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/single_thread_task_runner.h"
+
+namespace net {
+
+namespace {
+
+// Packets in flight from one worker to another.
+const size_t kHandoffRingCapacity = 64;
+
+}  // namespace
+
+PacketHandoffRing::Packet::Packet()
+    : length(0),
+      receipt_time(QuicTime::Zero()) {
+}
+
+PacketHandoffRing::Packet::~Packet() {}
+
+PacketHandoffRing::PacketHandoffRing(size_t capacity)
+    : mask_(static_cast<uint32_t>(capacity - 1)),
+      tail_(0),
+      head_(0) {
+  DCHECK_GT(capacity, 0u);
+  DCHECK_EQ(capacity & (capacity - 1), 0u);
+}
+
+PacketHandoffRing::~PacketHandoffRing() {}
+
+bool PacketHandoffRing::Push(const char* data,
+                             size_t length,
+                             const IPEndPoint& self_address,
+                             const IPEndPoint& peer_address,
+                             QuicTime receipt_time) {
+  if (length > kMaxPacketSize) {
+    return false;
+  }
+
+  uint32_t tail = static_cast<uint32_t>(base::subtle::NoBarrier_Load(&tail_));
+  uint32_t head = static_cast<uint32_t>(base::subtle::Acquire_Load(&head_));
+  if (tail - head > mask_) {
+    return false;
+  }
+
+  // The consumer only touches |slots_| after it observes the tail published
+  // below, so allocating here is safe.
+  if (!slots_) {
+    slots_.reset(new Packet[mask_ + 1]);
+  }
+
+  Packet* packet = &slots_[tail & mask_];
+  memcpy(packet->data, data, length);
+  packet->length = length;
+  packet->self_address = self_address;
+  packet->peer_address = peer_address;
+  packet->receipt_time = receipt_time;
+
+  base::subtle::Release_Store(&tail_,
+                              static_cast<base::subtle::Atomic32>(tail + 1));
+  return true;
+}
+
+const PacketHandoffRing::Packet* PacketHandoffRing::Front() const {
+  uint32_t head = static_cast<uint32_t>(base::subtle::NoBarrier_Load(&head_));
+  uint32_t tail = static_cast<uint32_t>(base::subtle::Acquire_Load(&tail_));
+  if (head == tail) {
+    return nullptr;
+  }
+  return &slots_[head & mask_];
+}
+
+void PacketHandoffRing::Pop() {
+  uint32_t head = static_cast<uint32_t>(base::subtle::NoBarrier_Load(&head_));
+  DCHECK_NE(head,
+            static_cast<uint32_t>(base::subtle::Acquire_Load(&tail_)));
+  base::subtle::Release_Store(&head_,
+                              static_cast<base::subtle::Atomic32>(head + 1));
+}
+
+WorkerPacketHandoff::Worker::Worker()
+    : registered(0),
+      drain_pending(0) {
+}
+
+WorkerPacketHandoff::Worker::~Worker() {}
+
+WorkerPacketHandoff::WorkerPacketHandoff(size_t worker_count) {
+  for (size_t to = 0; to < worker_count; ++to) {
+    std::unique_ptr<Worker> worker(new Worker());
+    worker->rings.resize(worker_count);
+    for (size_t from = 0; from < worker_count; ++from) {
+      if (from != to) {
+        worker->rings[from].reset(
+            new PacketHandoffRing(kHandoffRingCapacity));
+      }
+    }
+    workers_.push_back(std::move(worker));
+  }
+}
+
+WorkerPacketHandoff::~WorkerPacketHandoff() {}
+
+void WorkerPacketHandoff::RegisterWorker(
+    size_t worker_index,
+    scoped_refptr<base::SingleThreadTaskRunner> task_runner,
+    const base::Closure& drain_callback) {
+  DCHECK_LT(worker_index, workers_.size());
+  Worker* worker = workers_[worker_index].get();
+  DCHECK(!base::subtle::NoBarrier_Load(&worker->registered));
+
+  worker->task_runner = task_runner;
+  worker->drain_callback = drain_callback;
+  base::subtle::Release_Store(&worker->registered, 1);
+}
+
+bool WorkerPacketHandoff::Forward(size_t from,
+                                  size_t to,
+                                  const char* data,
+                                  size_t length,
+                                  const IPEndPoint& self_address,
+                                  const IPEndPoint& peer_address,
+                                  QuicTime receipt_time) {
+  DCHECK_LT(from, workers_.size());
+  DCHECK_LT(to, workers_.size());
+  DCHECK_NE(from, to);
+
+  Worker* worker = workers_[to].get();
+  if (!base::subtle::Acquire_Load(&worker->registered)) {
+    return false;
+  }
+
+  if (!worker->rings[from]->Push(data, length, self_address, peer_address,
+                                 receipt_time)) {
+    return false;
+  }
+
+  // Pairs with the barrier in Drain(): either the consumer sees the packet
+  // pushed above, or this sees the flag cleared and posts a new drain task.
+  base::subtle::MemoryBarrier();
+  if (base::subtle::NoBarrier_CompareAndSwap(&worker->drain_pending, 0, 1) ==
+      0) {
+    worker->task_runner->PostTask(FROM_HERE, worker->drain_callback);
+  }
+  return true;
+}
+
+size_t WorkerPacketHandoff::Drain(size_t worker_index,
+                                  const PacketCallback& callback) {
+  DCHECK_LT(worker_index, workers_.size());
+  Worker* worker = workers_[worker_index].get();
+  DCHECK(worker->task_runner->BelongsToCurrentThread());
+
+  base::subtle::NoBarrier_Store(&worker->drain_pending, 0);
+  base::subtle::MemoryBarrier();
+
+  // Take at most one ring's worth from each producer so a busy producer
+  // can't keep this task running.
+  size_t count = 0;
+  bool more = false;
+  for (const auto& ring : worker->rings) {
+    if (!ring) {
+      continue;
+    }
+
+    for (size_t i = 0; i < kHandoffRingCapacity; ++i) {
+      const PacketHandoffRing::Packet* packet = ring->Front();
+      if (!packet) {
+        break;
+      }
+      callback.Run(*packet);
+      ring->Pop();
+      ++count;
+    }
+    more = more || ring->Front() != nullptr;
+  }
+
+  if (more &&
+      base::subtle::NoBarrier_CompareAndSwap(&worker->drain_pending, 0, 1) ==
+          0) {
+    worker->task_runner->PostTask(FROM_HERE, worker->drain_callback);
+  }
+  return count;
+}
+
+}  // namespace net
@@ -0,0 +1,149 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_SERVER_WORKER_PACKET_HANDOFF_H_
+#define STELLITE_SERVER_WORKER_PACKET_HANDOFF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <vector>
+
+#include "base/atomicops.h"
+#include "base/callback.h"
+#include "base/macros.h"
+#include "base/memory/ref_counted.h"
+#include "net/base/ip_endpoint.h"
+#include "net/base/net_export.h"
+#include "net/quic/core/quic_protocol.h"
+#include "net/quic/core/quic_time.h"
+
+namespace base {
+class SingleThreadTaskRunner;
+}
+
+namespace net {
+
+// A bounded queue of datagrams with a single producer thread and a single
+// consumer thread. Neither side takes a lock: each side owns one index and
+// publishes it to the other with a release store.
+class NET_EXPORT PacketHandoffRing {
+ public:
+  struct Packet {
+    Packet();
+    ~Packet();
+
+    char data[kMaxPacketSize];
+    size_t length;
+    IPEndPoint self_address;
+    IPEndPoint peer_address;
+    QuicTime receipt_time;
+  };
+
+  // |capacity| must be a power of two. Slots are allocated by the first
+  // Push(), so rings between workers that never forward cost nothing.
+  explicit PacketHandoffRing(size_t capacity);
+  ~PacketHandoffRing();
+
+  // Copies a datagram into the ring. Producer side only. Returns false if the
+  // ring is full or the datagram is larger than kMaxPacketSize.
+  bool Push(const char* data,
+            size_t length,
+            const IPEndPoint& self_address,
+            const IPEndPoint& peer_address,
+            QuicTime receipt_time);
+
+  // Returns the oldest datagram, or nullptr if the ring is empty. The packet
+  // stays valid until Pop(). Consumer side only.
+  const Packet* Front() const;
+  void Pop();
+
+ private:
+  const uint32_t mask_;
+  std::unique_ptr<Packet[]> slots_;
+
+  // Next slot to write. Written by the producer only.
+  base::subtle::Atomic32 tail_;
+
+  // Keeps the two indices on separate cache lines.
+  char padding_[64 - sizeof(base::subtle::Atomic32)];
+
+  // Next slot to read. Written by the consumer only.
+  base::subtle::Atomic32 head_;
+
+  DISALLOW_COPY_AND_ASSIGN(PacketHandoffRing);
+};
+
+// Moves datagrams between the dispatch threads of the workers sharing a port.
+// Every ordered pair of workers has its own PacketHandoffRing, so each ring
+// keeps a single producer and a single consumer. A worker that has packets
+// waiting gets one drain task posted to its dispatch thread.
+class NET_EXPORT WorkerPacketHandoff {
+ public:
+  typedef base::Callback<void(const PacketHandoffRing::Packet&)>
+      PacketCallback;
+
+  explicit WorkerPacketHandoff(size_t worker_count);
+  ~WorkerPacketHandoff();
+
+  size_t worker_count() const { return workers_.size(); }
+
+  // Lets |worker_index| receive packets: |drain_callback| is posted to
+  // |task_runner| whenever packets are waiting, and should call Drain().
+  // Packets forwarded to a worker before it registers are dropped.
+  void RegisterWorker(size_t worker_index,
+                      scoped_refptr<base::SingleThreadTaskRunner> task_runner,
+                      const base::Closure& drain_callback);
+
+  // Queues a datagram read by worker |from| for worker |to|. Called on the
+  // dispatch thread of |from|. Returns false if the packet was dropped.
+  bool Forward(size_t from,
+               size_t to,
+               const char* data,
+               size_t length,
+               const IPEndPoint& self_address,
+               const IPEndPoint& peer_address,
+               QuicTime receipt_time);
+
+  // Runs |callback| for every packet waiting for |worker_index|. Called on
+  // the dispatch thread of |worker_index|. Returns the number of packets.
+  size_t Drain(size_t worker_index, const PacketCallback& callback);
+
+ private:
+  struct Worker {
+    Worker();
+    ~Worker();
+
+    scoped_refptr<base::SingleThreadTaskRunner> task_runner;
+    base::Closure drain_callback;
+
+    // Set once the fields above are usable from other threads.
+    base::subtle::Atomic32 registered;
+
+    // Set while a drain task is posted and hasn't started yet.
+    base::subtle::Atomic32 drain_pending;
+
+    // Incoming packets, indexed by the producing worker.
+    std::vector<std::unique_ptr<PacketHandoffRing>> rings;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkerPacketHandoff);
+};
+
+}  // namespace net
+
+#endif  // STELLITE_SERVER_WORKER_PACKET_HANDOFF_H_
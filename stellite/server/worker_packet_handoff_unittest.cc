@@ -0,0 +1,218 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/worker_packet_handoff.h"
+
+#include <string.h>
+
+#include <string>
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/run_loop.h"
+#include "base/single_thread_task_runner.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "base/threading/thread.h"
+#include "base/threading/thread_task_runner_handle.h"
+#include "base/time/time.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+
+namespace {
+
+// Packets the worker rings hold; see worker_packet_handoff.cc.
+const size_t kHandoffRingCapacity = 64;
+
+const uint32_t kStressPacketCount = 200000;
+
+bool PushSequence(PacketHandoffRing* ring, uint32_t sequence) {
+  return ring->Push(reinterpret_cast<const char*>(&sequence),
+                    sizeof(sequence), IPEndPoint(), IPEndPoint(),
+                    QuicTime::Zero());
+}
+
+uint32_t ReadSequence(const PacketHandoffRing::Packet& packet) {
+  EXPECT_EQ(sizeof(uint32_t), packet.length);
+  uint32_t sequence;
+  memcpy(&sequence, packet.data, sizeof(sequence));
+  return sequence;
+}
+
+void Increment(int* count) {
+  ++(*count);
+}
+
+void ExpectPacket(const PacketHandoffRing::Packet& packet) {
+  EXPECT_EQ(std::string("packet", 7),
+            std::string(packet.data, packet.length));
+}
+
+// Worker 1 of a handoff, draining on a thread of its own and checking that
+// the packets of worker 0 arrive once each and in order.
+class DrainingWorker {
+ public:
+  DrainingWorker(WorkerPacketHandoff* handoff,
+                 base::WaitableEvent* done)
+      : handoff_(handoff),
+        done_(done),
+        next_sequence_(0),
+        out_of_order_(0) {
+  }
+
+  void Drain() {
+    handoff_->Drain(1, base::Bind(&DrainingWorker::OnPacket,
+                                  base::Unretained(this)));
+  }
+
+  uint32_t received() const { return next_sequence_; }
+  uint32_t out_of_order() const { return out_of_order_; }
+
+ private:
+  void OnPacket(const PacketHandoffRing::Packet& packet) {
+    uint32_t sequence = ReadSequence(packet);
+    if (sequence != next_sequence_) {
+      ++out_of_order_;
+    }
+    next_sequence_ = sequence + 1;
+    if (next_sequence_ == kStressPacketCount) {
+      done_->Signal();
+    }
+  }
+
+  WorkerPacketHandoff* handoff_;
+  base::WaitableEvent* done_;
+  uint32_t next_sequence_;
+  uint32_t out_of_order_;
+};
+
+// Forwards every sequence number from worker 0, retrying while the ring is
+// full.
+void ForwardAll(WorkerPacketHandoff* handoff) {
+  for (uint32_t sequence = 0; sequence < kStressPacketCount; ++sequence) {
+    while (!handoff->Forward(0, 1, reinterpret_cast<const char*>(&sequence),
+                             sizeof(sequence), IPEndPoint(), IPEndPoint(),
+                             QuicTime::Zero())) {
+      base::PlatformThread::YieldCurrentThread();
+    }
+  }
+}
+
+}  // namespace
+
+TEST(PacketHandoffRingTest, PushPopAcrossWraparound) {
+  PacketHandoffRing ring(4);
+  EXPECT_EQ(nullptr, ring.Front());
+
+  uint32_t pushed = 0;
+  uint32_t popped = 0;
+  for (int round = 0; round < 10; ++round) {
+    for (int i = 0; i < 3; ++i) {
+      ASSERT_TRUE(PushSequence(&ring, pushed++));
+    }
+    for (int i = 0; i < 3; ++i) {
+      const PacketHandoffRing::Packet* packet = ring.Front();
+      ASSERT_NE(nullptr, packet);
+      EXPECT_EQ(popped++, ReadSequence(*packet));
+      ring.Pop();
+    }
+    EXPECT_EQ(nullptr, ring.Front());
+  }
+}
+
+TEST(PacketHandoffRingTest, FullRingDrops) {
+  PacketHandoffRing ring(4);
+  for (uint32_t sequence = 0; sequence < 4; ++sequence) {
+    EXPECT_TRUE(PushSequence(&ring, sequence));
+  }
+  EXPECT_FALSE(PushSequence(&ring, 4));
+
+  // A free slot takes the next packet; the dropped one is gone.
+  ring.Pop();
+  EXPECT_TRUE(PushSequence(&ring, 5));
+  for (uint32_t sequence : {1u, 2u, 3u, 5u}) {
+    ASSERT_NE(nullptr, ring.Front());
+    EXPECT_EQ(sequence, ReadSequence(*ring.Front()));
+    ring.Pop();
+  }
+  EXPECT_EQ(nullptr, ring.Front());
+
+  // Datagrams over kMaxPacketSize don't fit a slot.
+  std::string oversized(kMaxPacketSize + 1, 'a');
+  EXPECT_FALSE(ring.Push(oversized.data(), oversized.size(), IPEndPoint(),
+                         IPEndPoint(), QuicTime::Zero()));
+}
+
+TEST(WorkerPacketHandoffTest, ForwardAndDrain) {
+  WorkerPacketHandoff handoff(2);
+  const char kData[] = "packet";
+
+  // Nobody receives for an unregistered worker.
+  EXPECT_FALSE(handoff.Forward(0, 1, kData, sizeof(kData), IPEndPoint(),
+                               IPEndPoint(), QuicTime::Zero()));
+
+  int drain_tasks = 0;
+  handoff.RegisterWorker(1, base::ThreadTaskRunnerHandle::Get(),
+                         base::Bind(&Increment, &drain_tasks));
+
+  // The ring fills up while the worker doesn't drain, and one drain task is
+  // posted for all of it.
+  for (size_t i = 0; i < kHandoffRingCapacity; ++i) {
+    EXPECT_TRUE(handoff.Forward(0, 1, kData, sizeof(kData), IPEndPoint(),
+                                IPEndPoint(), QuicTime::Zero()));
+  }
+  EXPECT_FALSE(handoff.Forward(0, 1, kData, sizeof(kData), IPEndPoint(),
+                               IPEndPoint(), QuicTime::Zero()));
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(1, drain_tasks);
+
+  size_t drained = handoff.Drain(1, base::Bind(&ExpectPacket));
+  EXPECT_EQ(kHandoffRingCapacity, drained);
+  EXPECT_EQ(0u, handoff.Drain(1, WorkerPacketHandoff::PacketCallback()));
+
+  // A drain clears the pending task, so the next packet posts another.
+  EXPECT_TRUE(handoff.Forward(0, 1, kData, sizeof(kData), IPEndPoint(),
+                              IPEndPoint(), QuicTime::Zero()));
+  base::RunLoop().RunUntilIdle();
+  EXPECT_EQ(2, drain_tasks);
+}
+
+TEST(WorkerPacketHandoffTest, ConcurrentForwardAndDrain) {
+  WorkerPacketHandoff handoff(2);
+  base::WaitableEvent done(base::WaitableEvent::ResetPolicy::MANUAL,
+                           base::WaitableEvent::InitialState::NOT_SIGNALED);
+  DrainingWorker worker(&handoff, &done);
+
+  base::Thread producer("handoff_producer");
+  base::Thread consumer("handoff_consumer");
+  ASSERT_TRUE(producer.Start());
+  ASSERT_TRUE(consumer.Start());
+
+  handoff.RegisterWorker(1, consumer.task_runner(),
+                         base::Bind(&DrainingWorker::Drain,
+                                    base::Unretained(&worker)));
+  producer.task_runner()->PostTask(FROM_HERE,
+                                   base::Bind(&ForwardAll, &handoff));
+
+  // A lost wakeup would leave packets in the ring with no drain task.
+  EXPECT_TRUE(done.TimedWait(base::TimeDelta::FromSeconds(30)));
+  producer.Stop();
+  consumer.Stop();
+
+  EXPECT_EQ(kStressPacketCount, worker.received());
+  EXPECT_EQ(0u, worker.out_of_order());
+}
+
+}  // namespace net
@@ -0,0 +1,145 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/worker_thread_topology.h"
+
+#include "base/logging.h"
+#include "base/message_loop/message_loop.h"
+#include "base/single_thread_task_runner.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/threading/thread.h"
+
+namespace net {
+
+namespace {
+
+const char* kFetchLayoutPerWorker = "per_worker";
+const char* kFetchLayoutSharedPool = "shared_pool";
+const char* kFetchLayoutInline = "inline";
+
+const char* kDispatchThreadPrefix = "dispatch thread ";
+const char* kFetchThreadPrefix = "fetch thread ";
+
+bool StartThreads(const std::vector<std::unique_ptr<base::Thread>>& threads) {
+  base::Thread::Options io_options(base::MessageLoop::TYPE_IO, 0);
+  for (const auto& thread : threads) {
+    if (!thread->StartWithOptions(io_options)) {
+      LOG(ERROR) << "Failed to start " << thread->thread_name();
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+// static
+bool WorkerThreadTopology::ParseFetchLayout(const std::string& name,
+                                            FetchLayout* layout) {
+  DCHECK(layout);
+  if (name == kFetchLayoutPerWorker) {
+    *layout = FETCH_LAYOUT_PER_WORKER;
+  } else if (name == kFetchLayoutSharedPool) {
+    *layout = FETCH_LAYOUT_SHARED_POOL;
+  } else if (name == kFetchLayoutInline) {
+    *layout = FETCH_LAYOUT_INLINE;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// static
+std::string WorkerThreadTopology::DispatchThreadName(size_t index) {
+  return kDispatchThreadPrefix + base::SizeTToString(index);
+}
+
+// static
+std::string WorkerThreadTopology::FetchThreadName(size_t index) {
+  return kFetchThreadPrefix + base::SizeTToString(index);
+}
+
+WorkerThreadTopology::WorkerThreadTopology(FetchLayout layout,
+                                           size_t worker_count,
+                                           size_t fetch_pool_size)
+    : layout_(layout) {
+  DCHECK_GT(worker_count, 0u);
+  for (size_t i = 0; i < worker_count; ++i) {
+    dispatch_threads_.push_back(
+        std::unique_ptr<base::Thread>(new base::Thread(DispatchThreadName(i))));
+  }
+
+  size_t fetch_thread_count = 0;
+  switch (layout_) {
+    case FETCH_LAYOUT_PER_WORKER:
+      fetch_thread_count = worker_count;
+      break;
+    case FETCH_LAYOUT_SHARED_POOL:
+      DCHECK_GT(fetch_pool_size, 0u);
+      fetch_thread_count = fetch_pool_size;
+      break;
+    case FETCH_LAYOUT_INLINE:
+      break;
+  }
+
+  for (size_t i = 0; i < fetch_thread_count; ++i) {
+    fetch_threads_.push_back(
+        std::unique_ptr<base::Thread>(new base::Thread(FetchThreadName(i))));
+  }
+}
+
+WorkerThreadTopology::~WorkerThreadTopology() {
+  Stop();
+}
+
+bool WorkerThreadTopology::Start() {
+  return StartThreads(dispatch_threads_) && StartThreads(fetch_threads_);
+}
+
+void WorkerThreadTopology::Stop() {
+  for (const auto& thread : dispatch_threads_) {
+    thread->Stop();
+  }
+
+  for (const auto& thread : fetch_threads_) {
+    thread->Stop();
+  }
+}
+
+scoped_refptr<base::SingleThreadTaskRunner>
+WorkerThreadTopology::dispatch_task_runner(size_t worker_index) const {
+  return dispatch_thread(worker_index)->task_runner();
+}
+
+scoped_refptr<base::SingleThreadTaskRunner>
+WorkerThreadTopology::fetch_task_runner(size_t worker_index) const {
+  DCHECK_LT(worker_index, dispatch_threads_.size());
+  if (layout_ == FETCH_LAYOUT_INLINE) {
+    return dispatch_task_runner(worker_index);
+  }
+  return fetch_thread(worker_index % fetch_threads_.size())->task_runner();
+}
+
+base::Thread* WorkerThreadTopology::dispatch_thread(
+    size_t worker_index) const {
+  DCHECK_LT(worker_index, dispatch_threads_.size());
+  return dispatch_threads_[worker_index].get();
+}
+
+base::Thread* WorkerThreadTopology::fetch_thread(size_t index) const {
+  DCHECK_LT(index, fetch_threads_.size());
+  return fetch_threads_[index].get();
+}
+
+}  // namespace net
@@ -0,0 +1,100 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_SERVER_WORKER_THREAD_TOPOLOGY_H_
+#define STELLITE_SERVER_WORKER_THREAD_TOPOLOGY_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/macros.h"
+#include "base/memory/ref_counted.h"
+#include "net/base/net_export.h"
+
+namespace base {
+class SingleThreadTaskRunner;
+class Thread;
+}
+
+namespace net {
+
+// Owns the threads of the QUIC workers and decides which of them each worker
+// role runs on. Every worker has its own dispatch thread, which reads the
+// socket and runs the QUIC sessions. Backend fetching runs on the threads
+// chosen by the FetchLayout.
+class NET_EXPORT WorkerThreadTopology {
+ public:
+  enum FetchLayout {
+    // One fetch thread per worker.
+    FETCH_LAYOUT_PER_WORKER,
+
+    // A pool of fetch threads shared by every worker; worker i fetches on
+    // pool thread i % pool size.
+    FETCH_LAYOUT_SHARED_POOL,
+
+    // Fetching runs on the dispatch thread of the worker.
+    FETCH_LAYOUT_INLINE,
+  };
+
+  // Parses "per_worker", "shared_pool" or "inline".
+  static bool ParseFetchLayout(const std::string& name, FetchLayout* layout);
+
+  // |fetch_pool_size| is only used by FETCH_LAYOUT_SHARED_POOL.
+  WorkerThreadTopology(FetchLayout layout,
+                       size_t worker_count,
+                       size_t fetch_pool_size);
+  ~WorkerThreadTopology();
+
+  // Starts every thread. Returns false if one of them failed to start.
+  bool Start();
+
+  // Joins every thread.
+  void Stop();
+
+  FetchLayout layout() const { return layout_; }
+  size_t worker_count() const { return dispatch_threads_.size(); }
+
+  // Task runners of the roles of |worker_index|.
+  scoped_refptr<base::SingleThreadTaskRunner> dispatch_task_runner(
+      size_t worker_index) const;
+  scoped_refptr<base::SingleThreadTaskRunner> fetch_task_runner(
+      size_t worker_index) const;
+
+  // The threads themselves, e.g. for pinning. There are no fetch threads with
+  // FETCH_LAYOUT_INLINE.
+  base::Thread* dispatch_thread(size_t worker_index) const;
+  size_t fetch_thread_count() const { return fetch_threads_.size(); }
+  base::Thread* fetch_thread(size_t index) const;
+
+  // Thread names, "dispatch thread <n>" and "fetch thread <n>".
+  static std::string DispatchThreadName(size_t index);
+  static std::string FetchThreadName(size_t index);
+
+ private:
+  typedef std::vector<std::unique_ptr<base::Thread>> ThreadVector;
+
+  const FetchLayout layout_;
+
+  ThreadVector dispatch_threads_;
+  ThreadVector fetch_threads_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkerThreadTopology);
+};
+
+}  // namespace net
+
+#endif  // STELLITE_SERVER_WORKER_THREAD_TOPOLOGY_H_
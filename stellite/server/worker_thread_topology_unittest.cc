@@ -0,0 +1,166 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/server/worker_thread_topology.h"
+
+#include <memory>
+#include <string>
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/single_thread_task_runner.h"
+#include "base/synchronization/waitable_event.h"
+#include "base/threading/platform_thread.h"
+#include "net/base/ip_address.h"
+#include "net/base/ip_endpoint.h"
+#include "net/quic/chromium/crypto/proof_source_chromium.h"
+#include "net/quic/core/quic_config.h"
+#include "net/quic/core/quic_protocol.h"
+#include "stellite/server/quic_proxy_worker.h"
+#include "stellite/server/server_config.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+namespace test {
+
+class QuicProxyWorkerPeer {
+ public:
+  static scoped_refptr<base::SingleThreadTaskRunner> dispatch_task_runner(
+      QuicProxyWorker* worker) {
+    return worker->dispatch_task_runner();
+  }
+
+  static scoped_refptr<base::SingleThreadTaskRunner> http_fetch_task_runner(
+      QuicProxyWorker* worker) {
+    return worker->http_fetch_task_runner();
+  }
+};
+
+namespace {
+
+const size_t kWorkerCount = 3;
+const size_t kFetchPoolSize = 2;
+
+void GetThreadName(std::string* name, base::WaitableEvent* done) {
+  *name = base::PlatformThread::GetName();
+  done->Signal();
+}
+
+// Returns the name of the thread |task_runner| runs tasks on.
+std::string RunsOn(scoped_refptr<base::SingleThreadTaskRunner> task_runner) {
+  std::string name;
+  base::WaitableEvent done(base::WaitableEvent::ResetPolicy::AUTOMATIC,
+                           base::WaitableEvent::InitialState::NOT_SIGNALED);
+  task_runner->PostTask(FROM_HERE, base::Bind(&GetThreadName, &name, &done));
+  done.Wait();
+  return name;
+}
+
+// Builds the workers of |topology| the way QuicProxyServer::Start does.
+std::unique_ptr<QuicProxyWorker> CreateWorker(
+    const WorkerThreadTopology& topology, size_t worker_index) {
+  return std::unique_ptr<QuicProxyWorker>(new QuicProxyWorker(
+      topology,
+      static_cast<uint32_t>(worker_index),
+      nullptr,
+      nullptr,
+      IPEndPoint(IPAddress::IPv4AllZeros(), 0),
+      QuicConfig(),
+      ServerConfig(),
+      AllSupportedVersions(),
+      std::unique_ptr<ProofSource>(new ProofSourceChromium())));
+}
+
+// Checks that every worker dispatches on its own dispatch thread and fetches
+// on |fetch_thread_name(worker index)|.
+void ExpectWorkerThreads(const WorkerThreadTopology& topology,
+                         std::string (*fetch_thread_name)(size_t)) {
+  for (size_t i = 0; i < topology.worker_count(); ++i) {
+    std::unique_ptr<QuicProxyWorker> worker(CreateWorker(topology, i));
+    EXPECT_EQ(WorkerThreadTopology::DispatchThreadName(i),
+              RunsOn(QuicProxyWorkerPeer::dispatch_task_runner(worker.get())));
+    EXPECT_EQ(fetch_thread_name(i),
+              RunsOn(QuicProxyWorkerPeer::http_fetch_task_runner(
+                  worker.get())));
+  }
+}
+
+std::string SharedPoolFetchThreadName(size_t worker_index) {
+  return WorkerThreadTopology::FetchThreadName(worker_index % kFetchPoolSize);
+}
+
+}  // namespace
+
+TEST(WorkerThreadTopologyTest, ParseFetchLayout) {
+  WorkerThreadTopology::FetchLayout layout;
+  EXPECT_TRUE(WorkerThreadTopology::ParseFetchLayout("per_worker", &layout));
+  EXPECT_EQ(WorkerThreadTopology::FETCH_LAYOUT_PER_WORKER, layout);
+  EXPECT_TRUE(WorkerThreadTopology::ParseFetchLayout("shared_pool", &layout));
+  EXPECT_EQ(WorkerThreadTopology::FETCH_LAYOUT_SHARED_POOL, layout);
+  EXPECT_TRUE(WorkerThreadTopology::ParseFetchLayout("inline", &layout));
+  EXPECT_EQ(WorkerThreadTopology::FETCH_LAYOUT_INLINE, layout);
+  EXPECT_FALSE(WorkerThreadTopology::ParseFetchLayout("shared", &layout));
+}
+
+TEST(WorkerThreadTopologyTest, PerWorker) {
+  WorkerThreadTopology topology(WorkerThreadTopology::FETCH_LAYOUT_PER_WORKER,
+                                kWorkerCount, kFetchPoolSize);
+  ASSERT_TRUE(topology.Start());
+  EXPECT_EQ(kWorkerCount, topology.fetch_thread_count());
+
+  for (size_t i = 0; i < kWorkerCount; ++i) {
+    EXPECT_EQ(WorkerThreadTopology::DispatchThreadName(i),
+              RunsOn(topology.dispatch_task_runner(i)));
+    EXPECT_EQ(WorkerThreadTopology::FetchThreadName(i),
+              RunsOn(topology.fetch_task_runner(i)));
+  }
+
+  ExpectWorkerThreads(topology, &WorkerThreadTopology::FetchThreadName);
+}
+
+TEST(WorkerThreadTopologyTest, SharedPool) {
+  WorkerThreadTopology topology(
+      WorkerThreadTopology::FETCH_LAYOUT_SHARED_POOL, kWorkerCount,
+      kFetchPoolSize);
+  ASSERT_TRUE(topology.Start());
+  EXPECT_EQ(kFetchPoolSize, topology.fetch_thread_count());
+
+  for (size_t i = 0; i < kWorkerCount; ++i) {
+    EXPECT_EQ(WorkerThreadTopology::DispatchThreadName(i),
+              RunsOn(topology.dispatch_task_runner(i)));
+    EXPECT_EQ(WorkerThreadTopology::FetchThreadName(i % kFetchPoolSize),
+              RunsOn(topology.fetch_task_runner(i)));
+  }
+
+  ExpectWorkerThreads(topology, &SharedPoolFetchThreadName);
+}
+
+TEST(WorkerThreadTopologyTest, Inline) {
+  WorkerThreadTopology topology(WorkerThreadTopology::FETCH_LAYOUT_INLINE,
+                                kWorkerCount, kFetchPoolSize);
+  ASSERT_TRUE(topology.Start());
+  EXPECT_EQ(0u, topology.fetch_thread_count());
+
+  for (size_t i = 0; i < kWorkerCount; ++i) {
+    EXPECT_EQ(WorkerThreadTopology::DispatchThreadName(i),
+              RunsOn(topology.dispatch_task_runner(i)));
+    EXPECT_EQ(WorkerThreadTopology::DispatchThreadName(i),
+              RunsOn(topology.fetch_task_runner(i)));
+  }
+
+  ExpectWorkerThreads(topology, &WorkerThreadTopology::DispatchThreadName);
+}
+
+}  // namespace test
+}  // namespace net
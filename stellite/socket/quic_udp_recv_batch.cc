@@ -0,0 +1,155 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/socket/quic_udp_recv_batch.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "base/logging.h"
+#include "base/time/time.h"
+
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+namespace net {
+
+namespace {
+
+#if defined(STELLITE_HAVE_MMSG)
+const size_t kControlBufferSize =
+    CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t));
+#endif
+
+}  // namespace
+
+QuicUDPRecvBatch::QuicUDPRecvBatch(size_t capacity, size_t packet_size)
+    : capacity_(capacity),
+      packet_size_(packet_size),
+      size_(0),
+      buffer_(new char[capacity * packet_size]),
+      lengths_(capacity, 0),
+      addresses_(capacity),
+      raw_addresses_(capacity),
+      raw_address_lengths_(capacity, 0),
+      receive_times_(capacity, QuicWallTime::Zero()),
+      drop_count_(0)
+#if defined(STELLITE_HAVE_MMSG)
+      ,
+      iovecs_(capacity),
+      mmsg_headers_(capacity),
+      control_buffer_(new char[capacity * kControlBufferSize])
+#endif
+{
+  DCHECK_GT(capacity, 0u);
+  DCHECK_GT(packet_size, 0u);
+}
+
+QuicUDPRecvBatch::~QuicUDPRecvBatch() {}
+
+const char* QuicUDPRecvBatch::data(size_t index) const {
+  DCHECK_LT(index, size_);
+  return buffer_.get() + index * packet_size_;
+}
+
+size_t QuicUDPRecvBatch::length(size_t index) const {
+  DCHECK_LT(index, size_);
+  return lengths_[index];
+}
+
+const IPEndPoint& QuicUDPRecvBatch::address(size_t index) const {
+  DCHECK_LT(index, size_);
+  return addresses_[index];
+}
+
+QuicWallTime QuicUDPRecvBatch::receive_time(size_t index) const {
+  DCHECK_LT(index, size_);
+  return receive_times_[index];
+}
+
+void QuicUDPRecvBatch::PrepareForRead() {
+  size_ = 0;
+  for (size_t i = 0; i < capacity_; ++i) {
+    lengths_[i] = 0;
+    raw_address_lengths_[i] = sizeof(raw_addresses_[i]);
+    receive_times_[i] = QuicWallTime::Zero();
+
+#if defined(STELLITE_HAVE_MMSG)
+    iovecs_[i].iov_base = mutable_data(i);
+    iovecs_[i].iov_len = packet_size_;
+
+    struct msghdr* header = &mmsg_headers_[i].msg_hdr;
+    memset(header, 0, sizeof(*header));
+    header->msg_name = &raw_addresses_[i];
+    header->msg_namelen = sizeof(raw_addresses_[i]);
+    header->msg_iov = &iovecs_[i];
+    header->msg_iovlen = 1;
+    header->msg_control = control_buffer_.get() + i * kControlBufferSize;
+    header->msg_controllen = kControlBufferSize;
+    mmsg_headers_[i].msg_len = 0;
+#endif
+  }
+}
+
+bool QuicUDPRecvBatch::SetReceived(size_t index, size_t length) {
+  DCHECK_LT(index, capacity_);
+#if defined(STELLITE_HAVE_MMSG)
+  struct msghdr* header = &mmsg_headers_[index].msg_hdr;
+  raw_address_lengths_[index] = header->msg_namelen;
+
+  for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(header); cmsg != NULL;
+       cmsg = CMSG_NXTHDR(header, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET) {
+      continue;
+    }
+
+    if (cmsg->cmsg_type == SO_TIMESTAMPNS) {
+      struct timespec ts;
+      memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+      uint64_t microseconds =
+          static_cast<uint64_t>(ts.tv_sec) *
+              base::Time::kMicrosecondsPerSecond +
+          ts.tv_nsec / base::Time::kNanosecondsPerMicrosecond;
+      receive_times_[index] = QuicWallTime::FromUNIXMicroseconds(microseconds);
+    } else if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+      memcpy(&drop_count_, CMSG_DATA(cmsg), sizeof(drop_count_));
+    }
+  }
+#endif
+  if (!addresses_[index].FromSockAddr(raw_address(index),
+                                      raw_address_lengths_[index])) {
+    lengths_[index] = 0;
+    return false;
+  }
+  lengths_[index] = length;
+  return true;
+}
+
+char* QuicUDPRecvBatch::mutable_data(size_t index) {
+  DCHECK_LT(index, capacity_);
+  return buffer_.get() + index * packet_size_;
+}
+
+struct sockaddr* QuicUDPRecvBatch::raw_address(size_t index) {
+  DCHECK_LT(index, capacity_);
+  return reinterpret_cast<struct sockaddr*>(&raw_addresses_[index]);
+}
+
+socklen_t* QuicUDPRecvBatch::raw_address_len(size_t index) {
+  DCHECK_LT(index, capacity_);
+  return &raw_address_lengths_[index];
+}
+
+}  // namespace net
@@ -0,0 +1,117 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_SOCKET_QUIC_UDP_RECV_BATCH_H_
+#define STELLITE_SOCKET_QUIC_UDP_RECV_BATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <memory>
+#include <vector>
+
+#include "base/macros.h"
+#include "build/build_config.h"
+#include "net/base/ip_endpoint.h"
+#include "net/base/net_export.h"
+#include "net/quic/core/quic_time.h"
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+#define STELLITE_HAVE_MMSG 1
+#endif
+
+namespace net {
+
+// A fixed set of pre-allocated datagram slots used by
+// QuicUDPSocketPosix::RecvMultipleFrom(). All packet buffers, message headers
+// and address storage are allocated once up front so that reading a batch of
+// datagrams doesn't touch the heap.
+class NET_EXPORT QuicUDPRecvBatch {
+ public:
+  QuicUDPRecvBatch(size_t capacity, size_t packet_size);
+  ~QuicUDPRecvBatch();
+
+  // Maximum number of datagrams read by a single batch read.
+  size_t capacity() const { return capacity_; }
+
+  // Maximum size of a single datagram.
+  size_t packet_size() const { return packet_size_; }
+
+  // Number of datagrams filled in by the last read.
+  size_t size() const { return size_; }
+
+  // Accessors for the |index|th datagram of the last read. A datagram with a
+  // zero length carries nothing and should be skipped.
+  const char* data(size_t index) const;
+  size_t length(size_t index) const;
+  const IPEndPoint& address(size_t index) const;
+
+  // Kernel receive time of the |index|th datagram, or QuicWallTime::Zero() if
+  // receive timestamps are not enabled on the socket.
+  QuicWallTime receive_time(size_t index) const;
+
+  // Total number of datagrams the kernel has dropped on the socket because
+  // its receive buffer was full, as last reported with SO_RXQ_OVFL. The
+  // counter wraps around.
+  uint32_t drop_count() const { return drop_count_; }
+
+ private:
+  friend class QuicUDPSocketPosix;
+
+  // Resets the slots before they are handed to the kernel.
+  void PrepareForRead();
+
+  // Records the |length| bytes datagram received at |index| along with the
+  // ancillary data the kernel attached to it. Returns false if the sender
+  // address couldn't be parsed, in which case the slot is left empty.
+  bool SetReceived(size_t index, size_t length);
+
+  void set_size(size_t size) { size_ = size; }
+
+  char* mutable_data(size_t index);
+  struct sockaddr* raw_address(size_t index);
+  socklen_t* raw_address_len(size_t index);
+
+#if defined(STELLITE_HAVE_MMSG)
+  struct mmsghdr* mmsg_headers() { return mmsg_headers_.data(); }
+#endif
+
+  const size_t capacity_;
+  const size_t packet_size_;
+  size_t size_;
+
+  std::unique_ptr<char[]> buffer_;
+  std::vector<size_t> lengths_;
+  std::vector<IPEndPoint> addresses_;
+  std::vector<struct sockaddr_storage> raw_addresses_;
+  std::vector<socklen_t> raw_address_lengths_;
+  std::vector<QuicWallTime> receive_times_;
+  uint32_t drop_count_;
+
+#if defined(STELLITE_HAVE_MMSG)
+  std::vector<struct iovec> iovecs_;
+  std::vector<struct mmsghdr> mmsg_headers_;
+
+  // Room for the SO_TIMESTAMPNS and SO_RXQ_OVFL messages of each datagram.
+  std::unique_ptr<char[]> control_buffer_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(QuicUDPRecvBatch);
+};
+
+}  // namespace net
+
+#endif  // STELLITE_SOCKET_QUIC_UDP_RECV_BATCH_H_
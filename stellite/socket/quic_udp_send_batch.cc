@@ -0,0 +1,199 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/socket/quic_udp_send_batch.h"
+
+#include <netinet/in.h>
+#include <string.h>
+
+#include "base/logging.h"
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+namespace net {
+
+namespace {
+
+// Kernel limits for a single UDP_SEGMENT message.
+const size_t kMaxSegments = 64;
+const size_t kMaxSegmentationBytes = 64000;
+
+#if defined(STELLITE_HAVE_MMSG)
+const size_t kControlBufferSize = CMSG_SPACE(sizeof(uint16_t));
+#endif
+
+}  // namespace
+
+QuicUDPSendBatch::QuicUDPSendBatch(size_t capacity, size_t packet_size)
+    : capacity_(capacity),
+      packet_size_(packet_size),
+      use_segmentation_(false),
+      arena_(new char[capacity * packet_size]),
+      sent_(0),
+      unsent_bytes_(0)
+#if defined(STELLITE_HAVE_MMSG)
+      ,
+      raw_addresses_(capacity),
+      iovecs_(capacity),
+      mmsg_headers_(capacity),
+      control_buffer_(new char[capacity * kControlBufferSize])
+#endif
+{
+  DCHECK_GT(capacity, 0u);
+  DCHECK_GT(packet_size, 0u);
+  packets_.reserve(capacity);
+  message_packets_.reserve(capacity);
+}
+
+QuicUDPSendBatch::~QuicUDPSendBatch() {}
+
+bool QuicUDPSendBatch::Append(const char* data,
+                              size_t length,
+                              const IPEndPoint& peer_address) {
+  if (full() || length > packet_size_) {
+    return false;
+  }
+
+  memcpy(arena_.get() + packets_.size() * packet_size_, data, length);
+  Packet packet;
+  packet.length = length;
+  packet.peer_address = peer_address;
+  packets_.push_back(packet);
+  unsent_bytes_ += length;
+  return true;
+}
+
+void QuicUDPSendBatch::Clear() {
+  packets_.clear();
+  message_packets_.clear();
+  sent_ = 0;
+  unsent_bytes_ = 0;
+}
+
+size_t QuicUDPSendBatch::Compact() {
+  size_t discarded = sent_;
+  if (discarded == 0) {
+    return 0;
+  }
+
+  memmove(arena_.get(), arena_.get() + discarded * packet_size_,
+          unsent() * packet_size_);
+  packets_.erase(packets_.begin(), packets_.begin() + discarded);
+  message_packets_.clear();
+  sent_ = 0;
+  return discarded;
+}
+
+size_t QuicUDPSendBatch::DropFirstMessage() {
+  DCHECK(!empty());
+  if (message_packets_.empty()) {
+    // Nothing was prepared, so the packets went out one by one.
+    DidSendNextPacket();
+    return 1;
+  }
+  return DidSend(1);
+}
+
+size_t QuicUDPSendBatch::PrepareForWrite() {
+  message_packets_.clear();
+
+  size_t index = sent_;
+  while (index < packets_.size()) {
+    const Packet& first = packets_[index];
+
+    // A segmented message carries equally sized packets to one peer; only
+    // the last segment may be shorter.
+    size_t count = 1;
+    size_t total = first.length;
+    if (use_segmentation_) {
+      while (index + count < packets_.size() && count < kMaxSegments) {
+        const Packet& next = packets_[index + count];
+        if (next.length > first.length ||
+            total + next.length > kMaxSegmentationBytes ||
+            !(next.peer_address == first.peer_address)) {
+          break;
+        }
+        total += next.length;
+        ++count;
+        if (next.length < first.length) {
+          break;
+        }
+      }
+    }
+
+#if defined(STELLITE_HAVE_MMSG)
+    size_t message = message_packets_.size();
+    for (size_t i = 0; i < count; ++i) {
+      iovecs_[index + i].iov_base = arena_.get() + (index + i) * packet_size_;
+      iovecs_[index + i].iov_len = packets_[index + i].length;
+    }
+
+    struct msghdr* header = &mmsg_headers_[message].msg_hdr;
+    memset(header, 0, sizeof(*header));
+    socklen_t address_len = sizeof(raw_addresses_[message]);
+    if (!first.peer_address.ToSockAddr(
+            reinterpret_cast<struct sockaddr*>(&raw_addresses_[message]),
+            &address_len)) {
+      NOTREACHED();
+    }
+    header->msg_name = &raw_addresses_[message];
+    header->msg_namelen = address_len;
+    header->msg_iov = &iovecs_[index];
+    header->msg_iovlen = count;
+    mmsg_headers_[message].msg_len = 0;
+
+    if (count > 1) {
+      char* control = control_buffer_.get() + message * kControlBufferSize;
+      memset(control, 0, kControlBufferSize);
+      header->msg_control = control;
+      header->msg_controllen = kControlBufferSize;
+
+      struct cmsghdr* cmsg = CMSG_FIRSTHDR(header);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      uint16_t segment_size = static_cast<uint16_t>(first.length);
+      memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+    }
+#endif
+
+    message_packets_.push_back(count);
+    index += count;
+  }
+
+  return message_packets_.size();
+}
+
+size_t QuicUDPSendBatch::DidSend(size_t messages) {
+  DCHECK_LE(messages, message_packets_.size());
+  size_t packets = 0;
+  for (size_t i = 0; i < messages; ++i) {
+    packets += message_packets_[i];
+  }
+  message_packets_.erase(message_packets_.begin(),
+                         message_packets_.begin() + messages);
+  for (size_t i = 0; i < packets; ++i) {
+    DidSendNextPacket();
+  }
+  DCHECK_LE(sent_, packets_.size());
+  return packets;
+}
+
+}  // namespace net
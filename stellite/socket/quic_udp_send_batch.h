@@ -0,0 +1,134 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_SOCKET_QUIC_UDP_SEND_BATCH_H_
+#define STELLITE_SOCKET_QUIC_UDP_SEND_BATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <memory>
+#include <vector>
+
+#include "base/macros.h"
+#include "net/base/ip_endpoint.h"
+#include "net/base/net_export.h"
+#include "stellite/socket/quic_udp_recv_batch.h"
+
+namespace net {
+
+// Datagrams waiting to be flushed by QuicUDPSocketPosix::SendMultipleTo().
+// Packets are copied into a pre-allocated arena in the order they are
+// appended. When segmentation is enabled, consecutive packets going to the
+// same peer are sent as a single UDP_SEGMENT (GSO) message.
+class NET_EXPORT QuicUDPSendBatch {
+ public:
+  QuicUDPSendBatch(size_t capacity, size_t packet_size);
+  ~QuicUDPSendBatch();
+
+  // Copies a datagram into the next free slot of the batch. Returns false if
+  // the batch is full or |length| is larger than |packet_size()|.
+  bool Append(const char* data, size_t length, const IPEndPoint& peer_address);
+
+  // Forgets every packet in the batch.
+  void Clear();
+
+  // Moves the unsent packets to the front of the batch to make room for new
+  // ones. Returns the number of sent packets that were discarded; callers
+  // tracking per-packet state must drop as many entries from the front.
+  size_t Compact();
+
+  // Drops the packets of the first unsent message, which the kernel refused,
+  // and returns how many of them were dropped.
+  size_t DropFirstMessage();
+
+  size_t capacity() const { return capacity_; }
+  size_t packet_size() const { return packet_size_; }
+
+  // Number of packets appended since the last Clear().
+  size_t size() const { return packets_.size(); }
+
+  // Number of packets handed to the kernel so far.
+  size_t sent() const { return sent_; }
+
+  // Number of packets and bytes not handed to the kernel yet.
+  size_t unsent() const { return packets_.size() - sent_; }
+  size_t unsent_bytes() const { return unsent_bytes_; }
+
+  bool full() const { return packets_.size() == capacity_; }
+  bool empty() const { return sent_ == packets_.size(); }
+
+  bool use_segmentation() const { return use_segmentation_; }
+  void set_use_segmentation(bool use_segmentation) {
+    use_segmentation_ = use_segmentation;
+  }
+
+ private:
+  friend class QuicUDPSocketPosix;
+
+  struct Packet {
+    size_t length;
+    IPEndPoint peer_address;
+  };
+
+  // Groups the unsent packets into messages. Returns the number of messages.
+  size_t PrepareForWrite();
+
+  // Marks the first |messages| prepared messages as sent. Returns the number
+  // of packets they carried.
+  size_t DidSend(size_t messages);
+
+  // The first unsent packet, used by the sendto() fallback.
+  const Packet& next_packet() const { return packets_[sent_]; }
+  const char* next_packet_data() const {
+    return arena_.get() + sent_ * packet_size_;
+  }
+  void DidSendNextPacket() {
+    unsent_bytes_ -= packets_[sent_].length;
+    ++sent_;
+  }
+
+#if defined(STELLITE_HAVE_MMSG)
+  struct mmsghdr* mmsg_headers() { return mmsg_headers_.data(); }
+#endif
+
+  const size_t capacity_;
+  const size_t packet_size_;
+  bool use_segmentation_;
+
+  // One |packet_size_| slot per packet.
+  std::unique_ptr<char[]> arena_;
+
+  std::vector<Packet> packets_;
+  size_t sent_;
+  size_t unsent_bytes_;
+
+  // Number of packets in each prepared message.
+  std::vector<size_t> message_packets_;
+
+#if defined(STELLITE_HAVE_MMSG)
+  std::vector<struct sockaddr_storage> raw_addresses_;
+  std::vector<struct iovec> iovecs_;
+  std::vector<struct mmsghdr> mmsg_headers_;
+  std::unique_ptr<char[]> control_buffer_;
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(QuicUDPSendBatch);
+};
+
+}  // namespace net
+
+#endif  // STELLITE_SOCKET_QUIC_UDP_SEND_BATCH_H_
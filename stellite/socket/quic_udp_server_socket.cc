@@ -57,6 +57,39 @@ int QuicUDPServerSocket::RecvFrom(IOBuffer* buf,
   return socket_.RecvFrom(buf, buf_len, address, callback);
 }
 
+int QuicUDPServerSocket::RecvMultipleFrom(
+    QuicUDPRecvBatch* batch,
+    const CompletionCallback& callback) {
+  return socket_.RecvMultipleFrom(batch, callback);
+}
+
+int QuicUDPServerSocket::SendMultipleTo(
+    QuicUDPSendBatch* batch,
+    const CompletionCallback& callback) {
+  return socket_.SendMultipleTo(batch, callback);
+}
+
+bool QuicUDPServerSocket::SupportsUDPSegmentation() const {
+  return socket_.SupportsUDPSegmentation();
+}
+
+int QuicUDPServerSocket::AttachReusePortConnectionIdSteering(
+    uint32_t group_size) {
+  return socket_.AttachReusePortConnectionIdSteering(group_size);
+}
+
+int QuicUDPServerSocket::EnableReceiveTimestamps() {
+  return socket_.EnableReceiveTimestamps();
+}
+
+int QuicUDPServerSocket::EnableReceiveDropCount() {
+  return socket_.EnableReceiveDropCount();
+}
+
+int QuicUDPServerSocket::SetIncomingCpu(int cpu) {
+  return socket_.SetIncomingCpu(cpu);
+}
+
 int QuicUDPServerSocket::SendTo(IOBuffer* buf,
                             int buf_len,
                             const IPEndPoint& address,
@@ -18,6 +18,8 @@ namespace net {
 
 class IPAddress;
 class IPEndPoint;
+class QuicUDPRecvBatch;
+class QuicUDPSendBatch;
 struct NetLogSource;
 
 // A client socket that uses UDP as the transport layer.
@@ -51,10 +53,28 @@ class NET_EXPORT QuicUDPServerSocket : public DatagramServerSocket {
   void AllowAddressReuse() override;
   void AllowBroadcast() override;
   void AllowPortReuse();
+
+  // See QuicUDPSocketPosix::AttachReusePortConnectionIdSteering(). Should be
+  // called after Listen().
+  int AttachReusePortConnectionIdSteering(uint32_t group_size);
   void Close() override;
   void DetachFromThread() override;
   void UseNonBlockingIO() override;
 
+  // Reads a batch of datagrams; see QuicUDPSocketPosix::RecvMultipleFrom().
+  int RecvMultipleFrom(QuicUDPRecvBatch* batch,
+                       const CompletionCallback& callback);
+
+  // Sends a batch of datagrams; see QuicUDPSocketPosix::SendMultipleTo().
+  int SendMultipleTo(QuicUDPSendBatch* batch,
+                     const CompletionCallback& callback);
+
+  bool SupportsUDPSegmentation() const;
+
+  int EnableReceiveTimestamps();
+  int EnableReceiveDropCount();
+  int SetIncomingCpu(int cpu);
+
  private:
   QuicUDPSocket socket_;
   NetLogWithSource net_log_;
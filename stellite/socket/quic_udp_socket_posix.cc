@@ -33,6 +33,12 @@
 #include "net/log/net_log_source_type.h"
 #include "net/socket/socket_descriptor.h"
 #include "net/udp/udp_net_log_parameters.h"
+#include "stellite/socket/quic_udp_recv_batch.h"
+#include "stellite/socket/quic_udp_send_batch.h"
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+#include <linux/filter.h>
+#endif
 
 #if defined(OS_ANDROID)
 #include <dlfcn.h>
@@ -47,10 +53,33 @@
 #define SO_REUSEPORT 15
 #endif
 
+#ifndef SO_RXQ_OVFL
+#define SO_RXQ_OVFL 40
+#endif
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
 namespace net {
 
 namespace {
 
+// Public flag of a QUIC header carrying the connection ID.
+const uint8_t kQuicPublicFlags8ByteConnectionId = 0x08;
+
 const int kBindRetries = 10;
 const int kPortStart = 1024;
 const int kPortEnd = 65535;
@@ -92,7 +121,9 @@ QuicUDPSocketPosix::QuicUDPSocketPosix(DatagramSocket::BindType bind_type,
       write_watcher_(this),
       read_buf_len_(0),
       recv_from_address_(NULL),
-      write_buf_len_(0) {
+      recv_batch_(NULL),
+      write_buf_len_(0),
+      send_batch_(NULL) {
   if (bind_type == DatagramSocket::RANDOM_BIND)
     DCHECK(!rand_int_cb.is_null());
 }
@@ -128,10 +159,12 @@ void QuicUDPSocketPosix::Close() {
   read_buf_len_ = 0;
   read_callback_.Reset();
   recv_from_address_ = NULL;
+  recv_batch_ = NULL;
   write_buf_ = NULL;
   write_buf_len_ = 0;
   write_callback_.Reset();
   send_to_address_.reset();
+  send_batch_ = NULL;
 
   bool ok = read_socket_watcher_.StopWatchingFileDescriptor();
   DCHECK(ok);
@@ -199,6 +232,7 @@ int QuicUDPSocketPosix::RecvFrom(IOBuffer* buf,
   DCHECK_NE(kInvalidSocket, socket_);
   CHECK(read_callback_.is_null());
   DCHECK(!recv_from_address_);
+  DCHECK(!recv_batch_);
   DCHECK(!callback.is_null());  // Synchronous operation not supported
   DCHECK_GT(buf_len, 0);
 
@@ -222,6 +256,32 @@ int QuicUDPSocketPosix::RecvFrom(IOBuffer* buf,
   return ERR_IO_PENDING;
 }
 
+int QuicUDPSocketPosix::RecvMultipleFrom(QuicUDPRecvBatch* batch,
+                                         const CompletionCallback& callback) {
+  DCHECK(CalledOnValidThread());
+  DCHECK_NE(kInvalidSocket, socket_);
+  CHECK(read_callback_.is_null());
+  DCHECK(!read_buf_.get());
+  DCHECK(!recv_batch_);
+  DCHECK(batch);
+  DCHECK(!callback.is_null());  // Synchronous operation not supported
+
+  int result = InternalRecvMultipleFrom(batch);
+  if (result != ERR_IO_PENDING)
+    return result;
+
+  if (!base::MessageLoopForIO::current()->WatchFileDescriptor(
+          socket_, true, base::MessageLoopForIO::WATCH_READ,
+          &read_socket_watcher_, &read_watcher_)) {
+    PLOG(ERROR) << "WatchFileDescriptor failed on read";
+    return MapSystemError(errno);
+  }
+
+  recv_batch_ = batch;
+  read_callback_ = callback;
+  return ERR_IO_PENDING;
+}
+
 int QuicUDPSocketPosix::Write(IOBuffer* buf,
                           int buf_len,
                           const CompletionCallback& callback) {
@@ -242,6 +302,7 @@ int QuicUDPSocketPosix::SendToOrWrite(IOBuffer* buf,
   DCHECK(CalledOnValidThread());
   DCHECK_NE(kInvalidSocket, socket_);
   CHECK(write_callback_.is_null());
+  DCHECK(!send_batch_);
   DCHECK(!callback.is_null());  // Synchronous operation not supported
   DCHECK_GT(buf_len, 0);
 
@@ -268,6 +329,44 @@ int QuicUDPSocketPosix::SendToOrWrite(IOBuffer* buf,
   return ERR_IO_PENDING;
 }
 
+int QuicUDPSocketPosix::SendMultipleTo(QuicUDPSendBatch* batch,
+                                       const CompletionCallback& callback) {
+  DCHECK(CalledOnValidThread());
+  DCHECK_NE(kInvalidSocket, socket_);
+  CHECK(write_callback_.is_null());
+  DCHECK(!write_buf_.get());
+  DCHECK(!send_batch_);
+  DCHECK(batch);
+  DCHECK(!batch->empty());
+  DCHECK(!callback.is_null());  // Synchronous operation not supported
+
+  int result = InternalSendMultipleTo(batch);
+  if (result != ERR_IO_PENDING)
+    return result;
+
+  if (!base::MessageLoopForIO::current()->WatchFileDescriptor(
+          socket_, true, base::MessageLoopForIO::WATCH_WRITE,
+          &write_socket_watcher_, &write_watcher_)) {
+    DVLOG(1) << "WatchFileDescriptor failed on write, errno " << errno;
+    return MapSystemError(errno);
+  }
+
+  send_batch_ = batch;
+  write_callback_ = callback;
+  return ERR_IO_PENDING;
+}
+
+bool QuicUDPSocketPosix::SupportsUDPSegmentation() const {
+#if defined(STELLITE_HAVE_MMSG)
+  int segment_size = 0;
+  socklen_t length = sizeof(segment_size);
+  return getsockopt(socket_, SOL_UDP, UDP_SEGMENT, &segment_size,
+                    &length) == 0;
+#else
+  return false;
+#endif
+}
+
 int QuicUDPSocketPosix::Connect(const IPEndPoint& address) {
   DCHECK_NE(socket_, kInvalidSocket);
   int rv = InternalConnect(address);
@@ -468,6 +567,80 @@ int QuicUDPSocketPosix::AllowPortReuse() {
   return rv == 0 ? OK : MapSystemError(errno);
 }
 
+// static
+const uint32_t QuicUDPSocketPosix::kQuicPublicFlagsOffset;
+const uint32_t QuicUDPSocketPosix::kQuicConnectionIdLowByteOffset;
+
+int QuicUDPSocketPosix::AttachReusePortConnectionIdSteering(
+    uint32_t group_size) {
+  DCHECK_NE(socket_, kInvalidSocket);
+  DCHECK(CalledOnValidThread());
+  DCHECK_GT(group_size, 0u);
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+  struct sock_filter code[] = {
+    // A = public flags
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, kQuicPublicFlagsOffset),
+    // if (!(A & 8BYTE_CONNECTION_ID)) goto hash
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K,
+             kQuicPublicFlags8ByteConnectionId, 0, 3),
+    // return lowest connection ID byte % group_size
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, kQuicConnectionIdLowByteOffset),
+    BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, group_size),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+    // hash: return rxhash % group_size
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_RXHASH),
+    BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, group_size),
+    BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+
+  struct sock_fprog program;
+  program.len = arraysize(code);
+  program.filter = code;
+  int rv = setsockopt(socket_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                      &program, sizeof(program));
+  return rv == 0 ? OK : MapSystemError(errno);
+#else
+  return ERR_NOT_IMPLEMENTED;
+#endif
+}
+
+int QuicUDPSocketPosix::EnableReceiveTimestamps() {
+  DCHECK_NE(socket_, kInvalidSocket);
+  DCHECK(CalledOnValidThread());
+#if defined(STELLITE_HAVE_MMSG)
+  int true_value = 1;
+  int rv = setsockopt(
+      socket_, SOL_SOCKET, SO_TIMESTAMPNS, &true_value, sizeof(true_value));
+  return rv == 0 ? OK : MapSystemError(errno);
+#else
+  return ERR_NOT_IMPLEMENTED;
+#endif
+}
+
+int QuicUDPSocketPosix::EnableReceiveDropCount() {
+  DCHECK_NE(socket_, kInvalidSocket);
+  DCHECK(CalledOnValidThread());
+#if defined(STELLITE_HAVE_MMSG)
+  int true_value = 1;
+  int rv = setsockopt(
+      socket_, SOL_SOCKET, SO_RXQ_OVFL, &true_value, sizeof(true_value));
+  return rv == 0 ? OK : MapSystemError(errno);
+#else
+  return ERR_NOT_IMPLEMENTED;
+#endif
+}
+
+int QuicUDPSocketPosix::SetIncomingCpu(int cpu) {
+  DCHECK_NE(socket_, kInvalidSocket);
+  DCHECK(CalledOnValidThread());
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+  int rv = setsockopt(socket_, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+  return rv == 0 ? OK : MapSystemError(errno);
+#else
+  return ERR_NOT_IMPLEMENTED;
+#endif
+}
+
 int QuicUDPSocketPosix::SetBroadcast(bool broadcast) {
   DCHECK_NE(socket_, kInvalidSocket);
   DCHECK(CalledOnValidThread());
@@ -522,12 +695,14 @@ void QuicUDPSocketPosix::DoWriteCallback(int rv) {
 }
 
 void QuicUDPSocketPosix::DidCompleteRead() {
-  int result =
+  int result = recv_batch_ ?
+      InternalRecvMultipleFrom(recv_batch_) :
       InternalRecvFrom(read_buf_.get(), read_buf_len_, recv_from_address_);
   if (result != ERR_IO_PENDING) {
     read_buf_ = NULL;
     read_buf_len_ = 0;
     recv_from_address_ = NULL;
+    recv_batch_ = NULL;
     bool ok = read_socket_watcher_.StopWatchingFileDescriptor();
     DCHECK(ok);
     DoReadCallback(result);
@@ -546,13 +721,15 @@ void QuicUDPSocketPosix::LogRead(int result,
 }
 
 void QuicUDPSocketPosix::DidCompleteWrite() {
-  int result =
+  int result = send_batch_ ?
+      InternalSendMultipleTo(send_batch_) :
       InternalSendTo(write_buf_.get(), write_buf_len_, send_to_address_.get());
 
   if (result != ERR_IO_PENDING) {
     write_buf_ = NULL;
     write_buf_len_ = 0;
     send_to_address_.reset();
+    send_batch_ = NULL;
     write_socket_watcher_.StopWatchingFileDescriptor();
     DoWriteCallback(result);
   }
@@ -596,6 +773,47 @@ int QuicUDPSocketPosix::InternalRecvFrom(IOBuffer* buf,
   return result;
 }
 
+int QuicUDPSocketPosix::InternalRecvMultipleFrom(QuicUDPRecvBatch* batch) {
+  batch->PrepareForRead();
+
+  size_t count = 0;
+  int bytes_received = 0;
+#if defined(STELLITE_HAVE_MMSG)
+  int rv = HANDLE_EINTR(recvmmsg(socket_, batch->mmsg_headers(),
+                                 batch->capacity(), 0, NULL));
+  if (rv < 0)
+    return MapSystemError(errno);
+
+  count = rv;
+  for (size_t i = 0; i < count; ++i) {
+    size_t length = batch->mmsg_headers()[i].msg_len;
+    if (batch->SetReceived(i, length))
+      bytes_received += length;
+  }
+#else
+  for (; count < batch->capacity(); ++count) {
+    int rv = HANDLE_EINTR(recvfrom(socket_,
+                                   batch->mutable_data(count),
+                                   batch->packet_size(),
+                                   0,
+                                   batch->raw_address(count),
+                                   batch->raw_address_len(count)));
+    if (rv < 0) {
+      // Hand over whatever was read before the socket ran dry.
+      if (count > 0)
+        break;
+      return MapSystemError(errno);
+    }
+    if (batch->SetReceived(count, rv))
+      bytes_received += rv;
+  }
+#endif
+
+  batch->set_size(count);
+  LogRead(bytes_received, NULL, 0, NULL);
+  return static_cast<int>(count);
+}
+
 int QuicUDPSocketPosix::InternalSendTo(IOBuffer* buf,
                                    int buf_len,
                                    const IPEndPoint* address) {
@@ -625,6 +843,51 @@ int QuicUDPSocketPosix::InternalSendTo(IOBuffer* buf,
   return result;
 }
 
+int QuicUDPSocketPosix::InternalSendMultipleTo(QuicUDPSendBatch* batch) {
+  size_t packets = 0;
+  int bytes_sent = 0;
+#if defined(STELLITE_HAVE_MMSG)
+  size_t messages = batch->PrepareForWrite();
+  int rv = HANDLE_EINTR(sendmmsg(socket_, batch->mmsg_headers(), messages, 0));
+  if (rv < 0)
+    return MapSystemError(errno);
+
+  for (int i = 0; i < rv; ++i)
+    bytes_sent += batch->mmsg_headers()[i].msg_len;
+  packets = batch->DidSend(rv);
+#else
+  while (!batch->empty()) {
+    const QuicUDPSendBatch::Packet& packet = batch->next_packet();
+    SockaddrStorage storage;
+    if (!packet.peer_address.ToSockAddr(storage.addr, &storage.addr_len)) {
+      if (packets > 0)
+        break;
+      return ERR_ADDRESS_INVALID;
+    }
+
+    int rv = HANDLE_EINTR(sendto(socket_,
+                                 batch->next_packet_data(),
+                                 packet.length,
+                                 0,
+                                 storage.addr,
+                                 storage.addr_len));
+    if (rv < 0) {
+      // Report what was sent; the error comes back on the next call.
+      if (packets > 0)
+        break;
+      return MapSystemError(errno);
+    }
+
+    bytes_sent += rv;
+    ++packets;
+    batch->DidSendNextPacket();
+  }
+#endif
+
+  LogWrite(bytes_sent, NULL, NULL);
+  return static_cast<int>(packets);
+}
+
 int QuicUDPSocketPosix::SetMulticastOptions() {
   if (!(socket_options_ & SOCKET_OPTION_MULTICAST_LOOP)) {
     int rv;
@@ -28,6 +28,8 @@
 namespace net {
 class IPAddress;
 class NetLog;
+class QuicUDPRecvBatch;
+class QuicUDPSendBatch;
 
 class NET_EXPORT QuicUDPSocketPosix : public base::NonThreadSafe {
  public:
@@ -96,6 +98,16 @@ class NET_EXPORT QuicUDPSocketPosix : public base::NonThreadSafe {
                IPEndPoint* address,
                const CompletionCallback& callback);
 
+  // Reads as many datagrams as are queued on the socket, up to
+  // |batch->capacity()|, with a single recvmmsg() call where the platform
+  // supports it and a recvfrom() loop otherwise.
+  // Returns the number of datagrams stored in |batch|, or a net error code.
+  // If ERR_IO_PENDING is returned, |callback| is called with the same kind of
+  // result once the socket becomes readable, and the caller must keep |batch|
+  // alive until then.
+  int RecvMultipleFrom(QuicUDPRecvBatch* batch,
+                       const CompletionCallback& callback);
+
   // Sends to a socket with a particular destination.
   // |buf| is the buffer to send.
   // |buf_len| is the number of bytes to send.
@@ -109,6 +121,37 @@ class NET_EXPORT QuicUDPSocketPosix : public base::NonThreadSafe {
              const IPEndPoint& address,
              const CompletionCallback& callback);
 
+  // Sends the unsent datagrams of |batch| with a single sendmmsg() call where
+  // the platform supports it and a sendto() loop otherwise.
+  // Returns the number of datagrams sent, which may be fewer than |batch|
+  // holds, or a net error code for the first unsent message of |batch|.
+  // If ERR_IO_PENDING is returned, nothing was sent; |callback| is called with
+  // the same kind of result once the socket becomes writable, and the caller
+  // must keep |batch| alive until then.
+  int SendMultipleTo(QuicUDPSendBatch* batch,
+                     const CompletionCallback& callback);
+
+  // Returns true if the kernel accepts UDP_SEGMENT (GSO) messages on this
+  // socket.
+  bool SupportsUDPSegmentation() const;
+
+  // Asks the kernel to attach the receive time (SO_TIMESTAMPNS) to every
+  // datagram read with RecvMultipleFrom().
+  // Returns a net error code.
+  int EnableReceiveTimestamps();
+
+  // Asks the kernel to attach the number of datagrams dropped for lack of
+  // receive buffer space (SO_RXQ_OVFL) to datagrams read with
+  // RecvMultipleFrom().
+  // Returns a net error code.
+  int EnableReceiveDropCount();
+
+  // Records |cpu| as the CPU expected to handle the socket (SO_INCOMING_CPU),
+  // so the kernel prefers this socket within its SO_REUSEPORT group for
+  // packets received on that CPU.
+  // Returns a net error code.
+  int SetIncomingCpu(int cpu);
+
   // Sets the receive buffer size (in bytes) for the socket.
   // Returns a net error code.
   int SetReceiveBufferSize(int32_t size);
@@ -134,6 +177,20 @@ class NET_EXPORT QuicUDPSocketPosix : public base::NonThreadSafe {
   int AllowAddressReuse();
   int AllowPortReuse();
 
+  // QUIC public header layout read by the steering program below. The UDP
+  // header is already pulled off when the program runs, so offset 0 is the
+  // public flags byte and the little-endian connection ID follows it.
+  static const uint32_t kQuicPublicFlagsOffset = 0;
+  static const uint32_t kQuicConnectionIdLowByteOffset = 1;
+
+  // Attaches a classic BPF program to the SO_REUSEPORT group of this socket
+  // that picks the receiving socket by QUIC connection ID instead of by
+  // 4-tuple hash: a packet carrying a connection ID goes to the socket at
+  // index (lowest connection ID byte % |group_size|) in bind order, anything
+  // else is spread by the receive hash. Should be called after Bind().
+  // Returns a net error code.
+  int AttachReusePortConnectionIdSteering(uint32_t group_size);
+
   // Sets corresponding flags in |socket_options_| to allow or disallow sending
   // and receiving packets to and from broadcast addresses.
   // Returns a net error code.
@@ -251,7 +308,9 @@ class NET_EXPORT QuicUDPSocketPosix : public base::NonThreadSafe {
 
   int InternalConnect(const IPEndPoint& address);
   int InternalRecvFrom(IOBuffer* buf, int buf_len, IPEndPoint* address);
+  int InternalRecvMultipleFrom(QuicUDPRecvBatch* batch);
   int InternalSendTo(IOBuffer* buf, int buf_len, const IPEndPoint* address);
+  int InternalSendMultipleTo(QuicUDPSendBatch* batch);
 
   // Applies |socket_options_| to |socket_|. Should be called before
   // Bind().
@@ -301,11 +360,17 @@ class NET_EXPORT QuicUDPSocketPosix : public base::NonThreadSafe {
   int read_buf_len_;
   IPEndPoint* recv_from_address_;
 
+  // The batch used by InternalRecvMultipleFrom() to retry batched reads
+  QuicUDPRecvBatch* recv_batch_;
+
   // The buffer used by InternalWrite() to retry Write requests
   scoped_refptr<IOBuffer> write_buf_;
   int write_buf_len_;
   std::unique_ptr<IPEndPoint> send_to_address_;
 
+  // The batch used by InternalSendMultipleTo() to retry batched writes
+  QuicUDPSendBatch* send_batch_;
+
   // External callback; called when read is complete.
   CompletionCallback read_callback_;
 
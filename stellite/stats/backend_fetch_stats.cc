@@ -0,0 +1,42 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/stats/backend_fetch_stats.h"
+
+#include "stellite/stats/server_stats_macro.h"
+
+namespace net {
+
+BackendFetchStats::BackendFetchStats() {}
+
+BackendFetchStats::~BackendFetchStats() {}
+
+void BackendFetchStats::OnRequestSent() {
+  SERVER_STAT_ADD(STAT_HTTP_SENT, 1);
+}
+
+void BackendFetchStats::OnResponseReceived(base::TimeDelta latency) {
+  SERVER_STAT_ADD(STAT_HTTP_RECEIVED, 1);
+  SERVER_HISTOGRAM_ADD(HISTOGRAM_BACKEND_LATENCY, latency.InMilliseconds());
+}
+
+void BackendFetchStats::OnRequestTimeout() {
+  SERVER_STAT_ADD(STAT_HTTP_TIMEOUT, 1);
+}
+
+void BackendFetchStats::OnRequestFailed(int error_code) {
+  SERVER_STAT_ADD(STAT_HTTP_FAILED, 1);
+}
+
+} // namespace net
@@ -0,0 +1,43 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef STELLITE_STATS_BACKEND_FETCH_STATS_H_
+#define STELLITE_STATS_BACKEND_FETCH_STATS_H_
+
+#include "base/macros.h"
+#include "net/base/net_export.h"
+#include "stellite/fetcher/http_fetcher_task.h"
+
+namespace net {
+
+// Records the backend requests of an HttpFetcher into the server stats.
+class NET_EXPORT BackendFetchStats
+    : public stellite::HttpFetcherTask::Observer {
+ public:
+  BackendFetchStats();
+  ~BackendFetchStats() override;
+
+  // Implements stellite::HttpFetcherTask::Observer
+  void OnRequestSent() override;
+  void OnResponseReceived(base::TimeDelta latency) override;
+  void OnRequestTimeout() override;
+  void OnRequestFailed(int error_code) override;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(BackendFetchStats);
+};
+
+} // namespace net
+
+#endif // STELLITE_STATS_BACKEND_FETCH_STATS_H_
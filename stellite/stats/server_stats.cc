@@ -14,10 +14,51 @@
 
 #include "stellite/stats/server_stats.h"
 
+#include "base/macros.h"
 #include "base/process/process.h"
 
 namespace net {
 
+namespace {
+
+const char* const kServerStatNames[] = {
+  "udp_packets_received",
+  "udp_packets_sent",
+  "udp_recv_dropped",
+  "packet_forwarded",
+  "packet_forward_dropped",
+  "packets_lost",
+  "packets_retransmitted",
+  "session_created",
+  "session_closed",
+  "stream_created",
+  "stream_closed",
+  "http_sent",
+  "http_received",
+  "http_timeout",
+  "http_failed",
+};
+
+const char* const kServerHistogramNames[] = {
+  "backend_latency_ms",
+  "stream_duration_ms",
+};
+
+static_assert(arraysize(kServerStatNames) == STAT_COUNT,
+              "every server stat needs a name");
+static_assert(arraysize(kServerHistogramNames) == HISTOGRAM_COUNT,
+              "every server histogram needs a name");
+
+}  // anonymous namespace
+
+const char* GetServerStatName(ServerStat stat) {
+  return kServerStatNames[stat];
+}
+
+const char* GetServerHistogramName(ServerHistogram histogram) {
+  return kServerHistogramNames[histogram];
+}
+
 QuicStats::QuicStats()
     : estimated_bandwidth(0),
       bytes_received(0),
@@ -15,6 +15,7 @@
 #ifndef STELLITE_STATS_SERVER_STATS_H_
 #define STELLITE_STATS_SERVER_STATS_H_
 
+#include "net/base/net_export.h"
 #include "net/quic/core/quic_connection_stats.h"
 
 namespace net {
@@ -86,6 +87,53 @@ const StatTag kHttpTimeout  = STAT_TAG('H', 'T', 'I', 'O'); // HTIO
 const StatTag kHttpFailed   = STAT_TAG('H', 'C', 'F', 'A'); // HCFA
 const StatTag kHttpReceived = STAT_TAG('H', 'R', 'E', 'C'); // HREC
 
+// Counters of the server, recorded as things happen through
+// ServerStatsRecorder. The sessions and streams alive are the created ones
+// less the closed ones.
+enum ServerStat {
+  STAT_UDP_PACKETS_RECEIVED,
+  STAT_UDP_PACKETS_SENT,
+
+  // Datagrams the kernel dropped because a socket receive buffer was full
+  STAT_UDP_RECV_DROPPED,
+
+  // Datagrams handed to the worker owning their connection ID, and those
+  // dropped because the handoff ring to that worker was full
+  STAT_PACKET_FORWARDED,
+  STAT_PACKET_FORWARD_DROPPED,
+
+  // Added up when a connection closes
+  STAT_PACKETS_LOST,
+  STAT_PACKETS_RETRANSMITTED,
+
+  STAT_SESSION_CREATED,
+  STAT_SESSION_CLOSED,
+  STAT_STREAM_CREATED,
+  STAT_STREAM_CLOSED,
+
+  // Backend requests
+  STAT_HTTP_SENT,
+  STAT_HTTP_RECEIVED,
+  STAT_HTTP_TIMEOUT,
+  STAT_HTTP_FAILED,
+
+  STAT_COUNT,
+};
+
+// Distributions of the server, in milliseconds.
+enum ServerHistogram {
+  // From sending a backend request to its response header
+  HISTOGRAM_BACKEND_LATENCY,
+
+  // From opening a stream to closing it
+  HISTOGRAM_STREAM_DURATION,
+
+  HISTOGRAM_COUNT,
+};
+
+NET_EXPORT const char* GetServerStatName(ServerStat stat);
+NET_EXPORT const char* GetServerHistogramName(ServerHistogram histogram);
+
 } // namespace net
 
 #endif // STELLITE_STATS_SERVER_STATS_H_
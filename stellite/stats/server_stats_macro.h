@@ -19,14 +19,12 @@
 #include "stellite/stats/server_stats_recorder.h"
 
 #define STATIC_SERVER_STAT_BLOCK(stats_method_invocation)                      \
-  net::ServerStatsRecorder* recorder =                                         \
-      net::ServerStatsRecorder::GetInstance();                                 \
-  recorder->stats_method_invocation
+  net::ServerStatsRecorder::GetInstance()->stats_method_invocation
 
-#define SERVER_STAT_ADD(tag, amount) \
-    STATIC_SERVER_STAT_BLOCK(AddStat(tag, amount))
+#define SERVER_STAT_ADD(stat, amount) \
+    STATIC_SERVER_STAT_BLOCK(AddStat(net::stat, amount))
 
-#define SERVER_STAT_RESET(tag) \
-    STATIC_SERVER_STAT_BLOCK(name, Reset())
+#define SERVER_HISTOGRAM_ADD(histogram, sample) \
+    STATIC_SERVER_STAT_BLOCK(AddSample(net::histogram, sample))
 
 #endif // STELLITE_STATS_SERVER_STATS_MACRO_H_
@@ -14,49 +14,307 @@
 
 #include "stellite/stats/server_stats_recorder.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <new>
+
+#include "base/compiler_specific.h"
+#include "base/logging.h"
+#include "base/memory/aligned_memory.h"
+#include "base/memory/singleton.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/threading/platform_thread.h"
 #include "stellite/stats/server_stats.h"
 
 namespace net {
 
-ServerStatsRecorder::ServerStatsRecorder() {}
-ServerStatsRecorder::~ServerStatsRecorder() {}
+namespace {
+
+const size_t kCacheLineSize = 64;
+
+int GetBucket(uint64_t sample) {
+  int bucket = 0;
+  while (sample) {
+    ++bucket;
+    sample >>= 1;
+  }
+  return std::min(bucket, ServerStatsRecorder::kHistogramBucketCount - 1);
+}
+
+uint64_t LoadCounter(const base::subtle::AtomicWord* counter) {
+  return static_cast<uint64_t>(static_cast<uintptr_t>(
+      base::subtle::NoBarrier_Load(counter)));
+}
+
+}  // anonymous namespace
+
+// static
+const int ServerStatsRecorder::kHistogramBucketCount;
+const size_t ServerStatsRecorder::kMaxThreadBlocks;
 
-uint64_t ServerStatsRecorder::GetStat(const StatTag& tag) {
-  StatsMap::iterator it = stats_map_.find(tag);
-  if (it == stats_map_.end()) {
+// Counters are machine words. The server is built for 64-bit hosts, where
+// they never wrap; a 32-bit build would wrap them.
+struct ALIGNAS(64) ServerStatsRecorder::ThreadBlock {
+  ThreadBlock(const std::string& name, bool shared_block)
+      : thread_name(name),
+        shared(shared_block) {
+    memset(stats, 0, sizeof(stats));
+    memset(buckets, 0, sizeof(buckets));
+    memset(sample_sums, 0, sizeof(sample_sums));
+  }
+
+  base::subtle::AtomicWord stats[STAT_COUNT];
+  base::subtle::AtomicWord buckets[HISTOGRAM_COUNT][kHistogramBucketCount];
+  base::subtle::AtomicWord sample_sums[HISTOGRAM_COUNT];
+
+  // Set before the block is published.
+  const std::string thread_name;
+  const bool shared;
+};
+
+ServerStatsRecorder::Snapshot::Snapshot() {
+  memset(stats, 0, sizeof(stats));
+  memset(buckets, 0, sizeof(buckets));
+  memset(sample_sums, 0, sizeof(sample_sums));
+}
+
+ServerStatsRecorder::Snapshot::Snapshot(const Snapshot& other) = default;
+
+ServerStatsRecorder::Snapshot::~Snapshot() {}
+
+void ServerStatsRecorder::Snapshot::Add(const Snapshot& other) {
+  for (int i = 0; i < STAT_COUNT; ++i) {
+    stats[i] += other.stats[i];
+  }
+
+  for (int i = 0; i < HISTOGRAM_COUNT; ++i) {
+    for (int j = 0; j < kHistogramBucketCount; ++j) {
+      buckets[i][j] += other.buckets[i][j];
+    }
+    sample_sums[i] += other.sample_sums[i];
+  }
+}
+
+uint64_t ServerStatsRecorder::Snapshot::GetSampleCount(
+    ServerHistogram histogram) const {
+  uint64_t count = 0;
+  for (int i = 0; i < kHistogramBucketCount; ++i) {
+    count += buckets[histogram][i];
+  }
+  return count;
+}
+
+uint64_t ServerStatsRecorder::Snapshot::GetPercentile(
+    ServerHistogram histogram, double percentile) const {
+  uint64_t count = GetSampleCount(histogram);
+  if (count == 0) {
     return 0;
   }
 
-  return it->second;
+  uint64_t rank = static_cast<uint64_t>(std::ceil(count * percentile / 100));
+  rank = std::min(std::max<uint64_t>(rank, 1), count);
+
+  uint64_t seen = 0;
+  int bucket = 0;
+  for (; bucket < kHistogramBucketCount - 1; ++bucket) {
+    seen += buckets[histogram][bucket];
+    if (seen >= rank) {
+      break;
+    }
+  }
+
+  // the last bucket has no upper bound; its lower bound stands in
+  if (bucket == kHistogramBucketCount - 1) {
+    return UINT64_C(1) << (bucket - 1);
+  }
+  return (UINT64_C(1) << bucket) - 1;
 }
 
-void ServerStatsRecorder::AddStat(const StatTag& tag, uint64_t value) {
-  StatsMap::iterator it = stats_map_.find(tag);
-  if (it == stats_map_.end()) {
-    stats_map_.insert(std::make_pair(tag, value));
-    return;
+std::string ServerStatsRecorder::Snapshot::ToString() const {
+  std::string result = thread_name.empty() ? "total" : thread_name;
+  result += ":";
+  for (int i = 0; i < STAT_COUNT; ++i) {
+    result += " ";
+    result += GetServerStatName(static_cast<ServerStat>(i));
+    result += "=" + base::Uint64ToString(stats[i]);
   }
 
-  it->second += value;
+  for (int i = 0; i < HISTOGRAM_COUNT; ++i) {
+    ServerHistogram histogram = static_cast<ServerHistogram>(i);
+    uint64_t count = GetSampleCount(histogram);
+    result += " ";
+    result += GetServerHistogramName(histogram);
+    result += "{count=" + base::Uint64ToString(count);
+    if (count > 0) {
+      result += " avg=" + base::Uint64ToString(sample_sums[i] / count);
+      result += " p50=" +
+          base::Uint64ToString(GetPercentile(histogram, 50));
+      result += " p99=" +
+          base::Uint64ToString(GetPercentile(histogram, 99));
+    }
+    result += "}";
+  }
+  return result;
 }
 
-void ServerStatsRecorder::SubStat(const StatTag& tag, uint64_t value) {
-  StatsMap::iterator it = stats_map_.find(tag);
-  if (it == stats_map_.end()) {
-    stats_map_.insert(std::make_pair(tag, -value));
+ServerStatsRecorder::ServerStatsRecorder()
+    : block_count_(0),
+      shared_block_(NewBlock("shared", true)) {
+  memset(blocks_, 0, sizeof(blocks_));
+}
+
+ServerStatsRecorder::~ServerStatsRecorder() {
+  size_t block_count =
+      static_cast<size_t>(base::subtle::Acquire_Load(&block_count_));
+  for (size_t i = 0; i < block_count; ++i) {
+    DeleteBlock(blocks_[i]);
   }
+  DeleteBlock(shared_block_);
+}
+
+// static
+ServerStatsRecorder* ServerStatsRecorder::GetInstance() {
+  // worker threads may still record while the process exits
+  return base::Singleton<
+      ServerStatsRecorder,
+      base::LeakySingletonTraits<ServerStatsRecorder>>::get();
+}
 
-  it->second -= value;
+void ServerStatsRecorder::AddStat(ServerStat stat, uint64_t value) {
+  ThreadBlock* block = GetThreadBlock();
+  Increment(block, &block->stats[stat], value);
 }
 
-void ServerStatsRecorder::Reset(const StatTag& tag) {
-  StatsMap::iterator it = stats_map_.find(tag);
-  if (it == stats_map_.end()) {
-    stats_map_.insert(std::make_pair(tag, 0));
+void ServerStatsRecorder::AddSample(ServerHistogram histogram,
+                                    uint64_t sample) {
+  ThreadBlock* block = GetThreadBlock();
+  Increment(block, &block->buckets[histogram][GetBucket(sample)], 1);
+  Increment(block, &block->sample_sums[histogram], sample);
+}
+
+uint64_t ServerStatsRecorder::GetStat(ServerStat stat) const {
+  uint64_t value = LoadCounter(&shared_block_->stats[stat]);
+  size_t block_count =
+      static_cast<size_t>(base::subtle::Acquire_Load(&block_count_));
+  for (size_t i = 0; i < block_count; ++i) {
+    value += LoadCounter(&blocks_[i]->stats[stat]);
+  }
+  return value;
+}
+
+void ServerStatsRecorder::GetSnapshot(Snapshot* snapshot) const {
+  std::vector<Snapshot> snapshots;
+  GetThreadSnapshots(&snapshots);
+
+  *snapshot = Snapshot();
+  for (const Snapshot& thread_snapshot : snapshots) {
+    snapshot->Add(thread_snapshot);
+  }
+}
+
+void ServerStatsRecorder::GetThreadSnapshots(
+    std::vector<Snapshot>* snapshots) const {
+  size_t block_count =
+      static_cast<size_t>(base::subtle::Acquire_Load(&block_count_));
+  snapshots->resize(block_count);
+  for (size_t i = 0; i < block_count; ++i) {
+    ReadBlock(*blocks_[i], &(*snapshots)[i]);
+  }
+
+  if (block_count == kMaxThreadBlocks) {
+    snapshots->resize(block_count + 1);
+    ReadBlock(*shared_block_, &snapshots->back());
+  }
+}
+
+void ServerStatsRecorder::LogStats() const {
+  std::vector<Snapshot> snapshots;
+  GetThreadSnapshots(&snapshots);
+
+  Snapshot total;
+  for (const Snapshot& snapshot : snapshots) {
+    total.Add(snapshot);
+  }
+
+  LOG(INFO) << "server stats " << total.ToString();
+  for (const Snapshot& snapshot : snapshots) {
+    LOG(INFO) << "server stats " << snapshot.ToString();
+  }
+}
+
+ServerStatsRecorder::ThreadBlock* ServerStatsRecorder::GetThreadBlock() {
+  ThreadBlock* block = thread_block_.Get();
+  if (block) {
+    return block;
+  }
+
+  base::AutoLock lock(lock_);
+  size_t block_count =
+      static_cast<size_t>(base::subtle::NoBarrier_Load(&block_count_));
+  if (block_count == kMaxThreadBlocks) {
+    block = shared_block_;
+  } else {
+    std::string name = base::PlatformThread::GetName();
+    if (name.empty()) {
+      name = "thread-" + base::IntToString(
+          static_cast<int>(base::PlatformThread::CurrentId()));
+    }
+
+    block = NewBlock(name, false);
+    blocks_[block_count] = block;
+    base::subtle::Release_Store(
+        &block_count_, static_cast<base::subtle::Atomic32>(block_count + 1));
+  }
+
+  thread_block_.Set(block);
+  return block;
+}
+
+// static
+ServerStatsRecorder::ThreadBlock* ServerStatsRecorder::NewBlock(
+    const std::string& thread_name, bool shared) {
+  void* memory = base::AlignedAlloc(sizeof(ThreadBlock), kCacheLineSize);
+  return new (memory) ThreadBlock(thread_name, shared);
+}
+
+// static
+void ServerStatsRecorder::DeleteBlock(ThreadBlock* block) {
+  block->~ThreadBlock();
+  base::AlignedFree(block);
+}
+
+// static
+void ServerStatsRecorder::Increment(ThreadBlock* block,
+                                    base::subtle::AtomicWord* counter,
+                                    uint64_t value) {
+  base::subtle::AtomicWord increment =
+      static_cast<base::subtle::AtomicWord>(value);
+  if (block->shared) {
+    base::subtle::NoBarrier_AtomicIncrement(counter, increment);
     return;
   }
 
-  it->second = 0;
+  // the owning thread is the only writer
+  base::subtle::NoBarrier_Store(
+      counter, base::subtle::NoBarrier_Load(counter) + increment);
+}
+
+// static
+void ServerStatsRecorder::ReadBlock(const ThreadBlock& block,
+                                    Snapshot* snapshot) {
+  snapshot->thread_name = block.thread_name;
+  for (int i = 0; i < STAT_COUNT; ++i) {
+    snapshot->stats[i] = LoadCounter(&block.stats[i]);
+  }
+
+  for (int i = 0; i < HISTOGRAM_COUNT; ++i) {
+    for (int j = 0; j < kHistogramBucketCount; ++j) {
+      snapshot->buckets[i][j] = LoadCounter(&block.buckets[i][j]);
+    }
+    snapshot->sample_sums[i] = LoadCounter(&block.sample_sums[i]);
+  }
 }
 
 } // namespace net
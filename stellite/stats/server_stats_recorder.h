@@ -15,27 +15,108 @@
 #ifndef STELLITE_STATS_SERVER_STATS_RECORDER_H_
 #define STELLITE_STATS_SERVER_STATS_RECORDER_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <string>
-#include <map>
+#include <vector>
 
+#include "base/atomicops.h"
+#include "base/macros.h"
+#include "base/synchronization/lock.h"
+#include "base/threading/thread_local.h"
+#include "net/base/net_export.h"
 #include "stellite/stats/server_stats.h"
 
+namespace base {
+template <typename T>
+struct DefaultSingletonTraits;
+}
+
 namespace net {
 
-class ServerStatsRecorder {
+// Records the server stats on the threads they happen on.
+//
+// Every thread counts into a block of its own, aligned to cache lines so
+// that no two threads write to the same line. Only the owning thread writes
+// a block, so recording is a plain load and store without a lock or a locked
+// instruction. Readers sum the blocks without locking; a snapshot may see an
+// update of one thread before an earlier update of another. Counters only
+// grow: rates are the difference of two snapshots.
+class NET_EXPORT ServerStatsRecorder {
  public:
+  // Histogram bucket 0 holds the samples of 0, bucket n those in
+  // [2^(n-1), 2^n), and the last bucket all the larger ones.
+  static const int kHistogramBucketCount = 32;
+
+  // Threads past this many share one block, updated with atomic increments.
+  static const size_t kMaxThreadBlocks = 128;
+
+  struct NET_EXPORT Snapshot {
+    Snapshot();
+    Snapshot(const Snapshot& other);
+    ~Snapshot();
+
+    void Add(const Snapshot& other);
+
+    uint64_t GetSampleCount(ServerHistogram histogram) const;
+
+    // The upper bound of the bucket holding the |percentile| sample of
+    // |histogram|, or 0 without samples.
+    uint64_t GetPercentile(ServerHistogram histogram,
+                           double percentile) const;
+
+    std::string ToString() const;
+
+    // Empty for the sum of all threads.
+    std::string thread_name;
+
+    uint64_t stats[STAT_COUNT];
+    uint64_t buckets[HISTOGRAM_COUNT][kHistogramBucketCount];
+    uint64_t sample_sums[HISTOGRAM_COUNT];
+  };
+
   ServerStatsRecorder();
   ~ServerStatsRecorder();
 
-  // Stat CRUD functions
-  uint64_t GetStat(const StatTag& tag);
-  void AddStat(const StatTag& tag, uint64_t value);
-  void SubStat(const StatTag& tag, uint64_t value);
-  void Reset(const StatTag& tag);
+  static ServerStatsRecorder* GetInstance();
+
+  void AddStat(ServerStat stat, uint64_t value);
+  void AddSample(ServerHistogram histogram, uint64_t sample);
+
+  uint64_t GetStat(ServerStat stat) const;
+
+  // The sum of all threads, and one snapshot per thread that recorded.
+  void GetSnapshot(Snapshot* snapshot) const;
+  void GetThreadSnapshots(std::vector<Snapshot>* snapshots) const;
+
+  // Logs the sum of all threads and the stats of every thread.
+  void LogStats() const;
 
  private:
-  typedef std::map<StatTag, uint64_t> StatsMap;
-  StatsMap stats_map_;
+  friend struct base::DefaultSingletonTraits<ServerStatsRecorder>;
+
+  struct ThreadBlock;
+
+  // The block of the calling thread, registered on first use.
+  ThreadBlock* GetThreadBlock();
+
+  static ThreadBlock* NewBlock(const std::string& thread_name, bool shared);
+  static void DeleteBlock(ThreadBlock* block);
+
+  static void Increment(ThreadBlock* block,
+                        base::subtle::AtomicWord* counter,
+                        uint64_t value);
+  static void ReadBlock(const ThreadBlock& block, Snapshot* snapshot);
+
+  base::ThreadLocalPointer<ThreadBlock> thread_block_;
+
+  // |blocks_| up to |block_count_| are published with a release store, so
+  // readers need no lock. |lock_| serializes registration.
+  ThreadBlock* blocks_[kMaxThreadBlocks];
+  base::subtle::Atomic32 block_count_;
+  ThreadBlock* shared_block_;
+  base::Lock lock_;
 
   DISALLOW_COPY_AND_ASSIGN(ServerStatsRecorder);
 };
@@ -0,0 +1,105 @@
+// Copyright 2016 LINE Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "stellite/stats/server_stats_recorder.h"
+
+#include <vector>
+
+#include "base/bind.h"
+#include "base/location.h"
+#include "base/single_thread_task_runner.h"
+#include "base/threading/thread.h"
+#include "testing/gtest/include/gtest/gtest.h"
+
+namespace net {
+
+namespace {
+
+void AddStats(ServerStatsRecorder* recorder, int count) {
+  for (int i = 0; i < count; ++i) {
+    recorder->AddStat(STAT_HTTP_SENT, 1);
+  }
+  recorder->AddSample(HISTOGRAM_BACKEND_LATENCY, 10);
+}
+
+}  // namespace
+
+TEST(ServerStatsRecorderTest, AddStat) {
+  ServerStatsRecorder recorder;
+  EXPECT_EQ(0u, recorder.GetStat(STAT_UDP_PACKETS_RECEIVED));
+
+  recorder.AddStat(STAT_UDP_PACKETS_RECEIVED, 3);
+  recorder.AddStat(STAT_UDP_PACKETS_RECEIVED, 4);
+  EXPECT_EQ(7u, recorder.GetStat(STAT_UDP_PACKETS_RECEIVED));
+  EXPECT_EQ(0u, recorder.GetStat(STAT_UDP_PACKETS_SENT));
+}
+
+TEST(ServerStatsRecorderTest, Histogram) {
+  ServerStatsRecorder recorder;
+  for (uint64_t sample = 1; sample <= 100; ++sample) {
+    recorder.AddSample(HISTOGRAM_BACKEND_LATENCY, sample);
+  }
+
+  ServerStatsRecorder::Snapshot snapshot;
+  recorder.GetSnapshot(&snapshot);
+  EXPECT_EQ(100u, snapshot.GetSampleCount(HISTOGRAM_BACKEND_LATENCY));
+  EXPECT_EQ(5050u, snapshot.sample_sums[HISTOGRAM_BACKEND_LATENCY]);
+  EXPECT_EQ(0u, snapshot.GetSampleCount(HISTOGRAM_STREAM_DURATION));
+
+  // samples fall in power-of-two buckets: 32 to 63 hold the 50th
+  EXPECT_EQ(63u, snapshot.GetPercentile(HISTOGRAM_BACKEND_LATENCY, 50));
+  EXPECT_EQ(127u, snapshot.GetPercentile(HISTOGRAM_BACKEND_LATENCY, 99));
+  EXPECT_EQ(0u, snapshot.GetPercentile(HISTOGRAM_STREAM_DURATION, 50));
+}
+
+TEST(ServerStatsRecorderTest, BlockPerThread) {
+  ServerStatsRecorder recorder;
+  AddStats(&recorder, 1);
+
+  base::Thread first("stats_first");
+  base::Thread second("stats_second");
+  ASSERT_TRUE(first.Start());
+  ASSERT_TRUE(second.Start());
+  first.task_runner()->PostTask(FROM_HERE,
+                                base::Bind(&AddStats, &recorder, 10));
+  second.task_runner()->PostTask(FROM_HERE,
+                                 base::Bind(&AddStats, &recorder, 100));
+  first.Stop();
+  second.Stop();
+
+  std::vector<ServerStatsRecorder::Snapshot> snapshots;
+  recorder.GetThreadSnapshots(&snapshots);
+  ASSERT_EQ(3u, snapshots.size());
+
+  uint64_t first_count = 0;
+  uint64_t second_count = 0;
+  for (const ServerStatsRecorder::Snapshot& snapshot : snapshots) {
+    EXPECT_EQ(1u, snapshot.GetSampleCount(HISTOGRAM_BACKEND_LATENCY));
+    if (snapshot.thread_name == "stats_first") {
+      first_count = snapshot.stats[STAT_HTTP_SENT];
+    } else if (snapshot.thread_name == "stats_second") {
+      second_count = snapshot.stats[STAT_HTTP_SENT];
+    }
+  }
+  EXPECT_EQ(10u, first_count);
+  EXPECT_EQ(100u, second_count);
+
+  EXPECT_EQ(111u, recorder.GetStat(STAT_HTTP_SENT));
+  ServerStatsRecorder::Snapshot total;
+  recorder.GetSnapshot(&total);
+  EXPECT_EQ(111u, total.stats[STAT_HTTP_SENT]);
+  EXPECT_EQ(3u, total.GetSampleCount(HISTOGRAM_BACKEND_LATENCY));
+}
+
+}  // namespace net